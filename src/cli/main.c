@@ -26,6 +26,7 @@
  */
 
 #include "common/darktable.h"
+#include "common/bench.h"
 #include "common/debug.h"
 #include "common/collection.h"
 #include "common/points.h"
@@ -36,17 +37,89 @@
 #include "common/imageio_module.h"
 #include "common/exif.h"
 #include "common/history.h"
+#include "common/file_buffer.h"
+#include "common/mipmap_cache.h"
+#include "control/conf.h"
 
 #include <sys/time.h>
+#include <sys/resource.h>
+#include <fcntl.h>
 #include <unistd.h>
 int usleep(useconds_t usec);
 #include <inttypes.h>
 #include <libintl.h>
+#include <glib/gstdio.h>
 
 static void
 usage(const char* progname)
 {
-  fprintf(stderr, "usage: %s <input file> [<xmp file>] <output file> [--width <max width>,--height <max height>,--bpp <bpp>,--hq <0|1|true|false> --verbose]\n", progname);
+  fprintf(stderr, "usage: %s <input file> [<xmp file>] <output file> [--width <max width>,--height <max height>,--bpp <bpp>,--hq <0|1|true|false> --verbose --bench <runs>] [--core <darktable options>]\n", progname);
+}
+
+// drop everything we have of the input image, so the next export starts from the file on disk:
+static void
+bench_drop_caches(const int id, const char *filename)
+{
+  dt_mipmap_cache_invalidate(darktable.mipmap_cache, id);
+  dt_file_buffer_forget(filename);
+#if defined(POSIX_FADV_DONTNEED)
+  // and ask the kernel to forget it, too. only clean pages go, which the input should be.
+  const int fd = open(filename, O_RDONLY);
+  if(fd >= 0)
+  {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+#endif
+}
+
+// export the image runs times and print the timings of all runs and stages as json.
+static int
+bench_export(FILE *json, const int runs, const int cold, const int id, const char *image_filename,
+             const char *output_filename,
+             dt_imageio_module_storage_t *storage, dt_imageio_module_data_t *sdata,
+             dt_imageio_module_format_t *format, dt_imageio_module_data_t *fdata,
+             const gboolean high_quality)
+{
+  // the disk storage doesn't overwrite, so clean up after ourselves between runs:
+  gchar *written = g_strdup_printf("%s.%s", output_filename, format->extension(fdata));
+  double total = 0.0;
+  double *seconds = (double *)malloc(sizeof(double)*runs);
+  int res = 0;
+
+  dt_bench_reset(darktable.bench);
+  for(int k=0; k<runs && !res; k++)
+  {
+    if(cold) bench_drop_caches(id, image_filename);
+    g_unlink(written);
+    dt_times_t start;
+    dt_get_times(&start);
+    res = storage->store(storage, sdata, id, format, fdata, 1, 1, high_quality);
+    dt_times_t end;
+    dt_get_times(&end);
+    seconds[k] = end.clock - start.clock;
+    total += seconds[k];
+  }
+  g_free(written);
+  if(res)
+  {
+    free(seconds);
+    return res;
+  }
+
+  if(!cold) fprintf(json, ",\n");
+  fprintf(json, "    \"%s\": {\n", cold ? "cold" : "warm");
+  fprintf(json, "      \"runs\": %d,\n", runs);
+  fprintf(json, "      \"seconds\": %.6f,\n", total);
+  fprintf(json, "      \"images_per_second\": %.4f,\n", total > 0.0 ? runs/total : 0.0);
+  fprintf(json, "      \"run_seconds\": [");
+  for(int k=0; k<runs; k++) fprintf(json, "%s%.6f", k ? ", " : " ", seconds[k]);
+  fprintf(json, " ],\n");
+  fprintf(json, "      \"stages\": ");
+  dt_bench_print_json(darktable.bench, json, "      ");
+  fprintf(json, "\n    }");
+  free(seconds);
+  return 0;
 }
 
 int main(int argc, char *arg[])
@@ -63,8 +136,10 @@ int main(int argc, char *arg[])
   char *xmp_filename = NULL;
   char *output_filename = NULL;
   int file_counter = 0;
-  int width = 0, height = 0, bpp = 0;
+  int width = 0, height = 0, bpp = 0, bench_runs = 0;
   gboolean verbose = FALSE, high_quality = TRUE;
+  int core_argc = 0;
+  char **core_argv = NULL;
 
   for(int k=1; k<argc; k++)
   {
@@ -116,6 +191,18 @@ int main(int argc, char *arg[])
       {
         verbose = TRUE;
       }
+      else if(!strcmp(arg[k], "--bench") && k+1 < argc)
+      {
+        k++;
+        bench_runs = MAX(atoi(arg[k]), 1);
+      }
+      else if(!strcmp(arg[k], "--core"))
+      {
+        // everything from here on is for darktable itself (-d perf, -t 4, --configdir ...)
+        core_argc = argc - k - 1;
+        core_argv = arg + k + 1;
+        break;
+      }
 
     }
     else
@@ -145,12 +232,38 @@ int main(int argc, char *arg[])
   // the output file already exists, so there will be a sequence number added
   if(g_file_test(output_filename, G_FILE_TEST_EXISTS))
   {
+    if(bench_runs)
+    {
+      // the runs delete their output, better not be somebody else's file
+      fprintf(stderr, "%s\n", _("output file already exists, refusing to benchmark"));
+      exit(1);
+    }
     fprintf(stderr, "%s\n", _("output file already exists, it will get renamed"));
   }
 
-  char *m_arg[] = {"darktable-cli", "--library", ":memory:", NULL};
+  // in bench mode, the json goes to the real stdout. everything else printed from here
+  // on (-d output, export messages, the history) is sent to stderr, to keep it valid.
+  FILE *json = NULL;
+  if(bench_runs)
+  {
+    fflush(stdout);
+    json = fdopen(dup(STDOUT_FILENO), "w");
+    if(!json || dup2(STDERR_FILENO, STDOUT_FILENO) < 0)
+    {
+      fprintf(stderr, "%s\n", _("can't redirect stdout for the benchmark"));
+      exit(1);
+    }
+  }
+
+  char **m_arg = (char **)malloc(sizeof(char *)*(4 + core_argc));
+  m_arg[0] = "darktable-cli";
+  m_arg[1] = "--library";
+  m_arg[2] = ":memory:";
+  for(int k=0; k<core_argc; k++) m_arg[3+k] = core_argv[k];
+  m_arg[3+core_argc] = NULL;
   // init dt without gui:
-  if(dt_init(3, m_arg, 0)) exit(1);
+  if(dt_init(3 + core_argc, m_arg, 0)) exit(1);
+  free(m_arg);
 
   dt_film_t film;
   int id = 0;
@@ -254,7 +367,45 @@ int main(int argc, char *arg[])
 
   //TODO: add a callback to set the bpp without going through the config
 
-  storage->store(storage,sdata, id, format, fdata, 1, 1, high_quality);
+  int res = 0;
+  if(bench_runs)
+  {
+    darktable.bench = dt_bench_new();
+    fprintf(json, "{\n  \"image\": ");
+    dt_bench_print_json_string(json, image_filename);
+    fprintf(json, ",\n  \"xmp\": ");
+    if(xmp_filename) dt_bench_print_json_string(json, xmp_filename);
+    else fprintf(json, "null");
+    fprintf(json, ",\n  \"format\": ");
+    dt_bench_print_json_string(json, ext);
+    fprintf(json, ",\n  \"max_width\": %d,\n  \"max_height\": %d,\n  \"high_quality\": %s,\n",
+            fdata->max_width, fdata->max_height, high_quality ? "true" : "false");
+    fprintf(json, "  \"openmp_threads\": %d,\n  \"worker_threads\": %d,\n  \"parallel_export\": %d,\n",
+            darktable.num_openmp_threads, dt_conf_get_int("worker_threads"), dt_conf_get_int("parallel_export"));
+    fprintf(json, "  \"results\": {\n");
+    // cold first, the last cold run leaves the caches filled for the warm ones:
+    res = bench_export(json, bench_runs, 1, id, image_filename, output_filename, storage, sdata, format, fdata, high_quality);
+    if(!res)
+      res = bench_export(json, bench_runs, 0, id, image_filename, output_filename, storage, sdata, format, fdata, high_quality);
+    fprintf(json, "\n  },\n");
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+    const long peak_rss = ru.ru_maxrss / 1024; // bytes there
+#else
+    const long peak_rss = ru.ru_maxrss;
+#endif
+    fprintf(json, "  \"peak_rss_kb\": %ld,\n  \"status\": %s\n}\n", peak_rss, res ? "\"failed\"" : "\"ok\"");
+    if(res) fprintf(stderr, "%s\n", _("export failed, benchmark aborted"));
+    fflush(stdout);
+    fflush(json);
+    dup2(fileno(json), STDOUT_FILENO);
+    fclose(json);
+    dt_bench_destroy(darktable.bench);
+    darktable.bench = NULL;
+  }
+  else
+    res = storage->store(storage,sdata, id, format, fdata, 1, 1, high_quality);
 
   // cleanup time
   if(storage->finalize_store) storage->finalize_store(storage, sdata);
@@ -262,6 +413,7 @@ int main(int argc, char *arg[])
   format->free_params(format, fdata);
 
   dt_cleanup();
+  return res ? 1 : 0;
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -0,0 +1,126 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "common/bench.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct dt_bench_stage_t
+{
+  int count;
+  double total;   // wall clock seconds
+  double min, max;
+  double cpu;     // user time of the whole process meanwhile
+}
+dt_bench_stage_t;
+
+dt_bench_t *
+dt_bench_new()
+{
+  dt_bench_t *b = (dt_bench_t *)malloc(sizeof(dt_bench_t));
+  dt_pthread_mutex_init(&b->mutex, NULL);
+  b->stages = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free);
+  return b;
+}
+
+void
+dt_bench_destroy(dt_bench_t *b)
+{
+  if(!b) return;
+  g_hash_table_destroy(b->stages);
+  dt_pthread_mutex_destroy(&b->mutex);
+  free(b);
+}
+
+void
+dt_bench_reset(dt_bench_t *b)
+{
+  if(!b) return;
+  dt_pthread_mutex_lock(&b->mutex);
+  g_hash_table_remove_all(b->stages);
+  dt_pthread_mutex_unlock(&b->mutex);
+}
+
+void
+dt_bench_add(dt_bench_t *b, const dt_times_t *start, const char *stage, ...)
+{
+  if(!b) return;
+  dt_times_t end;
+  dt_get_times(&end);
+  const double wall = end.clock - start->clock;
+
+  char name[128];
+  va_list ap;
+  va_start(ap, stage);
+  vsnprintf(name, sizeof(name), stage, ap);
+  va_end(ap);
+
+  dt_pthread_mutex_lock(&b->mutex);
+  dt_bench_stage_t *s = (dt_bench_stage_t *)g_hash_table_lookup(b->stages, name);
+  if(!s)
+  {
+    s = (dt_bench_stage_t *)calloc(1, sizeof(dt_bench_stage_t));
+    s->min = wall;
+    g_hash_table_insert(b->stages, g_strdup(name), s);
+  }
+  s->count++;
+  s->total += wall;
+  s->min = MIN(s->min, wall);
+  s->max = MAX(s->max, wall);
+  s->cpu += end.user - start->user;
+  dt_pthread_mutex_unlock(&b->mutex);
+}
+
+void
+dt_bench_print_json_string(FILE *f, const char *s)
+{
+  fputc('"', f);
+  for(; s && *s; s++)
+  {
+    const unsigned char c = *s;
+    if(c == '"' || c == '\\') fprintf(f, "\\%c", c);
+    else if(c < 0x20) fprintf(f, "\\u%04x", c);
+    else fputc(c, f);
+  }
+  fputc('"', f);
+}
+
+void
+dt_bench_print_json(dt_bench_t *b, FILE *f, const char *indent)
+{
+  dt_pthread_mutex_lock(&b->mutex);
+  GList *names = g_list_sort(g_hash_table_get_keys(b->stages), (GCompareFunc)strcmp);
+  fprintf(f, "{");
+  for(GList *l = names; l; l = g_list_next(l))
+  {
+    const dt_bench_stage_t *s = (const dt_bench_stage_t *)g_hash_table_lookup(b->stages, l->data);
+    fprintf(f, "\n%s  ", indent);
+    dt_bench_print_json_string(f, (const char *)l->data);
+    fprintf(f, ": { \"count\": %d, \"total\": %.6f, \"mean\": %.6f, \"min\": %.6f, \"max\": %.6f, \"cpu\": %.6f }%s",
+            s->count, s->total, s->total/s->count, s->min, s->max, s->cpu, g_list_next(l) ? "," : "");
+  }
+  if(names) fprintf(f, "\n%s", indent);
+  fprintf(f, "}");
+  g_list_free(names);
+  dt_pthread_mutex_unlock(&b->mutex);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -0,0 +1,58 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef DT_COMMON_BENCH_H
+#define DT_COMMON_BENCH_H
+
+#include "common/darktable.h"
+#include "common/dtpthread.h"
+#include <glib.h>
+#include <stdio.h>
+
+/**
+ * timing statistics per named stage, for darktable-cli --bench.
+ *
+ * the places which time themselves for -d perf also report here when
+ * darktable.bench is set. stages may nest: `load' covers `read' and
+ * `decode', `pipe' covers all the `pipe/<module>' entries.
+ */
+typedef struct dt_bench_t
+{
+  dt_pthread_mutex_t mutex;
+  GHashTable *stages;     // name -> dt_bench_stage_t
+}
+dt_bench_t;
+
+dt_bench_t *dt_bench_new();
+void dt_bench_destroy(dt_bench_t *b);
+
+/** forget all samples, to start a new series. */
+void dt_bench_reset(dt_bench_t *b);
+
+/** add the time since start to the stage named by the printf style format. does nothing if b is NULL. */
+void dt_bench_add(dt_bench_t *b, const dt_times_t *start, const char *stage, ...);
+
+/** write the stages as a json object, sorted by name, each line prefixed by indent. */
+void dt_bench_print_json(dt_bench_t *b, FILE *f, const char *indent);
+
+/** write s as a quoted json string. */
+void dt_bench_print_json_string(FILE *f, const char *s);
+
+#endif
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -19,6 +19,8 @@
 #ifndef DT_COMMON_BILATERAL_H
 #define DT_COMMON_BILATERAL_H
 
+#include "develop/imageop.h"
+
 #ifdef HAVE_OPENCL
 // function definition on opencl path takes precedence
 #include "common/bilateralcl.h"
@@ -66,6 +68,7 @@ typedef struct dt_bilateral_t
   int width, height;
   float sigma_s, sigma_r;
   float *buf;
+  struct dt_dev_pixelpipe_iop_t *piece; // optional, stop early if the pipe of this piece got cancelled
 }
 dt_bilateral_t;
 
@@ -106,6 +109,7 @@ dt_bilateral_init(
   b->height = height;
   b->sigma_s = MAX(height/(b->size_y-1.0f), width/(b->size_x-1.0f));
   b->sigma_r = 100.0f/(b->size_z-1.0f);
+  b->piece = NULL;
   b->buf = dt_alloc_align(16, b->size_x*b->size_y*b->size_z*sizeof(float));
 
   memset(b->buf, 0, b->size_x*b->size_y*b->size_z*sizeof(float));
@@ -131,6 +135,8 @@ dt_bilateral_splat(
 #endif
   for(int j=0; j<b->height; j++)
   {
+    // nothing left to do if the pipe got cancelled, the result is thrown away
+    if(dt_iop_cancelled(b->piece)) continue;
     int index = 4*j*b->width;
     for(int i=0; i<b->width; i++)
     {
@@ -265,9 +271,11 @@ dt_bilateral_blur(
   // gaussian up to 3 sigma
   blur_line(b->buf, b->size_x*b->size_y, b->size_x, 1,
             b->size_z, b->size_y, b->size_x);
+  if(dt_iop_cancelled(b->piece)) return;
   // gaussian up to 3 sigma
   blur_line(b->buf, b->size_x*b->size_y, 1, b->size_x,
             b->size_z, b->size_x, b->size_y);
+  if(dt_iop_cancelled(b->piece)) return;
   // -2 derivative of the gaussian up to 3 sigma: x*exp(-x*x)
   blur_line_z(b->buf, 1, b->size_x, b->size_x*b->size_y,
               b->size_x, b->size_y, b->size_z);
@@ -291,6 +299,7 @@ dt_bilateral_slice(
 #endif
   for(int j=0; j<b->height; j++)
   {
+    if(dt_iop_cancelled(b->piece)) continue;
     int index = 4*j*b->width;
     for(int i=0; i<b->width; i++)
     {
@@ -341,6 +350,7 @@ dt_bilateral_slice_to_output(
 #endif
   for(int j=0; j<b->height; j++)
   {
+    if(dt_iop_cancelled(b->piece)) continue;
     int index = 4*j*b->width;
     for(int i=0; i<b->width; i++)
     {
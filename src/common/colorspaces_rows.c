@@ -0,0 +1,296 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "common/colorspaces_rows.h"
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#include <math.h>
+#include <string.h>
+
+// all conversions work on four pixels at a time, transposed to one
+// register per channel. the kernels below take and return the four
+// channel registers.
+typedef void (_row_kernel_t)(__m128 *c0, __m128 *c1, __m128 *c2);
+
+static inline __m128
+_select(const __m128 mask, const __m128 a, const __m128 b)
+{
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline void
+_process_row(_row_kernel_t kernel, const float *const in, float *const out, const int width)
+{
+  int i = 0;
+  for(; i+4<=width; i+=4)
+  {
+    __m128 p0 = _mm_loadu_ps(in + 4*i);
+    __m128 p1 = _mm_loadu_ps(in + 4*i + 4);
+    __m128 p2 = _mm_loadu_ps(in + 4*i + 8);
+    __m128 p3 = _mm_loadu_ps(in + 4*i + 12);
+    _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+    kernel(&p0, &p1, &p2);
+    _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+    _mm_storeu_ps(out + 4*i, p0);
+    _mm_storeu_ps(out + 4*i + 4, p1);
+    _mm_storeu_ps(out + 4*i + 8, p2);
+    _mm_storeu_ps(out + 4*i + 12, p3);
+  }
+  if(i < width)
+  {
+    // pad the tail with copies of its first pixel, so the unused lanes stay finite
+    const int rem = width - i;
+    float tmp[16];
+    for(int k=0; k<4; k++) memcpy(tmp + 4*k, in + 4*(i + (k < rem ? k : 0)), 4*sizeof(float));
+    _process_row(kernel, tmp, tmp, 4);
+    memcpy(out + 4*i, tmp, 4*sizeof(float)*rem);
+  }
+}
+
+// ---------------------------------------------------------------------
+// XYZ <-> Lab
+// ---------------------------------------------------------------------
+
+static inline __m128
+_lab_f(const __m128 x)
+{
+  const __m128 epsilon = _mm_set1_ps(216.0f/24389.0f);
+  const __m128 kappa   = _mm_set1_ps(24389.0f/27.0f);
+
+  // initial guess for cbrtf(x) from the exponent bits, refined by two halley steps.
+  // a single step (as in colorin) leaves ~1e-5 relative error, which a*500 turns into 1e-2.
+  __m128 a = _mm_castsi128_ps(_mm_add_epi32(_mm_cvtps_epi32(_mm_div_ps(_mm_cvtepi32_ps(_mm_castps_si128(x)),_mm_set1_ps(3.0f))),_mm_set1_epi32(709921077)));
+  for(int k=0; k<2; k++)
+  {
+    const __m128 a3 = _mm_mul_ps(_mm_mul_ps(a,a),a);
+    a = _mm_div_ps(_mm_mul_ps(a,_mm_add_ps(a3,_mm_add_ps(x,x))),_mm_add_ps(_mm_add_ps(a3,a3),x));
+  }
+  const __m128 res_big = a;
+
+  const __m128 res_small = _mm_div_ps(_mm_add_ps(_mm_mul_ps(kappa,x),_mm_set1_ps(16.0f)),_mm_set1_ps(116.0f));
+  return _select(_mm_cmpgt_ps(x,epsilon), res_big, res_small);
+}
+
+static inline __m128
+_lab_f_inv(const __m128 x)
+{
+  const __m128 epsilon = _mm_set1_ps(0.20689655172413796f); // cbrtf(216.0f/24389.0f);
+  const __m128 res_big   = _mm_mul_ps(_mm_mul_ps(x,x),x);
+  const __m128 res_small = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(116.0f*27.0f/24389.0f),x),_mm_set1_ps(16.0f*27.0f/24389.0f));
+  return _select(_mm_cmpgt_ps(x,epsilon), res_big, res_small);
+}
+
+static void
+_XYZ_to_Lab(__m128 *c0, __m128 *c1, __m128 *c2)
+{
+  const __m128 fx = _lab_f(_mm_mul_ps(*c0, _mm_set1_ps(1.0f/0.9642f)));
+  const __m128 fy = _lab_f(*c1);
+  const __m128 fz = _lab_f(_mm_mul_ps(*c2, _mm_set1_ps(1.0f/0.8249f)));
+  *c0 = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(116.0f), fy), _mm_set1_ps(16.0f));
+  *c1 = _mm_mul_ps(_mm_set1_ps(500.0f), _mm_sub_ps(fx, fy));
+  *c2 = _mm_mul_ps(_mm_set1_ps(200.0f), _mm_sub_ps(fy, fz));
+}
+
+static void
+_Lab_to_XYZ(__m128 *c0, __m128 *c1, __m128 *c2)
+{
+  const __m128 fy = _mm_mul_ps(_mm_add_ps(*c0, _mm_set1_ps(16.0f)), _mm_set1_ps(1.0f/116.0f));
+  const __m128 fx = _mm_add_ps(_mm_mul_ps(*c1, _mm_set1_ps(1.0f/500.0f)), fy);
+  const __m128 fz = _mm_sub_ps(fy, _mm_mul_ps(*c2, _mm_set1_ps(1.0f/200.0f)));
+  *c0 = _mm_mul_ps(_mm_set1_ps(0.9642f), _lab_f_inv(fx));
+  *c1 = _lab_f_inv(fy);
+  *c2 = _mm_mul_ps(_mm_set1_ps(0.8249f), _lab_f_inv(fz));
+}
+
+void
+dt_XYZ_to_Lab_row(const float *const XYZ, float *const Lab, const int width)
+{
+  _process_row(_XYZ_to_Lab, XYZ, Lab, width);
+}
+
+void
+dt_Lab_to_XYZ_row(const float *const Lab, float *const XYZ, const int width)
+{
+  _process_row(_Lab_to_XYZ, Lab, XYZ, width);
+}
+
+// ---------------------------------------------------------------------
+// Lab <-> LCh
+// ---------------------------------------------------------------------
+
+// atan2(y, x)/(2 pi) in [0,1], odd minimax polynomial for atan on [0,1]
+static inline __m128
+_atan2_turns(const __m128 y, const __m128 x)
+{
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  const __m128 ax = _mm_andnot_ps(sign, x);
+  const __m128 ay = _mm_andnot_ps(sign, y);
+  const __m128 mx = _mm_max_ps(ax, ay);
+  const __m128 mn = _mm_min_ps(ax, ay);
+  // t = mn/mx, with 0/0 mapped to 0
+  const __m128 t = _mm_and_ps(_mm_cmpgt_ps(mx, _mm_setzero_ps()), _mm_div_ps(mn, mx));
+  const __m128 s = _mm_mul_ps(t, t);
+  __m128 p = _mm_set1_ps(-0.01172120f);
+  p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps( 0.05265332f));
+  p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(-0.11643287f));
+  p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps( 0.19354346f));
+  p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(-0.33262347f));
+  p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps( 0.99997726f));
+  // r in turns: [0, 1/8]
+  __m128 r = _mm_mul_ps(_mm_mul_ps(p, t), _mm_set1_ps(1.0f/(2.0f*M_PI)));
+  r = _select(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(0.25f), r), r);
+  r = _select(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(0.5f), r), r);
+  // lower half plane wraps around to (1/2, 1)
+  return _select(_mm_cmplt_ps(y, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(1.0f), r), r);
+}
+
+// sin and cos of 2 pi h, for any h
+static inline void
+_sincos_turns(const __m128 h, __m128 *sn, __m128 *cs)
+{
+  // reduce to quadrant q and x in [-pi/4, pi/4]
+  const __m128i q = _mm_cvtps_epi32(_mm_mul_ps(h, _mm_set1_ps(4.0f)));
+  const __m128 x = _mm_mul_ps(_mm_sub_ps(h, _mm_mul_ps(_mm_cvtepi32_ps(q), _mm_set1_ps(0.25f))), _mm_set1_ps(2.0f*M_PI));
+  const __m128 x2 = _mm_mul_ps(x, x);
+
+  __m128 s = _mm_set1_ps(-1.0f/5040.0f);
+  s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps( 1.0f/120.0f));
+  s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(-1.0f/6.0f));
+  s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, x2), x), x);
+
+  __m128 c = _mm_set1_ps(1.0f/40320.0f);
+  c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(-1.0f/720.0f));
+  c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps( 1.0f/24.0f));
+  c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(-0.5f));
+  c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps( 1.0f));
+
+  // odd quadrants swap sin and cos, quadrants 2,3 negate sin, 1,2 negate cos
+  const __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+  const __m128 sneg = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, _mm_set1_epi32(2)), 30));
+  const __m128 cneg = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+  *sn = _mm_xor_ps(_select(swap, c, s), sneg);
+  *cs = _mm_xor_ps(_select(swap, s, c), cneg);
+}
+
+static void
+_Lab_to_LCh(__m128 *c0, __m128 *c1, __m128 *c2)
+{
+  const __m128 a = *c1, b = *c2;
+  *c1 = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(a, a), _mm_mul_ps(b, b)));
+  *c2 = _atan2_turns(b, a);
+}
+
+static void
+_LCh_to_Lab(__m128 *c0, __m128 *c1, __m128 *c2)
+{
+  __m128 sn, cs;
+  _sincos_turns(*c2, &sn, &cs);
+  const __m128 C = *c1;
+  *c1 = _mm_mul_ps(C, cs);
+  *c2 = _mm_mul_ps(C, sn);
+}
+
+void
+dt_Lab_to_LCh_row(const float *const Lab, float *const LCh, const int width)
+{
+  _process_row(_Lab_to_LCh, Lab, LCh, width);
+}
+
+void
+dt_LCh_to_Lab_row(const float *const LCh, float *const Lab, const int width)
+{
+  _process_row(_LCh_to_Lab, LCh, Lab, width);
+}
+
+// ---------------------------------------------------------------------
+// RGB <-> HSL
+// ---------------------------------------------------------------------
+
+static void
+_RGB_to_HSL(__m128 *c0, __m128 *c1, __m128 *c2)
+{
+  const __m128 R = *c0, G = *c1, B = *c2;
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 mx = _mm_max_ps(R, _mm_max_ps(G, B));
+  const __m128 mn = _mm_min_ps(R, _mm_min_ps(G, B));
+  const __m128 del = _mm_sub_ps(mx, mn);
+  const __m128 sum = _mm_add_ps(mx, mn);
+  const __m128 L = _mm_mul_ps(sum, _mm_set1_ps(0.5f));
+  const __m128 chromatic = _mm_cmpge_ps(del, _mm_set1_ps(1e-6f));
+
+  // guard the divisions on the grey lanes, they are masked out below
+  const __m128 den = _select(_mm_cmplt_ps(L, _mm_set1_ps(0.5f)), sum, _mm_sub_ps(_mm_set1_ps(2.0f), sum));
+  const __m128 S = _mm_div_ps(del, _select(chromatic, den, one));
+  const __m128 rdel6 = _mm_div_ps(_mm_set1_ps(1.0f/6.0f), _select(chromatic, del, one));
+
+  const __m128 hr = _mm_mul_ps(_mm_sub_ps(G, B), rdel6);
+  const __m128 hg = _mm_add_ps(_mm_set1_ps(1.0f/3.0f), _mm_mul_ps(_mm_sub_ps(B, R), rdel6));
+  const __m128 hb = _mm_add_ps(_mm_set1_ps(2.0f/3.0f), _mm_mul_ps(_mm_sub_ps(R, G), rdel6));
+  __m128 H = _select(_mm_cmpeq_ps(R, mx), hr, _select(_mm_cmpeq_ps(G, mx), hg, hb));
+  H = _mm_add_ps(H, _mm_and_ps(_mm_cmplt_ps(H, zero), one));
+  H = _mm_sub_ps(H, _mm_and_ps(_mm_cmpgt_ps(H, one), one));
+
+  *c0 = _mm_and_ps(chromatic, H);
+  *c1 = _mm_and_ps(chromatic, S);
+  *c2 = L;
+}
+
+static inline __m128
+_hue_to_rgb(const __m128 v1, const __m128 v2, __m128 vH)
+{
+  const __m128 one = _mm_set1_ps(1.0f);
+  vH = _mm_add_ps(vH, _mm_and_ps(_mm_cmplt_ps(vH, _mm_setzero_ps()), one));
+  vH = _mm_sub_ps(vH, _mm_and_ps(_mm_cmpgt_ps(vH, one), one));
+  const __m128 d = _mm_sub_ps(v2, v1);
+  const __m128 rise = _mm_add_ps(v1, _mm_mul_ps(d, _mm_mul_ps(_mm_set1_ps(6.0f), vH)));
+  const __m128 fall = _mm_add_ps(v1, _mm_mul_ps(d, _mm_mul_ps(_mm_set1_ps(6.0f), _mm_sub_ps(_mm_set1_ps(2.0f/3.0f), vH))));
+  return _select(_mm_cmplt_ps(vH, _mm_set1_ps(1.0f/6.0f)), rise,
+         _select(_mm_cmplt_ps(vH, _mm_set1_ps(0.5f)), v2,
+         _select(_mm_cmplt_ps(vH, _mm_set1_ps(2.0f/3.0f)), fall, v1)));
+}
+
+static void
+_HSL_to_RGB(__m128 *c0, __m128 *c1, __m128 *c2)
+{
+  const __m128 H = *c0, S = *c1, L = *c2;
+  const __m128 v2 = _select(_mm_cmplt_ps(L, _mm_set1_ps(0.5f)),
+                            _mm_mul_ps(L, _mm_add_ps(_mm_set1_ps(1.0f), S)),
+                            _mm_sub_ps(_mm_add_ps(L, S), _mm_mul_ps(S, L)));
+  const __m128 v1 = _mm_sub_ps(_mm_add_ps(L, L), v2);
+  const __m128 chromatic = _mm_cmpge_ps(S, _mm_set1_ps(1e-6f));
+  *c0 = _select(chromatic, _hue_to_rgb(v1, v2, _mm_add_ps(H, _mm_set1_ps(1.0f/3.0f))), L);
+  *c1 = _select(chromatic, _hue_to_rgb(v1, v2, H), L);
+  *c2 = _select(chromatic, _hue_to_rgb(v1, v2, _mm_sub_ps(H, _mm_set1_ps(1.0f/3.0f))), L);
+}
+
+void
+dt_RGB_to_HSL_row(const float *const RGB, float *const HSL, const int width)
+{
+  _process_row(_RGB_to_HSL, RGB, HSL, width);
+}
+
+void
+dt_HSL_to_RGB_row(const float *const HSL, float *const RGB, const int width)
+{
+  _process_row(_HSL_to_RGB, HSL, RGB, width);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
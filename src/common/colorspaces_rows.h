@@ -0,0 +1,63 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef DT_COMMON_COLORSPACES_ROWS_H
+#define DT_COMMON_COLORSPACES_ROWS_H
+
+/** batched colorspace conversions on rows of 4 float pixels.
+ *
+ * these replace the per pixel scalar helpers (cbrtf, atan2f, sinf, cosf)
+ * in the hot loops of blending and the color modules. four pixels are
+ * converted at once with polynomial approximations; the tail of a row goes
+ * through the same code on a padded copy, so results do not depend on the
+ * position of a pixel in the row.
+ *
+ * in and out may be the same buffer. the fourth channel is passed through
+ * unchanged. no alignment is required.
+ *
+ * error bounds, checked against libm by src/tests/colorspaces_rows.c:
+ * - XYZ -> Lab: 2e-4 absolute in L, a, b (a few float ulp, times 500 for a)
+ * - Lab -> XYZ: 1e-6 absolute
+ * - Lab -> LCh: C is exact (sqrt), h is within 2e-6 of atan2f(b,a)/(2 pi),
+ *   returned in [0,1]
+ * - LCh -> Lab: 2e-6 * C absolute for any h, which may be outside [0,1]
+ * - RGB <-> HSL: 2e-6 absolute, same conventions as the blend modes: greys
+ *   (max - min < 1e-6) get h = s = 0
+ */
+
+/** uses D50 white point, as dt_XYZ_to_Lab(). */
+void dt_XYZ_to_Lab_row(const float *const XYZ, float *const Lab, const int width);
+
+/** uses D50 white point, as dt_Lab_to_XYZ(). */
+void dt_Lab_to_XYZ_row(const float *const Lab, float *const XYZ, const int width);
+
+/** L is passed through, C = |(a,b)|, h = hue angle in turns. works for any scaling of Lab. */
+void dt_Lab_to_LCh_row(const float *const Lab, float *const LCh, const int width);
+
+/** inverse of dt_Lab_to_LCh_row(), h is taken modulo 1. */
+void dt_LCh_to_Lab_row(const float *const LCh, float *const Lab, const int width);
+
+/** rgb and hsl in [0,1]. */
+void dt_RGB_to_HSL_row(const float *const RGB, float *const HSL, const int width);
+
+/** inverse of dt_RGB_to_HSL_row(). */
+void dt_HSL_to_RGB_row(const float *const HSL, float *const RGB, const int width);
+
+#endif
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -0,0 +1,69 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/cpu_dispatch.h"
+#include "common/darktable.h"
+#include <cpuid.h>
+#include <string.h>
+
+// xgetbv, without needing -mxsave for the intrinsic:
+static inline uint64_t _xgetbv(const uint32_t index)
+{
+  uint32_t eax, edx;
+  __asm__ __volatile__(".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c"(index));
+  return ((uint64_t)edx << 32) | eax;
+}
+
+uint32_t dt_cpu_detect_flags()
+{
+  uint32_t flags = 0;
+  uint32_t eax, ebx, ecx, edx;
+  if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return flags;
+
+  if(edx & bit_SSE)  flags |= DT_CPU_FLAG_SSE;
+  if(edx & bit_SSE2) flags |= DT_CPU_FLAG_SSE2;
+  if(ecx & bit_SSE3) flags |= DT_CPU_FLAG_SSE3;
+
+  // avx needs the os to save the ymm registers on context switches
+  const int os_avx = (ecx & bit_OSXSAVE) && (_xgetbv(0) & 6) == 6;
+  if(!os_avx) return flags;
+  if(ecx & bit_AVX) flags |= DT_CPU_FLAG_AVX;
+  if(ecx & bit_FMA) flags |= DT_CPU_FLAG_FMA;
+
+  if(__get_cpuid_max(0, NULL) >= 7)
+  {
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    if(ebx & bit_AVX2) flags |= DT_CPU_FLAG_AVX2;
+  }
+  return flags;
+}
+
+void dt_cpu_kernels_init(dt_cpu_kernels_t *kernels, const uint32_t cpu_flags)
+{
+  dt_cpu_kernels_init_sse2(kernels);
+#ifdef HAVE_AVX2_KERNELS
+  const uint32_t avx2 = DT_CPU_FLAG_AVX | DT_CPU_FLAG_AVX2 | DT_CPU_FLAG_FMA;
+  if((cpu_flags & avx2) == avx2) dt_cpu_kernels_init_avx2(kernels);
+#endif
+  dt_print(DT_DEBUG_PERF, "[cpu_dispatch] using %s code path%s\n", kernels->name,
+           (cpu_flags & DT_CPU_FLAG_AVX2) && strcmp(kernels->name, "avx2") ? " (avx2 kernels not compiled in)" : "");
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -0,0 +1,76 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef DT_COMMON_CPU_DISPATCH_H
+#define DT_COMMON_CPU_DISPATCH_H
+
+#include <inttypes.h>
+
+/**
+ * the inner loops of a few hot modules, built once for the sse2 baseline and once
+ * for avx2/fma (if the compiler can do that). the variant is picked at startup
+ * from cpuid, so binary packages still run everywhere but use the wider units
+ * where they exist. all of these work on rows of 4 floats per pixel.
+ */
+typedef struct dt_cpu_kernels_t
+{
+  /** name of the active variant, for debug output */
+  const char *name;
+
+  /** one row j of the edge avoiding a-trous decomposition (atrous.c) for pixels i0..i1-1,
+   * which must be at least 2*mult away from all image borders. in, coarse and detail
+   * point to the start of the full images. */
+  void (*eaw_decompose_row)(const float *const in, float *const coarse, float *const detail,
+                            const int j, const int i0, const int i1, const int width,
+                            const int mult, const float sharpen);
+
+  /** non-local means patch distance for n pixels: s[i] += |p-ps|^2 - |m-ms|^2, weighted per
+   * channel by norm2[0..2]. the m terms are skipped if m is NULL. */
+  void (*nlmeans_dist_row)(float *const s, const float *const p, const float *const ps,
+                           const float *const m, const float *const ms, const float *const norm2, const int n);
+
+  /** camera rgb -> XYZ by the 3x3 matrix mat (row major), then to Lab. may work in place. */
+  void (*rgb_to_Lab_row)(float *const out, const float *const in, const float *const mat, const int width);
+
+  /** Lab -> XYZ, then to rgb by the 3x3 matrix mat (row major). may work in place. */
+  void (*Lab_to_rgb_row)(float *const out, const float *const in, const float *const mat, const int width);
+
+  /** one output row of the separable resampling in dt_interpolation_resample(): out_width
+   * pixels, each one summing vl input lines (vindex, vkernel) times hlength[] taps (hindex,
+   * hkernel), the horizontal arrays being consumed left to right. */
+  void (*resample_row)(float *const out, const float *const in, const int in_stride, const int out_width,
+                       const int *const hlength, const float *const hkernel, const int *const hindex,
+                       const int vl, const int *const vindex, const float *const vkernel);
+}
+dt_cpu_kernels_t;
+
+/** returns the DT_CPU_FLAG_* bits of the host cpu. */
+uint32_t dt_cpu_detect_flags();
+
+/** fills in the best variant for the given cpu flags. */
+void dt_cpu_kernels_init(dt_cpu_kernels_t *kernels, const uint32_t cpu_flags);
+
+// the variants, in cpu_kernels_*.c
+void dt_cpu_kernels_init_sse2(dt_cpu_kernels_t *kernels);
+#ifdef HAVE_AVX2_KERNELS
+void dt_cpu_kernels_init_avx2(dt_cpu_kernels_t *kernels);
+#endif
+
+#endif
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
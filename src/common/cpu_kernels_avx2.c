@@ -0,0 +1,279 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// avx2/fma variants of the kernels in cpu_dispatch.h. this file is compiled with
+// -mavx2 -mfma and must only be called after checking cpuid, see cpu_dispatch.c.
+// two pixels of 4 floats go into one ymm register, so most of the sse2 code carries
+// over lane by lane. the remaining odd pixel of a row goes through the 128 bit path.
+
+#include "common/cpu_dispatch.h"
+#include <immintrin.h>
+#include <stddef.h>
+
+static inline __m256
+fast_expf_avx2(const __m256 x)
+{
+  const __m256 fone = _mm256_set1_ps((float)0x3f800000u);
+  const __m256 femo = _mm256_set1_ps((float)0x00adf880u);
+  __m256i i = _mm256_cvtps_epi32(_mm256_fmadd_ps(x, femo, fone));
+  i = _mm256_andnot_si256(_mm256_srai_epi32(i, 31), i); // i = 0 if i < 0
+  return _mm256_castsi256_ps(i);
+}
+
+// (wl, wc, wc, 1) for two pixels at once, see weight_sse() in iop/atrous.c
+static inline __m256
+eaw_weight_avx2(const __m256 c1, const __m256 c2, const __m256 vsharpen)
+{
+  const __m256 diff = _mm256_sub_ps(c1, c2);
+  const __m256 square = _mm256_mul_ps(diff, diff);                             // (?, d3, d2, d1)
+  const __m256 square2 = _mm256_shuffle_ps(square, square, _MM_SHUFFLE(3, 1, 2, 0)); // (?, d2, d3, d1)
+  const __m256 added = _mm256_blend_ps(_mm256_add_ps(square, square2), square, 0x11); // (?, d2+d3, d2+d3, d1)
+  const __m256 exp = fast_expf_avx2(_mm256_mul_ps(added, vsharpen));
+  return _mm256_blend_ps(exp, _mm256_set1_ps(1.0f), 0x88);                   // (1, wc, wc, wl)
+}
+
+static void
+eaw_decompose_row_avx2(const float *const in, float *const coarse, float *const detail,
+                       const int j, const int i0, const int i1, const int width,
+                       const int mult, const float sharpen)
+{
+  static const float filter[5] = {1.0f/16.0f, 4.0f/16.0f, 6.0f/16.0f, 4.0f/16.0f, 1.0f/16.0f};
+  const __m256 vsharpen = _mm256_set1_ps(-sharpen);
+  int i = i0;
+  for(; i<i1-1; i+=2)
+  {
+    const float *px = in + 4*(j*width + i);
+    const __m256 c = _mm256_loadu_ps(px);
+    __m256 sum = _mm256_setzero_ps();
+    __m256 wgt = _mm256_setzero_ps();
+    const float *px2 = in + 4*(i-2*mult + (j-2*mult)*width);
+    for(int jj=0; jj<5; jj++)
+    {
+      for(int ii=0; ii<5; ii++)
+      {
+        const __m256 p2 = _mm256_loadu_ps(px2);
+        const __m256 w = _mm256_mul_ps(_mm256_set1_ps(filter[ii]*filter[jj]), eaw_weight_avx2(c, p2, vsharpen));
+        sum = _mm256_fmadd_ps(w, p2, sum);
+        wgt = _mm256_add_ps(wgt, w);
+        px2 += 4*mult;
+      }
+      px2 += 4*(width-5)*mult;
+    }
+    sum = _mm256_mul_ps(sum, _mm256_rcp_ps(wgt));
+    _mm256_storeu_ps(detail + 4*(j*width + i), _mm256_sub_ps(c, sum));
+    _mm256_storeu_ps(coarse + 4*(j*width + i), sum);
+  }
+  for(; i<i1; i++)
+  {
+    // same in the lower half only
+    const float *px = in + 4*(j*width + i);
+    const __m256 c = _mm256_castps128_ps256(_mm_loadu_ps(px));
+    __m256 sum = _mm256_setzero_ps();
+    __m256 wgt = _mm256_setzero_ps();
+    const float *px2 = in + 4*(i-2*mult + (j-2*mult)*width);
+    for(int jj=0; jj<5; jj++)
+    {
+      for(int ii=0; ii<5; ii++)
+      {
+        const __m256 p2 = _mm256_castps128_ps256(_mm_loadu_ps(px2));
+        const __m256 w = _mm256_mul_ps(_mm256_set1_ps(filter[ii]*filter[jj]), eaw_weight_avx2(c, p2, vsharpen));
+        sum = _mm256_fmadd_ps(w, p2, sum);
+        wgt = _mm256_add_ps(wgt, w);
+        px2 += 4*mult;
+      }
+      px2 += 4*(width-5)*mult;
+    }
+    const __m128 s = _mm_mul_ps(_mm256_castps256_ps128(sum), _mm_rcp_ps(_mm256_castps256_ps128(wgt)));
+    _mm_storeu_ps(detail + 4*(j*width + i), _mm_sub_ps(_mm256_castps256_ps128(c), s));
+    _mm_storeu_ps(coarse + 4*(j*width + i), s);
+  }
+}
+
+static void
+nlmeans_dist_row_avx2(float *const s, const float *const p, const float *const ps,
+                      const float *const m, const float *const ms, const float *const norm2, const int n)
+{
+  // channel weights for two pixels. alpha doesn't count, but is zeroed below
+  // instead of weighted by 0 here, since it may be nan or inf in pipe buffers.
+  const __m256 nv = _mm256_setr_ps(norm2[0], norm2[1], norm2[2], 0.0f, norm2[0], norm2[1], norm2[2], 0.0f);
+  // the horizontal adds below produce pixels in the order 0 2 4 6 | 1 3 5 7
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  int i = 0;
+  for(; i<n-8; i+=8)
+  {
+    __m256 d[4];
+    for(int k=0; k<4; k++)
+    {
+      const __m256 dp = _mm256_sub_ps(_mm256_loadu_ps(p + 4*i + 8*k), _mm256_loadu_ps(ps + 4*i + 8*k));
+      __m256 e = _mm256_mul_ps(dp, dp);
+      if(m)
+      {
+        const __m256 dm = _mm256_sub_ps(_mm256_loadu_ps(m + 4*i + 8*k), _mm256_loadu_ps(ms + 4*i + 8*k));
+        e = _mm256_fnmadd_ps(dm, dm, e);
+      }
+      e = _mm256_blend_ps(e, _mm256_setzero_ps(), 0x88);
+      d[k] = _mm256_mul_ps(e, nv);
+    }
+    const __m256 h = _mm256_hadd_ps(_mm256_hadd_ps(d[0], d[1]), _mm256_hadd_ps(d[2], d[3]));
+    _mm256_storeu_ps(s + i, _mm256_add_ps(_mm256_loadu_ps(s + i), _mm256_permutevar8x32_ps(h, order)));
+  }
+  for(; i<n; i++)
+  {
+    float stmp = s[i];
+    for(int k=0; k<3; k++)
+    {
+      stmp += (p[4*i+k] - ps[4*i+k])*(p[4*i+k] - ps[4*i+k]) * norm2[k];
+      if(m) stmp -= (m[4*i+k] - ms[4*i+k])*(m[4*i+k] - ms[4*i+k]) * norm2[k];
+    }
+    s[i] = stmp;
+  }
+}
+
+static inline __m256
+lab_f_m_avx2(const __m256 x)
+{
+  const __m256 epsilon = _mm256_set1_ps(216.0f/24389.0f);
+  const __m256 kappa   = _mm256_set1_ps(24389.0f/27.0f);
+
+  // cbrtf(x) approximation for x > epsilon, see colorin.c
+  const __m256 a = _mm256_castsi256_ps(_mm256_add_epi32(_mm256_cvtps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(_mm256_castps_si256(x)), _mm256_set1_ps(3.0f))), _mm256_set1_epi32(709921077)));
+  const __m256 a3 = _mm256_mul_ps(_mm256_mul_ps(a,a),a);
+  const __m256 res_big = _mm256_div_ps(_mm256_mul_ps(a,_mm256_add_ps(a3,_mm256_add_ps(x,x))),_mm256_add_ps(_mm256_add_ps(a3,a3),x));
+  // (kappa*x+16)/116 for x <= epsilon
+  const __m256 res_small = _mm256_div_ps(_mm256_fmadd_ps(kappa,x,_mm256_set1_ps(16.0f)),_mm256_set1_ps(116.0f));
+  return _mm256_blendv_ps(res_small, res_big, _mm256_cmp_ps(x, epsilon, _CMP_GT_OQ));
+}
+
+static inline __m256
+lab_f_inv_m_avx2(const __m256 x)
+{
+  const __m256 epsilon = _mm256_set1_ps(0.20689655172413796f); // cbrtf(216.0f/24389.0f);
+  const __m256 kappa_rcp_x16   = _mm256_set1_ps(16.0f*27.0f/24389.0f);
+  const __m256 kappa_rcp_x116   = _mm256_set1_ps(116.0f*27.0f/24389.0f);
+  const __m256 res_big   = _mm256_mul_ps(_mm256_mul_ps(x,x),x);
+  const __m256 res_small = _mm256_fmsub_ps(kappa_rcp_x116,x,kappa_rcp_x16);
+  return _mm256_blendv_ps(res_small, res_big, _mm256_cmp_ps(x, epsilon, _CMP_GT_OQ));
+}
+
+static inline __m256
+rgb_to_Lab_avx2(const __m256 cam, const __m256 m0, const __m256 m1, const __m256 m2)
+{
+  const __m256 d50_inv  = _mm256_setr_ps(1.0f/0.9642f, 1.0f, 1.0f/0.8249f, 0.0f, 1.0f/0.9642f, 1.0f, 1.0f/0.8249f, 0.0f);
+  const __m256 coef = _mm256_setr_ps(116.0f, 500.0f, 200.0f, 0.0f, 116.0f, 500.0f, 200.0f, 0.0f);
+  const __m256 xyz = _mm256_fmadd_ps(m2, _mm256_permute_ps(cam, _MM_SHUFFLE(2,2,2,2)),
+                     _mm256_fmadd_ps(m1, _mm256_permute_ps(cam, _MM_SHUFFLE(1,1,1,1)),
+                     _mm256_mul_ps(m0, _mm256_permute_ps(cam, _MM_SHUFFLE(0,0,0,0)))));
+  const __m256 f = lab_f_m_avx2(_mm256_mul_ps(xyz, d50_inv));
+  // lab_f(0) == 16/116 in the last channel, see colorin.c
+  return _mm256_mul_ps(coef, _mm256_sub_ps(_mm256_permute_ps(f, _MM_SHUFFLE(3,1,0,1)), _mm256_permute_ps(f, _MM_SHUFFLE(3,2,1,3))));
+}
+
+static void
+rgb_to_Lab_row_avx2(float *const out, const float *const in, const float *const mat, const int width)
+{
+  const __m256 m0 = _mm256_setr_ps(mat[0], mat[3], mat[6], 0.0f, mat[0], mat[3], mat[6], 0.0f);
+  const __m256 m1 = _mm256_setr_ps(mat[1], mat[4], mat[7], 0.0f, mat[1], mat[4], mat[7], 0.0f);
+  const __m256 m2 = _mm256_setr_ps(mat[2], mat[5], mat[8], 0.0f, mat[2], mat[5], mat[8], 0.0f);
+  int i = 0;
+  for(; i<width-1; i+=2)
+    _mm256_storeu_ps(out + 4*i, rgb_to_Lab_avx2(_mm256_loadu_ps(in + 4*i), m0, m1, m2));
+  if(i < width)
+    _mm_storeu_ps(out + 4*i, _mm256_castps256_ps128(rgb_to_Lab_avx2(_mm256_castps128_ps256(_mm_loadu_ps(in + 4*i)), m0, m1, m2)));
+}
+
+static inline __m256
+Lab_to_rgb_avx2(const __m256 Lab, const __m256 m0, const __m256 m1, const __m256 m2)
+{
+  const __m256 d50    = _mm256_setr_ps(0.9642f, 1.0f, 0.8249f, 0.0f, 0.9642f, 1.0f, 0.8249f, 0.0f);
+  const __m256 coef   = _mm256_setr_ps(1.0f/500.0f, 1.0f/116.0f, -1.0f/200.0f, 0.0f, 1.0f/500.0f, 1.0f/116.0f, -1.0f/200.0f, 0.0f);
+  const __m256 offset = _mm256_set1_ps(0.137931034f);
+  // last component taken from L to make sure it is not nan, see colorout.c
+  const __m256 f = _mm256_mul_ps(_mm256_permute_ps(Lab, _MM_SHUFFLE(0,2,0,1)), coef);
+  const __m256 xyz = _mm256_mul_ps(d50, lab_f_inv_m_avx2(_mm256_add_ps(_mm256_add_ps(f, _mm256_permute_ps(f, _MM_SHUFFLE(1,1,3,1))), offset)));
+  return _mm256_fmadd_ps(m0, _mm256_permute_ps(xyz, _MM_SHUFFLE(0,0,0,0)),
+         _mm256_fmadd_ps(m1, _mm256_permute_ps(xyz, _MM_SHUFFLE(1,1,1,1)),
+         _mm256_mul_ps(m2, _mm256_permute_ps(xyz, _MM_SHUFFLE(2,2,2,2)))));
+}
+
+static void
+Lab_to_rgb_row_avx2(float *const out, const float *const in, const float *const mat, const int width)
+{
+  const __m256 m0 = _mm256_setr_ps(mat[0], mat[3], mat[6], 0.0f, mat[0], mat[3], mat[6], 0.0f);
+  const __m256 m1 = _mm256_setr_ps(mat[1], mat[4], mat[7], 0.0f, mat[1], mat[4], mat[7], 0.0f);
+  const __m256 m2 = _mm256_setr_ps(mat[2], mat[5], mat[8], 0.0f, mat[2], mat[5], mat[8], 0.0f);
+  int i = 0;
+  for(; i<width-1; i+=2)
+    _mm256_storeu_ps(out + 4*i, Lab_to_rgb_avx2(_mm256_loadu_ps(in + 4*i), m0, m1, m2));
+  if(i < width)
+    _mm_storeu_ps(out + 4*i, _mm256_castps256_ps128(Lab_to_rgb_avx2(_mm256_castps128_ps256(_mm_loadu_ps(in + 4*i)), m0, m1, m2)));
+}
+
+static void
+resample_row_avx2(float *const out, const float *const in, const int in_stride, const int out_width,
+                  const int *const hlength, const float *const hkernel, const int *const hindex,
+                  const int vl, const int *const vindex, const float *const vkernel)
+{
+  // two input lines share one register: line iy in the lower, iy+1 in the upper half
+  int hkidx = 0, hiidx = 0;
+  for(int ox=0; ox<out_width; ox++)
+  {
+    const int hl = hlength[ox];
+    __m256 vs = _mm256_setzero_ps();
+    int iy = 0;
+    for(; iy<vl-1; iy+=2)
+    {
+      const float *i0 = (const float *)((const char *)in + (size_t)in_stride*vindex[iy]);
+      const float *i1 = (const float *)((const char *)in + (size_t)in_stride*vindex[iy+1]);
+      __m256 vhs = _mm256_setzero_ps();
+      for(int ix=0; ix<hl; ix++)
+      {
+        const int idx = 4*hindex[hiidx+ix];
+        const __m256 px = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load_ps(i0 + idx)), _mm_load_ps(i1 + idx), 1);
+        vhs = _mm256_fmadd_ps(px, _mm256_set1_ps(hkernel[hkidx+ix]), vhs);
+      }
+      const __m256 vtap = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(vkernel[iy])), _mm_set1_ps(vkernel[iy+1]), 1);
+      vs = _mm256_fmadd_ps(vhs, vtap, vs);
+    }
+    __m128 vs4 = _mm_add_ps(_mm256_castps256_ps128(vs), _mm256_extractf128_ps(vs, 1));
+    if(iy < vl)
+    {
+      const float *i0 = (const float *)((const char *)in + (size_t)in_stride*vindex[iy]);
+      __m128 vhs = _mm_setzero_ps();
+      for(int ix=0; ix<hl; ix++)
+        vhs = _mm_fmadd_ps(_mm_load_ps(i0 + 4*hindex[hiidx+ix]), _mm_set1_ps(hkernel[hkidx+ix]), vhs);
+      vs4 = _mm_fmadd_ps(vhs, _mm_set1_ps(vkernel[iy]), vs4);
+    }
+    _mm_stream_ps(out + 4*ox, vs4);
+    hiidx += hl;
+    hkidx += hl;
+  }
+}
+
+void dt_cpu_kernels_init_avx2(dt_cpu_kernels_t *kernels)
+{
+  kernels->name = "avx2";
+  kernels->eaw_decompose_row = eaw_decompose_row_avx2;
+  kernels->nlmeans_dist_row = nlmeans_dist_row_avx2;
+  kernels->rgb_to_Lab_row = rgb_to_Lab_row_avx2;
+  kernels->Lab_to_rgb_row = Lab_to_rgb_row_avx2;
+  kernels->resample_row = resample_row_avx2;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
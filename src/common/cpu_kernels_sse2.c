@@ -0,0 +1,288 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// baseline variants of the kernels in cpu_dispatch.h. these are the loops as
+// they used to live in the modules, please keep the avx2 versions in sync.
+
+#include "common/cpu_dispatch.h"
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#include <stddef.h>
+
+#define ALIGNED(a) __attribute__((aligned(a)))
+#define VEC4(a) {(a), (a), (a), (a)}
+
+static const __m128 fone ALIGNED(16) = VEC4(0x3f800000u);
+static const __m128 femo ALIGNED(16) = VEC4(0x00adf880u);
+static const __m128 ooo1 ALIGNED(16) = {0.f, 0.f, 0.f, 1.f};
+
+/* SSE intrinsics version of dt_fast_expf defined in darktable.h */
+static inline __m128
+fast_expf_sse2(const __m128 x)
+{
+  __m128  f = _mm_add_ps(fone, _mm_mul_ps(x, femo)); // f(n) = i1 + x(n)*(i2-i1)
+  __m128i i = _mm_cvtps_epi32(f);                    // i(n) = int(f(n))
+  __m128i mask = _mm_srai_epi32(i, 31);              // mask(n) = 0xffffffff if i(n) < 0
+  i = _mm_andnot_si128(mask, i);                     // i(n) = 0 if i(n) < 0
+  return _mm_castsi128_ps(i);                        // return *(float*)&i
+}
+
+/* (wl, wc, wc, 1), see weight_sse() in iop/atrous.c */
+static inline __m128
+eaw_weight_sse2(const __m128 *c1, const __m128 *c2, const float sharpen)
+{
+  const __m128 vsharpen = _mm_set1_ps(-sharpen);  // (-s, -s, -s, -s)
+  __m128 diff = _mm_sub_ps(*c1, *c2);
+  __m128 square = _mm_mul_ps(diff, diff);         // (?, d3, d2, d1)
+  __m128 square2 = _mm_shuffle_ps(square, square, _MM_SHUFFLE(3, 1, 2, 0)); // (?, d2, d3, d1)
+  __m128 added = _mm_add_ps(square, square2);     // (?, d2+d3, d2+d3, 2*d1)
+  added = _mm_sub_ss(added, square);              // (?, d2+d3, d2+d3, d1)
+  __m128 sharpened = _mm_mul_ps(added, vsharpen); // (?, -s*(d2+d3), -s*(d2+d3), -s*d1)
+  __m128 exp = fast_expf_sse2(sharpened);         // (?, wc, wc, wl)
+  exp = _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(exp), 4)); // (wc, wc, wl, 0)
+  exp = _mm_castsi128_ps(_mm_srli_si128(_mm_castps_si128(exp), 4)); // (0, wc, wc, wl)
+  exp = _mm_or_ps(exp, ooo1); // (1, wc, wc, wl)
+  return exp;
+}
+
+static void
+eaw_decompose_row_sse2(const float *const in, float *const coarse, float *const detail,
+                       const int j, const int i0, const int i1, const int width,
+                       const int mult, const float sharpen)
+{
+  static const float filter[5] = {1.0f/16.0f, 4.0f/16.0f, 6.0f/16.0f, 4.0f/16.0f, 1.0f/16.0f};
+  const __m128 *px = ((__m128 *)in) + j*width + i0;
+  float *pdetail = detail + 4*(j*width + i0);
+  float *pcoarse = coarse + 4*(j*width + i0);
+
+  for(int i=i0; i<i1; i++)
+  {
+    __m128 sum = _mm_setzero_ps();
+    __m128 wgt = _mm_setzero_ps();
+    const __m128 *px2 = ((__m128 *)in) + i-2*mult + (j-2*mult)*width;
+    for(int jj=0; jj<5; jj++)
+    {
+      for(int ii=0; ii<5; ii++)
+      {
+        const __m128 f = _mm_set1_ps(filter[ii]*filter[jj]);
+        const __m128 wp = eaw_weight_sse2(px, px2, sharpen);
+        const __m128 w = _mm_mul_ps(f, wp);
+        sum = _mm_add_ps(sum, _mm_mul_ps(w, *px2));
+        wgt = _mm_add_ps(wgt, w);
+        px2 += mult;
+      }
+      px2 += (width-5)*mult;
+    }
+    sum = _mm_mul_ps(sum, _mm_rcp_ps(wgt));
+
+    _mm_stream_ps(pdetail, _mm_sub_ps(*px, sum));
+    _mm_stream_ps(pcoarse, sum);
+    px++;
+    pdetail += 4;
+    pcoarse += 4;
+  }
+}
+
+static void
+nlmeans_dist_row_sse2(float *const s, const float *const p, const float *const ps,
+                      const float *const m, const float *const ms, const float *const norm2, const int n)
+{
+  int i = 0;
+  for(; ((size_t)(s+i) & 0xf) != 0 && i<n; i++)
+  {
+    float stmp = s[i];
+    for(int k=0; k<3; k++)
+    {
+      stmp += (p[4*i+k] - ps[4*i+k])*(p[4*i+k] - ps[4*i+k]) * norm2[k];
+      if(m) stmp -= (m[4*i+k] - ms[4*i+k])*(m[4*i+k] - ms[4*i+k]) * norm2[k];
+    }
+    s[i] = stmp;
+  }
+  const __m128 n0 = _mm_set1_ps(norm2[0]), n1 = _mm_set1_ps(norm2[1]), n2 = _mm_set1_ps(norm2[2]);
+  /* Process most of the line 4 pixels at a time */
+  for(; i<n-4; i+=4)
+  {
+    __m128 sv = _mm_load_ps(s+i);
+    const float *inp = p + 4*i, *inps = ps + 4*i;
+    const __m128 inp1 = _mm_sub_ps(_mm_loadu_ps(inp),    _mm_loadu_ps(inps));
+    const __m128 inp2 = _mm_sub_ps(_mm_loadu_ps(inp+4),  _mm_loadu_ps(inps+4));
+    const __m128 inp3 = _mm_sub_ps(_mm_loadu_ps(inp+8),  _mm_loadu_ps(inps+8));
+    const __m128 inp4 = _mm_sub_ps(_mm_loadu_ps(inp+12), _mm_loadu_ps(inps+12));
+
+    const __m128 inp12lo = _mm_unpacklo_ps(inp1,inp2);
+    const __m128 inp34lo = _mm_unpacklo_ps(inp3,inp4);
+    const __m128 inp12hi = _mm_unpackhi_ps(inp1,inp2);
+    const __m128 inp34hi = _mm_unpackhi_ps(inp3,inp4);
+
+    const __m128 inpv0 = _mm_movelh_ps(inp12lo,inp34lo);
+    sv = _mm_add_ps(sv, _mm_mul_ps(_mm_mul_ps(inpv0, inpv0), n0));
+    const __m128 inpv1 = _mm_movehl_ps(inp34lo,inp12lo);
+    sv = _mm_add_ps(sv, _mm_mul_ps(_mm_mul_ps(inpv1, inpv1), n1));
+    const __m128 inpv2 = _mm_movelh_ps(inp12hi,inp34hi);
+    sv = _mm_add_ps(sv, _mm_mul_ps(_mm_mul_ps(inpv2, inpv2), n2));
+
+    if(m)
+    {
+      const float *inm = m + 4*i, *inms = ms + 4*i;
+      const __m128 inm1 = _mm_sub_ps(_mm_loadu_ps(inm),    _mm_loadu_ps(inms));
+      const __m128 inm2 = _mm_sub_ps(_mm_loadu_ps(inm+4),  _mm_loadu_ps(inms+4));
+      const __m128 inm3 = _mm_sub_ps(_mm_loadu_ps(inm+8),  _mm_loadu_ps(inms+8));
+      const __m128 inm4 = _mm_sub_ps(_mm_loadu_ps(inm+12), _mm_loadu_ps(inms+12));
+
+      const __m128 inm12lo = _mm_unpacklo_ps(inm1,inm2);
+      const __m128 inm34lo = _mm_unpacklo_ps(inm3,inm4);
+      const __m128 inm12hi = _mm_unpackhi_ps(inm1,inm2);
+      const __m128 inm34hi = _mm_unpackhi_ps(inm3,inm4);
+
+      const __m128 inmv0 = _mm_movelh_ps(inm12lo,inm34lo);
+      sv = _mm_sub_ps(sv, _mm_mul_ps(_mm_mul_ps(inmv0, inmv0), n0));
+      const __m128 inmv1 = _mm_movehl_ps(inm34lo,inm12lo);
+      sv = _mm_sub_ps(sv, _mm_mul_ps(_mm_mul_ps(inmv1, inmv1), n1));
+      const __m128 inmv2 = _mm_movelh_ps(inm12hi,inm34hi);
+      sv = _mm_sub_ps(sv, _mm_mul_ps(_mm_mul_ps(inmv2, inmv2), n2));
+    }
+
+    _mm_store_ps(s+i, sv);
+  }
+  for(; i<n; i++)
+  {
+    float stmp = s[i];
+    for(int k=0; k<3; k++)
+    {
+      stmp += (p[4*i+k] - ps[4*i+k])*(p[4*i+k] - ps[4*i+k]) * norm2[k];
+      if(m) stmp -= (m[4*i+k] - ms[4*i+k])*(m[4*i+k] - ms[4*i+k]) * norm2[k];
+    }
+    s[i] = stmp;
+  }
+}
+
+static inline __m128
+lab_f_m_sse2(const __m128 x)
+{
+  const __m128 epsilon = _mm_set1_ps(216.0f/24389.0f);
+  const __m128 kappa   = _mm_set1_ps(24389.0f/27.0f);
+
+  // calculate as if x > epsilon : result = cbrtf(x)
+  // approximate cbrtf(x):
+  const __m128 a = _mm_castsi128_ps(_mm_add_epi32(_mm_cvtps_epi32(_mm_div_ps(_mm_cvtepi32_ps(_mm_castps_si128(x)),_mm_set1_ps(3.0f))),_mm_set1_epi32(709921077)));
+  const __m128 a3 = _mm_mul_ps(_mm_mul_ps(a,a),a);
+  const __m128 res_big = _mm_div_ps(_mm_mul_ps(a,_mm_add_ps(a3,_mm_add_ps(x,x))),_mm_add_ps(_mm_add_ps(a3,a3),x));
+
+  // calculate as if x <= epsilon : result = (kappa*x+16)/116
+  const __m128 res_small = _mm_div_ps(_mm_add_ps(_mm_mul_ps(kappa,x),_mm_set1_ps(16.0f)),_mm_set1_ps(116.0f));
+
+  // blend results according to whether each component is > epsilon or not
+  const __m128 mask = _mm_cmpgt_ps(x,epsilon);
+  return _mm_or_ps(_mm_and_ps(mask,res_big),_mm_andnot_ps(mask,res_small));
+}
+
+static inline __m128
+lab_f_inv_m_sse2(const __m128 x)
+{
+  const __m128 epsilon = _mm_set1_ps(0.20689655172413796f); // cbrtf(216.0f/24389.0f);
+  const __m128 kappa_rcp_x16   = _mm_set1_ps(16.0f*27.0f/24389.0f);
+  const __m128 kappa_rcp_x116   = _mm_set1_ps(116.0f*27.0f/24389.0f);
+
+  // x > epsilon
+  const __m128 res_big   = _mm_mul_ps(_mm_mul_ps(x,x),x);
+  // x <= epsilon
+  const __m128 res_small = _mm_sub_ps(_mm_mul_ps(kappa_rcp_x116,x),kappa_rcp_x16);
+
+  // blend results according to whether each component is > epsilon or not
+  const __m128 mask = _mm_cmpgt_ps(x,epsilon);
+  return _mm_or_ps(_mm_and_ps(mask,res_big),_mm_andnot_ps(mask,res_small));
+}
+
+static void
+rgb_to_Lab_row_sse2(float *const out, const float *const in, const float *const mat, const int width)
+{
+  const __m128 m0 = _mm_set_ps(0.0f,mat[6],mat[3],mat[0]);
+  const __m128 m1 = _mm_set_ps(0.0f,mat[7],mat[4],mat[1]);
+  const __m128 m2 = _mm_set_ps(0.0f,mat[8],mat[5],mat[2]);
+  const __m128 d50_inv  = _mm_set_ps(0.0f, 1.0f/0.8249f, 1.0f, 1.0f/0.9642f);
+  const __m128 coef = _mm_set_ps(0.0f,200.0f,500.0f,116.0f);
+  for(int i=0; i<width; i++)
+  {
+    const __m128 cam = _mm_loadu_ps(in + 4*i);
+    const __m128 xyz = _mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(m0,_mm_shuffle_ps(cam,cam,_MM_SHUFFLE(0,0,0,0))),
+        _mm_mul_ps(m1,_mm_shuffle_ps(cam,cam,_MM_SHUFFLE(1,1,1,1)))),
+        _mm_mul_ps(m2,_mm_shuffle_ps(cam,cam,_MM_SHUFFLE(2,2,2,2))));
+    const __m128 f = lab_f_m_sse2(_mm_mul_ps(xyz,d50_inv));
+    // because d50_inv.z is 0.0f, lab_f(0) == 16/116, so Lab[0] = 116*f[0] - 16 equal to 116*(f[0]-f[3])
+    _mm_storeu_ps(out + 4*i, _mm_mul_ps(coef,_mm_sub_ps(_mm_shuffle_ps(f,f,_MM_SHUFFLE(3,1,0,1)),_mm_shuffle_ps(f,f,_MM_SHUFFLE(3,2,1,3)))));
+  }
+}
+
+static void
+Lab_to_rgb_row_sse2(float *const out, const float *const in, const float *const mat, const int width)
+{
+  const __m128 m0 = _mm_set_ps(0.0f,mat[6],mat[3],mat[0]);
+  const __m128 m1 = _mm_set_ps(0.0f,mat[7],mat[4],mat[1]);
+  const __m128 m2 = _mm_set_ps(0.0f,mat[8],mat[5],mat[2]);
+  const __m128 d50    = _mm_set_ps(0.0f, 0.8249f, 1.0f, 0.9642f);
+  const __m128 coef   = _mm_set_ps(0.0f,-1.0f/200.0f,1.0f/116.0f,1.0f/500.0f);
+  const __m128 offset = _mm_set1_ps(0.137931034f);
+  for(int i=0; i<width; i++)
+  {
+    const __m128 Lab = _mm_loadu_ps(in + 4*i);
+    // last component ins shuffle taken from 1st component of Lab to make sure it is not nan, so it will become 0.0f in f
+    const __m128 f = _mm_mul_ps(_mm_shuffle_ps(Lab,Lab,_MM_SHUFFLE(0,2,0,1)),coef);
+    const __m128 xyz = _mm_mul_ps(d50,lab_f_inv_m_sse2(_mm_add_ps(_mm_add_ps(f,_mm_shuffle_ps(f,f,_MM_SHUFFLE(1,1,3,1))),offset)));
+    const __m128 t = _mm_add_ps(_mm_mul_ps(m0,_mm_shuffle_ps(xyz,xyz,_MM_SHUFFLE(0,0,0,0))),_mm_add_ps(_mm_mul_ps(m1,_mm_shuffle_ps(xyz,xyz,_MM_SHUFFLE(1,1,1,1))),_mm_mul_ps(m2,_mm_shuffle_ps(xyz,xyz,_MM_SHUFFLE(2,2,2,2)))));
+    _mm_storeu_ps(out + 4*i, t);
+  }
+}
+
+static void
+resample_row_sse2(float *const out, const float *const in, const int in_stride, const int out_width,
+                  const int *const hlength, const float *const hkernel, const int *const hindex,
+                  const int vl, const int *const vindex, const float *const vkernel)
+{
+  int hkidx = 0, hiidx = 0;
+  for(int ox=0; ox<out_width; ox++)
+  {
+    __m128 vs = _mm_setzero_ps();
+    const int hl = hlength[ox];
+    for(int iy=0; iy<vl; iy++)
+    {
+      const float *i = (const float *)((const char *)in + (size_t)in_stride*vindex[iy]);
+      __m128 vhs = _mm_setzero_ps();
+      for(int ix=0; ix<hl; ix++)
+        vhs = _mm_add_ps(vhs, _mm_mul_ps(_mm_load_ps(i + 4*hindex[hiidx+ix]), _mm_set_ps1(hkernel[hkidx+ix])));
+      vs = _mm_add_ps(vs, _mm_mul_ps(vhs, _mm_set_ps1(vkernel[iy])));
+    }
+    _mm_stream_ps(out + 4*ox, vs);
+    hiidx += hl;
+    hkidx += hl;
+  }
+}
+
+void dt_cpu_kernels_init_sse2(dt_cpu_kernels_t *kernels)
+{
+  kernels->name = "sse2";
+  kernels->eaw_decompose_row = eaw_decompose_row_sse2;
+  kernels->nlmeans_dist_row = nlmeans_dist_row_sse2;
+  kernels->rgb_to_Lab_row = rgb_to_Lab_row_sse2;
+  kernels->Lab_to_rgb_row = Lab_to_rgb_row_sse2;
+  kernels->resample_row = resample_row_sse2;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
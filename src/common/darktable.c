@@ -30,10 +30,16 @@
 #include "common/camera_control.h"
 #endif
 #include "common/film.h"
+#include "common/icc_lut.h"
+#include "common/file_buffer.h"
+#include "common/name_index.h"
+#include "common/cpu_dispatch.h"
 #include "common/image.h"
 #include "common/image_cache.h"
 #include "common/imageio_module.h"
 #include "common/mipmap_cache.h"
+#include "common/mipmap_regen.h"
+#include "common/numa.h"
 #include "common/opencl.h"
 #include "common/points.h"
 #include "develop/imageop.h"
@@ -453,7 +459,7 @@ int dt_init(int argc, char *argv[], const int init_gui)
       else if(argv[k][1] == 't' && argc > k+1)
       {
         darktable.num_openmp_threads = CLAMP(atol(argv[k+1]), 1, 100);
-        printf("[dt_init] using %d threads for openmp parallel sections\n", darktable.num_openmp_threads);
+        fprintf(stderr, "[dt_init] using %d threads for openmp parallel sections\n", darktable.num_openmp_threads);
         k ++;
       }
     }
@@ -474,6 +480,7 @@ int dt_init(int argc, char *argv[], const int init_gui)
 #ifdef _OPENMP
   omp_set_num_threads(darktable.num_openmp_threads);
 #endif
+  darktable.numa = dt_numa_init();
   dt_loc_init_datadir(datadir_from_command);
   dt_loc_init_plugindir(moduledir_from_command);
   if(dt_loc_init_tmp_dir(tmpdir_from_command))
@@ -576,6 +583,7 @@ int dt_init(int argc, char *argv[], const int init_gui)
 
   // Initialize the filesystem watcher
   darktable.fswatch=dt_fswatch_new();
+  dt_film_watch_init();
 
 #ifdef HAVE_GPHOTO2
   // Initialize the camera control
@@ -624,6 +632,10 @@ int dt_init(int argc, char *argv[], const int init_gui)
   /* initialize sellection */
   darktable.selection = dt_selection_new();
 
+  // in-memory lookup of tag names and film roll folders for the keyword entry and collect module
+  darktable.tag_index = dt_name_index_new("select id, name from tags");
+  darktable.film_index = dt_name_index_new("select id, folder from film_rolls");
+
   /* capabilities set to NULL */
   darktable.capabilities = NULL;
 
@@ -632,6 +644,10 @@ int dt_init(int argc, char *argv[], const int init_gui)
   InitializeMagick(darktable.progname);
 #endif
 
+  darktable.cpu_flags = dt_cpu_detect_flags();
+  darktable.kernels = (dt_cpu_kernels_t *)malloc(sizeof(dt_cpu_kernels_t));
+  dt_cpu_kernels_init(darktable.kernels, darktable.cpu_flags);
+
   darktable.opencl = (dt_opencl_t *)malloc(sizeof(dt_opencl_t));
   memset(darktable.opencl, 0, sizeof(dt_opencl_t));
   dt_opencl_init(darktable.opencl, argc, argv);
@@ -644,6 +660,12 @@ int dt_init(int argc, char *argv[], const int init_gui)
   memset(darktable.points, 0, sizeof(dt_points_t));
   dt_points_init(darktable.points, dt_get_num_threads());
 
+  darktable.icc_luts = (dt_icc_lut_cache_t *)malloc(sizeof(dt_icc_lut_cache_t));
+  dt_icc_lut_cache_init(darktable.icc_luts);
+
+  darktable.file_buffers = (dt_file_buffer_cache_t *)malloc(sizeof(dt_file_buffer_cache_t));
+  dt_file_buffer_cache_init(darktable.file_buffers);
+
   // must come before mipmap_cache, because that one will need to access
   // image dimensions stored in here:
   darktable.image_cache = (dt_image_cache_t *)malloc(sizeof(dt_image_cache_t));
@@ -654,6 +676,9 @@ int dt_init(int argc, char *argv[], const int init_gui)
   memset(darktable.mipmap_cache, 0, sizeof(dt_mipmap_cache_t));
   dt_mipmap_cache_init(darktable.mipmap_cache);
 
+  // render dropped thumbnails in the background, only useful with a lighttable to show them:
+  darktable.mipmap_regen = init_gui ? dt_mipmap_regen_new() : NULL;
+
   // The GUI must be initialized before the views, because the init()
   // functions of the views depend on darktable.control->accels_* to register
   // their keyboard accelerators
@@ -753,6 +778,11 @@ int dt_init(int argc, char *argv[], const int init_gui)
 
 void dt_cleanup()
 {
+  // the watch thread imports and invalidates thumbnails, stop it before any of that goes away:
+  dt_fswatch_destroy(darktable.fswatch);
+  darktable.fswatch = NULL;
+  dt_film_watch_cleanup();
+
   dt_ctl_switch_mode_to(DT_MODE_NONE);
   const int init_gui = (darktable.gui != NULL);
 
@@ -775,6 +805,8 @@ void dt_cleanup()
     dt_gui_gtk_cleanup(darktable.gui);
     free(darktable.gui);
   }
+  dt_mipmap_regen_destroy(darktable.mipmap_regen);
+  darktable.mipmap_regen = NULL;
   dt_image_cache_cleanup(darktable.image_cache);
   free(darktable.image_cache);
   dt_mipmap_cache_cleanup(darktable.mipmap_cache);
@@ -790,13 +822,20 @@ void dt_cleanup()
   dt_points_cleanup(darktable.points);
   free(darktable.points);
   dt_iop_unload_modules_so();
+  dt_icc_lut_cache_cleanup(darktable.icc_luts);
+  free(darktable.icc_luts);
+  dt_file_buffer_cache_cleanup(darktable.file_buffers);
+  free(darktable.file_buffers);
+  dt_name_index_destroy(darktable.tag_index);
+  dt_name_index_destroy(darktable.film_index);
+  dt_numa_cleanup(darktable.numa);
+  free(darktable.kernels);
   dt_opencl_cleanup(darktable.opencl);
   free(darktable.opencl);
 #ifdef HAVE_GPHOTO2
   dt_camctl_destroy(darktable.camctl);
 #endif
   dt_pwstorage_destroy(darktable.pwstorage);
-  dt_fswatch_destroy(darktable.fswatch);
 
 #ifdef HAVE_GRAPHICSMAGICK
   DestroyMagick();
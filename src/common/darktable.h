@@ -130,9 +130,15 @@ struct dt_image_cache_t;
 struct dt_lib_t;
 struct dt_conf_t;
 struct dt_points_t;
+struct dt_icc_lut_cache_t;
+struct dt_cpu_kernels_t;
 struct dt_imageio_t;
 struct dt_bauhaus_t;
 struct dt_undo_t;
+struct dt_name_index_t;
+struct dt_mipmap_regen_t;
+struct dt_bench_t;
+struct dt_numa_t;
 
 typedef enum dt_debug_thread_t
 {
@@ -157,6 +163,9 @@ dt_debug_thread_t;
 #define DT_CPU_FLAG_SSE    1
 #define DT_CPU_FLAG_SSE2   2
 #define DT_CPU_FLAG_SSE3   4
+#define DT_CPU_FLAG_AVX    8
+#define DT_CPU_FLAG_AVX2   16
+#define DT_CPU_FLAG_FMA    32
 
 typedef struct darktable_t
 {
@@ -176,6 +185,8 @@ typedef struct darktable_t
   struct dt_control_signal_t     *signals;
   struct dt_gui_gtk_t            *gui;
   struct dt_mipmap_cache_t       *mipmap_cache;
+  struct dt_mipmap_regen_t       *mipmap_regen;
+  struct dt_bench_t              *bench;
   struct dt_image_cache_t        *image_cache;
   struct dt_bauhaus_t            *bauhaus;
   const struct dt_database_t     *db;
@@ -185,6 +196,12 @@ typedef struct darktable_t
   const struct dt_collection_t   *collection;
   struct dt_selection_t          *selection;
   struct dt_points_t             *points;
+  struct dt_icc_lut_cache_t      *icc_luts;
+  struct dt_file_buffer_cache_t  *file_buffers;
+  struct dt_name_index_t         *tag_index;
+  struct dt_name_index_t         *film_index;
+  struct dt_cpu_kernels_t        *kernels;
+  struct dt_numa_t               *numa;
   struct dt_imageio_t            *imageio;
   struct dt_opencl_t             *opencl;
   struct dt_blendop_t            *blendop;
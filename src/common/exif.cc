@@ -28,11 +28,13 @@ extern "C"
 {
 #include "common/exif.h"
 #include "common/darktable.h"
+#include "common/file_buffer.h"
 #include "common/colorlabels.h"
 #include "common/imageio_jpeg.h"
 #include "common/image_cache.h"
 #include "common/imageio.h"
 #include "common/metadata.h"
+#include "common/name_index.h"
 #include "common/tags.h"
 #include "common/debug.h"
 #include "control/conf.h"
@@ -49,6 +51,8 @@ extern "C"
 #include <sstream>
 #include <cassert>
 #include <glib.h>
+#include <glib/gstdio.h>
+#include <sys/stat.h>
 #include <string>
 
 #define DT_XMP_KEYS_NUM 15 // the number of XmpBag XmpSeq keys that dt uses
@@ -740,6 +744,26 @@ static bool dt_exif_read_exif_data(dt_image_t *img, Exiv2::ExifData &exifData)
   }
 }
 
+// holds on to the shared contents of an image file (see common/file_buffer.h) while
+// exiv2 reads from it, if they are cached already. exiv2 only needs the metadata, so
+// otherwise it maps the file itself. has to outlive the Exiv2::Image opened on it.
+class FileBufferRef
+{
+public:
+  FileBufferRef(const char *path) : buffer(dt_file_buffer_peek(path)), path(path) {}
+  ~FileBufferRef() { dt_file_buffer_release(buffer); }
+
+  Exiv2::Image::AutoPtr open()
+  {
+    if(buffer) return Exiv2::ImageFactory::open((const Exiv2::byte *)buffer->data, buffer->size);
+    return Exiv2::ImageFactory::open(path);
+  }
+
+private:
+  const dt_file_buffer_t *buffer;
+  const char *path;
+};
+
 //TODO: can this blob also contain xmp and iptc data?
 int dt_exif_read_from_blob(dt_image_t *img, uint8_t *blob, const int size)
 {
@@ -764,8 +788,9 @@ int dt_exif_read(dt_image_t *img, const char* path)
 {
   try
   {
+    FileBufferRef file(path);
     Exiv2::Image::AutoPtr image;
-    image = Exiv2::ImageFactory::open(path);
+    image = file.open();
     assert(image.get() != 0);
     image->readMetadata();
     bool res;
@@ -841,8 +866,9 @@ int dt_exif_read_blob(
 {
   try
   {
+    FileBufferRef file(path);
     Exiv2::Image::AutoPtr image;
-    image = Exiv2::ImageFactory::open(path);
+    image = file.open();
     assert(image.get() != 0);
     image->readMetadata();
     Exiv2::ExifData &exifData = image->exifData();
@@ -1193,6 +1219,8 @@ static void _exif_import_tags(dt_image_t *img,Exiv2::XmpData::iterator &pos)
             sqlite3_step(stmt_upd_tagxtag);
             sqlite3_reset(stmt_upd_tagxtag);
             sqlite3_clear_bindings(stmt_upd_tagxtag);
+
+            dt_name_index_insert(darktable.tag_index, tagid, tag);
           }
           break;
         }
@@ -1840,6 +1868,59 @@ int dt_exif_xmp_attach (const int imgid, const char* filename)
 }
 
 // write xmp sidecar file:
+// hash over the darktable part of the xmp data. together with the size and mtime of the
+// sidecar it was last written to, this tells us whether writing it again would change anything.
+static std::string _exif_xmp_data_hash(const Exiv2::XmpData &xmpData)
+{
+  GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA1);
+  for(Exiv2::XmpData::const_iterator it = xmpData.begin(); it != xmpData.end(); ++it)
+  {
+    const std::string key = it->key(), value = it->toString();
+    // include the terminating 0 to separate the fields
+    g_checksum_update(checksum, (const guchar *)key.c_str(), key.size() + 1);
+    g_checksum_update(checksum, (const guchar *)value.c_str(), value.size() + 1);
+  }
+  const std::string hash = g_checksum_get_string(checksum);
+  g_checksum_free(checksum);
+  return hash;
+}
+
+static bool _exif_xmp_unchanged(const int imgid, const char *filename, const std::string &hash)
+{
+  struct stat st;
+  if(g_stat(filename, &st)) return false;
+  bool unchanged = false;
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "select 1 from xmp_hashes where imgid = ?1 and filename = ?2 and "
+                              "hash = ?3 and mtime = ?4 and size = ?5", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, filename, -1, SQLITE_TRANSIENT);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 3, hash.c_str(), -1, SQLITE_TRANSIENT);
+  DT_DEBUG_SQLITE3_BIND_INT64(stmt, 4, (sqlite3_int64)st.st_mtime);
+  DT_DEBUG_SQLITE3_BIND_INT64(stmt, 5, (sqlite3_int64)st.st_size);
+  if(sqlite3_step(stmt) == SQLITE_ROW) unchanged = true;
+  sqlite3_finalize(stmt);
+  return unchanged;
+}
+
+static void _exif_xmp_remember(const int imgid, const char *filename, const std::string &hash)
+{
+  struct stat st;
+  if(g_stat(filename, &st)) return;
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "insert or replace into xmp_hashes (imgid, filename, hash, mtime, size) "
+                              "values (?1, ?2, ?3, ?4, ?5)", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, filename, -1, SQLITE_TRANSIENT);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 3, hash.c_str(), -1, SQLITE_TRANSIENT);
+  DT_DEBUG_SQLITE3_BIND_INT64(stmt, 4, (sqlite3_int64)st.st_mtime);
+  DT_DEBUG_SQLITE3_BIND_INT64(stmt, 5, (sqlite3_int64)st.st_size);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+}
+
 int dt_exif_xmp_write (const int imgid, const char* filename)
 {
   // refuse to write sidecar for non-existent image:
@@ -1850,6 +1931,14 @@ int dt_exif_xmp_write (const int imgid, const char* filename)
 
   try
   {
+    // our part of the sidecar, straight from the db:
+    Exiv2::XmpData dtData;
+    dt_exif_xmp_read_data(dtData, imgid);
+
+    // skip sidecars we wrote ourselves with the same contents and nobody touched since:
+    const std::string hash = _exif_xmp_data_hash(dtData);
+    if(_exif_xmp_unchanged(imgid, filename, hash)) return 0;
+
     Exiv2::XmpData xmpData;
     std::string xmpPacket;
     if(g_file_test(filename, G_FILE_TEST_EXISTS))
@@ -1862,20 +1951,29 @@ int dt_exif_xmp_write (const int imgid, const char* filename)
       dt_remove_known_keys(xmpData);
     }
 
-    // initialize xmp data:
-    dt_exif_xmp_read_data(xmpData, imgid);
+    // merge our data into whatever other applications put there:
+    for(Exiv2::XmpData::const_iterator it = dtData.begin(); it != dtData.end(); ++it)
+    {
+      Exiv2::XmpData::iterator pos = xmpData.findKey(Exiv2::XmpKey(it->key()));
+      if(pos != xmpData.end()) pos->setValue(&it->value());
+      else xmpData.add(*it);
+    }
 
     // serialize the xmp data and output the xmp packet
     if (Exiv2::XmpParser::encode(xmpPacket, xmpData) != 0)
     {
       throw Exiv2::Error(1, "[xmp_write] failed to serialize xmp data");
     }
-    std::ofstream fout(filename);
-    if(fout.is_open())
+    // written to a temporary file and renamed over the old sidecar, so readers (and a crash)
+    // never see a half written one.
+    GError *error = NULL;
+    if(!g_file_set_contents(filename, xmpPacket.data(), xmpPacket.size(), &error))
     {
-      fout << xmpPacket;
-      fout.close();
+      std::cerr << "[xmp_write] failed to write `" << filename << "': " << error->message << "\n";
+      g_error_free(error);
+      return -1;
     }
+    _exif_xmp_remember(imgid, filename, hash);
     return 0;
   }
   catch (Exiv2::AnyError& e)
@@ -1897,8 +1995,9 @@ int dt_exif_thumbnail(
   // fprintf(stderr, "[exif] trying to load thumbnail `%s'!\n", filename);
   try
   {
+    FileBufferRef file(filename);
     Exiv2::Image::AutoPtr image;
-    image = Exiv2::ImageFactory::open(filename);
+    image = file.open();
     assert(image.get() != 0);
     image->readMetadata();
 
@@ -1951,12 +2050,22 @@ int dt_exif_thumbnail(
   }
 }
 
+// the xmp toolkit isn't thread safe, exiv2 serializes calls into it through this.
+static dt_pthread_mutex_t _exif_xmp_toolkit_mutex;
+
+static void _exif_xmp_toolkit_lock(void *data, bool lock)
+{
+  if(lock) dt_pthread_mutex_lock((dt_pthread_mutex_t *)data);
+  else dt_pthread_mutex_unlock((dt_pthread_mutex_t *)data);
+}
+
 void dt_exif_init()
 {
   // mute exiv2:
   // Exiv2::LogMsg::setLevel(Exiv2::LogMsg::error);
 
-  Exiv2::XmpParser::initialize();
+  dt_pthread_mutex_init(&_exif_xmp_toolkit_mutex, NULL);
+  Exiv2::XmpParser::initialize(_exif_xmp_toolkit_lock, &_exif_xmp_toolkit_mutex);
   // this has te stay with the old url (namespace already propagated outside dt)
   Exiv2::XmpProperties::registerNs("http://darktable.sf.net/", "darktable");
   Exiv2::XmpProperties::registerNs("http://ns.adobe.com/lightroom/1.0/", "lr");
@@ -1965,6 +2074,7 @@ void dt_exif_init()
 void dt_exif_cleanup()
 {
   Exiv2::XmpParser::terminate();
+  dt_pthread_mutex_destroy(&_exif_xmp_toolkit_mutex);
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -0,0 +1,256 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "common/file_buffer.h"
+#include "common/bench.h"
+#include "control/conf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+// seconds an unused buffer is kept around
+#define DT_FILE_BUFFER_TTL 10.0
+
+static void
+_file_buffer_free(dt_file_buffer_t *b)
+{
+  if(!b) return;
+  free((void *)b->data);
+  g_free(b->path);
+  free(b);
+}
+
+void
+dt_file_buffer_cache_init(dt_file_buffer_cache_t *cache)
+{
+  dt_pthread_mutex_init(&cache->lock, NULL);
+  pthread_cond_init(&cache->cond, NULL);
+  cache->buffers = NULL;
+  cache->size = 0;
+  cache->max_size = (size_t)MAX(0, dt_conf_get_int("cache_file_buffers")) << 20;
+  cache->clock = 0;
+}
+
+void
+dt_file_buffer_cache_cleanup(dt_file_buffer_cache_t *cache)
+{
+  for(GList *l = cache->buffers; l; l = g_list_next(l))
+    _file_buffer_free((dt_file_buffer_t *)l->data);
+  g_list_free(cache->buffers);
+  cache->buffers = NULL;
+  pthread_cond_destroy(&cache->cond);
+  dt_pthread_mutex_destroy(&cache->lock);
+}
+
+// take a buffer out of the cache. it is freed once the last reader lets go.
+// called with the lock held.
+static void
+_file_buffer_detach(dt_file_buffer_cache_t *cache, dt_file_buffer_t *b)
+{
+  cache->buffers = g_list_remove(cache->buffers, b);
+  cache->size -= b->size;
+  if(b->refs == 0) _file_buffer_free(b);
+}
+
+// drop unused buffers which are too old, then the least recently used ones
+// until the cache fits its budget. called with the lock held.
+static void
+_file_buffer_cache_trim(dt_file_buffer_cache_t *cache)
+{
+  const double now = dt_get_wtime();
+  GList *l = cache->buffers;
+  while(l)
+  {
+    dt_file_buffer_t *b = (dt_file_buffer_t *)l->data;
+    l = g_list_next(l);
+    if(b->refs == 0 && now - b->released > DT_FILE_BUFFER_TTL) _file_buffer_detach(cache, b);
+  }
+  while(cache->size > cache->max_size)
+  {
+    dt_file_buffer_t *victim = NULL;
+    for(GList *l = cache->buffers; l; l = g_list_next(l))
+    {
+      dt_file_buffer_t *b = (dt_file_buffer_t *)l->data;
+      if(b->refs == 0 && (!victim || b->last_used < victim->last_used))
+        victim = b;
+    }
+    if(!victim) return;
+    _file_buffer_detach(cache, victim);
+  }
+}
+
+static uint8_t *
+_file_buffer_read(const char *path, const size_t size)
+{
+  FILE *f = g_fopen(path, "rb");
+  if(!f) return NULL;
+  uint8_t *data = (uint8_t *)malloc(size);
+  if(data && fread(data, 1, size, f) != size)
+  {
+    free(data);
+    data = NULL;
+  }
+  fclose(f);
+  return data;
+}
+
+// the cached buffer for path, dropping it if the file changed on disk since.
+// called with the lock held.
+static dt_file_buffer_t *
+_file_buffer_find(dt_file_buffer_cache_t *cache, const char *path, const struct stat *st)
+{
+  dt_file_buffer_t *b = NULL;
+  for(GList *l = cache->buffers; l; l = g_list_next(l))
+  {
+    dt_file_buffer_t *cand = (dt_file_buffer_t *)l->data;
+    if(!strcmp(cand->path, path))
+    {
+      b = cand;
+      break;
+    }
+  }
+  if(b && !b->loading && (b->mtime != st->st_mtime || b->size != (size_t)st->st_size))
+  {
+    // changed on disk, readers still holding the old contents keep them:
+    _file_buffer_detach(cache, b);
+    b = NULL;
+  }
+  return b;
+}
+
+const dt_file_buffer_t *
+dt_file_buffer_peek(const char *path)
+{
+  dt_file_buffer_cache_t *cache = darktable.file_buffers;
+  struct stat st;
+  if(!cache || !path || g_stat(path, &st) || st.st_size <= 0) return NULL;
+
+  dt_pthread_mutex_lock(&cache->lock);
+  dt_file_buffer_t *b = _file_buffer_find(cache, path, &st);
+  // one still being read isn't worth waiting for, the caller only needs a small part
+  if(b && (b->loading || !b->data)) b = NULL;
+  if(b)
+  {
+    b->refs++;
+    b->last_used = ++cache->clock;
+  }
+  dt_pthread_mutex_unlock(&cache->lock);
+  return b;
+}
+
+const dt_file_buffer_t *
+dt_file_buffer_get(const char *path)
+{
+  dt_file_buffer_cache_t *cache = darktable.file_buffers;
+  struct stat st;
+  if(!cache || !path || g_stat(path, &st) || st.st_size <= 0) return NULL;
+  // nothing we could keep, the caller is better off reading the file its own way:
+  if((size_t)st.st_size > cache->max_size) return NULL;
+
+  dt_pthread_mutex_lock(&cache->lock);
+  dt_file_buffer_t *b = _file_buffer_find(cache, path, &st);
+
+  if(b)
+  {
+    // somebody else may still be reading it:
+    b->refs++;
+    while(b->loading) dt_pthread_cond_wait(&cache->cond, &cache->lock);
+    if(!b->data)
+    {
+      // that failed, the reader took it out of the cache already
+      if(--b->refs == 0) _file_buffer_free(b);
+      b = NULL;
+    }
+    else b->last_used = ++cache->clock;
+    dt_pthread_mutex_unlock(&cache->lock);
+    return b;
+  }
+
+  b = (dt_file_buffer_t *)malloc(sizeof(dt_file_buffer_t));
+  b->data = NULL;
+  b->size = st.st_size;
+  b->path = g_strdup(path);
+  b->mtime = st.st_mtime;
+  b->refs = 1;
+  b->loading = 1;
+  b->last_used = ++cache->clock;
+  b->released = 0.0;
+  cache->buffers = g_list_prepend(cache->buffers, b);
+  cache->size += b->size;
+  dt_pthread_mutex_unlock(&cache->lock);
+
+  // read without holding the lock, other files can be served meanwhile.
+  dt_times_t start;
+  dt_get_times(&start);
+  uint8_t *data = _file_buffer_read(path, b->size);
+  dt_show_times(&start, "[file_buffer] reading", "`%s' (%.1f MB)", path, b->size/(1024.0*1024.0));
+  dt_bench_add(darktable.bench, &start, "read");
+
+  dt_pthread_mutex_lock(&cache->lock);
+  b->data = data;
+  b->loading = 0;
+  if(!data)
+  {
+    b->refs--;
+    _file_buffer_detach(cache, b);
+    b = NULL;
+  }
+  _file_buffer_cache_trim(cache);
+  pthread_cond_broadcast(&cache->cond);
+  dt_pthread_mutex_unlock(&cache->lock);
+  return b;
+}
+
+void
+dt_file_buffer_release(const dt_file_buffer_t *buffer)
+{
+  if(!buffer) return;
+  dt_file_buffer_cache_t *cache = darktable.file_buffers;
+  dt_file_buffer_t *b = (dt_file_buffer_t *)buffer;
+  dt_pthread_mutex_lock(&cache->lock);
+  b->released = dt_get_wtime();
+  if(--b->refs == 0 && !g_list_find(cache->buffers, b))
+    _file_buffer_free(b); // detached while in use
+  else
+    _file_buffer_cache_trim(cache);
+  dt_pthread_mutex_unlock(&cache->lock);
+}
+
+void
+dt_file_buffer_forget(const char *path)
+{
+  dt_file_buffer_cache_t *cache = darktable.file_buffers;
+  if(!cache || !path) return;
+  dt_pthread_mutex_lock(&cache->lock);
+  for(GList *l = cache->buffers; l; l = g_list_next(l))
+  {
+    dt_file_buffer_t *b = (dt_file_buffer_t *)l->data;
+    if(!b->loading && !strcmp(b->path, path))
+    {
+      _file_buffer_detach(cache, b);
+      break;
+    }
+  }
+  dt_pthread_mutex_unlock(&cache->lock);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
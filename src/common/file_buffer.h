@@ -0,0 +1,80 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef DT_COMMON_FILE_BUFFER_H
+#define DT_COMMON_FILE_BUFFER_H
+
+#include "common/darktable.h"
+#include "common/dtpthread.h"
+#include <sys/types.h>
+#include <time.h>
+
+/** the contents of an image file, read once by the raw decoder and shared
+ * with the readers which would otherwise open the same file again after it
+ * (exif blob for export, the next decode). metadata readers only use it if
+ * it's there already. */
+typedef struct dt_file_buffer_t
+{
+  const uint8_t *data;
+  size_t size;
+
+  // cache bookkeeping
+  char *path;
+  time_t mtime;
+  int refs;
+  int loading;
+  uint64_t last_used;
+  double released;   /**< dt_get_wtime() of the last release */
+}
+dt_file_buffer_t;
+
+/** short lived cache of file contents, keyed by path and modification time.
+ * buffers nobody holds stay around for a few seconds and within a memory
+ * budget (config key cache_file_buffers, in MB), to bridge import, thumbnail
+ * creation and export of the same image. */
+typedef struct dt_file_buffer_cache_t
+{
+  dt_pthread_mutex_t lock;
+  pthread_cond_t cond;
+  GList *buffers;
+  size_t size;       /**< bytes held by all buffers */
+  size_t max_size;
+  uint64_t clock;
+}
+dt_file_buffer_cache_t;
+
+void dt_file_buffer_cache_init(dt_file_buffer_cache_t *cache);
+void dt_file_buffer_cache_cleanup(dt_file_buffer_cache_t *cache);
+
+/** get the contents of the file at path, reading it if it isn't cached or changed on disk.
+ * returns NULL if the file can't be read or is larger than the whole budget (also if that is 0),
+ * the caller then has to read it itself. give it back with dt_file_buffer_release(). */
+const dt_file_buffer_t *dt_file_buffer_get(const char *path);
+
+/** like dt_file_buffer_get(), but never reads the file: NULL unless its contents are cached
+ * already. for readers which only need a small part of it (metadata, embedded thumbnail). */
+const dt_file_buffer_t *dt_file_buffer_peek(const char *path);
+
+void dt_file_buffer_release(const dt_file_buffer_t *buffer);
+
+/** drop the cached contents of path, the next get reads the file again. */
+void dt_file_buffer_forget(const char *path);
+
+#endif
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -21,10 +21,13 @@
 #include "control/conf.h"
 #include "control/jobs.h"
 #include "common/film.h"
+#include "common/name_index.h"
 #include "common/dtpthread.h"
 #include "common/collection.h"
 #include "common/image_cache.h"
+#include "common/mipmap_regen.h"
 #include "common/debug.h"
+#include "common/fswatch.h"
 #include "views/view.h"
 
 #include <stdio.h>
@@ -82,6 +85,52 @@ void dt_film_set_query(const int32_t id)
   dt_collection_update_query(darktable.collection);
 }
 
+// the film roll whose folder is watched, only the one opened last is
+static int32_t _film_watched = -1;
+static dt_pthread_mutex_t _film_watch_mutex;
+
+void dt_film_watch_init()
+{
+  dt_pthread_mutex_init(&_film_watch_mutex, NULL);
+  _film_watched = -1;
+}
+
+void dt_film_watch_cleanup()
+{
+  // the watch itself goes away with darktable.fswatch
+  dt_pthread_mutex_destroy(&_film_watch_mutex);
+  _film_watched = -1;
+}
+
+// pick up files added to or changed in the folder while it's open
+static void _film_watch(const int32_t id)
+{
+  dt_pthread_mutex_lock(&_film_watch_mutex);
+  if(_film_watched != id)
+  {
+    if(_film_watched >= 0)
+      dt_fswatch_remove(darktable.fswatch, DT_FSWATCH_FILMROLL, GINT_TO_POINTER(_film_watched));
+    _film_watched = -1;
+    if(dt_conf_get_bool("watch_film_rolls"))
+    {
+      dt_fswatch_add(darktable.fswatch, DT_FSWATCH_FILMROLL, GINT_TO_POINTER(id));
+      _film_watched = id;
+    }
+  }
+  dt_pthread_mutex_unlock(&_film_watch_mutex);
+}
+
+static void _film_unwatch(const int32_t id)
+{
+  dt_pthread_mutex_lock(&_film_watch_mutex);
+  if(_film_watched == id)
+  {
+    dt_fswatch_remove(darktable.fswatch, DT_FSWATCH_FILMROLL, GINT_TO_POINTER(id));
+    _film_watched = -1;
+  }
+  dt_pthread_mutex_unlock(&_film_watch_mutex);
+}
+
 /** open film with given id. */
 int
 dt_film_open2 (dt_film_t *film)
@@ -111,6 +160,7 @@ dt_film_open2 (dt_film_t *film)
     sqlite3_step (stmt);
 
     sqlite3_finalize (stmt);
+    _film_watch(film->id);
     dt_film_set_query (film->id);
     dt_control_queue_redraw_center ();
     dt_view_manager_reset (darktable.view_manager);
@@ -143,6 +193,7 @@ int dt_film_open(const int32_t id)
     sqlite3_step(stmt);
   }
   sqlite3_finalize(stmt);
+  _film_watch(id);
   // TODO: prefetch to cache using image_open
   dt_film_set_query(id);
   dt_control_queue_redraw_center();
@@ -219,6 +270,7 @@ int dt_film_new(dt_film_t *film, const char *directory)
       film->id = sqlite3_column_int(stmt, 0);
     sqlite3_finalize(stmt);
     dt_pthread_mutex_unlock(&darktable.db_insert);
+    if(film->id > 0) dt_name_index_insert(darktable.film_index, film->id, directory);
   }
 
   if(film->id<=0)
@@ -275,6 +327,7 @@ int dt_film_import_blocking(const char *dirname)
     if(sqlite3_step(stmt) == SQLITE_ROW)
       film->id = sqlite3_column_int(stmt, 0);
     sqlite3_finalize(stmt);
+    if(film->id > 0) dt_name_index_insert(darktable.film_index, film->id, dirname);
   }
 
   /* bail out if we got troubles */
@@ -478,6 +531,7 @@ void dt_film_remove_empty()
                                 "delete from film_rolls where id=?1", -1, &stmt, NULL);
     DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
     sqlite3_step(stmt);
+    dt_name_index_remove(darktable.film_index, id);
     dt_control_signal_raise(darktable.signals , DT_SIGNAL_FILMROLLS_REMOVED);
   }
   sqlite3_finalize(stmt);
@@ -499,6 +553,7 @@ int dt_film_is_empty(const int id)
 // It just does the iteration over all images in the SQL statement
 void dt_film_remove(const int id)
 {
+  _film_unwatch(id);
   sqlite3_stmt *stmt;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                               "update tagxtag set count = count - 1 where "
@@ -547,6 +602,7 @@ void dt_film_remove(const int id)
   {
     const uint32_t imgid = sqlite3_column_int(stmt, 0);
     dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
+    dt_mipmap_regen_forget(darktable.mipmap_regen, imgid);
     dt_image_cache_remove (darktable.image_cache, imgid);
   }
   sqlite3_finalize(stmt);
@@ -563,6 +619,7 @@ void dt_film_remove(const int id)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  dt_name_index_remove(darktable.film_index, id);
   // dt_control_update_recent_films();
   dt_control_signal_raise(darktable.signals , DT_SIGNAL_FILMROLLS_CHANGED);
 }
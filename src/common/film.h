@@ -65,6 +65,9 @@ int dt_film_is_empty(const int id);
 int dt_film_new(dt_film_t *film,const char *directory);
 /** removes all empty film rolls. */
 void dt_film_remove_empty();
+/** set up and tear down the watch on the folder of the film roll opened last, see watch_film_rolls. */
+void dt_film_watch_init();
+void dt_film_watch_cleanup();
 
 #endif
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
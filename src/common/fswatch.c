@@ -20,20 +20,31 @@
 #endif
 
 #include "common/darktable.h"
+#include "common/debug.h"
 #include "common/dtpthread.h"
 #include "common/image.h"
+#include "common/mipmap_cache.h"
 #include "common/fswatch.h"
+#include "control/control.h"
+#include "control/signal.h"
 #include "develop/develop.h"
 
 #include <stdio.h>
 #include <unistd.h>
 #include <errno.h>
 #include <glib.h>
+#include <string.h>
 #include <strings.h>
-#if 0//def  HAVE_INOTIFY
+#include <limits.h>
+#ifdef HAVE_INOTIFY
 #include <sys/inotify.h>
+#include <poll.h>
 #endif
 
+// changes are picked up once the directory has been quiet for this long (seconds),
+// so copying a whole card ends up in one import. but not later than the second value.
+#define DT_FSWATCH_SETTLE_TIME 1.0
+#define DT_FSWATCH_MAX_DELAY   10.0
 
 typedef struct _watch_t
 {
@@ -41,113 +52,238 @@ typedef struct _watch_t
   dt_fswatch_type_t type;        // DT_FSWATCH_* type
   void *data;				// Assigned data
   int events;				// events occured..
+  struct _watch_t *next;  // more watches on the same inode share the descriptor
 } _watch_t;
 
 
-#if 0// def  HAVE_INOTIFY
+#ifdef HAVE_INOTIFY
 
-typedef struct inotify_event_t
+static void _fswatch_image_modified(dt_fswatch_t *fswatch, const int imgid)
 {
-  uint32_t wd;       /* Watch descriptor */
-  uint32_t mask;     /* Mask of events */
-  uint32_t cookie;   /* Unique cookie associating related events (for rename(2)) */
-  uint32_t len;      /* Size of 'name' field */
-  char     name[];   /* Optional null-terminated name */
-} inotify_event_t;
-
-// Compare func for GList
-static gint _fswatch_items_by_data(const void* a,const void *b)
+  g_hash_table_insert(fswatch->modified, GINT_TO_POINTER(imgid), GINT_TO_POINTER(imgid));
+}
+
+// called with the mutex held.
+static void _fswatch_film_file_changed(dt_fswatch_t *fswatch, const int film_id, const char *name)
 {
-  return (((_watch_t*)a)->data<b)?-1:((((_watch_t*)a)->data==b)?0:1);
+  GHashTable *files = (GHashTable *)g_hash_table_lookup(fswatch->changed, GINT_TO_POINTER(film_id));
+  if(!files)
+  {
+    files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_hash_table_insert(fswatch->changed, GINT_TO_POINTER(film_id), files);
+  }
+  g_hash_table_insert(files, g_strdup(name), NULL);
 }
 
-// Compare func for GList
-static gint _fswatch_items_by_descriptor(const void *a,const void *b)
+// called with the mutex held.
+static void _fswatch_event(dt_fswatch_t *fswatch, const struct inotify_event *event)
 {
-  gint result=(((_watch_t*)a)->descriptor < *(const int *)b)?-1:((((_watch_t*)a)->descriptor==*(const int *)b)?0:1);
-  return result;
+  _watch_t *item = (_watch_t *)g_hash_table_lookup(fswatch->items, GINT_TO_POINTER(event->wd));
+  if(!item)
+  {
+    dt_print(DT_DEBUG_FSWATCH,"[fswatch_thread] Failed to found watch item for descriptor %d\n", event->wd );
+    return;
+  }
+  for(; item; item = item->next)
+  {
+    item->events=item->events|event->mask;
+
+    switch( item->type )
+    {
+      case DT_FSWATCH_IMAGE:
+      {
+        dt_image_t *img=(dt_image_t *)item->data;
+        if( (event->mask&IN_CLOSE) && (item->events&IN_MODIFY) ) // Check if file modified and closed...
+        {
+          //  Something wrote on image externally and closed it, lets tag item as dirty...
+          img->force_reimport = 1;
+          _fswatch_image_modified(fswatch, img->id);
+          if(darktable.develop->image==img)
+            dt_dev_raw_reload(darktable.develop);
+          item->events=0;
+        }
+        else if( (event->mask&IN_ATTRIB) && (item->events&IN_DELETE_SELF) && (item->events&IN_IGNORED))
+        {
+          // This pattern showed up when another file is replacing the orginal...
+          img->force_reimport = 1;
+          _fswatch_image_modified(fswatch, img->id);
+          if(darktable.develop->image==img)
+            dt_dev_raw_reload(darktable.develop);
+          item->events=0;
+        }
+      }
+      break;
+
+      case DT_FSWATCH_FILMROLL:
+        // written and closed, or moved in (copy tools like to rename temporary files):
+        if(event->len && !(event->mask & IN_ISDIR) && (event->mask & (IN_CLOSE_WRITE|IN_MOVED_TO)))
+          _fswatch_film_file_changed(fswatch, GPOINTER_TO_INT(item->data), event->name);
+        item->events=0;
+        break;
+
+      default:
+        dt_print(DT_DEBUG_FSWATCH,"[fswatch_thread] Unhandled object type %d for event descriptor %d\n", item->type, event->wd );
+        break;
+    }
+  }
 }
 
+// import the new files and drop the cached buffers of modified images which piled up
+// since the last time. runs on the fswatch thread, without holding the mutex.
+static void _fswatch_flush(dt_fswatch_t *fswatch)
+{
+  dt_pthread_mutex_lock(&fswatch->mutex);
+  GHashTable *changed = fswatch->changed;
+  GHashTable *modified = fswatch->modified;
+  fswatch->changed = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_hash_table_destroy);
+  fswatch->modified = g_hash_table_new(g_direct_hash, g_direct_equal);
+  dt_pthread_mutex_unlock(&fswatch->mutex);
+
+  // sort the changed files into modified images and new ones:
+  GList *new_files = NULL, *new_films = NULL;
+  GHashTableIter it;
+  gpointer key, value;
+  g_hash_table_iter_init(&it, changed);
+  while(g_hash_table_iter_next(&it, &key, &value))
+  {
+    const int film_id = GPOINTER_TO_INT(key);
+    gchar *folder = NULL;
+    sqlite3_stmt *stmt;
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                "select folder from film_rolls where id = ?1", -1, &stmt, NULL);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, film_id);
+    if(sqlite3_step(stmt) == SQLITE_ROW)
+      folder = g_strdup((const gchar *)sqlite3_column_text(stmt, 0));
+    sqlite3_finalize(stmt);
+    if(!folder) continue; // film roll is gone
+
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                "select id from images where film_id = ?1 and filename = ?2", -1, &stmt, NULL);
+    GHashTableIter fit;
+    gpointer name;
+    g_hash_table_iter_init(&fit, (GHashTable *)value);
+    while(g_hash_table_iter_next(&fit, &name, NULL))
+    {
+      int known = 0;
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, film_id);
+      DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, (const char *)name, -1, SQLITE_TRANSIENT);
+      while(sqlite3_step(stmt) == SQLITE_ROW)
+      {
+        // all duplicates of it:
+        const int imgid = sqlite3_column_int(stmt, 0);
+        g_hash_table_insert(modified, GINT_TO_POINTER(imgid), GINT_TO_POINTER(imgid));
+        known = 1;
+      }
+      DT_DEBUG_SQLITE3_RESET(stmt);
+      DT_DEBUG_SQLITE3_CLEAR_BINDINGS(stmt);
+      if(!known && dt_supported_image((const gchar *)name))
+      {
+        new_files = g_list_prepend(new_files, g_build_filename(folder, (const gchar *)name, NULL));
+        new_films = g_list_prepend(new_films, GINT_TO_POINTER(film_id));
+      }
+    }
+    sqlite3_finalize(stmt);
+    g_free(folder);
+  }
+  g_hash_table_destroy(changed);
+
+  // images changed on disk: drop everything derived from the old contents
+  g_hash_table_iter_init(&it, modified);
+  while(g_hash_table_iter_next(&it, &key, NULL))
+    dt_mipmap_cache_invalidate(darktable.mipmap_cache, GPOINTER_TO_INT(key));
+  const int num_modified = g_hash_table_size(modified);
+  g_hash_table_destroy(modified);
+
+  // and all new files in one go:
+  const int total = g_list_length(new_files);
+  if(total)
+  {
+    gchar message[512] = {0};
+    g_snprintf(message, sizeof(message) - 1,
+               ngettext("importing %d new image","importing %d new images", total), total);
+    const guint *jid = dt_control_backgroundjobs_create(darktable.control, 0, message);
+    double fraction = 0;
+    GList *f = new_films;
+    for(GList *l = new_files; l; l = g_list_next(l), f = g_list_next(f))
+    {
+      dt_image_import(GPOINTER_TO_INT(f->data), (const gchar *)l->data, FALSE);
+      fraction += 1.0/total;
+      dt_control_backgroundjobs_progress(darktable.control, jid, fraction);
+    }
+    dt_control_backgroundjobs_destroy(darktable.control, jid);
+    dt_control_signal_raise(darktable.signals, DT_SIGNAL_FILMROLLS_CHANGED);
+  }
+  g_list_free_full(new_files, g_free);
+  g_list_free(new_films);
+
+  dt_print(DT_DEBUG_FSWATCH,"[fswatch_flush] %d new files imported, %d modified images\n", total, num_modified);
+  if(total || num_modified) dt_control_queue_redraw_center();
+}
 
 static void *_fswatch_thread(void *data)
 {
   dt_fswatch_t *fswatch=(dt_fswatch_t *)data;
-  uint32_t res=0;
-  uint32_t event_hdr_size=sizeof(inotify_event_t);
-  inotify_event_t *event_hdr=g_malloc(sizeof(inotify_event_t));
-  memset (event_hdr,0,event_hdr_size);
-  char *name=g_malloc(2048);
-  memset (name,0, 2048);
+  // read all events queued up at once instead of one header at a time. the buffer
+  // has room for at least one event with the longest possible name.
+  const size_t buf_size = MAX(64*1024, sizeof(struct inotify_event) + NAME_MAX + 1);
+  char *buf = g_malloc(buf_size);
   dt_print(DT_DEBUG_FSWATCH,"[fswatch_thread] Starting thread of context %lx\n",(unsigned long int)data);
   while(1)
   {
-    // Blocking read loop of event fd into event
-    if(read(fswatch->inotify_fd,event_hdr,event_hdr_size) != event_hdr_size)
+    dt_pthread_mutex_lock(&fswatch->mutex);
+    const int pending = g_hash_table_size(fswatch->changed) || g_hash_table_size(fswatch->modified);
+    const double first = fswatch->first_change, last = fswatch->last_change;
+    dt_pthread_mutex_unlock(&fswatch->mutex);
+
+    const double now = dt_get_wtime();
+    if(pending && (now - last >= DT_FSWATCH_SETTLE_TIME || now - first >= DT_FSWATCH_MAX_DELAY))
+    {
+      _fswatch_flush(fswatch);
+      continue;
+    }
+
+    // wait for events, or until it is time to look at the pending changes:
+    struct pollfd fds[2] = {{ fswatch->inotify_fd, POLLIN, 0 }, { fswatch->wakeup[0], POLLIN, 0 }};
+    const int timeout = pending ? (int)(1000.0 * DT_FSWATCH_SETTLE_TIME / 4) : -1;
+    const int ret = poll(fds, 2, timeout);
+    if(ret < 0)
     {
       if(errno == EINTR) continue;
-      perror("[fswatch_thread] read inotify fd");
+      perror("[fswatch_thread] poll inotify fd");
       break;
     }
+    if(fds[1].revents) break; // shutting down
+    if(ret == 0 || !(fds[0].revents & POLLIN)) continue;
 
-    // Read name into buffer if any...
-    if( event_hdr->len > 0 )
+    const ssize_t len = read(fswatch->inotify_fd, buf, buf_size);
+    if(len <= 0)
     {
-      res=read(fswatch->inotify_fd,name,event_hdr_size);
-      name[res]='\0';
+      if(len < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+      perror("[fswatch_thread] read inotify fd");
+      break;
     }
 
     dt_pthread_mutex_lock(&fswatch->mutex);
-    GList *gitem=g_list_find_custom(fswatch->items,&event_hdr->wd,&_fswatch_items_by_descriptor);
-    if( gitem )
+    const int was_pending = g_hash_table_size(fswatch->changed) || g_hash_table_size(fswatch->modified);
+    for(char *p = buf; p < buf + len; )
     {
-      _watch_t *item = gitem->data;
-      item->events=item->events|event_hdr->mask;
-
-      switch( item->type )
-      {
-        case DT_FSWATCH_IMAGE:
-        {
-          if( (event_hdr->mask&IN_CLOSE) && (item->events&IN_MODIFY) ) // Check if file modified and closed...
-          {
-            //  Something wrote on image externally and closed it, lets tag item as dirty...
-            dt_image_t *img=(dt_image_t *)item->data;
-            img->force_reimport = 1;
-            if(darktable.develop->image==img)
-              dt_dev_raw_reload(darktable.develop);
-            item->events=0;
-          }
-          else if( (event_hdr->mask&IN_ATTRIB) && (item->events&IN_DELETE_SELF) && (item->events&IN_IGNORED))
-          {
-            // This pattern showed up when another file is replacing the orginal...
-            dt_image_t *img=(dt_image_t *)item->data;
-            img->force_reimport = 1;
-            if(darktable.develop->image==img)
-              dt_dev_raw_reload(darktable.develop);
-            item->events=0;
-          }
-        }
-        break;
-
-        default:
-          dt_print(DT_DEBUG_FSWATCH,"[fswatch_thread] Unhandled object type %d for event descriptor %ld\n", item->type, event_hdr->wd );
-          break;
-      }
+      const struct inotify_event *event = (const struct inotify_event *)p;
+      _fswatch_event(fswatch, event);
+      p += sizeof(struct inotify_event) + event->len;
+    }
+    if(g_hash_table_size(fswatch->changed) || g_hash_table_size(fswatch->modified))
+    {
+      fswatch->last_change = dt_get_wtime();
+      if(!was_pending) fswatch->first_change = fswatch->last_change;
     }
-    else
-      dt_print(DT_DEBUG_FSWATCH,"[fswatch_thread] Failed to found watch item for descriptor %ld\n", event_hdr->wd );
-
     dt_pthread_mutex_unlock(&fswatch->mutex);
   }
   dt_print(DT_DEBUG_FSWATCH,"[fswatch_thread] terminating.\n");
-  g_free(event_hdr);
-  g_free(name);
+  g_free(buf);
   return NULL;
 }
 
 
-
-
-
 const dt_fswatch_t* dt_fswatch_new()
 {
   dt_fswatch_t *fswatch=g_malloc(sizeof(dt_fswatch_t));
@@ -157,7 +293,15 @@ const dt_fswatch_t* dt_fswatch_new()
     g_free(fswatch);
     return NULL;
   }
-  fswatch->items=NULL;
+  if(pipe(fswatch->wakeup))
+  {
+    close(fswatch->inotify_fd);
+    g_free(fswatch);
+    return NULL;
+  }
+  fswatch->items=g_hash_table_new(g_direct_hash, g_direct_equal);
+  fswatch->changed=g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_hash_table_destroy);
+  fswatch->modified=g_hash_table_new(g_direct_hash, g_direct_equal);
   dt_pthread_mutex_init(&fswatch->mutex, NULL);
   pthread_create(&fswatch->thread, NULL, &_fswatch_thread, fswatch);
   dt_print(DT_DEBUG_FSWATCH,"[fswatch_new] Creating new context %lx\n",(unsigned long int)fswatch);
@@ -167,21 +311,66 @@ const dt_fswatch_t* dt_fswatch_new()
 
 void dt_fswatch_destroy(const dt_fswatch_t *fswatch)
 {
+  if(!fswatch) return;
   dt_print(DT_DEBUG_FSWATCH,"[fswatch_destroy] Destroying context %lx\n",(unsigned long int)fswatch);
   dt_fswatch_t *ctx=(dt_fswatch_t *)fswatch;
+  // stop the thread, changes not picked up yet are dropped:
+  const char c = 0;
+  ssize_t written;
+  do written = write(ctx->wakeup[1], &c, 1);
+  while(written < 0 && errno == EINTR);
+  if(written != 1)
+  {
+    // the thread can't be told to stop, so leave it and everything it uses alone
+    perror("[fswatch_destroy] waking up thread");
+    return;
+  }
+  pthread_join(ctx->thread, NULL);
   dt_pthread_mutex_destroy(&ctx->mutex);
-  GList *item=g_list_first(fswatch->items);
-  while(item)
+  GHashTableIter it;
+  gpointer value;
+  g_hash_table_iter_init(&it, ctx->items);
+  while(g_hash_table_iter_next(&it, NULL, &value))
   {
-    g_free( item->data );
-    item=g_list_next(item);
+    _watch_t *item = (_watch_t *)value;
+    while(item)
+    {
+      _watch_t *next = item->next;
+      g_free(item);
+      item = next;
+    }
   }
-  g_list_free(fswatch->items);
+  g_hash_table_destroy(ctx->items);
+  g_hash_table_destroy(ctx->changed);
+  g_hash_table_destroy(ctx->modified);
+  close(ctx->inotify_fd);
+  close(ctx->wakeup[0]);
+  close(ctx->wakeup[1]);
   g_free(ctx);
 }
 
+// find the watch of type with data, and the one in front of it on the same descriptor.
+// called with the mutex held.
+static _watch_t *_fswatch_find(dt_fswatch_t *ctx, dt_fswatch_type_t type, void *data, _watch_t **prev)
+{
+  GHashTableIter it;
+  gpointer value;
+  g_hash_table_iter_init(&it, ctx->items);
+  while(g_hash_table_iter_next(&it, NULL, &value))
+  {
+    *prev = NULL;
+    for(_watch_t *item = (_watch_t *)value; item; item = item->next)
+    {
+      if(item->type == type && item->data == data) return item;
+      *prev = item;
+    }
+  }
+  return NULL;
+}
+
 void dt_fswatch_add(const dt_fswatch_t * fswatch,dt_fswatch_type_t type, void *data)
 {
+  if(!fswatch) return;
   char filename[DT_MAX_PATH_LEN];
   uint32_t mask=0;
   dt_fswatch_t *ctx=(dt_fswatch_t *)fswatch;
@@ -195,6 +384,18 @@ void dt_fswatch_add(const dt_fswatch_t * fswatch,dt_fswatch_type_t type, void *d
       break;
     case DT_FSWATCH_CURVE_DIRECTORY:
       break;
+    case DT_FSWATCH_FILMROLL:
+    {
+      mask=IN_CLOSE_WRITE|IN_MOVED_TO|IN_ONLYDIR;
+      sqlite3_stmt *stmt;
+      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                  "select folder from film_rolls where id = ?1", -1, &stmt, NULL);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, GPOINTER_TO_INT(data));
+      if(sqlite3_step(stmt) == SQLITE_ROW)
+        g_strlcpy(filename, (const char *)sqlite3_column_text(stmt, 0), DT_MAX_PATH_LEN);
+      sqlite3_finalize(stmt);
+    }
+    break;
     default:
       dt_print(DT_DEBUG_FSWATCH,"[fswatch_add] Unhandled object type %d\n",type);
       break;
@@ -203,11 +404,27 @@ void dt_fswatch_add(const dt_fswatch_t * fswatch,dt_fswatch_type_t type, void *d
   if(filename[0] != '\0')
   {
     dt_pthread_mutex_lock(&ctx->mutex);
+    _watch_t *prev;
+    if(_fswatch_find(ctx, type, data, &prev))
+    {
+      dt_pthread_mutex_unlock(&ctx->mutex);
+      return;
+    }
+    // adding to the mask of an inode already watched gives the same descriptor again:
+    const int descriptor=inotify_add_watch(fswatch->inotify_fd,filename,mask|IN_MASK_ADD);
+    if(descriptor < 0)
+    {
+      dt_pthread_mutex_unlock(&ctx->mutex);
+      dt_print(DT_DEBUG_FSWATCH,"[fswatch_add] Failed to watch %s: %s\n",filename,g_strerror(errno));
+      return;
+    }
     _watch_t *item = g_malloc(sizeof(_watch_t));
     item->type=type;
     item->data=data;
-    ctx->items=g_list_append(fswatch->items, item);
-    item->descriptor=inotify_add_watch(fswatch->inotify_fd,filename,mask);
+    item->events=0;
+    item->descriptor=descriptor;
+    item->next=(_watch_t *)g_hash_table_lookup(ctx->items, GINT_TO_POINTER(descriptor));
+    g_hash_table_insert(ctx->items, GINT_TO_POINTER(descriptor), item);
     dt_pthread_mutex_unlock(&ctx->mutex);
     dt_print(DT_DEBUG_FSWATCH,"[fswatch_add] Watch on object %lx added on file %s\n",(unsigned long int)data,filename);
   }
@@ -218,15 +435,22 @@ void dt_fswatch_add(const dt_fswatch_t * fswatch,dt_fswatch_type_t type, void *d
 
 void dt_fswatch_remove(const dt_fswatch_t * fswatch,dt_fswatch_type_t type, void *data)
 {
+  if(!fswatch) return;
   dt_fswatch_t *ctx=(dt_fswatch_t *)fswatch;
   dt_pthread_mutex_lock(&ctx->mutex);
   dt_print(DT_DEBUG_FSWATCH,"[fswatch_remove] removing watch on object %lx\n",(unsigned long int)data);
-  GList *gitem=g_list_find_custom(fswatch->items,data,&_fswatch_items_by_data);
-  if( gitem )
+  _watch_t *prev = NULL;
+  _watch_t *item = _fswatch_find(ctx, type, data, &prev);
+  if( item )
   {
-    _watch_t *item=gitem->data;
-    ctx->items=g_list_remove(ctx->items,item);
-    inotify_rm_watch(fswatch->inotify_fd,item->descriptor);
+    if(prev) prev->next = item->next;
+    else if(item->next) g_hash_table_insert(ctx->items, GINT_TO_POINTER(item->descriptor), item->next);
+    else
+    {
+      // last one on this inode
+      g_hash_table_remove(ctx->items, GINT_TO_POINTER(item->descriptor));
+      inotify_rm_watch(fswatch->inotify_fd,item->descriptor);
+    }
     g_free(item);
   }
   else
@@ -25,10 +25,14 @@
 /** fswatch context */
 typedef struct dt_fswatch_t
 {
-  uint32_t inotify_fd;
+  int inotify_fd;
+  int wakeup[2];            // pipe to wake the thread up for shutdown
   dt_pthread_mutex_t mutex;
   pthread_t thread;
-  GList *items;
+  GHashTable *items;        // watch descriptor -> watches on it
+  GHashTable *changed;      // film id -> set of file names written to in its directory
+  GHashTable *modified;     // set of image ids whose file was written to
+  double first_change, last_change;
 }
 dt_fswatch_t;
 
@@ -39,6 +43,9 @@ typedef enum dt_fswatch_type_t
   DT_FSWATCH_IMAGE = 0,
   /** watch is on directory for curves files << Just an test  */
   DT_FSWATCH_CURVE_DIRECTORY,
+  /** watch is on the directory of a film roll, data is GINT_TO_POINTER(film id).
+   *  new files get imported, modified ones have their cached buffers dropped. */
+  DT_FSWATCH_FILMROLL,
 }
 dt_fswatch_type_t;
 
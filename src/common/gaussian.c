@@ -19,9 +19,12 @@
 
 #include <math.h>
 #include <assert.h>
+#include <string.h>
 #include <xmmintrin.h>
+#include "common/darktable.h"
 #include "common/opencl.h"
 #include "common/gaussian.h"
+#include "develop/imageop.h"
 
 #define CLAMPF(a, mn, mx) ((a) < (mn) ? (mn) : ((a) > (mx) ? (mx) : (a)))
 #define MMCLAMPPS(a, mn, mx) (_mm_min_ps((mx), _mm_max_ps((a), (mn))))
@@ -81,13 +84,34 @@ void compute_gauss_params(const float sigma, dt_gaussian_order_t order, float *a
   *coefn = (*a2 + *a3)/(1.0f + *b1 + *b2);
 }
 
+// number of floats per row a thread works on at once in the vertical pass. the
+// columns of such a block are blurred together, so every row is touched with
+// one contiguous access instead of one cache line per column.
+#define COLUMN_BLOCK_LANES 64
+
+static inline int
+column_block_width(const int channels)
+{
+  return MAX(1, COLUMN_BLOCK_LANES / channels);
+}
+
+// size in floats of the scratch space each thread needs: the forward pass of
+// one column block, or one row for the horizontal pass.
+static inline size_t
+scratch_size_per_thread(const int width, const int height, const int channels)
+{
+  const size_t block = (size_t)height * column_block_width(channels) * channels;
+  const size_t row = (size_t)width * channels;
+  return block > row ? block : row;
+}
+
 size_t
 dt_gaussian_memory_use(
   const int width,       // width of input image
   const int height,      // height of input image
   const int channels)    // channels per pixel
 {
-  size_t mem_use = width*height*channels*sizeof(float);
+  size_t mem_use = dt_get_num_threads()*scratch_size_per_thread(width, height, channels)*sizeof(float);
 #ifdef HAVE_OPENCL
   mem_use = (width+BLOCKSIZE)*(height+BLOCKSIZE)*channels*sizeof(float)*2;
 #endif
@@ -127,6 +151,7 @@ dt_gaussian_init(
   g->sigma = sigma;
   g->order = order;
   g->buf = NULL;
+  g->piece = NULL;
   g->max = (float *)malloc(channels * sizeof(float));
   g->min = (float *)malloc(channels * sizeof(float));
 
@@ -138,7 +163,9 @@ dt_gaussian_init(
     g->min[k] = min[k];
   }
 
-  g->buf = dt_alloc_align(64, width*height*channels*sizeof(float));
+  // keep every thread's scratch area on its own cache lines
+  g->bufsize = (scratch_size_per_thread(width, height, channels) + 15) & ~(size_t)15;
+  g->buf = dt_alloc_align(64, dt_get_num_threads()*g->bufsize*sizeof(float));
   if(!g->buf) goto error;
 
   return g;
@@ -162,93 +189,114 @@ dt_gaussian_blur(
   const int width = g->width;
   const int height = g->height;
   const int ch = g->channels;
+  const int bw = column_block_width(ch);
 
   float a0, a1, a2, a3, b1, b2, coefp, coefn;
 
   compute_gauss_params(g->sigma, g->order, &a0, &a1, &a2, &a3, &b1, &b2, &coefp, &coefn);
 
-  float *temp = g->buf;
-
   float *Labmax = g->max;
   float *Labmin = g->min;
 
-  // vertical blur column by column
+  // vertical blur, a block of columns at a time. the forward pass goes to the
+  // thread's scratch area, the backward pass adds to it and writes to out. in
+  // and out may be the same buffer: every input row is read before it is written.
 #ifdef _OPENMP
-  #pragma omp parallel for default(none) shared(in,out,temp,Labmin,Labmax,a0,a1,a2,a3,b1,b2,coefp,coefn) schedule(static)
+  #pragma omp parallel for default(none) shared(g,in,out,Labmin,Labmax,a0,a1,a2,a3,b1,b2,coefp,coefn) schedule(static)
 #endif
-  for(int i=0; i<width; i++)
+  for(int i0=0; i0<width; i0+=bw)
   {
-    float xp[ch];
-    float yb[ch];
-    float yp[ch];
-    float xc[ch];
-    float yc[ch];
-    float xn[ch];
-    float xa[ch];
-    float yn[ch];
-    float ya[ch];
+    // the pipe got cancelled, the result will be thrown away
+    if(dt_iop_cancelled(g->piece)) continue;
+
+    const int lanes = MIN(bw, width - i0)*ch;
+    float *temp = g->buf + dt_get_thread_num()*g->bufsize;
+
+    float lmin[lanes];
+    float lmax[lanes];
+    float xp[lanes];
+    float yb[lanes];
+    float yp[lanes];
+    float xn[lanes];
+    float xa[lanes];
+    float yn[lanes];
+    float ya[lanes];
+
+    for(int l=0; l<lanes; l++)
+    {
+      lmin[l] = Labmin[l % ch];
+      lmax[l] = Labmax[l % ch];
+    }
 
     // forward filter
-    for(int k=0; k<ch; k++)
+    const float *first = in + i0*ch;
+    for(int l=0; l<lanes; l++)
     {
-      xp[k] = CLAMPF(in[i*ch+k], Labmin[k], Labmax[k]);
-      yb[k] = xp[k] * coefp;
-      yp[k] = yb[k];
-      xc[k] = yc[k] = xn[k] = xa[k] = yn[k] = ya[k] = 0.0f;
+      xp[l] = CLAMPF(first[l], lmin[l], lmax[l]);
+      yb[l] = xp[l] * coefp;
+      yp[l] = yb[l];
     }
 
     for(int j=0; j<height; j++)
     {
-      int offset = (i + j * width)*ch;
+      const float *inrow = in + ((size_t)j*width + i0)*ch;
+      float *tmprow = temp + (size_t)j*lanes;
 
-      for(int k=0; k<ch; k++)
+      for(int l=0; l<lanes; l++)
       {
-        xc[k] = CLAMPF(in[offset+k], Labmin[k], Labmax[k]);
-        yc[k] = (a0 * xc[k]) + (a1 * xp[k]) - (b1 * yp[k]) - (b2 * yb[k]);
+        const float xc = CLAMPF(inrow[l], lmin[l], lmax[l]);
+        const float yc = (a0 * xc) + (a1 * xp[l]) - (b1 * yp[l]) - (b2 * yb[l]);
 
-        temp[offset+k] = yc[k];
+        tmprow[l] = yc;
 
-        xp[k] = xc[k];
-        yb[k] = yp[k];
-        yp[k] = yc[k];
+        xp[l] = xc;
+        yb[l] = yp[l];
+        yp[l] = yc;
       }
     }
 
     // backward filter
-    for(int k=0; k<ch; k++)
+    const float *last = in + ((size_t)(height - 1)*width + i0)*ch;
+    for(int l=0; l<lanes; l++)
     {
-      xn[k] = CLAMPF(in[((height - 1) * width + i)*ch+k], Labmin[k], Labmax[k]);
-      xa[k] = xn[k];
-      yn[k] = xn[k] * coefn;
-      ya[k] = yn[k];
+      xn[l] = CLAMPF(last[l], lmin[l], lmax[l]);
+      xa[l] = xn[l];
+      yn[l] = xn[l] * coefn;
+      ya[l] = yn[l];
     }
 
     for(int j=height - 1; j > -1; j--)
     {
-      int offset = (i + j * width)*ch;
+      const float *inrow = in + ((size_t)j*width + i0)*ch;
+      const float *tmprow = temp + (size_t)j*lanes;
+      float *outrow = out + ((size_t)j*width + i0)*ch;
 
-      for(int k=0; k<ch; k++)
+      for(int l=0; l<lanes; l++)
       {
-        xc[k] = CLAMPF(in[offset+k], Labmin[k], Labmax[k]);
+        const float xc = CLAMPF(inrow[l], lmin[l], lmax[l]);
 
-        yc[k] = (a2 * xn[k]) + (a3 * xa[k]) - (b1 * yn[k]) - (b2 * ya[k]);
+        const float yc = (a2 * xn[l]) + (a3 * xa[l]) - (b1 * yn[l]) - (b2 * ya[l]);
 
-        xa[k] = xn[k];
-        xn[k] = xc[k];
-        ya[k] = yn[k];
-        yn[k] = yc[k];
+        xa[l] = xn[l];
+        xn[l] = xc;
+        ya[l] = yn[l];
+        yn[l] = yc;
 
-        temp[offset+k] += yc[k];
+        outrow[l] = tmprow[l] + yc;
       }
     }
   }
 
-  // horizontal blur line by line
+  if(dt_iop_cancelled(g->piece)) return;
+
+  // horizontal blur line by line, reading from a copy of the line
 #ifdef _OPENMP
-  #pragma omp parallel for default(none) shared(out,temp,Labmin,Labmax,a0,a1,a2,a3,b1,b2,coefp,coefn) schedule(static)
+  #pragma omp parallel for default(none) shared(g,out,Labmin,Labmax,a0,a1,a2,a3,b1,b2,coefp,coefn) schedule(static)
 #endif
   for(int j=0; j<height; j++)
   {
+    if(dt_iop_cancelled(g->piece)) continue;
+
     float xp[ch];
     float yb[ch];
     float yp[ch];
@@ -259,10 +307,14 @@ dt_gaussian_blur(
     float yn[ch];
     float ya[ch];
 
+    float *temp = g->buf + dt_get_thread_num()*g->bufsize;
+    float *outrow = out + (size_t)j*width*ch;
+    memcpy(temp, outrow, width*ch*sizeof(float));
+
     // forward filter
     for(int k=0; k<ch; k++)
     {
-      xp[k] = CLAMPF(temp[j*width*ch+k], Labmin[k], Labmax[k]);
+      xp[k] = CLAMPF(temp[k], Labmin[k], Labmax[k]);
       yb[k] = xp[k] * coefp;
       yp[k] = yb[k];
       xc[k] = yc[k] = xn[k] = xa[k] = yn[k] = ya[k] = 0.0f;
@@ -270,14 +322,14 @@ dt_gaussian_blur(
 
     for(int i=0; i<width; i++)
     {
-      int offset = (i + j * width)*ch;
+      int offset = i*ch;
 
       for(int k=0; k<ch; k++)
       {
         xc[k] = CLAMPF(temp[offset+k], Labmin[k], Labmax[k]);
         yc[k] = (a0 * xc[k]) + (a1 * xp[k]) - (b1 * yp[k]) - (b2 * yb[k]);
 
-        out[offset+k] = yc[k];
+        outrow[offset+k] = yc[k];
 
         xp[k] = xc[k];
         yb[k] = yp[k];
@@ -288,7 +340,7 @@ dt_gaussian_blur(
     // backward filter
     for(int k=0; k<ch; k++)
     {
-      xn[k] = CLAMPF(temp[((j + 1)*width - 1)*ch + k], Labmin[k], Labmax[k]);
+      xn[k] = CLAMPF(temp[(width - 1)*ch + k], Labmin[k], Labmax[k]);
       xa[k] = xn[k];
       yn[k] = xn[k] * coefn;
       ya[k] = yn[k];
@@ -296,7 +348,7 @@ dt_gaussian_blur(
 
     for(int i=width - 1; i > -1; i--)
     {
-      int offset = (i + j * width)*ch;
+      int offset = i*ch;
 
       for(int k=0; k<ch; k++)
       {
@@ -309,7 +361,7 @@ dt_gaussian_blur(
         ya[k] = yn[k];
         yn[k] = yc[k];
 
-        out[offset+k] += yc[k];
+        outrow[offset+k] += yc[k];
       }
     }
   }
@@ -327,6 +379,7 @@ dt_gaussian_blur_4c(
   const int width = g->width;
   const int height = g->height;
   const int ch = 4;
+  const int bw = column_block_width(ch);
 
   assert(g->channels == 4);
 
@@ -337,82 +390,99 @@ dt_gaussian_blur_4c(
   const __m128 Labmax = _mm_set_ps(g->max[3], g->max[2], g->max[1], g->max[0]);
   const __m128 Labmin = _mm_set_ps(g->min[3], g->min[2], g->min[1], g->min[0]);
 
-  float *temp = g->buf;
 
-
-  // vertical blur column by column
+  // vertical blur, a block of columns at a time (see dt_gaussian_blur())
 #ifdef _OPENMP
-  #pragma omp parallel for default(none) shared(in,out,temp,a0,a1,a2,a3,b1,b2,coefp,coefn) schedule(static)
+  #pragma omp parallel for default(none) shared(g,in,out,a0,a1,a2,a3,b1,b2,coefp,coefn) schedule(static)
 #endif
-  for(int i=0; i<width; i++)
+  for(int i0=0; i0<width; i0+=bw)
   {
-    __m128 xp = _mm_setzero_ps();
-    __m128 yb = _mm_setzero_ps();
-    __m128 yp = _mm_setzero_ps();
-    __m128 xc = _mm_setzero_ps();
-    __m128 yc = _mm_setzero_ps();
-    __m128 xn = _mm_setzero_ps();
-    __m128 xa = _mm_setzero_ps();
-    __m128 yn = _mm_setzero_ps();
-    __m128 ya = _mm_setzero_ps();
+    // the pipe got cancelled, the result will be thrown away
+    if(dt_iop_cancelled(g->piece)) continue;
 
-    // forward filter
-    xp = MMCLAMPPS(_mm_load_ps(in+i*ch), Labmin, Labmax);
-    yb = _mm_mul_ps(_mm_set_ps1(coefp), xp);
-    yp = yb;
+    const int cols = MIN(bw, width - i0);
+    float *temp = g->buf + dt_get_thread_num()*g->bufsize;
 
+    __m128 xp[cols];
+    __m128 yb[cols];
+    __m128 yp[cols];
+    __m128 xn[cols];
+    __m128 xa[cols];
+    __m128 yn[cols];
+    __m128 ya[cols];
+
+    // forward filter
+    for(int c=0; c<cols; c++)
+    {
+      xp[c] = MMCLAMPPS(_mm_load_ps(in+(i0+c)*ch), Labmin, Labmax);
+      yb[c] = _mm_mul_ps(_mm_set_ps1(coefp), xp[c]);
+      yp[c] = yb[c];
+    }
 
     for(int j=0; j<height; j++)
     {
-      int offset = (i + j * width)*ch;
+      const float *inrow = in + ((size_t)j*width + i0)*ch;
+      float *tmprow = temp + (size_t)j*cols*ch;
 
-      xc = MMCLAMPPS(_mm_load_ps(in+offset), Labmin, Labmax);
+      for(int c=0; c<cols; c++)
+      {
+        const __m128 xc = MMCLAMPPS(_mm_load_ps(inrow+c*ch), Labmin, Labmax);
 
+        const __m128 yc = _mm_add_ps(_mm_mul_ps(xc, _mm_set_ps1(a0)),
+                                     _mm_sub_ps(_mm_mul_ps(xp[c], _mm_set_ps1(a1)),
+                                                _mm_add_ps(_mm_mul_ps(yp[c], _mm_set_ps1(b1)), _mm_mul_ps(yb[c], _mm_set_ps1(b2)))));
 
-      yc = _mm_add_ps(_mm_mul_ps(xc, _mm_set_ps1(a0)),
-                      _mm_sub_ps(_mm_mul_ps(xp, _mm_set_ps1(a1)),
-                                 _mm_add_ps(_mm_mul_ps(yp, _mm_set_ps1(b1)), _mm_mul_ps(yb, _mm_set_ps1(b2)))));
-
-      _mm_store_ps(temp+offset, yc);
-
-      xp = xc;
-      yb = yp;
-      yp = yc;
+        _mm_store_ps(tmprow+c*ch, yc);
 
+        xp[c] = xc;
+        yb[c] = yp[c];
+        yp[c] = yc;
+      }
     }
 
     // backward filter
-    xn = MMCLAMPPS(_mm_load_ps(in+((height - 1) * width + i)*ch), Labmin, Labmax);
-    xa = xn;
-    yn = _mm_mul_ps(_mm_set_ps1(coefn), xn);
-    ya = yn;
+    for(int c=0; c<cols; c++)
+    {
+      xn[c] = MMCLAMPPS(_mm_load_ps(in+((size_t)(height - 1)*width + i0 + c)*ch), Labmin, Labmax);
+      xa[c] = xn[c];
+      yn[c] = _mm_mul_ps(_mm_set_ps1(coefn), xn[c]);
+      ya[c] = yn[c];
+    }
 
     for(int j=height - 1; j > -1; j--)
     {
-      int offset = (i + j * width)*ch;
-
-      xc = MMCLAMPPS(_mm_load_ps(in+offset), Labmin, Labmax);
+      const float *inrow = in + ((size_t)j*width + i0)*ch;
+      const float *tmprow = temp + (size_t)j*cols*ch;
+      float *outrow = out + ((size_t)j*width + i0)*ch;
 
-      yc = _mm_add_ps(_mm_mul_ps(xn, _mm_set_ps1(a2)),
-                      _mm_sub_ps(_mm_mul_ps(xa, _mm_set_ps1(a3)),
-                                 _mm_add_ps(_mm_mul_ps(yn, _mm_set_ps1(b1)), _mm_mul_ps(ya, _mm_set_ps1(b2)))));
+      for(int c=0; c<cols; c++)
+      {
+        const __m128 xc = MMCLAMPPS(_mm_load_ps(inrow+c*ch), Labmin, Labmax);
 
+        const __m128 yc = _mm_add_ps(_mm_mul_ps(xn[c], _mm_set_ps1(a2)),
+                                     _mm_sub_ps(_mm_mul_ps(xa[c], _mm_set_ps1(a3)),
+                                                _mm_add_ps(_mm_mul_ps(yn[c], _mm_set_ps1(b1)), _mm_mul_ps(ya[c], _mm_set_ps1(b2)))));
 
-      xa = xn;
-      xn = xc;
-      ya = yn;
-      yn = yc;
+        xa[c] = xn[c];
+        xn[c] = xc;
+        ya[c] = yn[c];
+        yn[c] = yc;
 
-      _mm_store_ps(temp+offset, _mm_add_ps(_mm_load_ps(temp+offset), yc));
+        _mm_store_ps(outrow+c*ch, _mm_add_ps(_mm_load_ps(tmprow+c*ch), yc));
+      }
     }
   }
 
-  // horizontal blur line by line
+  if(dt_iop_cancelled(g->piece)) return;
+
+  // horizontal blur line by line, reading from a copy of the line
 #ifdef _OPENMP
-  #pragma omp parallel for default(none) shared(out,temp,a0,a1,a2,a3,b1,b2,coefp,coefn) schedule(static)
+  #pragma omp parallel for default(none) shared(g,out,a0,a1,a2,a3,b1,b2,coefp,coefn) schedule(static)
 #endif
   for(int j=0; j<height; j++)
   {
+    if(dt_iop_cancelled(g->piece)) continue;
+
     __m128 xp = _mm_setzero_ps();
     __m128 yb = _mm_setzero_ps();
     __m128 yp = _mm_setzero_ps();
@@ -423,15 +493,19 @@ dt_gaussian_blur_4c(
     __m128 yn = _mm_setzero_ps();
     __m128 ya = _mm_setzero_ps();
 
+    float *temp = g->buf + dt_get_thread_num()*g->bufsize;
+    float *outrow = out + (size_t)j*width*ch;
+    memcpy(temp, outrow, width*ch*sizeof(float));
+
     // forward filter
-    xp = MMCLAMPPS(_mm_load_ps(temp+j*width*ch), Labmin, Labmax);
+    xp = MMCLAMPPS(_mm_load_ps(temp), Labmin, Labmax);
     yb = _mm_mul_ps(_mm_set_ps1(coefp), xp);
     yp = yb;
 
 
     for(int i=0; i<width; i++)
     {
-      int offset = (i + j * width)*ch;
+      int offset = i*ch;
 
       xc = MMCLAMPPS(_mm_load_ps(temp+offset), Labmin, Labmax);
 
@@ -439,7 +513,7 @@ dt_gaussian_blur_4c(
                       _mm_sub_ps(_mm_mul_ps(xp, _mm_set_ps1(a1)),
                                  _mm_add_ps(_mm_mul_ps(yp, _mm_set_ps1(b1)), _mm_mul_ps(yb, _mm_set_ps1(b2)))));
 
-      _mm_store_ps(out+offset, yc);
+      _mm_store_ps(outrow+offset, yc);
 
       xp = xc;
       yb = yp;
@@ -447,7 +521,7 @@ dt_gaussian_blur_4c(
     }
 
     // backward filter
-    xn = MMCLAMPPS(_mm_load_ps(temp+((j + 1)*width - 1)*ch), Labmin, Labmax);
+    xn = MMCLAMPPS(_mm_load_ps(temp+(width - 1)*ch), Labmin, Labmax);
     xa = xn;
     yn = _mm_mul_ps(_mm_set_ps1(coefn), xn);
     ya = yn;
@@ -455,7 +529,7 @@ dt_gaussian_blur_4c(
 
     for(int i=width - 1; i > -1; i--)
     {
-      int offset = (i + j * width)*ch;
+      int offset = i*ch;
 
       xc = MMCLAMPPS(_mm_load_ps(temp+offset), Labmin, Labmax);
 
@@ -469,7 +543,7 @@ dt_gaussian_blur_4c(
       ya = yn;
       yn = yc;
 
-      _mm_store_ps(out+offset, _mm_add_ps(_mm_load_ps(out+offset), yc));
+      _mm_store_ps(outrow+offset, _mm_add_ps(_mm_load_ps(outrow+offset), yc));
     }
   }
 }
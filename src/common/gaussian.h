@@ -24,6 +24,8 @@
 #include <xmmintrin.h>
 #include "common/opencl.h"
 
+struct dt_dev_pixelpipe_iop_t;
+
 typedef enum dt_gaussian_order_t
 {
   DT_IOP_GAUSSIAN_ZERO = 0,
@@ -41,6 +43,8 @@ typedef struct dt_gaussian_t
   float *max;
   float *min;
   float *buf;
+  size_t bufsize;
+  struct dt_dev_pixelpipe_iop_t *piece; // optional, stop early if the pipe of this piece got cancelled
 }
 dt_gaussian_t;
 
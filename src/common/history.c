@@ -28,6 +28,8 @@
 #include "common/mipmap_cache.h"
 #include "common/tags.h"
 #include "common/utility.h"
+#include "control/conf.h"
+#include "control/jobs.h"
 
 static void
 remove_preset_flag(const int imgid)
@@ -294,32 +296,133 @@ dt_history_get_items_as_string(int32_t imgid)
   return dt_util_glist_to_str("\n", items, count);
 }
 
+void
+dt_history_paste_targets_begin()
+{
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "begin transaction", NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "delete from memory.paste_targets", NULL, NULL, NULL);
+}
+
+void
+dt_history_copy_on_paste_targets(GList *ops)
+{
+  //  prepare SQL request. reading from the table we insert into is fine,
+  //  sqlite evaluates the select completely before inserting.
+  char req[2048];
+  strcpy (req, "insert into history (imgid, num, module, operation, op_params, enabled, blendop_params, blendop_version, multi_name, multi_priority) select t.imgid, h.num+t.offs, h.module, h.operation, h.op_params, h.enabled, h.blendop_params, h.blendop_version, h.multi_name, h.multi_priority from memory.paste_targets t join history h on h.imgid = t.srcid");
+
+  //  Add ops selection if any format: ... and num in (val1, val2)
+  if (ops)
+  {
+    GList *l = ops;
+    int first = 1;
+    strcat (req, " where h.num in (");
+
+    while (l)
+    {
+      long unsigned int value = (long unsigned int)l->data;
+      char v[30];
+
+      if (!first) strcat (req, ",");
+      snprintf (v, 30, "%lu", value);
+      strcat (req, v);
+      first=0;
+      l = g_list_next(l);
+    }
+    strcat (req, ")");
+  }
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), req, NULL, NULL, NULL);
+
+  // and the shapes of the masks
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
+                        "insert into mask (imgid, formid, form, name, version, points, points_count, source) select t.imgid, m.formid, m.form, m.name, m.version, m.points, m.points_count, m.source from memory.paste_targets t join mask m on m.imgid = t.srcid",
+                        NULL, NULL, NULL);
+}
+
+void
+dt_history_paste_targets_finish()
+{
+  GList *imgs = NULL;
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "select imgid from memory.paste_targets", -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+    imgs = g_list_prepend(imgs, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
+  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "delete from memory.paste_targets", NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "commit", NULL, NULL, NULL);
+
+  for(GList *l = imgs; l; l = g_list_next(l))
+  {
+    const int32_t imgid = GPOINTER_TO_INT(l->data);
+
+    /* if current image in develop reload history */
+    if (dt_dev_is_current_image(darktable.develop, imgid))
+    {
+      dt_dev_reload_history_items (darktable.develop);
+      dt_dev_modulegroups_set(darktable.develop, dt_dev_modulegroups_get(darktable.develop));
+    }
+
+    /* remove old obsolete thumbnails */
+    dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
+  }
+
+  /* update xmp files, without blocking the gui */
+  if(imgs && dt_conf_get_bool("write_sidecar_files"))
+    dt_control_write_sidecar_files_list(imgs);
+  else
+    g_list_free(imgs);
+
+  /* redraw center view to update visible mipmaps */
+  dt_control_queue_redraw_center();
+}
+
 int
 dt_history_copy_and_paste_on_selection (int32_t imgid, gboolean merge, GList *ops)
 {
   if (imgid < 0) return 1;
 
-  int res=0;
   sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "select * from selected_images where imgid != ?1", -1, &stmt, NULL);
+  dt_history_paste_targets_begin();
+
+  /* paste onto all selected images but the source, after their history if merging */
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              merge ?
+                              "insert into memory.paste_targets (imgid, srcid, offs) select imgid, ?1, "
+                              "(select ifnull(MAX(num)+1, 0) from history where history.imgid = selected_images.imgid) "
+                              "from selected_images where imgid != ?1" :
+                              "insert into memory.paste_targets (imgid, srcid, offs) select imgid, ?1, 0 "
+                              "from selected_images where imgid != ?1",
+                              -1, &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  if (sqlite3_step(stmt) == SQLITE_ROW)
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+  const int count = sqlite3_changes(dt_database_get(darktable.db));
+
+  if (count > 0 && !merge)
   {
-    do
-    {
-      /* get imgid of selected image */
-      int32_t dest_imgid = sqlite3_column_int (stmt, 0);
+    /* replace history stacks, and remove all existing shapes */
+    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
+                          "delete from history where imgid in (select imgid from memory.paste_targets)",
+                          NULL, NULL, NULL);
+    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
+                          "delete from mask where imgid in (select imgid from memory.paste_targets)",
+                          NULL, NULL, NULL);
+  }
 
-      /* paste history stack onto image id */
-      dt_history_copy_and_paste_on_image(imgid,dest_imgid,merge,ops);
+  if (count > 0)
+    dt_history_copy_on_paste_targets(ops);
 
-    }
-    while (sqlite3_step (stmt) == SQLITE_ROW);
+  if (count > 0 && merge && ops)
+  {
+    /* same as _dt_history_cleanup_multi_instance(), for the new items of all targets at once */
+    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
+                          "update history set multi_priority=(select COUNT(0)-1 from history hst2, memory.paste_targets t where t.imgid=history.imgid and hst2.imgid=history.imgid and hst2.num<=history.num and hst2.num>=t.offs and hst2.operation=history.operation) "
+                          "where imgid in (select imgid from memory.paste_targets) and num>=(select offs from memory.paste_targets t where t.imgid=history.imgid)",
+                          NULL, NULL, NULL);
   }
-  else res = 1;
 
-  sqlite3_finalize(stmt);
-  return res;
+  dt_history_paste_targets_finish();
+  return count > 0 ? 0 : 1;
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
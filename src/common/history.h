@@ -30,6 +30,16 @@ void dt_history_delete_on_image(int32_t imgid);
 /** copy history from imgid and pasts on selected images, merge or overwrite... */
 int dt_history_copy_and_paste_on_selection(int32_t imgid, gboolean merge,GList *ops);
 
+/** batch pasting works on the images in memory.paste_targets: each one gets the history of
+    srcid appended at num offs. begin clears the table and opens a transaction. */
+void dt_history_paste_targets_begin();
+
+/** copy the history items (only those with num in ops, if given) and shapes of srcid onto the targets. */
+void dt_history_copy_on_paste_targets(GList *ops);
+
+/** commit, then reload the darkroom and drop the thumbnails if needed and write the sidecar files in the background. */
+void dt_history_paste_targets_finish();
+
 /** load a dt file and applies to selected images */
 int dt_history_load_and_apply_on_selection(gchar *filename);
 
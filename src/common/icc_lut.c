@@ -0,0 +1,434 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "common/icc_lut.h"
+#include <xmmintrin.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// number of luts kept around when they are not in use by any pipe
+#define DT_ICC_LUT_CACHE_SIZE 8
+
+// number of random samples compared against lcms after baking
+#define DT_ICC_LUT_CHECK_SAMPLES 4096
+
+// pixels handed to lcms in one go when they are outside the lut domain
+#define DT_ICC_LUT_MISS_CHUNK 64
+
+// grid layouts tried in turn until the lut is accurate enough
+static const struct
+{
+  int size;
+  int shaped;
+}
+_icc_lut_layouts[] = { { 33, 1 }, { 65, 1 }, { 65, 0 } };
+
+// largest tolerated deviation from lcms: in Lab units for colorin, in rgb for colorout
+static const float _icc_lut_tolerance[] = { 0.5f, 1.0f/255.0f };
+
+// maps a pixel to normalized [0,1]^3 lut coordinates. the rgb domain is sampled on
+// a sqrt shaper to spend more grid points on the shadows.
+static inline __m128
+_icc_lut_normalize(const dt_icc_lut_domain_t domain, const float *px)
+{
+  const __m128 v = _mm_set_ps(0.0f, px[2], px[1], px[0]);
+  if(domain == DT_ICC_LUT_RGB_TO_LAB)
+    return _mm_sqrt_ps(_mm_max_ps(v, _mm_setzero_ps()));
+  return _mm_add_ps(_mm_mul_ps(v, _mm_set_ps(0.0f, 1.0f/256.0f, 1.0f/256.0f, 1.0f/100.0f)),
+                    _mm_set_ps(0.0f, 0.5f, 0.5f, 0.0f));
+}
+
+static inline int
+_icc_lut_in_domain(const dt_icc_lut_domain_t domain, const float *px)
+{
+  if(domain == DT_ICC_LUT_RGB_TO_LAB)
+    return px[0] >= 0.0f && px[0] <= 1.0f && px[1] >= 0.0f && px[1] <= 1.0f && px[2] >= 0.0f && px[2] <= 1.0f;
+  return px[0] >= 0.0f && px[0] <= 100.0f && px[1] >= -128.0f && px[1] <= 128.0f && px[2] >= -128.0f && px[2] <= 128.0f;
+}
+
+// rgb nodes the lut can interpolate safely: inside the gamut and above the toe of
+// the usual output curves (0.04 is where the linear segment of srgb ends), where
+// they are too steep for a coarse grid.
+static inline int
+_icc_lut_in_gamut(const float *rgb)
+{
+  return rgb[0] >= 0.04f && rgb[0] <= 1.0f && rgb[1] >= 0.04f && rgb[1] <= 1.0f && rgb[2] >= 0.04f && rgb[2] <= 1.0f;
+}
+
+// the inverse of _icc_lut_normalize(), for node positions t in [0,1]^3
+static inline void
+_icc_lut_denormalize(const dt_icc_lut_domain_t domain, const float *t, float *px)
+{
+  if(domain == DT_ICC_LUT_RGB_TO_LAB)
+  {
+    for(int c=0; c<3; c++) px[c] = t[c]*t[c];
+  }
+  else
+  {
+    px[0] = 100.0f*t[0];
+    px[1] = 256.0f*t[1] - 128.0f;
+    px[2] = 256.0f*t[2] - 128.0f;
+  }
+}
+
+// tetrahedral interpolation of the lut at normalized coordinates p
+static inline __m128
+_icc_lut_lookup(const dt_icc_lut_t *lut, const __m128 p)
+{
+  const int n = lut->size;
+  const __m128 f = _mm_mul_ps(p, _mm_set1_ps(n - 1));
+  float fp[4] __attribute__((aligned(16)));
+  _mm_store_ps(fp, f);
+
+  const int ix = MIN((int)fp[0], n - 2);
+  const int iy = MIN((int)fp[1], n - 2);
+  const int iz = MIN((int)fp[2], n - 2);
+  const float rx = fp[0] - ix, ry = fp[1] - iy, rz = fp[2] - iz;
+
+  const int sx = 4, sy = 4*n, sz = 4*n*n;
+  const float *c = lut->grid + (size_t)ix*sx + (size_t)iy*sy + (size_t)iz*sz;
+  const __m128 c000 = _mm_load_ps(c);
+  const __m128 c111 = _mm_load_ps(c + sx + sy + sz);
+
+  __m128 c1, c2, w0, w1, w2;
+  if(rx >= ry)
+  {
+    if(ry >= rz)
+    {
+      c1 = _mm_load_ps(c + sx);
+      c2 = _mm_load_ps(c + sx + sy);
+      w0 = _mm_set1_ps(rx); w1 = _mm_set1_ps(ry); w2 = _mm_set1_ps(rz);
+    }
+    else if(rx >= rz)
+    {
+      c1 = _mm_load_ps(c + sx);
+      c2 = _mm_load_ps(c + sx + sz);
+      w0 = _mm_set1_ps(rx); w1 = _mm_set1_ps(rz); w2 = _mm_set1_ps(ry);
+    }
+    else
+    {
+      c1 = _mm_load_ps(c + sz);
+      c2 = _mm_load_ps(c + sx + sz);
+      w0 = _mm_set1_ps(rz); w1 = _mm_set1_ps(rx); w2 = _mm_set1_ps(ry);
+    }
+  }
+  else
+  {
+    if(rz > ry)
+    {
+      c1 = _mm_load_ps(c + sz);
+      c2 = _mm_load_ps(c + sy + sz);
+      w0 = _mm_set1_ps(rz); w1 = _mm_set1_ps(ry); w2 = _mm_set1_ps(rx);
+    }
+    else if(rz > rx)
+    {
+      c1 = _mm_load_ps(c + sy);
+      c2 = _mm_load_ps(c + sy + sz);
+      w0 = _mm_set1_ps(ry); w1 = _mm_set1_ps(rz); w2 = _mm_set1_ps(rx);
+    }
+    else
+    {
+      c1 = _mm_load_ps(c + sy);
+      c2 = _mm_load_ps(c + sx + sy);
+      w0 = _mm_set1_ps(ry); w1 = _mm_set1_ps(rx); w2 = _mm_set1_ps(rz);
+    }
+  }
+  // c000 + w0 (c1 - c000) + w1 (c2 - c1) + w2 (c111 - c2)
+  return _mm_add_ps(_mm_add_ps(c000, _mm_mul_ps(w0, _mm_sub_ps(c1, c000))),
+                    _mm_add_ps(_mm_mul_ps(w1, _mm_sub_ps(c2, c1)), _mm_mul_ps(w2, _mm_sub_ps(c111, c2))));
+}
+
+// output shaper: the lut stores squared rgb values, which are much closer to linear
+// than gamma encoded output and so interpolate better in the shadows.
+static inline __m128
+_icc_lut_unshape(const dt_icc_lut_t *lut, const __m128 v)
+{
+  if(!lut->shaped) return v;
+  // keep the gamut flag in the fourth channel as is
+  const __m128 mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+  const __m128 rgb = _mm_sqrt_ps(_mm_max_ps(v, _mm_setzero_ps()));
+  return _mm_or_ps(_mm_and_ps(mask, rgb), _mm_andnot_ps(mask, v));
+}
+
+void
+dt_icc_lut_transform(const dt_icc_lut_t *lut, cmsHTRANSFORM xform, const float *in, float *out, const int width)
+{
+  float miss_in[3*DT_ICC_LUT_MISS_CHUNK], miss_out[3*DT_ICC_LUT_MISS_CHUNK];
+  int miss[DT_ICC_LUT_MISS_CHUNK];
+  int nmiss = 0;
+  float px[4] __attribute__((aligned(16)));
+
+  for(int i=0; i<width; i++)
+  {
+    const float *ip = in + 3*i;
+    // the fourth channel interpolates the gamut flags of the nodes, so it is
+    // non-zero whenever one of the nodes used for this pixel is out of gamut.
+    int hit = _icc_lut_in_domain(lut->domain, ip);
+    if(hit)
+    {
+      _mm_store_ps(px, _icc_lut_unshape(lut, _icc_lut_lookup(lut, _icc_lut_normalize(lut->domain, ip))));
+      hit = px[3] == 0.0f;
+    }
+    if(!hit)
+    {
+      memcpy(miss_in + 3*nmiss, ip, 3*sizeof(float));
+      miss[nmiss++] = i;
+      if(nmiss == DT_ICC_LUT_MISS_CHUNK)
+      {
+        cmsDoTransform(xform, miss_in, miss_out, nmiss);
+        for(int k=0; k<nmiss; k++) memcpy(out + 3*miss[k], miss_out + 3*k, 3*sizeof(float));
+        nmiss = 0;
+      }
+      continue;
+    }
+    memcpy(out + 3*i, px, 3*sizeof(float));
+  }
+  if(nmiss)
+  {
+    cmsDoTransform(xform, miss_in, miss_out, nmiss);
+    for(int k=0; k<nmiss; k++) memcpy(out + 3*miss[k], miss_out + 3*k, 3*sizeof(float));
+  }
+}
+
+int
+dt_icc_lut_transform_lut(const dt_icc_lut_t *lut, const float *in, float *out, uint8_t *miss, const int width)
+{
+  int nmiss = 0;
+  float px[4] __attribute__((aligned(16)));
+
+  for(int i=0; i<width; i++)
+  {
+    const float *ip = in + 3*i;
+    int hit = _icc_lut_in_domain(lut->domain, ip);
+    if(hit)
+    {
+      _mm_store_ps(px, _icc_lut_unshape(lut, _icc_lut_lookup(lut, _icc_lut_normalize(lut->domain, ip))));
+      hit = px[3] == 0.0f;
+    }
+    miss[i] = !hit;
+    if(hit) memcpy(out + 3*i, px, 3*sizeof(float));
+    else
+    {
+      memcpy(out + 3*i, ip, 3*sizeof(float));
+      nmiss++;
+    }
+  }
+  return nmiss;
+}
+
+static dt_icc_lut_t *
+_icc_lut_bake(cmsHTRANSFORM xform, const dt_icc_lut_domain_t domain, const int n, const int shaped)
+{
+  dt_icc_lut_t *lut = (dt_icc_lut_t *)malloc(sizeof(dt_icc_lut_t));
+  lut->domain = domain;
+  lut->size = n;
+  lut->shaped = shaped;
+  lut->max_error = INFINITY;
+  lut->refs = 0;
+  lut->last_used = 0;
+  lut->grid = (float *)dt_alloc_align(64, sizeof(float)*4*n*n*n);
+  if(!lut->grid)
+  {
+    free(lut);
+    return NULL;
+  }
+
+  float rowin[3*n], rowout[3*n];
+  for(int k=0; k<n; k++) for(int j=0; j<n; j++)
+    {
+      for(int i=0; i<n; i++)
+      {
+        const float t[3] = { i/(n - 1.0f), j/(n - 1.0f), k/(n - 1.0f) };
+        _icc_lut_denormalize(domain, t, rowin + 3*i);
+      }
+      cmsDoTransform(xform, rowin, rowout, n);
+      float *node = lut->grid + 4*(size_t)n*(j + (size_t)n*k);
+      for(int i=0; i<n; i++)
+      {
+        for(int c=0; c<3; c++)
+        {
+          const float v = rowout[3*i+c];
+          node[4*i+c] = shaped ? v*fabsf(v) : v;
+        }
+        // rgb output is clipped to the gamut later on, which a linear interpolation can't
+        // follow. flag nodes outside the gamut so cells touching the boundary go to lcms.
+        // only pixels inside of it end up in the lut, in practice most of an image.
+        node[4*i+3] = (domain == DT_ICC_LUT_LAB_TO_RGB && !_icc_lut_in_gamut(rowout + 3*i)) ? 1.0f : 0.0f;
+      }
+    }
+
+  // self-check: compare against lcms on pseudo random points. these are drawn
+  // uniformly in lut coordinates, so they are spread the same way as the nodes.
+  float chkin[3*DT_ICC_LUT_MISS_CHUNK], chklcms[3*DT_ICC_LUT_MISS_CHUNK], chklut[3*DT_ICC_LUT_MISS_CHUNK];
+  uint32_t seed = 0x2545f491u;
+  float max_error = 0.0f;
+  for(int s=0; s<DT_ICC_LUT_CHECK_SAMPLES; s+=DT_ICC_LUT_MISS_CHUNK)
+  {
+    for(int i=0; i<DT_ICC_LUT_MISS_CHUNK; i++)
+    {
+      float t[3];
+      for(int c=0; c<3; c++)
+      {
+        seed = seed*1664525u + 1013904223u;
+        t[c] = (seed >> 8) * (1.0f/16777216.0f);
+      }
+      _icc_lut_denormalize(domain, t, chkin + 3*i);
+    }
+    cmsDoTransform(xform, chkin, chklcms, DT_ICC_LUT_MISS_CHUNK);
+    dt_icc_lut_transform(lut, xform, chkin, chklut, DT_ICC_LUT_MISS_CHUNK);
+    for(int i=0; i<3*DT_ICC_LUT_MISS_CHUNK; i++)
+    {
+      const float err = fabsf(chklut[i] - chklcms[i]);
+      // nan compares false, make sure it fails the check
+      if(!(err <= max_error)) max_error = isnan(err) ? INFINITY : err;
+    }
+  }
+  lut->max_error = max_error;
+  return lut;
+}
+
+static void
+_icc_lut_free(dt_icc_lut_t *lut)
+{
+  if(!lut) return;
+  free(lut->grid);
+  free(lut);
+}
+
+void
+dt_icc_lut_cache_init(dt_icc_lut_cache_t *cache)
+{
+  dt_pthread_mutex_init(&cache->lock, NULL);
+  cache->luts = NULL;
+  cache->clock = 0;
+}
+
+void
+dt_icc_lut_cache_cleanup(dt_icc_lut_cache_t *cache)
+{
+  for(GList *l = cache->luts; l; l = g_list_next(l))
+    _icc_lut_free((dt_icc_lut_t *)l->data);
+  g_list_free(cache->luts);
+  cache->luts = NULL;
+  dt_pthread_mutex_destroy(&cache->lock);
+}
+
+// drop the least recently used luts nobody holds on to. called with the lock held.
+static void
+_icc_lut_cache_trim(dt_icc_lut_cache_t *cache)
+{
+  while(g_list_length(cache->luts) > DT_ICC_LUT_CACHE_SIZE)
+  {
+    GList *victim = NULL;
+    for(GList *l = cache->luts; l; l = g_list_next(l))
+    {
+      dt_icc_lut_t *lut = (dt_icc_lut_t *)l->data;
+      if(lut->refs == 0 && (!victim || lut->last_used < ((dt_icc_lut_t *)victim->data)->last_used))
+        victim = l;
+    }
+    if(!victim) return;
+    _icc_lut_free((dt_icc_lut_t *)victim->data);
+    cache->luts = g_list_delete_link(cache->luts, victim);
+  }
+}
+
+dt_icc_lut_t *
+dt_icc_lut_get(cmsHPROFILE in, cmsHPROFILE out, const int intent, const dt_icc_lut_domain_t domain)
+{
+  dt_icc_lut_cache_t *cache = darktable.icc_luts;
+  if(!cache || !in || !out) return NULL;
+
+  uint8_t key[36];
+  memset(key, 0, sizeof(key));
+  cmsMD5computeID(in);
+  cmsGetHeaderProfileID(in, key);
+  cmsMD5computeID(out);
+  cmsGetHeaderProfileID(out, key + 16);
+  key[32] = intent;
+  key[33] = domain;
+
+  dt_pthread_mutex_lock(&cache->lock);
+  dt_icc_lut_t *lut = NULL;
+  for(GList *l = cache->luts; l; l = g_list_next(l))
+  {
+    dt_icc_lut_t *cand = (dt_icc_lut_t *)l->data;
+    if(!memcmp(cand->key, key, sizeof(key)))
+    {
+      lut = cand;
+      break;
+    }
+  }
+
+  if(!lut)
+  {
+    // bake while holding the lock, so concurrent pipes don't build the same lut twice
+    dt_times_t start;
+    dt_get_times(&start);
+    const int in_type = domain == DT_ICC_LUT_RGB_TO_LAB ? TYPE_RGB_FLT : TYPE_Lab_FLT;
+    const int out_type = domain == DT_ICC_LUT_RGB_TO_LAB ? TYPE_Lab_FLT : TYPE_RGB_FLT;
+    cmsHTRANSFORM xform = cmsCreateTransform(in, in_type, out, out_type, intent, 0);
+    if(xform)
+    {
+      for(int k=0; k<sizeof(_icc_lut_layouts)/sizeof(_icc_lut_layouts[0]); k++)
+      {
+        // lab input has no use for the output shaper
+        if(domain == DT_ICC_LUT_RGB_TO_LAB && _icc_lut_layouts[k].shaped) continue;
+        _icc_lut_free(lut);
+        lut = _icc_lut_bake(xform, domain, _icc_lut_layouts[k].size, _icc_lut_layouts[k].shaped);
+        if(!lut || lut->max_error <= _icc_lut_tolerance[domain]) break;
+      }
+      cmsDeleteTransform(xform);
+    }
+    if(!lut)
+    {
+      dt_pthread_mutex_unlock(&cache->lock);
+      return NULL;
+    }
+    if(lut->max_error > _icc_lut_tolerance[domain])
+    {
+      // remember the failure, but don't keep the grid around
+      free(lut->grid);
+      lut->grid = NULL;
+    }
+    memcpy(lut->key, key, sizeof(key));
+    cache->luts = g_list_prepend(cache->luts, lut);
+    dt_show_times(&start, "[icc_lut] baking lut", "(%d^3 nodes, max error %g%s)", lut->size, lut->max_error,
+                  lut->grid ? "" : ", using lcms instead");
+  }
+
+  lut->last_used = ++cache->clock;
+  if(lut->grid) lut->refs++;
+  else lut = NULL;
+  _icc_lut_cache_trim(cache);
+  dt_pthread_mutex_unlock(&cache->lock);
+  return lut;
+}
+
+void
+dt_icc_lut_release(dt_icc_lut_t *lut)
+{
+  if(!lut) return;
+  dt_icc_lut_cache_t *cache = darktable.icc_luts;
+  dt_pthread_mutex_lock(&cache->lock);
+  lut->refs--;
+  dt_pthread_mutex_unlock(&cache->lock);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
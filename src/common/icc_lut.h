@@ -0,0 +1,84 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef DT_COMMON_ICC_LUT_H
+#define DT_COMMON_ICC_LUT_H
+
+#include "common/darktable.h"
+#include "common/dtpthread.h"
+#include <lcms2.h>
+
+/** input domain of a baked transform */
+typedef enum dt_icc_lut_domain_t
+{
+  DT_ICC_LUT_RGB_TO_LAB = 0, /**< rgb in [0,1] (sampled on a sqrt shaper) to Lab, as in colorin */
+  DT_ICC_LUT_LAB_TO_RGB = 1  /**< Lab with L in [0,100], a,b in [-128,128] to rgb, as in colorout */
+}
+dt_icc_lut_domain_t;
+
+/** an arbitrary icc transform baked into a 3d lut, evaluated with
+ * tetrahedral interpolation. values outside the domain are passed
+ * on to lcms. */
+typedef struct dt_icc_lut_t
+{
+  dt_icc_lut_domain_t domain;
+  int size;          /**< grid points per axis */
+  int shaped;        /**< rgb output is stored squared, see dt_icc_lut_transform() */
+  float *grid;       /**< size^3 nodes of 4 floats each, first axis varies fastest */
+  float max_error;   /**< largest deviation from lcms found by the self-check */
+
+  // cache bookkeeping
+  uint8_t key[36];
+  int refs;
+  uint64_t last_used;
+}
+dt_icc_lut_t;
+
+/** cache of luts, shared by all pipes, keyed by profile pair, intent and domain */
+typedef struct dt_icc_lut_cache_t
+{
+  dt_pthread_mutex_t lock;
+  GList *luts;
+  uint64_t clock;
+}
+dt_icc_lut_cache_t;
+
+void dt_icc_lut_cache_init(dt_icc_lut_cache_t *cache);
+void dt_icc_lut_cache_cleanup(dt_icc_lut_cache_t *cache);
+
+/** get the lut for the transform from profile in to profile out with the given intent.
+ * the lut is built (and checked against lcms) on first use. returns NULL if the transform
+ * can't be approximated accurately enough, in which case lcms should be used directly.
+ * the returned lut has to be given back with dt_icc_lut_release(). */
+dt_icc_lut_t *dt_icc_lut_get(cmsHPROFILE in, cmsHPROFILE out, const int intent, const dt_icc_lut_domain_t domain);
+
+void dt_icc_lut_release(dt_icc_lut_t *lut);
+
+/** drop in replacement for cmsDoTransform() on rows of 3 floats per pixel. pixels outside
+ * the lut domain are converted by xform, which has to be the same transform the lut was
+ * built for. */
+void dt_icc_lut_transform(const dt_icc_lut_t *lut, cmsHTRANSFORM xform, const float *in, float *out, const int width);
+
+/** the lut half of dt_icc_lut_transform(), for callers which can't run lcms in parallel: pixels
+ * the lut can't convert are copied to out unchanged and flagged in miss, to be converted by lcms
+ * in a later pass. returns the number of these. */
+int dt_icc_lut_transform_lut(const dt_icc_lut_t *lut, const float *in, float *out, uint8_t *miss, const int width);
+
+#endif
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -25,6 +25,7 @@
 #include "common/imageio.h"
 #include "common/grouping.h"
 #include "common/mipmap_cache.h"
+#include "common/mipmap_regen.h"
 #include "common/tags.h"
 #include "control/control.h"
 #include "control/conf.h"
@@ -354,6 +355,11 @@ void dt_image_remove(const int32_t imgid)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "delete from xmp_hashes where imgid = ?1", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                               "delete from color_labels where imgid = ?1", -1, &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
@@ -371,6 +377,7 @@ void dt_image_remove(const int32_t imgid)
   sqlite3_finalize(stmt);
   // also clear all thumbnails in mipmap_cache.
   dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
+  dt_mipmap_regen_forget(darktable.mipmap_regen, imgid);
 }
 
 int dt_image_altered(const uint32_t imgid)
@@ -886,18 +893,38 @@ int32_t dt_image_copy(const int32_t imgid, const int32_t filmid)
 // xmp stuff
 // *******************************************************
 
+static void _image_write_sidecar_file(const int imgid)
+{
+  // dt_exif_xmp_write() skips the write if nothing changed since the last one.
+  char filename[DT_MAX_PATH_LEN+8];
+  dt_image_full_path(imgid, filename, DT_MAX_PATH_LEN);
+  dt_image_path_append_version(imgid, filename, DT_MAX_PATH_LEN);
+  char *c = filename + strlen(filename);
+  sprintf(c, ".xmp");
+  dt_exif_xmp_write(imgid, filename);
+}
+
 void dt_image_write_sidecar_file(int imgid)
 {
-  // TODO: compute hash and don't write if not needed!
   // write .xmp file
   if(imgid > 0 && dt_conf_get_bool("write_sidecar_files"))
+    _image_write_sidecar_file(imgid);
+}
+
+void dt_image_write_sidecar_files(const int *imgs, const int count)
+{
+  // these are small files, time goes into waiting for the disk or network share.
+  // so keep a few writes in flight.
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(dynamic) default(none) shared(imgs, darktable)
+#endif
+  for(int k=0; k<count; k++)
   {
-    char filename[DT_MAX_PATH_LEN+8];
-    dt_image_full_path(imgid, filename, DT_MAX_PATH_LEN);
-    dt_image_path_append_version(imgid, filename, DT_MAX_PATH_LEN);
-    char *c = filename + strlen(filename);
-    sprintf(c, ".xmp");
-    dt_exif_xmp_write(imgid, filename);
+    if(imgs[k] <= 0) continue;
+    // keep the image in the cache while we're at it:
+    const dt_image_t *img = dt_image_cache_read_get(darktable.image_cache, imgs[k]);
+    _image_write_sidecar_file(imgs[k]);
+    dt_image_cache_read_release(darktable.image_cache, img);
   }
 }
 
@@ -909,15 +936,18 @@ void dt_image_synch_xmp(const int selected)
   }
   else if(dt_conf_get_bool("write_sidecar_files"))
   {
+    GArray *imgs = g_array_new(FALSE, FALSE, sizeof(int));
     sqlite3_stmt *stmt;
     DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                                 "select imgid from selected_images", -1, &stmt, NULL);
     while(sqlite3_step(stmt) == SQLITE_ROW)
     {
       const int imgid = sqlite3_column_int(stmt, 0);
-      dt_image_write_sidecar_file(imgid);
+      g_array_append_val(imgs, imgid);
     }
     sqlite3_finalize(stmt);
+    dt_image_write_sidecar_files((const int *)imgs->data, imgs->len);
+    g_array_free(imgs, TRUE);
   }
 }
 
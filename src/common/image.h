@@ -318,6 +318,8 @@ int32_t dt_image_move(const int32_t imgid, const int32_t filmid);
 int32_t dt_image_copy(const int32_t imgid, const int32_t filmid);
 // xmp functions:
 void dt_image_write_sidecar_file(int imgid);
+/** write the sidecars of count images at once, regardless of the write_sidecar_files setting. */
+void dt_image_write_sidecar_files(const int *imgs, const int count);
 void dt_image_synch_xmp(const int selected);
 void dt_image_synch_all_xmp(const gchar *pathname);
 
@@ -20,12 +20,14 @@
 #include "config.h"
 #endif
 #include "common/darktable.h"
+#include "common/bench.h"
 #include "common/colorlabels.h"
 #include "common/debug.h"
 #include "common/exif.h"
 #include "common/image_cache.h"
 #include "common/imageio.h"
 #include "common/imageio_module.h"
+#include "common/imageio_writer.h"
 #include "common/imageio_exr.h"
 #ifdef HAVE_OPENJPEG
 #include "common/imageio_j2k.h"
@@ -498,6 +500,20 @@ void dt_imageio_to_fractional(float in, uint32_t *num, uint32_t *den)
   }
 }
 
+static int _export_with_flags(
+  const uint32_t                 imgid,
+  const char                    *filename,
+  dt_imageio_module_format_t    *format,
+  dt_imageio_module_data_t      *format_params,
+  const int32_t                  ignore_exif,
+  const int32_t                  display_byteorder,
+  const gboolean                 high_quality,
+  const int32_t                  thumbnail_export,
+  const char                    *filter,
+  struct dt_imageio_writer_t    *writer,
+  dt_imageio_written_callback_t *callback,
+  void                          *user_data);
+
 int dt_imageio_export(
   const uint32_t              imgid,
   const char                 *filename,
@@ -513,6 +529,27 @@ int dt_imageio_export(
                                         0, 0, high_quality, 0, NULL);
 }
 
+void dt_imageio_export_async(
+  const uint32_t                 imgid,
+  const char                    *filename,
+  dt_imageio_module_format_t    *format,
+  dt_imageio_module_data_t      *format_params,
+  const gboolean                 high_quality,
+  dt_imageio_written_callback_t *callback,
+  void                          *user_data)
+{
+  struct dt_imageio_writer_t *writer = dt_imageio_writer_attached();
+  if(!writer || strcmp(format->mime(format_params),"x-copy")==0)
+  {
+    const int res = dt_imageio_export(imgid, filename, format, format_params, high_quality);
+    if(callback) callback(res, imgid, filename, format, format_params, user_data);
+    return;
+  }
+  // on success the writer calls back once the file is written:
+  if(_export_with_flags(imgid, filename, format, format_params, 0, 0, high_quality, 0, NULL, writer, callback, user_data))
+    if(callback) callback(1, imgid, filename, format, format_params, user_data);
+}
+
 // internal function: to avoid exif blob reading + 8-bit byteorder flag + high-quality override
 int dt_imageio_export_with_flags(
   const uint32_t              imgid,
@@ -524,6 +561,24 @@ int dt_imageio_export_with_flags(
   const gboolean              high_quality,
   const int32_t               thumbnail_export,
   const char                 *filter)
+{
+  return _export_with_flags(imgid, filename, format, format_params, ignore_exif, display_byteorder,
+                            high_quality, thumbnail_export, filter, NULL, NULL, NULL);
+}
+
+static int _export_with_flags(
+  const uint32_t                 imgid,
+  const char                    *filename,
+  dt_imageio_module_format_t    *format,
+  dt_imageio_module_data_t      *format_params,
+  const int32_t                  ignore_exif,
+  const int32_t                  display_byteorder,
+  const gboolean                 high_quality,
+  const int32_t                  thumbnail_export,
+  const char                    *filter,
+  struct dt_imageio_writer_t    *writer,
+  dt_imageio_written_callback_t *callback,
+  void                          *user_data)
 {
   dt_develop_t dev;
   dt_dev_init(&dev, 0);
@@ -696,6 +751,7 @@ int dt_imageio_export_with_flags(
     outbuf = pipe.backbuf;
   }
   dt_show_times(&start, thumbnail_export ? "[dev_process_thumbnail] pixel pipeline processing" : "[dev_process_export] pixel pipeline processing", NULL);
+  dt_bench_add(darktable.bench, &start, "pipe");
 
   // downconversion to low-precision formats:
   if(bpp == 8 && !display_byteorder)
@@ -753,14 +809,33 @@ int dt_imageio_export_with_flags(
     uint8_t exif_profile[65535]; // C++ alloc'ed buffer is uncool, so we waste some bits here.
     char pathname[1024];
     dt_image_full_path(imgid, pathname, 1024);
+    dt_get_times(&start);
     // last param is dng mode, it's false here
     length = dt_exif_read_blob(exif_profile, pathname, imgid, sRGB, processed_width, processed_height, 0);
+    dt_bench_add(darktable.bench, &start, "exif");
 
-    res = format->write_image (format_params, filename, outbuf, exif_profile, length, imgid);
+    if(writer)
+      // hand the pixels over to the encoder threads, the pipe is free for the next image after this:
+      dt_imageio_writer_push(writer, imgid, filename, format, format_params, outbuf,
+                             (size_t)processed_width*processed_height*4*(bpp/8), exif_profile, length, callback, user_data);
+    else
+    {
+      dt_get_times(&start);
+      res = format->write_image (format_params, filename, outbuf, exif_profile, length, imgid);
+      dt_bench_add(darktable.bench, &start, "encode");
+    }
   }
   else
   {
-    res = format->write_image (format_params, filename, outbuf, NULL, 0, imgid);
+    if(writer)
+      dt_imageio_writer_push(writer, imgid, filename, format, format_params, outbuf,
+                             (size_t)processed_width*processed_height*4*(bpp/8), NULL, 0, callback, user_data);
+    else
+    {
+      dt_get_times(&start);
+      res = format->write_image (format_params, filename, outbuf, NULL, 0, imgid);
+      dt_bench_add(darktable.bench, &start, "encode");
+    }
   }
 
   dt_dev_pixelpipe_cleanup(&pipe);
@@ -768,7 +843,8 @@ int dt_imageio_export_with_flags(
   dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
   free(moutbuf);
 
-  if(!thumbnail_export)
+  // the writer raises this one itself, once the file is there:
+  if(!thumbnail_export && !writer)
   {
     dt_control_signal_raise(darktable.signals,DT_SIGNAL_IMAGE_EXPORT_TMPFILE,imgid,filename);
   }
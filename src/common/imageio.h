@@ -60,6 +60,28 @@ dt_imageio_export(
   struct dt_imageio_module_data_t *format_params,
   const gboolean high_quality);
 
+/** called once an exported file is written (or failed to be), see dt_imageio_export_async(). */
+typedef void (dt_imageio_written_callback_t)(
+  const int res,
+  const uint32_t imgid,
+  const char *filename,
+  struct dt_imageio_module_format_t *format,
+  struct dt_imageio_module_data_t *fdata,
+  void *user_data);
+
+/** as dt_imageio_export(), but if the calling thread has an export writer attached
+ *  (see common/imageio_writer.h) encoding and writing are left to the writer threads.
+ *  callback is called with the result once the file is written, in any case. */
+void
+dt_imageio_export_async(
+  const uint32_t imgid,
+  const char *filename,
+  struct dt_imageio_module_format_t *format,
+  struct dt_imageio_module_data_t *format_params,
+  const gboolean high_quality,
+  dt_imageio_written_callback_t *callback,
+  void *user_data);
+
 int
 dt_imageio_export_with_flags(
   const uint32_t                     imgid,
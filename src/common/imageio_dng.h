@@ -212,19 +212,41 @@ dt_imageio_dng_write_tiff_header ( FILE *fp, uint32_t xs, uint32_t ys, float Tv,
     fprintf(stderr, "[dng_write_header] failed to write image header!\n");
 }
 
+/** start writing a dng of wd x ht floats: writes the header, then the caller appends
+ *  the rows top to bottom with dt_imageio_dng_write_rows(). NULL on failure. */
+static inline FILE *
+dt_imageio_dng_open(const char *filename, const int wd, const int ht, const uint32_t filter, const float whitelevel)
+{
+  FILE* f = fopen(filename, "wb");
+  if(f) dt_imageio_dng_write_tiff_header(f, wd, ht, 1.0f/100.0f, 1.0f/4.0f, 50.0f, 100.0f, filter, whitelevel);
+  return f;
+}
+
+/** append num_rows rows of pixel data. returns non-zero on error. */
+static inline int
+dt_imageio_dng_write_rows(FILE *f, const float *const rows, const int wd, const int num_rows)
+{
+  const size_t n = (size_t)wd*num_rows;
+  return fwrite(rows, sizeof(float), n, f) != n;
+}
+
+/** finish the file and add the exif data. */
+static inline void
+dt_imageio_dng_close(FILE *f, const char *filename, void *exif, const int exif_len)
+{
+  fclose(f);
+  if(exif) dt_exif_write_blob(exif,exif_len,filename);
+}
+
 static inline void
 dt_imageio_write_dng(const char *filename, const float *const pixel, const int wd, const int ht, void *exif, const int exif_len, const uint32_t filter, const float whitelevel)
 {
-  FILE* f = fopen(filename, "wb");
-  int k = 0;
+  FILE* f = dt_imageio_dng_open(filename, wd, ht, filter, whitelevel);
   if(f)
   {
-    dt_imageio_dng_write_tiff_header(f, wd, ht, 1.0f/100.0f, 1.0f/4.0f, 50.0f, 100.0f, filter, whitelevel);
-    k = fwrite(pixel, sizeof(float), wd*ht, f);
-    if (k != wd*ht)
+    if(dt_imageio_dng_write_rows(f, pixel, wd, ht))
       fprintf(stderr, "[dng_write] Error writing image data to %s\n", filename);
-    fclose(f);
-    if(exif) dt_exif_write_blob(exif,exif_len,filename);
+    dt_imageio_dng_close(f, filename, exif, exif_len);
   }
 }
 
@@ -37,6 +37,8 @@ extern "C"
 #include "common/darktable.h"
 #include "common/colorspaces.h"
 #include "common/file_location.h"
+#include "common/file_buffer.h"
+#include "common/bench.h"
 }
 
 // define this function, it is only declared in rawspeed:
@@ -108,8 +110,36 @@ dt_imageio_open_rawspeed(
       dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
     }
 
-    m = auto_ptr<FileMap>(f.readFile());
+    // keep the file's contents around for the exif blob of the export and the next
+    // decode. the decoder byteswaps and terminates strings in place, so it gets a
+    // private copy.
+    const dt_file_buffer_t *fb = dt_file_buffer_get(filename);
+    if(fb)
+    {
+      FileMap *copy = NULL;
+      try
+      {
+        copy = new FileMap(fb->size);
+        memcpy(copy->getDataWrt(0), fb->data, fb->size);
+      }
+      catch(...)
+      {
+        delete copy;
+        copy = NULL;
+      }
+      dt_file_buffer_release(fb);
+      m = auto_ptr<FileMap>(copy ? copy : f.readFile());
+    }
+    else
+    {
+      dt_times_t read_start;
+      dt_get_times(&read_start);
+      m = auto_ptr<FileMap>(f.readFile());
+      dt_bench_add(darktable.bench, &read_start, "read");
+    }
 
+    dt_times_t start;
+    dt_get_times(&start);
     RawParser t(m.get());
     d = auto_ptr<RawDecoder>(t.getDecoder());
 
@@ -120,6 +150,7 @@ dt_imageio_open_rawspeed(
     d->checkSupport(meta);
     d->decodeRaw();
     d->decodeMetaData(meta);
+    dt_bench_add(darktable.bench, &start, "decode");
     RawImage r = d->mRaw;
 
     /* free auto pointers on spot */
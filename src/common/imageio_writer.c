@@ -0,0 +1,200 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "common/imageio_writer.h"
+#include "common/darktable.h"
+#include "common/bench.h"
+#include "control/control.h"
+#include "control/signal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+typedef struct dt_imageio_writer_job_t
+{
+  uint32_t imgid;
+  char *filename;
+  dt_imageio_module_format_t *format;
+  dt_imageio_module_data_t *fdata;
+  void *buf;
+  void *exif;
+  int exif_len;
+  dt_imageio_written_callback_t *callback;
+  void *user_data;
+}
+dt_imageio_writer_job_t;
+
+typedef struct dt_imageio_writer_t
+{
+  dt_pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  GQueue *queue;
+  int queue_length;
+  int shutdown;
+  int failed;
+  int num_threads;
+  pthread_t *threads;
+}
+dt_imageio_writer_t;
+
+static pthread_key_t _writer_key;
+static pthread_once_t _writer_key_once = PTHREAD_ONCE_INIT;
+
+static void
+_writer_key_init()
+{
+  pthread_key_create(&_writer_key, NULL);
+}
+
+static void *
+_writer_work(void *ptr)
+{
+  dt_imageio_writer_t *w = (dt_imageio_writer_t *)ptr;
+  while(1)
+  {
+    dt_pthread_mutex_lock(&w->mutex);
+    while(g_queue_is_empty(w->queue) && !w->shutdown)
+      dt_pthread_cond_wait(&w->cond, &w->mutex);
+    dt_imageio_writer_job_t *j = (dt_imageio_writer_job_t *)g_queue_pop_head(w->queue);
+    // wake up producers waiting for a free slot:
+    pthread_cond_broadcast(&w->cond);
+    dt_pthread_mutex_unlock(&w->mutex);
+    if(!j) break; // empty and shut down
+
+    dt_times_t start;
+    dt_get_times(&start);
+    const int res = j->format->write_image(j->fdata, j->filename, j->buf, j->exif, j->exif_len, j->imgid);
+    dt_show_times(&start, "[export] encoding and writing", "`%s'", j->filename);
+    dt_bench_add(darktable.bench, &start, "encode");
+    if(res)
+    {
+      dt_pthread_mutex_lock(&w->mutex);
+      w->failed++;
+      dt_pthread_mutex_unlock(&w->mutex);
+    }
+    else
+    {
+      dt_control_signal_raise(darktable.signals, DT_SIGNAL_IMAGE_EXPORT_TMPFILE, j->imgid, j->filename);
+    }
+    if(j->callback) j->callback(res, j->imgid, j->filename, j->format, j->fdata, j->user_data);
+
+    j->format->free_params(j->format, j->fdata);
+    free(j->buf);
+    free(j->exif);
+    g_free(j->filename);
+    free(j);
+  }
+  return NULL;
+}
+
+dt_imageio_writer_t *
+dt_imageio_writer_new(const int threads, const int queue_length)
+{
+  pthread_once(&_writer_key_once, _writer_key_init);
+  dt_imageio_writer_t *w = (dt_imageio_writer_t *)malloc(sizeof(dt_imageio_writer_t));
+  dt_pthread_mutex_init(&w->mutex, NULL);
+  pthread_cond_init(&w->cond, NULL);
+  w->queue = g_queue_new();
+  w->queue_length = MAX(1, queue_length);
+  w->shutdown = 0;
+  w->failed = 0;
+  w->num_threads = MAX(1, threads);
+  w->threads = (pthread_t *)malloc(sizeof(pthread_t)*w->num_threads);
+  for(int k=0; k<w->num_threads; k++)
+    pthread_create(&w->threads[k], NULL, _writer_work, w);
+  return w;
+}
+
+int
+dt_imageio_writer_destroy(dt_imageio_writer_t *w)
+{
+  if(!w) return 0;
+  dt_pthread_mutex_lock(&w->mutex);
+  w->shutdown = 1;
+  pthread_cond_broadcast(&w->cond);
+  dt_pthread_mutex_unlock(&w->mutex);
+  for(int k=0; k<w->num_threads; k++)
+    pthread_join(w->threads[k], NULL);
+  const int failed = w->failed;
+  g_queue_free(w->queue);
+  pthread_cond_destroy(&w->cond);
+  dt_pthread_mutex_destroy(&w->mutex);
+  free(w->threads);
+  free(w);
+  return failed;
+}
+
+void
+dt_imageio_writer_attach(dt_imageio_writer_t *w)
+{
+  pthread_once(&_writer_key_once, _writer_key_init);
+  pthread_setspecific(_writer_key, w);
+}
+
+dt_imageio_writer_t *
+dt_imageio_writer_attached()
+{
+  pthread_once(&_writer_key_once, _writer_key_init);
+  return (dt_imageio_writer_t *)pthread_getspecific(_writer_key);
+}
+
+void
+dt_imageio_writer_push(
+  dt_imageio_writer_t *w,
+  const uint32_t imgid,
+  const char *filename,
+  dt_imageio_module_format_t *format,
+  const dt_imageio_module_data_t *fdata,
+  const void *buf,
+  const size_t size,
+  const void *exif,
+  const int exif_len,
+  dt_imageio_written_callback_t *callback,
+  void *user_data)
+{
+  dt_imageio_writer_job_t *j = (dt_imageio_writer_job_t *)malloc(sizeof(dt_imageio_writer_job_t));
+  j->imgid = imgid;
+  j->filename = g_strdup(filename);
+  j->format = format;
+  // fresh private part (encoder state), copy of the public parameters:
+  j->fdata = format->get_params(format);
+  memcpy(j->fdata, fdata, format->params_size(format));
+  j->buf = dt_alloc_align(64, size);
+  memcpy(j->buf, buf, size);
+  j->exif = NULL;
+  j->exif_len = 0;
+  if(exif && exif_len > 0)
+  {
+    j->exif = malloc(exif_len);
+    memcpy(j->exif, exif, exif_len);
+    j->exif_len = exif_len;
+  }
+  j->callback = callback;
+  j->user_data = user_data;
+
+  dt_pthread_mutex_lock(&w->mutex);
+  while(g_queue_get_length(w->queue) >= w->queue_length)
+    dt_pthread_cond_wait(&w->cond, &w->mutex);
+  g_queue_push_tail(w->queue, j);
+  pthread_cond_broadcast(&w->cond);
+  dt_pthread_mutex_unlock(&w->mutex);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
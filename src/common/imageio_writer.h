@@ -0,0 +1,66 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef DT_IMAGEIO_WRITER_H
+#define DT_IMAGEIO_WRITER_H
+
+#include "common/imageio.h"
+#include "common/imageio_module.h"
+
+/**
+ * encode and write stage of the export job.
+ *
+ * a writer owns a few threads and a bounded queue of processed images. a
+ * thread which attached a writer hands its finished buffers over instead of
+ * running format->write_image() itself and can go on with the next pixelpipe,
+ * while the (mostly single threaded) encoders run on the writer threads. when
+ * the queue is full, handing over blocks, so memory stays bounded by the
+ * queue length.
+ */
+struct dt_imageio_writer_t;
+
+/** start a writer with the given number of threads and queue length. */
+struct dt_imageio_writer_t *dt_imageio_writer_new(const int threads, const int queue_length);
+
+/** wait for all queued images to be written, then stop the threads. returns the number of failed writes. */
+int dt_imageio_writer_destroy(struct dt_imageio_writer_t *w);
+
+/** route writes of the calling thread through w, NULL to write synchronously again. */
+void dt_imageio_writer_attach(struct dt_imageio_writer_t *w);
+
+/** the writer attached to the calling thread, or NULL. */
+struct dt_imageio_writer_t *dt_imageio_writer_attached();
+
+/** queue an image for writing. buf (size bytes) and exif are copied, and so is fdata.
+ *  the callback runs on the writer thread after the write, with the writer's copy of fdata. */
+void dt_imageio_writer_push(
+  struct dt_imageio_writer_t *w,
+  const uint32_t imgid,
+  const char *filename,
+  dt_imageio_module_format_t *format,
+  const dt_imageio_module_data_t *fdata,
+  const void *buf,
+  const size_t size,
+  const void *exif,
+  const int exif_len,
+  dt_imageio_written_callback_t *callback,
+  void *user_data);
+
+#endif
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -18,6 +18,7 @@
 
 #include "common/darktable.h"
 #include "common/interpolation.h"
+#include "common/cpu_dispatch.h"
 #include "control/conf.h"
 
 #include <math.h>
@@ -1347,77 +1348,23 @@ dt_interpolation_resample(
 #endif
 
   // Process each output line
+  const dt_cpu_kernels_t *const kernels = darktable.kernels;
 #ifdef _OPENMP
   #pragma omp parallel for default(none) shared(out, hindex, hlength, hkernel, vindex, vlength, vkernel, vmeta)
 #endif
   for (int oy=0; oy<roi_out->height; oy++)
   {
     // Initialize column resampling indexes
-    int vlidx = vmeta[3*oy + 0]; // V(ertical) L(ength) I(n)d(e)x
-    int vkidx = vmeta[3*oy + 1]; // V(ertical) K(ernel) I(n)d(e)x
-    int viidx = vmeta[3*oy + 2]; // V(ertical) I(ndex) I(n)d(e)x
-
-    // Initialize row resampling indexes
-    int hlidx = 0; // H(orizontal) L(ength) I(n)d(e)x
-    int hkidx = 0; // H(orizontal) K(ernel) I(n)d(e)x
-    int hiidx = 0; // H(orizontal) I(ndex) I(n)d(e)x
+    const int vlidx = vmeta[3*oy + 0]; // V(ertical) L(ength) I(n)d(e)x
+    const int vkidx = vmeta[3*oy + 1]; // V(ertical) K(ernel) I(n)d(e)x
+    const int viidx = vmeta[3*oy + 2]; // V(ertical) I(ndex) I(n)d(e)x
 
     // Number of lines contributing to the output line
-    int vl = vlength[vlidx++]; // V(ertical) L(ength)
-
-    // Process each output column
-    for (int ox=0; ox < roi_out->width; ox++)
-    {
-      debug_extra("output %p [% 4d % 4d]\n", out, ox, oy);
-
-      // This will hold the resulting pixel
-      __m128 vs = _mm_setzero_ps();
-
-      // Number of horizontal samples contributing to the output
-      int hl = hlength[hlidx++]; // H(orizontal) L(ength)
-
-      for (int iy=0; iy < vl; iy++)
-      {
-        // This is our input line
-        const float* i = (float*)((char*)in + in_stride*vindex[viidx++]);
-
-        __m128 vhs = _mm_setzero_ps();
-
-        for (int ix=0; ix< hl; ix++)
-        {
-          // Apply the precomputed filter kernel
-          int baseidx = hindex[hiidx++]*4;
-          float htap = hkernel[hkidx++];
-          __m128 vhtap = _mm_set_ps1(htap);
-          vhs = _mm_add_ps(vhs, _mm_mul_ps(*(__m128*)&i[baseidx], vhtap));
-        }
-
-        // Accumulate contribution from this line
-        float vtap = vkernel[vkidx++];
-        __m128 vvtap = _mm_set_ps1(vtap);
-        vs = _mm_add_ps(vs, _mm_mul_ps(vhs, vvtap));
-
-        // Reset horizontal resampling context
-        hkidx -= hl;
-        hiidx -= hl;
-      }
-
-      // Output pixel is ready
-      float* o = (float*)((char*)out + oy*out_stride + ox*4*sizeof(float));
-      _mm_stream_ps(o, vs);
-
-      // Reset vertical resampling context
-      viidx -= vl;
-      vkidx -= vl;
-
-      // Progress in horizontal context
-      hiidx += hl;
-      hkidx += hl;
-    }
+    const int vl = vlength[vlidx]; // V(ertical) L(ength)
 
-    // Progress in vertical context
-    viidx += vl;
-    vkidx += vl;
+    // Row resampling indexes start over for each line
+    float *o = (float*)((char*)out + oy*out_stride);
+    kernels->resample_row(o, in, in_stride, roi_out->width, hlength, hkernel, hindex, vl, &vindex[viidx], &vkernel[vkidx]);
   }
 
   _mm_sfence();
@@ -18,11 +18,14 @@
 
 #include "common/darktable.h"
 #include "common/exif.h"
+#include "common/file_buffer.h"
 #include "common/image_cache.h"
 #include "common/imageio.h"
 #include "common/imageio_module.h"
 #include "common/imageio_jpeg.h"
 #include "common/mipmap_cache.h"
+#include "common/mipmap_regen.h"
+#include "common/bench.h"
 #include "control/conf.h"
 #include "control/jobs.h"
 #include "libraw/libraw.h"
@@ -713,7 +716,9 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
   }
 
   // full buffer needs dynamic alloc:
-  const int full_entries = MAX(2, parallel); // even with one thread you want two buffers. one for dr one for thumbs.
+  // even with one thread you want two buffers. one for dr one for thumbs.
+  // two more for the images the export job decodes ahead of its pixelpipes.
+  const int full_entries = MAX(2, parallel) + 2;
   int32_t max_mem_bufs = nearest_power_of_two(full_entries);
 
   // for this buffer, because it can be very busy during import, we want the minimum
@@ -873,7 +878,10 @@ dt_mipmap_cache_read_get(
           dt_image_full_path(buffered_image.id, filename, DT_MAX_PATH_LEN);
           dt_mipmap_cache_allocator_t a = (dt_mipmap_cache_allocator_t)&dsc;
           struct dt_mipmap_buffer_dsc* prvdsc = dsc;
+          dt_times_t start;
+          dt_get_times(&start);
           dt_imageio_retval_t ret = dt_imageio_open(&buffered_image, filename, a);
+          dt_bench_add(darktable.bench, &start, "load");
           if(dsc != prvdsc)
           {
             // fprintf(stderr, "[mipmap cache] realloc %lX\n", (uint64_t)data);
@@ -1054,11 +1062,26 @@ dt_mipmap_cache_remove(
   dt_mipmap_cache_t *cache,
   const uint32_t imgid)
 {
-  // get rid of all ldr thumbnails:
+  // get rid of all ldr thumbnails, and render the ones we had again in the background:
   for(int k=DT_MIPMAP_0; k<DT_MIPMAP_F; k++)
   {
     const uint32_t key = get_key(imgid, k);
-    dt_cache_remove(&cache->mip[k].cache, key);
+    if(!dt_cache_remove(&cache->mip[k].cache, key))
+      dt_mipmap_regen_add(darktable.mipmap_regen, imgid, k);
+  }
+}
+
+void
+dt_mipmap_cache_invalidate(
+  dt_mipmap_cache_t *cache,
+  const uint32_t imgid)
+{
+  // everything, including the buffers decoded from the file:
+  for(int k=DT_MIPMAP_0; k<DT_MIPMAP_NONE; k++)
+  {
+    const uint32_t key = get_key(imgid, k);
+    if(!dt_cache_remove(&cache->mip[k].cache, key))
+      dt_mipmap_regen_add(darktable.mipmap_regen, imgid, k);
   }
 }
 
@@ -1236,7 +1259,10 @@ _init_8(
       // raw image thumbnail
       libraw_data_t *raw = libraw_init(0);
       libraw_processed_image_t *image = NULL;
-      ret = libraw_open_file(raw, filename);
+      // only the thumbnail is needed, use the file's contents if somebody read it already:
+      const dt_file_buffer_t *fb = dt_file_buffer_peek(filename);
+      if(fb) ret = libraw_open_buffer(raw, (void *)fb->data, fb->size);
+      else   ret = libraw_open_file(raw, filename);
       if(ret) goto libraw_fail;
       ret = libraw_unpack_thumb(raw);
       if(ret) goto libraw_fail;
@@ -1275,6 +1301,7 @@ libraw_fail:
         libraw_close(raw);
         res = 1;
       }
+      dt_file_buffer_release(fb);
     }
   }
 
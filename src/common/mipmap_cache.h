@@ -156,6 +156,13 @@ dt_mipmap_cache_remove(
   dt_mipmap_cache_t *cache,
   const uint32_t imgid);
 
+// the image file changed on disk: also drop the full and float buffers.
+// entries currently in use are left alone.
+void
+dt_mipmap_cache_invalidate(
+  dt_mipmap_cache_t *cache,
+  const uint32_t imgid);
+
 // return the closest mipmap size
 // for the given window you wish to draw.
 // a dt_mipmap_size_t has always a fixed resolution associated with it,
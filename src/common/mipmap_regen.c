@@ -0,0 +1,165 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "common/mipmap_regen.h"
+#include "common/darktable.h"
+#include "control/conf.h"
+
+#include <stdlib.h>
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+static inline guint
+_regen_key(const uint32_t imgid, const dt_mipmap_size_t mip)
+{
+  return imgid*DT_MIPMAP_NONE + mip;
+}
+
+static void *
+_regen_work(void *ptr)
+{
+  dt_mipmap_regen_t *r = (dt_mipmap_regen_t *)ptr;
+#ifdef _OPENMP
+  // one core per thread, the config key sets the budget:
+  omp_set_num_threads(1);
+#endif
+#ifdef __linux__
+  // stay out of the way of the gui and the interactive jobs
+  setpriority(PRIO_PROCESS, syscall(SYS_gettid), 10);
+#endif
+  while(1)
+  {
+    dt_pthread_mutex_lock(&r->mutex);
+    while(!r->shutdown && (r->paused || g_queue_is_empty(r->queue)))
+      dt_pthread_cond_wait(&r->cond, &r->mutex);
+    if(r->shutdown)
+    {
+      dt_pthread_mutex_unlock(&r->mutex);
+      break;
+    }
+    const guint key = GPOINTER_TO_UINT(g_queue_pop_head(r->queue));
+    g_hash_table_remove(r->pending, GUINT_TO_POINTER(key));
+    dt_pthread_mutex_unlock(&r->mutex);
+
+    const uint32_t imgid = key / DT_MIPMAP_NONE;
+    const dt_mipmap_size_t mip = key % DT_MIPMAP_NONE;
+    // if the lighttable got there first, this finds it in the cache and is done.
+    dt_times_t start;
+    dt_get_times(&start);
+    dt_mipmap_buffer_t buf;
+    dt_mipmap_cache_read_get(darktable.mipmap_cache, &buf, imgid, mip, DT_MIPMAP_BLOCKING);
+    dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
+    dt_show_times(&start, "[mipmap_regen] rendering", "image %u mip %d", imgid, mip);
+  }
+  return NULL;
+}
+
+dt_mipmap_regen_t *
+dt_mipmap_regen_new()
+{
+  const int threads = MIN(dt_conf_get_int("background_thumbnail_threads"), dt_get_num_threads());
+  if(threads <= 0) return NULL;
+  dt_mipmap_regen_t *r = (dt_mipmap_regen_t *)malloc(sizeof(dt_mipmap_regen_t));
+  dt_pthread_mutex_init(&r->mutex, NULL);
+  pthread_cond_init(&r->cond, NULL);
+  r->queue = g_queue_new();
+  r->pending = g_hash_table_new(g_direct_hash, g_direct_equal);
+  r->paused = 0;
+  r->shutdown = 0;
+  r->num_threads = threads;
+  r->threads = (pthread_t *)malloc(sizeof(pthread_t)*threads);
+  for(int k=0; k<threads; k++)
+    pthread_create(&r->threads[k], NULL, _regen_work, r);
+  dt_print(DT_DEBUG_CACHE, "[mipmap_regen] %d background threads\n", threads);
+  return r;
+}
+
+void
+dt_mipmap_regen_destroy(dt_mipmap_regen_t *r)
+{
+  if(!r) return;
+  dt_pthread_mutex_lock(&r->mutex);
+  r->shutdown = 1;
+  pthread_cond_broadcast(&r->cond);
+  dt_pthread_mutex_unlock(&r->mutex);
+  for(int k=0; k<r->num_threads; k++)
+    pthread_join(r->threads[k], NULL);
+  g_queue_free(r->queue);
+  g_hash_table_destroy(r->pending);
+  pthread_cond_destroy(&r->cond);
+  dt_pthread_mutex_destroy(&r->mutex);
+  free(r->threads);
+  free(r);
+}
+
+void
+dt_mipmap_regen_add(dt_mipmap_regen_t *r, const uint32_t imgid, const dt_mipmap_size_t mip)
+{
+  if(!r || imgid == 0 || mip >= DT_MIPMAP_F) return;
+  const guint key = _regen_key(imgid, mip);
+  dt_pthread_mutex_lock(&r->mutex);
+  if(!g_hash_table_lookup(r->pending, GUINT_TO_POINTER(key)))
+  {
+    g_hash_table_insert(r->pending, GUINT_TO_POINTER(key), GINT_TO_POINTER(1));
+    g_queue_push_tail(r->queue, GUINT_TO_POINTER(key));
+    pthread_cond_signal(&r->cond);
+  }
+  dt_pthread_mutex_unlock(&r->mutex);
+}
+
+void
+dt_mipmap_regen_forget(dt_mipmap_regen_t *r, const uint32_t imgid)
+{
+  if(!r) return;
+  dt_pthread_mutex_lock(&r->mutex);
+  for(int k=DT_MIPMAP_0; k<DT_MIPMAP_F; k++)
+  {
+    const gpointer key = GUINT_TO_POINTER(_regen_key(imgid, k));
+    if(g_hash_table_remove(r->pending, key))
+      g_queue_remove(r->queue, key);
+  }
+  dt_pthread_mutex_unlock(&r->mutex);
+}
+
+void
+dt_mipmap_regen_pause(dt_mipmap_regen_t *r)
+{
+  if(!r) return;
+  dt_pthread_mutex_lock(&r->mutex);
+  r->paused++;
+  dt_pthread_mutex_unlock(&r->mutex);
+}
+
+void
+dt_mipmap_regen_resume(dt_mipmap_regen_t *r)
+{
+  if(!r) return;
+  dt_pthread_mutex_lock(&r->mutex);
+  if(r->paused > 0 && --r->paused == 0)
+    pthread_cond_broadcast(&r->cond);
+  dt_pthread_mutex_unlock(&r->mutex);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -0,0 +1,65 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef DT_MIPMAP_REGEN_H
+#define DT_MIPMAP_REGEN_H
+
+#include "common/dtpthread.h"
+#include "common/mipmap_cache.h"
+#include <glib.h>
+
+/**
+ * background regeneration of thumbnails.
+ *
+ * thumbnails dropped by dt_mipmap_cache_remove() (pasted history, styles,
+ * changes on disk) are queued here and rendered again by a few low priority
+ * threads, so the lighttable finds them ready instead of waiting for the
+ * export pipes. the number of threads comes from the config key
+ * background_thumbnail_threads, each of them uses a single core. while the
+ * darkroom or an export is running, the threads pause.
+ */
+typedef struct dt_mipmap_regen_t
+{
+  dt_pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  GQueue *queue;          // (imgid, mip) keys waiting to be rendered, oldest first
+  GHashTable *pending;    // the same keys, so nothing is queued twice
+  int paused;             // nesting count of pause requests
+  int shutdown;
+  int num_threads;
+  pthread_t *threads;
+}
+dt_mipmap_regen_t;
+
+/** start the threads, NULL if disabled in the config. all functions accept NULL. */
+dt_mipmap_regen_t *dt_mipmap_regen_new();
+/** stop the threads, dropping what is still queued. */
+void dt_mipmap_regen_destroy(dt_mipmap_regen_t *r);
+
+/** render the given mip of imgid again, when there is time. */
+void dt_mipmap_regen_add(dt_mipmap_regen_t *r, const uint32_t imgid, const dt_mipmap_size_t mip);
+/** the image is being removed, don't render anything for it any more. */
+void dt_mipmap_regen_forget(dt_mipmap_regen_t *r, const uint32_t imgid);
+
+/** keep the threads from starting new work until the matching resume. */
+void dt_mipmap_regen_pause(dt_mipmap_regen_t *r);
+void dt_mipmap_regen_resume(dt_mipmap_regen_t *r);
+
+#endif
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
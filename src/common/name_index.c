@@ -0,0 +1,305 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "common/name_index.h"
+#include "common/darktable.h"
+#include "common/debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct dt_name_index_entry_t
+{
+  gchar *name;
+  gchar *folded;  // ascii lower case, what we match against
+}
+dt_name_index_entry_t;
+
+static void
+_entry_free(gpointer data)
+{
+  dt_name_index_entry_t *e = (dt_name_index_entry_t *)data;
+  g_free(e->name);
+  g_free(e->folded);
+  free(e);
+}
+
+static void
+_ids_free(gpointer data)
+{
+  g_array_free((GArray *)data, TRUE);
+}
+
+static inline gpointer
+_trigram(const char *s)
+{
+  return GUINT_TO_POINTER(((guint)(guchar)s[0] << 16) | ((guint)(guchar)s[1] << 8) | (guint)(guchar)s[2]);
+}
+
+// skip one utf-8 character, like sqlite's _ does.
+static inline const char *
+_next_char(const char *s)
+{
+  s++;
+  while((*s & 0xc0) == 0x80) s++;
+  return s;
+}
+
+// sqlite's like on case folded strings: % matches any sequence, _ any single character.
+static int
+_like_match(const char *s, const char *p)
+{
+  const char *bp = NULL, *bs = NULL;
+  while(*s)
+  {
+    if(*p == '%')
+    {
+      // try the empty match first, come back here on mismatch
+      bp = ++p;
+      bs = s;
+    }
+    else if(*p == '_')
+    {
+      p++;
+      s = _next_char(s);
+    }
+    else if(*p && *p == *s)
+    {
+      p++;
+      s++;
+    }
+    else if(bp)
+    {
+      bs = _next_char(bs);
+      p = bp;
+      s = bs;
+    }
+    else return 0;
+  }
+  while(*p == '%') p++;
+  return !*p;
+}
+
+static void
+_remove_locked(dt_name_index_t *idx, const guint id)
+{
+  dt_name_index_entry_t *e = (dt_name_index_entry_t *)g_hash_table_lookup(idx->names, GUINT_TO_POINTER(id));
+  if(!e) return;
+  const int len = strlen(e->folded);
+  for(int k=0; k+3<=len; k++)
+  {
+    const gpointer key = _trigram(e->folded + k);
+    GArray *ids = (GArray *)g_hash_table_lookup(idx->trigrams, key);
+    if(!ids) continue; // repeated trigram, already gone
+    for(guint i=0; i<ids->len; i++)
+    {
+      if(g_array_index(ids, guint, i) == id)
+      {
+        g_array_remove_index_fast(ids, i);
+        break;
+      }
+    }
+    if(ids->len == 0) g_hash_table_remove(idx->trigrams, key);
+  }
+  g_hash_table_remove(idx->names, GUINT_TO_POINTER(id));
+}
+
+static void
+_insert_locked(dt_name_index_t *idx, const guint id, const char *name)
+{
+  _remove_locked(idx, id);
+  dt_name_index_entry_t *e = (dt_name_index_entry_t *)malloc(sizeof(dt_name_index_entry_t));
+  e->name = g_strdup(name);
+  e->folded = g_ascii_strdown(name, -1);
+  g_hash_table_insert(idx->names, GUINT_TO_POINTER(id), e);
+  const int len = strlen(e->folded);
+  for(int k=0; k+3<=len; k++)
+  {
+    const gpointer key = _trigram(e->folded + k);
+    GArray *ids = (GArray *)g_hash_table_lookup(idx->trigrams, key);
+    if(!ids)
+    {
+      ids = g_array_new(FALSE, FALSE, sizeof(guint));
+      g_hash_table_insert(idx->trigrams, key, ids);
+    }
+    // a trigram repeated in this name was appended just now:
+    else if(ids->len && g_array_index(ids, guint, ids->len-1) == id) continue;
+    g_array_append_val(ids, id);
+  }
+}
+
+static void
+_fill_locked(dt_name_index_t *idx)
+{
+  dt_times_t start;
+  dt_get_times(&start);
+  g_hash_table_remove_all(idx->trigrams);
+  g_hash_table_remove_all(idx->names);
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), idx->query, -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const char *name = (const char *)sqlite3_column_text(stmt, 1);
+    if(name) _insert_locked(idx, sqlite3_column_int(stmt, 0), name);
+  }
+  sqlite3_finalize(stmt);
+  idx->dirty = 0;
+  dt_show_times(&start, "[name_index] filling", "`%s' (%d names, %d trigrams)", idx->query,
+                g_hash_table_size(idx->names), g_hash_table_size(idx->trigrams));
+}
+
+dt_name_index_t *
+dt_name_index_new(const char *query)
+{
+  dt_name_index_t *idx = (dt_name_index_t *)malloc(sizeof(dt_name_index_t));
+  dt_pthread_mutex_init(&idx->mutex, NULL);
+  idx->query = g_strdup(query);
+  idx->names = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, _entry_free);
+  idx->trigrams = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, _ids_free);
+  _fill_locked(idx);
+  return idx;
+}
+
+void
+dt_name_index_destroy(dt_name_index_t *idx)
+{
+  if(!idx) return;
+  g_hash_table_destroy(idx->trigrams);
+  g_hash_table_destroy(idx->names);
+  g_free(idx->query);
+  dt_pthread_mutex_destroy(&idx->mutex);
+  free(idx);
+}
+
+void
+dt_name_index_insert(dt_name_index_t *idx, const guint id, const char *name)
+{
+  if(!idx || !name) return;
+  dt_pthread_mutex_lock(&idx->mutex);
+  if(!idx->dirty) _insert_locked(idx, id, name);
+  dt_pthread_mutex_unlock(&idx->mutex);
+}
+
+void
+dt_name_index_remove(dt_name_index_t *idx, const guint id)
+{
+  if(!idx) return;
+  dt_pthread_mutex_lock(&idx->mutex);
+  if(!idx->dirty) _remove_locked(idx, id);
+  dt_pthread_mutex_unlock(&idx->mutex);
+}
+
+void
+dt_name_index_invalidate(dt_name_index_t *idx)
+{
+  if(!idx) return;
+  dt_pthread_mutex_lock(&idx->mutex);
+  idx->dirty = 1;
+  dt_pthread_mutex_unlock(&idx->mutex);
+}
+
+gchar *
+dt_name_index_get_name(dt_name_index_t *idx, const guint id)
+{
+  if(!idx) return NULL;
+  dt_pthread_mutex_lock(&idx->mutex);
+  if(idx->dirty) _fill_locked(idx);
+  dt_name_index_entry_t *e = (dt_name_index_entry_t *)g_hash_table_lookup(idx->names, GUINT_TO_POINTER(id));
+  gchar *name = e ? g_strdup(e->name) : NULL;
+  dt_pthread_mutex_unlock(&idx->mutex);
+  return name;
+}
+
+static GList *
+_append_if_match(GList *result, const guint id, const dt_name_index_entry_t *e, const char *pattern)
+{
+  if(!e || !_like_match(e->folded, pattern)) return result;
+  dt_name_index_item_t *item = (dt_name_index_item_t *)g_malloc(sizeof(dt_name_index_item_t));
+  item->id = id;
+  item->name = g_strdup(e->name);
+  return g_list_prepend(result, item);
+}
+
+GList *
+dt_name_index_like(dt_name_index_t *idx, const char *pattern)
+{
+  if(!idx || !pattern) return NULL;
+  gchar *folded = g_ascii_strdown(pattern, -1);
+  GList *result = NULL;
+  dt_pthread_mutex_lock(&idx->mutex);
+  if(idx->dirty) _fill_locked(idx);
+
+  // every match contains all literal runs of the pattern, so it is enough to
+  // look at the names sharing the rarest trigram of any of them.
+  GArray *candidates = NULL;
+  int empty = 0;
+  for(const char *run = folded; *run && !empty; )
+  {
+    const int len = strcspn(run, "%_");
+    for(int k=0; k+3<=len; k++)
+    {
+      GArray *ids = (GArray *)g_hash_table_lookup(idx->trigrams, _trigram(run + k));
+      if(!ids)
+      {
+        empty = 1; // no name has it
+        break;
+      }
+      if(!candidates || ids->len < candidates->len) candidates = ids;
+    }
+    run += len;
+    if(*run) run++;
+  }
+
+  if(!empty && candidates)
+  {
+    for(guint i=0; i<candidates->len; i++)
+    {
+      const guint id = g_array_index(candidates, guint, i);
+      result = _append_if_match(result, id, g_hash_table_lookup(idx->names, GUINT_TO_POINTER(id)), folded);
+    }
+  }
+  else if(!empty)
+  {
+    // pattern too short to narrow down, check all names:
+    GHashTableIter it;
+    gpointer key, value;
+    g_hash_table_iter_init(&it, idx->names);
+    while(g_hash_table_iter_next(&it, &key, &value))
+      result = _append_if_match(result, GPOINTER_TO_UINT(key), value, folded);
+  }
+  dt_pthread_mutex_unlock(&idx->mutex);
+  g_free(folded);
+  return result;
+}
+
+static void
+_item_free(gpointer data)
+{
+  dt_name_index_item_t *item = (dt_name_index_item_t *)data;
+  g_free(item->name);
+  g_free(item);
+}
+
+void
+dt_name_index_free_result(GList *result)
+{
+  g_list_free_full(result, _item_free);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -0,0 +1,75 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef DT_COMMON_NAME_INDEX_H
+#define DT_COMMON_NAME_INDEX_H
+
+#include "common/dtpthread.h"
+#include <glib.h>
+
+/**
+ * in-memory index over the names of a table (tag names, film roll folders),
+ * to answer the `like' lookups of the keyword entry and the collect module
+ * on every keystroke without scanning the table in sqlite.
+ *
+ * names are split into trigrams (case folded like sqlite's like does for
+ * ascii), each pointing to the ids of the names containing it. a pattern is
+ * checked against the names sharing its rarest trigram only.
+ */
+typedef struct dt_name_index_t
+{
+  dt_pthread_mutex_t mutex;
+  char *query;            /**< select id, name from ..., to (re)fill the index */
+  int dirty;              /**< table was changed behind our back, refill on next lookup */
+  GHashTable *names;      /**< id -> dt_name_index_entry_t */
+  GHashTable *trigrams;   /**< trigram -> GArray of ids */
+}
+dt_name_index_t;
+
+/** one result of a lookup. */
+typedef struct dt_name_index_item_t
+{
+  guint id;
+  gchar *name;
+}
+dt_name_index_item_t;
+
+/** create an index filled by query, which has to return id and name columns. */
+dt_name_index_t *dt_name_index_new(const char *query);
+void dt_name_index_destroy(dt_name_index_t *idx);
+
+/** add a name, or replace the name of an id already in the index. */
+void dt_name_index_insert(dt_name_index_t *idx, const guint id, const char *name);
+void dt_name_index_remove(dt_name_index_t *idx, const guint id);
+
+/** the table was changed in ways not tracked above, refill from the database on next use. */
+void dt_name_index_invalidate(dt_name_index_t *idx);
+
+/** name of id as a newly allocated string, NULL if it's not in the index. */
+gchar *dt_name_index_get_name(dt_name_index_t *idx, const guint id);
+
+/** all names matching pattern, with the semantics of sqlite's `name like pattern'
+ *  (% and _ wildcards, ascii case insensitive). returns a list of dt_name_index_item_t
+ *  in no particular order, free it with dt_name_index_free_result(). */
+GList *dt_name_index_like(dt_name_index_t *idx, const char *pattern);
+
+void dt_name_index_free_result(GList *result);
+
+#endif
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -0,0 +1,171 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#include <pthread.h>
+#endif
+
+#include "common/numa.h"
+#include "common/darktable.h"
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+
+// cpus listed like 0-7,16-23 which we are allowed to run on, into a newly allocated array.
+static int
+_parse_cpulist(const char *list, const cpu_set_t *allowed, int **cpus)
+{
+  int num = 0;
+  *cpus = (int *)malloc(sizeof(int)*CPU_SETSIZE);
+  const char *c = list;
+  while(*c >= '0' && *c <= '9')
+  {
+    char *end;
+    const int first = strtol(c, &end, 10);
+    int last = first;
+    if(*end == '-') last = strtol(end + 1, &end, 10);
+    for(int k=first; k<=last && k<CPU_SETSIZE; k++)
+      if(CPU_ISSET(k, allowed)) (*cpus)[num++] = k;
+    c = (*end == ',') ? end + 1 : end;
+  }
+  return num;
+}
+
+dt_numa_t *
+dt_numa_init()
+{
+  cpu_set_t allowed;
+  if(sched_getaffinity(0, sizeof(allowed), &allowed)) return NULL;
+
+  GDir *dir = g_dir_open("/sys/devices/system/node", 0, NULL);
+  if(!dir) return NULL;
+  dt_numa_t *numa = (dt_numa_t *)malloc(sizeof(dt_numa_t));
+  numa->num_nodes = 0;
+  numa->num_cpus = NULL;
+  numa->cpus = NULL;
+  const gchar *name;
+  while((name = g_dir_read_name(dir)))
+  {
+    if(strncmp(name, "node", 4) || name[4] < '0' || name[4] > '9') continue;
+    gchar *filename = g_strdup_printf("/sys/devices/system/node/%s/cpulist", name);
+    gchar *list = NULL;
+    if(g_file_get_contents(filename, &list, NULL, NULL))
+    {
+      int *cpus;
+      const int num = _parse_cpulist(list, &allowed, &cpus);
+      if(num > 0)
+      {
+        // memory only nodes and the ones we're not allowed on don't count
+        numa->num_cpus = (int *)realloc(numa->num_cpus, sizeof(int)*(numa->num_nodes+1));
+        numa->cpus = (int **)realloc(numa->cpus, sizeof(int *)*(numa->num_nodes+1));
+        numa->num_cpus[numa->num_nodes] = num;
+        numa->cpus[numa->num_nodes] = cpus;
+        numa->num_nodes++;
+      }
+      else free(cpus);
+      g_free(list);
+    }
+    g_free(filename);
+  }
+  g_dir_close(dir);
+
+  numa->num_allowed = 0;
+  numa->allowed = (int *)malloc(sizeof(int)*CPU_COUNT(&allowed));
+  for(int k=0; k<CPU_SETSIZE; k++)
+    if(CPU_ISSET(k, &allowed)) numa->allowed[numa->num_allowed++] = k;
+
+  if(numa->num_nodes < 2)
+  {
+    dt_numa_cleanup(numa);
+    return NULL;
+  }
+  for(int n=0; n<numa->num_nodes; n++)
+    dt_print(DT_DEBUG_CONTROL, "[numa] node %d: %d cpus\n", n, numa->num_cpus[n]);
+  return numa;
+}
+
+void
+dt_numa_cleanup(dt_numa_t *numa)
+{
+  if(!numa) return;
+  for(int n=0; n<numa->num_nodes; n++) free(numa->cpus[n]);
+  free(numa->cpus);
+  free(numa->num_cpus);
+  free(numa->allowed);
+  free(numa);
+}
+
+static int
+_set_affinity(const int *cpus, const int num)
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for(int k=0; k<num; k++) CPU_SET(cpus[k], &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+int
+dt_numa_bind_thread(const dt_numa_t *numa, const int node)
+{
+  if(!numa || node < 0 || node >= numa->num_nodes) return 1;
+  return _set_affinity(numa->cpus[node], numa->num_cpus[node]);
+}
+
+void
+dt_numa_unbind_thread(const dt_numa_t *numa)
+{
+  if(!numa) return;
+  _set_affinity(numa->allowed, numa->num_allowed);
+}
+
+#else
+
+dt_numa_t *
+dt_numa_init()
+{
+  return NULL;
+}
+
+void
+dt_numa_cleanup(dt_numa_t *numa)
+{
+}
+
+int
+dt_numa_bind_thread(const dt_numa_t *numa, const int node)
+{
+  return 1;
+}
+
+void
+dt_numa_unbind_thread(const dt_numa_t *numa)
+{
+}
+
+#endif
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -0,0 +1,50 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef DT_COMMON_NUMA_H
+#define DT_COMMON_NUMA_H
+
+/**
+ * numa nodes and their cpus, as far as this process may run on them.
+ *
+ * there is no placement api here: linux puts a page on the node of the
+ * thread touching it first, so a thread bound to a node gets its freshly
+ * allocated buffers there as well.
+ */
+typedef struct dt_numa_t
+{
+  int num_nodes;
+  int *num_cpus;    // per node
+  int **cpus;       // per node, the cpu numbers
+  int num_allowed;  // the cpus we were started on, to undo a binding
+  int *allowed;
+}
+dt_numa_t;
+
+/** read the topology, NULL if there is only one node or we can't tell (everything but linux). */
+dt_numa_t *dt_numa_init();
+void dt_numa_cleanup(dt_numa_t *numa);
+
+/** restrict the calling thread to the cpus of node. returns 0 on success. */
+int dt_numa_bind_thread(const dt_numa_t *numa, const int node);
+/** let the calling thread run on all cpus of the process again. */
+void dt_numa_unbind_thread(const dt_numa_t *numa);
+
+#endif
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -373,18 +373,72 @@ dt_styles_create_from_image (const char *name,const char *description,int32_t im
 void
 dt_styles_apply_to_selection(const char *name,gboolean duplicate)
 {
-  gboolean selected = FALSE;
-  /* for each selected image apply style */
+  const int id = dt_styles_get_id_by_name(name);
+  if (id == 0) return;
+
+  /* apply style to all selected images at once */
   sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "select * from selected_images", -1, &stmt, NULL);
+  dt_history_paste_targets_begin();
+  if (duplicate)
+  {
+    /* the duplicates start out with the history of their original */
+    GList *imgs = NULL;
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "select imgid from selected_images", -1, &stmt, NULL);
+    while(sqlite3_step(stmt) == SQLITE_ROW)
+      imgs = g_list_prepend(imgs, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
+    sqlite3_finalize(stmt);
+
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "insert into memory.paste_targets (imgid, srcid, offs) values (?1, ?2, 0)", -1, &stmt, NULL);
+    for(GList *l = imgs; l; l = g_list_next(l))
+    {
+      const int32_t imgid = GPOINTER_TO_INT(l->data);
+      const int32_t newimgid = dt_image_duplicate(imgid);
+      if (newimgid == -1) continue;
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newimgid);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, imgid);
+      sqlite3_step(stmt);
+      sqlite3_reset(stmt);
+      sqlite3_clear_bindings(stmt);
+    }
+    sqlite3_finalize(stmt);
+    g_list_free(imgs);
+    dt_history_copy_on_paste_targets(NULL);
+  }
+  else
+  {
+    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
+                          "insert into memory.paste_targets (imgid, srcid, offs) select imgid, imgid, 0 from selected_images",
+                          NULL, NULL, NULL);
+  }
+
+  /* merge onto history stacks, let's find history offset in destination images */
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
+                        "update memory.paste_targets set offs = (select ifnull(MAX(num)+1, 0) from history where history.imgid = paste_targets.imgid)",
+                        NULL, NULL, NULL);
+
+  /* copy history items from styles onto images */
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "insert into history (imgid,num,module,operation,op_params,enabled,blendop_params,blendop_version,multi_priority,multi_name) select t.imgid, s.num+t.offs, s.module, s.operation, s.op_params, s.enabled, s.blendop_params, s.blendop_version, s.multi_priority, s.multi_name from memory.paste_targets t join style_items s on s.styleid=?1", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
+  sqlite3_step (stmt);
+  sqlite3_finalize (stmt);
+
+  /* add tag */
+  gboolean selected = FALSE;
+  guint tagid=0;
+  gchar ntag[512]= {0};
+  g_snprintf(ntag,512,"darktable|style|%s",name);
+  const gboolean tagged = dt_tag_new(ntag,&tagid);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "select imgid from memory.paste_targets", -1, &stmt, NULL);
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
-    int imgid = sqlite3_column_int (stmt, 0);
-    dt_styles_apply_to_image (name,duplicate,imgid);
+    if (tagged) dt_tag_attach(tagid, sqlite3_column_int(stmt, 0));
     selected = TRUE;
   }
   sqlite3_finalize(stmt);
 
+  /* commit, update thumbnails, darkroom and xmp files */
+  dt_history_paste_targets_finish();
+
   if (!selected)
     dt_control_log(_("no image selected!"));
 }
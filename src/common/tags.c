@@ -20,6 +20,7 @@
 #include "common/darktable.h"
 #include "common/tags.h"
 #include "common/debug.h"
+#include "common/name_index.h"
 #include "control/conf.h"
 #include "control/control.h"
 
@@ -71,6 +72,8 @@ gboolean dt_tag_new(const char *name,guint *tagid)
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
 
+  dt_name_index_insert(darktable.tag_index, id, name);
+
   if( tagid != NULL)
     *tagid=id;
 
@@ -118,6 +121,8 @@ guint dt_tag_remove(const guint tagid, gboolean final)
     sqlite3_step(stmt);
     sqlite3_finalize(stmt);
 
+    dt_name_index_remove(darktable.tag_index, tagid);
+
     /* raise signal of tags change to refresh keywords module */
     dt_control_signal_raise(darktable.signals, DT_SIGNAL_TAG_CHANGED);
 
@@ -164,6 +169,7 @@ void dt_tag_reorganize(const gchar *source, const gchar *dest)
              source, dest, tag, source);
 
   DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), query, NULL, NULL, NULL);
+  dt_name_index_invalidate(darktable.tag_index);
 
   /* raise signal of tags change to refresh keywords module */
   //dt_control_signal_raise(darktable.signals, DT_SIGNAL_TAG_CHANGED);
@@ -475,7 +481,6 @@ gchar *dt_tag_get_hierarchical(gint imgid, const gchar *separator)
 uint32_t dt_tag_get_suggestions(const gchar *keyword, GList **result)
 {
   sqlite3_stmt *stmt;
-  char query[1024];
   /*
    * Earlier versions of this function used a large collation of selects
    * and joins, resulting in multi-*second* timings for sqlite3_exec().
@@ -484,6 +489,9 @@ uint32_t dt_tag_get_suggestions(const gchar *keyword, GList **result)
    * execution engine to work more effectively, which is very important
    * for interactive response since we call this function several times
    * in quick succession (on every keystroke).
+   *
+   * The tag names are matched against the in-memory index instead of
+   * scanning the tags table, only the tag co-occurrences come from sqlite.
    */
 
   /* Quick sanity check - is keyword empty? If so .. return 0 */
@@ -491,12 +499,23 @@ uint32_t dt_tag_get_suggestions(const gchar *keyword, GList **result)
     return 0;
 
   /* SELECT T.id FROM tags T WHERE T.name LIKE '%%%s%%';  --> into temp table */
-  memset(query, 0, sizeof(query));
-  snprintf(query, sizeof(query),
-           "INSERT INTO memory.tagq (id) SELECT id FROM tags T WHERE "
-           "T.name LIKE '%%%s%%' ", keyword);
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), query,
-                        NULL, NULL, NULL);
+  gchar *pattern = g_strdup_printf("%%%s%%", keyword);
+  GList *matches = dt_name_index_like(darktable.tag_index, pattern);
+  g_free(pattern);
+  if(!matches)
+    return 0;
+
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT INTO memory.tagq (id) VALUES (?1)", -1, &stmt, NULL);
+  for(GList *m = matches; m; m = g_list_next(m))
+  {
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, ((dt_name_index_item_t *)m->data)->id);
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+  }
+  sqlite3_finalize(stmt);
+  dt_name_index_free_result(matches);
 
   /*
    * SELECT TXT.id2 FROM tagxtag TXT WHERE TXT.id1 IN (temp table)
@@ -522,12 +541,9 @@ uint32_t dt_tag_get_suggestions(const gchar *keyword, GList **result)
                         "ORDER BY TXT.count DESC",
                         NULL, NULL, NULL);
 
-  /* Now put all the bits together */
+  /* Now put all the bits together, the names come from the index */
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT T.name, T.id, MT.count FROM tags T JOIN memory.taglist MT ON "
-                              "MT.id = T.id WHERE T.id in "
-                              "(SELECT DISTINCT(MT.id) FROM memory.taglist MT) "
-                              "AND T.name NOT LIKE 'darktable|%%' ORDER BY T.id ASC",
+                              "SELECT DISTINCT(id) FROM memory.taglist ORDER BY id ASC",
                               -1, &stmt, NULL);
 
   /* ... and create the result list to send upwards */
@@ -535,9 +551,16 @@ uint32_t dt_tag_get_suggestions(const gchar *keyword, GList **result)
   dt_tag_t *t;
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
+    const guint id = sqlite3_column_int(stmt, 0);
+    gchar *name = dt_name_index_get_name(darktable.tag_index, id);
+    if(!name || g_str_has_prefix(name, "darktable|"))
+    {
+      g_free(name);
+      continue;
+    }
     t = g_malloc(sizeof(dt_tag_t));
-    t->tag = g_strdup((char *)sqlite3_column_text(stmt, 0));
-    t->id = sqlite3_column_int(stmt, 1);
+    t->tag = name;
+    t->id = id;
     *result = g_list_append((*result),t);
     count++;
   }
@@ -189,6 +189,9 @@ static void dt_control_sanitize_database()
                         "operation varchar(256) UNIQUE ON CONFLICT REPLACE, op_params blob, enabled integer, "
                         "blendop_params blob, blendop_version integer, multi_priority integer, multi_name varchar(256))",
                         NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
+                        "CREATE TABLE memory.paste_targets (imgid INTEGER PRIMARY KEY, srcid INTEGER, offs INTEGER)",
+                        NULL, NULL, NULL);
 
   // create a table legacy_presets with all the presets from pre-auto-apply-cleanup darktable.
   dt_legacy_presets_create();
@@ -449,6 +452,11 @@ void dt_control_create_database_schema()
   DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
                         "create table meta_data (id integer,key integer,value varchar)",
                         NULL, NULL, NULL);
+  // last sidecar written for each image, to skip writing it again unchanged
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
+                        "create table xmp_hashes (imgid integer primary key, filename varchar, "
+                        "hash char(40), mtime integer, size integer)",
+                        NULL, NULL, NULL);
   // quick hack to detect if the db is already used by another process
   DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
                         "create table lock (id integer)",
@@ -607,6 +615,10 @@ void dt_control_init(dt_control_t *s)
       sqlite3_exec(dt_database_get(darktable.db),
                    "create table meta_data (id integer, key integer,value varchar)",
                    NULL, NULL, NULL);
+      sqlite3_exec(dt_database_get(darktable.db),
+                   "create table xmp_hashes (imgid integer primary key, filename varchar, "
+                   "hash char(40), mtime integer, size integer)",
+                   NULL, NULL, NULL);
       // quick hack to detect if the db is already used by another process
       sqlite3_exec(dt_database_get(darktable.db),
                    "create table lock (id integer)",
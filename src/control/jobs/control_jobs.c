@@ -21,12 +21,15 @@
 #include "common/image.h"
 #include "common/image_cache.h"
 #include "common/mipmap_cache.h"
+#include "common/mipmap_regen.h"
+#include "common/numa.h"
 #include "common/imageio.h"
 #include "common/imageio_dng.h"
 #include "common/exif.h"
 #include "common/film.h"
 #include "common/history.h"
 #include "common/imageio_module.h"
+#include "common/imageio_writer.h"
 #include "common/debug.h"
 #include "common/tags.h"
 #include "common/debug.h"
@@ -67,26 +70,128 @@ void dt_control_write_sidecar_files_job_init(dt_job_t *job)
   dt_control_image_enumerator_job_selected_init(t);
 }
 
+void dt_control_write_sidecar_files_list(GList *imgs)
+{
+  dt_job_t j;
+  dt_control_job_init(&j, "write sidecar files");
+  j.execute = &dt_control_write_sidecar_files_job_run;
+  dt_control_image_enumerator_t *t = (dt_control_image_enumerator_t *)j.param;
+  t->index = imgs;
+  dt_control_add_job(darktable.control, &j);
+}
+
 int32_t dt_control_write_sidecar_files_job_run(dt_job_t *job)
 {
-  long int imgid = -1;
   dt_control_image_enumerator_t *t1 = (dt_control_image_enumerator_t *)job->param;
   GList *t = t1->index;
-  while(t)
+  const int total = g_list_length(t);
+  int *imgs = (int *)malloc(sizeof(int)*total);
+  int n = 0;
+  for(GList *l = t; l; l = g_list_next(l)) imgs[n++] = (long int)l->data;
+  g_list_free(t);
+  t1->index = NULL;
+  dt_image_write_sidecar_files(imgs, total);
+  free(imgs);
+  return 0;
+}
+
+
+// decode stage of the export and hdr merge jobs: a thread loading the full buffers
+// of the next images while the current ones are processed. it keeps at most `depth'
+// images ahead of the consumers, which bounds the memory held on top of one buffer
+// per consumer.
+typedef struct dt_control_prefetch_t
+{
+  dt_pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  pthread_t thread;
+  const uint32_t *imgs;
+  dt_mipmap_buffer_t *bufs;
+  int total;
+  int depth;
+  int decoded;  // images [0, decoded) have been loaded
+  int taken;    // images [0, taken) have been handed out
+  int stop;
+}
+dt_control_prefetch_t;
+
+static void *
+_prefetch_work(void *ptr)
+{
+  dt_control_prefetch_t *p = (dt_control_prefetch_t *)ptr;
+  for(int k=0; k<p->total; k++)
   {
-    imgid = (long int)t->data;
-    const dt_image_t *img = dt_image_cache_read_get(darktable.image_cache, (int32_t)imgid);
-    char dtfilename[DT_MAX_PATH_LEN+4];
-    dt_image_full_path(img->id, dtfilename, DT_MAX_PATH_LEN);
-    char *c = dtfilename + strlen(dtfilename);
-    sprintf(c, ".xmp");
-    dt_exif_xmp_write(imgid, dtfilename);
-    dt_image_cache_read_release(darktable.image_cache, img);
-    t = g_list_delete_link(t, t);
+    dt_pthread_mutex_lock(&p->mutex);
+    while(!p->stop && k >= p->taken + p->depth)
+      dt_pthread_cond_wait(&p->cond, &p->mutex);
+    const int stop = p->stop;
+    dt_pthread_mutex_unlock(&p->mutex);
+    if(stop) break;
+
+    // a pipe will ask for the same buffer again and find it in the cache:
+    dt_mipmap_cache_read_get(darktable.mipmap_cache, &p->bufs[k], p->imgs[k], DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING);
+
+    dt_pthread_mutex_lock(&p->mutex);
+    p->decoded = k+1;
+    pthread_cond_broadcast(&p->cond);
+    dt_pthread_mutex_unlock(&p->mutex);
   }
-  return 0;
+  return NULL;
 }
 
+static void
+_prefetch_start(dt_control_prefetch_t *p, const uint32_t *imgs, const int total, const int depth)
+{
+  dt_pthread_mutex_init(&p->mutex, NULL);
+  pthread_cond_init(&p->cond, NULL);
+  p->imgs = imgs;
+  p->bufs = (dt_mipmap_buffer_t *)calloc(MAX(1, total), sizeof(dt_mipmap_buffer_t));
+  p->total = total;
+  p->depth = depth;
+  p->decoded = p->taken = 0;
+  p->stop = 0;
+  pthread_create(&p->thread, NULL, _prefetch_work, p);
+}
+
+// hand out the next image, -1 if there is none. waits for the decoder.
+static int
+_prefetch_take(dt_control_prefetch_t *p)
+{
+  dt_pthread_mutex_lock(&p->mutex);
+  const int k = p->taken < p->total ? p->taken++ : -1;
+  pthread_cond_broadcast(&p->cond);
+  while(k >= 0 && !p->stop && p->decoded <= k)
+    dt_pthread_cond_wait(&p->cond, &p->mutex);
+  dt_pthread_mutex_unlock(&p->mutex);
+  return k;
+}
+
+static void
+_prefetch_release(dt_control_prefetch_t *p, const int k)
+{
+  dt_pthread_mutex_lock(&p->mutex);
+  const int loaded = k < p->decoded;
+  dt_pthread_mutex_unlock(&p->mutex);
+  if(loaded) dt_mipmap_cache_read_release(darktable.mipmap_cache, &p->bufs[k]);
+}
+
+// stop the decoder and drop what it loaded for images nobody will take any more
+// (cancelled job, error), then clean up.
+static void
+_prefetch_stop(dt_control_prefetch_t *p)
+{
+  dt_pthread_mutex_lock(&p->mutex);
+  p->stop = 1;
+  pthread_cond_broadcast(&p->cond);
+  dt_pthread_mutex_unlock(&p->mutex);
+  pthread_join(p->thread, NULL);
+  for(int k=p->taken; k<p->decoded; k++)
+    dt_mipmap_cache_read_release(darktable.mipmap_cache, &p->bufs[k]);
+  free(p->bufs);
+  p->bufs = NULL;
+  pthread_cond_destroy(&p->cond);
+  dt_pthread_mutex_destroy(&p->mutex);
+}
 
 static float
 envelope(const float xx)
@@ -109,29 +214,46 @@ envelope(const float xx)
   }
 }
 
+// rows per tile in the hdr merge. the raws are scanned, merged and written out in
+// tiles of this many rows, spread over the threads.
+#define DT_MERGE_HDR_TILE_ROWS 64
+
 int32_t dt_control_merge_hdr_job_run(dt_job_t *job)
 {
-  long int imgid = -1;
   dt_control_image_enumerator_t *t1 = (dt_control_image_enumerator_t *)job->param;
   GList *t = t1->index;
-  int total = g_list_length(t);
+  const int num = g_list_length(t);
+  int total = num;
   char message[512]= {0};
   double fraction=0;
   snprintf(message, 512, ngettext ("merging %d image", "merging %d images", total), total );
 
   const guint *jid = dt_control_backgroundjobs_create(darktable.control, 1, message);
 
+  uint32_t *imgs = (uint32_t *)malloc(sizeof(uint32_t)*MAX(1, num));
+  int n = 0;
+  for(GList *l = t; l; l = g_list_next(l)) imgs[n++] = (long int)l->data;
+  g_list_free(t);
+  t1->index = NULL;
+
+  // decode the next bracket while the current one is merged. this holds at most
+  // two raw buffers on top of the accumulation buffers.
+  dt_control_prefetch_t prefetch;
+  _prefetch_start(&prefetch, imgs, num, 1);
+
   float *pixels = NULL;
   float *weight = NULL;
-  int wd = 0, ht = 0, first_imgid = -1;
+  uint16_t *tile_max = NULL;
+  int wd = 0, ht = 0, tiles = 0, first_imgid = -1;
   uint32_t filter = 0;
   float whitelevel = 0.0f;
   total ++;
-  while(t)
+  while(1)
   {
-    imgid = (long int)t->data;
-    dt_mipmap_buffer_t buf;
-    dt_mipmap_cache_read_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING);
+    const int k = _prefetch_take(&prefetch);
+    if(k < 0) break;
+    const uint32_t imgid = imgs[k];
+    const dt_mipmap_buffer_t *buf = &prefetch.bufs[k];
     // just take a copy. also do it after blocking read, so filters and bpp will make sense.
     const dt_image_t *img = dt_image_cache_read_get(darktable.image_cache, imgid);
     dt_image_t image = *img;
@@ -139,37 +261,33 @@ int32_t dt_control_merge_hdr_job_run(dt_job_t *job)
     if(image.filters == 0 || image.bpp != sizeof(uint16_t))
     {
       dt_control_log(_("exposure bracketing only works on raw images"));
-      dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
-      free(pixels);
-      free(weight);
+      _prefetch_release(&prefetch, k);
       goto error;
     }
-    filter = dt_image_flipped_filter(img);
-    if(buf.size != DT_MIPMAP_FULL)
+    filter = dt_image_flipped_filter(&image);
+    if(buf->size != DT_MIPMAP_FULL)
     {
       dt_control_log(_("failed to get raw buffer from image `%s'"), image.filename);
-      dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
-      free(pixels);
-      free(weight);
+      _prefetch_release(&prefetch, k);
       goto error;
     }
 
     if(!pixels)
     {
       first_imgid = imgid;
-      pixels = (float *)malloc(sizeof(float)*image.width*image.height);
-      weight = (float *)malloc(sizeof(float)*image.width*image.height);
-      memset(pixels, 0x0, sizeof(float)*image.width*image.height);
-      memset(weight, 0x0, sizeof(float)*image.width*image.height);
       wd = image.width;
       ht = image.height;
+      tiles = (ht + DT_MERGE_HDR_TILE_ROWS - 1)/DT_MERGE_HDR_TILE_ROWS;
+      pixels = (float *)dt_alloc_align(64, sizeof(float)*wd*ht);
+      weight = (float *)dt_alloc_align(64, sizeof(float)*wd*ht);
+      tile_max = (uint16_t *)malloc(sizeof(uint16_t)*tiles);
+      memset(pixels, 0x0, sizeof(float)*wd*ht);
+      memset(weight, 0x0, sizeof(float)*wd*ht);
     }
     else if(image.width != wd || image.height != ht)
     {
       dt_control_log(_("images have to be of same size!"));
-      free(pixels);
-      free(weight);
-      dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
+      _prefetch_release(&prefetch, k);
       goto error;
     }
     // if no valid exif data can be found, assume peleng fisheye at f/16, 8mm, with half of the light lost in the system => f/22
@@ -182,50 +300,54 @@ int32_t dt_control_merge_hdr_job_run(dt_job_t *job)
     const float cal = 100.0f/(aperture*exp*iso);
     // about proportional to how many photons we can expect from this shot:
     const float photoncnt = 100.0f*aperture*exp/iso;
+    const uint16_t *const in = (const uint16_t *)buf->buf;
     // stupid, but we don't know the real sensor saturation level:
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static) default(none) shared(tile_max, wd, ht, tiles)
+#endif
+    for(int tile=0; tile<tiles; tile++)
+    {
+      const size_t beg = (size_t)tile*DT_MERGE_HDR_TILE_ROWS*wd;
+      const size_t end = (size_t)MIN(ht, (tile+1)*DT_MERGE_HDR_TILE_ROWS)*wd;
+      uint16_t m = 0;
+      for(size_t j=beg; j<end; j++) m = MAX(m, in[j]);
+      tile_max[tile] = m;
+    }
     uint16_t saturation = 0;
-    for(int k=0; k<wd*ht; k++)
-      saturation = MAX(saturation, ((uint16_t *)buf.buf)[k]);
+    for(int tile=0; tile<tiles; tile++)
+      saturation = MAX(saturation, tile_max[tile]);
     // seems to be around 64500--64700 for 5dm2
     // fprintf(stderr, "saturation: %u\n", saturation);
     whitelevel = fmaxf(whitelevel, saturation*cal);
 #ifdef _OPENMP
-    #pragma omp parallel for schedule(static) default(none) shared(buf, pixels, weight, wd, ht, saturation)
+    #pragma omp parallel for schedule(static) default(none) shared(pixels, weight, wd, ht, tiles, saturation)
 #endif
-    for(int k=0; k<wd*ht; k++)
+    for(int tile=0; tile<tiles; tile++)
     {
-      const uint16_t in = ((uint16_t *)buf.buf)[k];
-      // weights based on siggraph 12 poster
-      // zijian zhu, zhengguo li, susanto rahardja, pasi fraenti
-      // 2d denoising factor for high dynamic range imaging
-      float w = envelope(in/(float)saturation) * photoncnt;
-      // in case we are black and drop to zero weight, give it something
-      // just so numerics don't collapse. blown out whites are handled below.
-      if(w < 1e-3f && in < saturation/3) w = 1e-3f;
-      pixels[k] += w * in * cal;
-      weight[k] += w;
+      const size_t beg = (size_t)tile*DT_MERGE_HDR_TILE_ROWS*wd;
+      const size_t end = (size_t)MIN(ht, (tile+1)*DT_MERGE_HDR_TILE_ROWS)*wd;
+      for(size_t j=beg; j<end; j++)
+      {
+        // weights based on siggraph 12 poster
+        // zijian zhu, zhengguo li, susanto rahardja, pasi fraenti
+        // 2d denoising factor for high dynamic range imaging
+        float w = envelope(in[j]/(float)saturation) * photoncnt;
+        // in case we are black and drop to zero weight, give it something
+        // just so numerics don't collapse. blown out whites are handled below.
+        if(w < 1e-3f && in[j] < saturation/3) w = 1e-3f;
+        pixels[j] += w * in[j] * cal;
+        weight[j] += w;
+      }
     }
 
-    t = g_list_delete_link(t, t);
-
     /* update backgroundjob ui plate */
     fraction+=1.0/total;
     dt_control_backgroundjobs_progress(darktable.control, jid, fraction);
 
-    dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
-  }
-  // normalize by white level to make clipping at 1.0 work as expected (to be sure, scale down one more stop, thus the 0.5):
-#ifdef _OPENMP
-  #pragma omp parallel for schedule(static) default(none) shared(pixels, wd, ht, weight, whitelevel)
-#endif
-  for(int k=0; k<wd*ht; k++)
-  {
-    // in case w == 0, all pixels were overexposed (too dark would have been clamped to w >= eps above)
-    if(weight[k] < 1e-3f)
-      pixels[k] = 1.f; // mark as blown out.
-    else // normalize:
-      pixels[k] = fmaxf(0.0f, pixels[k]/(whitelevel*weight[k]));
+    _prefetch_release(&prefetch, k);
   }
+  _prefetch_stop(&prefetch);
+  if(!pixels) goto cleanup;
 
   // output hdr as digital negative with exif data.
   uint8_t exif[65535];
@@ -236,7 +358,41 @@ int32_t dt_control_merge_hdr_job_run(dt_job_t *job)
   char *c = pathname + strlen(pathname);
   while(*c != '.' && c > pathname) c--;
   g_strlcpy(c, "-hdr.dng", sizeof(pathname)-(c-pathname));
-  dt_imageio_write_dng(pathname, pixels, wd, ht, exif, exif_len, filter, 1.0f);
+
+  // normalize by white level to make clipping at 1.0 work as expected (to be sure, scale down one more stop, thus the 0.5),
+  // and stream the result to disk tile by tile.
+  FILE *f = dt_imageio_dng_open(pathname, wd, ht, filter, 1.0f);
+  if(!f)
+  {
+    dt_control_log(_("failed to write `%s'"), pathname);
+    goto cleanup;
+  }
+  int write_error = 0;
+  for(int tile=0; tile<tiles && !write_error; tile++)
+  {
+    const int row = tile*DT_MERGE_HDR_TILE_ROWS;
+    const int rows = MIN(ht - row, DT_MERGE_HDR_TILE_ROWS);
+    float *const out = pixels + (size_t)row*wd;
+    const float *const w = weight + (size_t)row*wd;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static) default(none) shared(wd, whitelevel)
+#endif
+    for(int j=0; j<rows*wd; j++)
+    {
+      // in case w == 0, all pixels were overexposed (too dark would have been clamped to w >= eps above)
+      if(w[j] < 1e-3f)
+        out[j] = 1.f; // mark as blown out.
+      else // normalize:
+        out[j] = fmaxf(0.0f, out[j]/(whitelevel*w[j]));
+    }
+    write_error = dt_imageio_dng_write_rows(f, out, wd, rows);
+  }
+  dt_imageio_dng_close(f, pathname, exif, exif_len);
+  if(write_error)
+  {
+    dt_control_log(_("failed to write `%s'"), pathname);
+    goto cleanup;
+  }
 
   dt_control_backgroundjobs_progress(darktable.control, jid, 1.0f);
 
@@ -249,10 +405,15 @@ int32_t dt_control_merge_hdr_job_run(dt_job_t *job)
   const int filmid = dt_film_new(&film, directory);
   dt_image_import(filmid, pathname, TRUE);
   g_free (directory);
+  goto cleanup;
 
+error:
+  _prefetch_stop(&prefetch);
+cleanup:
   free(pixels);
   free(weight);
-error:
+  free(tile_max);
+  free(imgs);
   dt_control_backgroundjobs_destroy(darktable.control, jid);
   dt_control_queue_redraw_center();
   return 0;
@@ -899,7 +1060,6 @@ int32_t dt_control_copy_images_job_run(dt_job_t *job)
 
 static int32_t dt_control_export_job_run(dt_job_t *job)
 {
-  long int imgid = -1;
   dt_control_image_enumerator_t *t1 = (dt_control_image_enumerator_t *)job->param;
   dt_control_export_t *settings = (dt_control_export_t*)t1->data;
   GList *t = t1->index;
@@ -938,20 +1098,61 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
   dt_control_backgroundjobs_set_cancellable(darktable.control, jid, job);
   const dt_control_t *control = darktable.control;
 
-  double fraction=0;
-#ifdef _OPENMP
+  // leave the cores to the export, thumbnails are rendered again afterwards:
+  dt_mipmap_regen_pause(darktable.mipmap_regen);
+
   // limit this to num threads = num full buffers - 1 (keep one for darkroom mode)
   // use min of user request and mipmap cache entries
   const int full_entries = dt_conf_get_int ("parallel_export");
-  // GCC won't accept that this variable is used in a macro, considers
-  // it set but not used, which makes for instance Fedora break.
-  const __attribute__((__unused__)) int num_threads = MAX(1, MIN(full_entries, 8));
+  const int num_threads = MAX(1, MIN(full_entries, 8));
+
+  // the export runs in three stages: one thread decoding ahead (bounded by the
+  // two extra full buffers the mipmap cache keeps for it), num_threads pixelpipes,
+  // and encoder threads taking the processed images from a queue as long as there
+  // are pipes. storages which need the file right away write synchronously.
+  uint32_t *imgs = (uint32_t *)malloc(sizeof(uint32_t)*total);
+  int n = 0;
+  for(GList *l = t; l; l = g_list_next(l)) imgs[n++] = (long int)l->data;
+  g_list_free(t);
+  t1->index = NULL;
+
+  dt_control_prefetch_t prefetch;
+  _prefetch_start(&prefetch, imgs, total, 2);
+
+  struct dt_imageio_writer_t *writer = dt_imageio_writer_new(num_threads, num_threads);
+
+  // on multi socket machines, spread the pipes over the numa nodes. a single pipe
+  // keeps all cores instead.
+#ifdef _OPENMP
+  const dt_numa_t *const numa = (num_threads > 1 && dt_conf_get_bool("numa_export")) ? darktable.numa : NULL;
+#endif
+
+  double fraction=0;
+#ifdef _OPENMP
 #if !defined(__SUNOS__) && !defined(__NetBSD__)
-  #pragma omp parallel default(none) private(imgid) shared(control, fraction, w, h, stderr, mformat, mstorage, t, sdata, job, jid, darktable, settings) num_threads(num_threads) if(num_threads > 1)
+  #pragma omp parallel default(none) shared(control, fraction, w, h, stderr, mformat, mstorage, imgs, prefetch, sdata, job, jid, darktable, settings, writer) num_threads(num_threads) if(num_threads > 1)
 #else
-  #pragma omp parallel private(imgid) shared(control, fraction, w, h, mformat, mstorage, t, sdata, job, jid, darktable, settings) num_threads(num_threads) if(num_threads > 1)
+  #pragma omp parallel shared(control, fraction, w, h, mformat, mstorage, imgs, prefetch, sdata, job, jid, darktable, settings, writer) num_threads(num_threads) if(num_threads > 1)
 #endif
   {
+    // bind this pipe to its node before it allocates anything, the buffers end up
+    // there on first touch. its modules get the node's cores, shared with the
+    // other pipes on the same node.
+    int numa_node = -1;
+    if(numa)
+    {
+      const int pipe = omp_get_thread_num(), pipes = omp_get_num_threads();
+      numa_node = pipe % numa->num_nodes;
+      if(dt_numa_bind_thread(numa, numa_node)) numa_node = -1;
+      else
+      {
+        const int pipes_on_node = pipes / numa->num_nodes + (numa_node < pipes % numa->num_nodes);
+        const int team = MAX(1, numa->num_cpus[numa_node] / pipes_on_node);
+        omp_set_nested(1);
+        omp_set_num_threads(team);
+        dt_print(DT_DEBUG_CONTROL, "[export] pipe %d on numa node %d with %d threads\n", pipe, numa_node, team);
+      }
+    }
 #endif
     // get a thread-safe fdata struct (one jpeg struct per thread etc):
     dt_imageio_module_data_t *fdata = mformat->get_params(mformat);
@@ -960,28 +1161,19 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
     fdata->max_width = (w!=0 && fdata->max_width >w)?w:fdata->max_width;
     fdata->max_height = (h!=0 && fdata->max_height >h)?h:fdata->max_height;
     strcpy(fdata->style,settings->style);
-    int num = 0;
     // Invariant: the tagid for 'darktable|changed' will not change while this function runs. Is this a sensible assumption?
     guint tagid = 0,
           etagid = 0;
     dt_tag_new("darktable|changed",&tagid);
     dt_tag_new("darktable|exported",&etagid);
+    dt_imageio_writer_attach(writer);
 
-    while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
+    while(dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
     {
-#ifdef _OPENMP
-      #pragma omp critical
-#endif
-      {
-        if(!t)
-          imgid = 0;
-        else
-        {
-          imgid = (long int)t->data;
-          t = g_list_delete_link(t, t);
-          num = total - g_list_length(t);
-        }
-      }
+      const int k = _prefetch_take(&prefetch);
+      if(k < 0) break;
+      const uint32_t imgid = imgs[k];
+      const int num = k+1;
       // remove 'changed' tag from image
       dt_tag_detach(tagid, imgid);
       // make sure the 'exported' tag is set on the image
@@ -1005,6 +1197,7 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
           mstorage->store(mstorage,sdata, imgid, mformat, fdata, num, total, settings->high_quality);
         }
       }
+      _prefetch_release(&prefetch, k);
 #ifdef _OPENMP
       #pragma omp critical
 #endif
@@ -1013,11 +1206,15 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
         dt_control_backgroundjobs_progress(control, jid, fraction);
       }
     }
+    dt_imageio_writer_attach(NULL);
 #ifdef _OPENMP
     #pragma omp barrier
     #pragma omp master
 #endif
     {
+      _prefetch_stop(&prefetch);
+      // wait for the encoders before the storage finalizes:
+      dt_imageio_writer_destroy(writer);
       dt_control_backgroundjobs_destroy(control, jid);
       if(mstorage->finalize_store) mstorage->finalize_store(mstorage, sdata);
       mstorage->free_params(mstorage, sdata);
@@ -1025,8 +1222,12 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
     // all threads free their fdata
     mformat->free_params (mformat, fdata);
 #ifdef _OPENMP
+    // the thread goes back to the pool, let it run anywhere again:
+    if(numa_node >= 0) dt_numa_unbind_thread(numa);
   }
 #endif
+  dt_mipmap_regen_resume(darktable.mipmap_regen);
+  free(imgs);
   g_free(t1->data);
   return 0;
 }
@@ -21,112 +21,18 @@
 #include "develop/tiling.h"
 #include "develop/masks.h"
 #include "common/gaussian.h"
+#include "common/colorspaces_rows.h"
 #include "blend.h"
 
-#define CLAMP_RANGE(x,y,z)      (CLAMP(x,y,z))
-
-typedef void (_blend_row_func)(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag);
-
-static inline void _RGB_2_HSL(const float *RGB, float *HSL)
-{
-  float H, S, L;
-
-  float R = RGB[0];
-  float G = RGB[1];
-  float B = RGB[2];
-
-  float var_Min = fminf(R, fminf(G, B));
-  float var_Max = fmaxf(R, fmaxf(G, B));
-  float del_Max = var_Max - var_Min;
-
-  L = (var_Max + var_Min) / 2.0f;
-
-  if (del_Max < 1e-6f)
-  {
-    H = 0.0f;
-    S = 0.0f;
-  }
-  else
-  {
-    if (L < 0.5f) S = del_Max / (var_Max + var_Min);
-    else          S = del_Max / (2.0f - var_Max - var_Min);
-
-    float del_R = (((var_Max - R) / 6.0f) + (del_Max / 2.0f)) / del_Max;
-    float del_G = (((var_Max - G) / 6.0f) + (del_Max / 2.0f)) / del_Max;
-    float del_B = (((var_Max - B) / 6.0f) + (del_Max / 2.0f)) / del_Max;
-
-    if      (R == var_Max) H = del_B - del_G;
-    else if (G == var_Max) H = (1.0f / 3.0f) + del_R - del_B;
-    else if (B == var_Max) H = (2.0f / 3.0f) + del_G - del_R;
-    else H = 0.0f;   // make GCC happy
-
-    if (H < 0.0f) H += 1.0f;
-    if (H > 1.0f) H -= 1.0f;
-  }
-
-  HSL[0] = H;
-  HSL[1] = S;
-  HSL[2] = L;
-}
-
-
-static inline float _Hue_2_RGB(float v1, float v2, float vH)
-{
-  if (vH < 0.0f) vH += 1.0f;
-  if (vH > 1.0f) vH -= 1.0f;
-  if ((6.0f * vH) < 1.0f) return (v1 + (v2 - v1) * 6.0f * vH);
-  if ((2.0f * vH) < 1.0f) return (v2);
-  if ((3.0f * vH) < 2.0f) return (v1 + (v2 - v1) * ((2.0f / 3.0f) - vH) * 6.0f);
-  return (v1);
-}
-
-
-static inline void _HSL_2_RGB(const float *HSL, float *RGB)
-{
-  float H = HSL[0];
-  float S = HSL[1];
-  float L = HSL[2];
-
-  float var_1, var_2;
-
-  if (S < 1e-6f)
-  {
-    RGB[0] = RGB[1] = RGB[2] = L;
-  }
-  else
-  {
-    if (L < 0.5f) var_2 = L * (1.0f + S);
-    else          var_2 = (L + S) - (S * L);
-
-    var_1 = 2.0f * L - var_2;
-
-    RGB[0] = _Hue_2_RGB(var_1, var_2, H + (1.0f / 3.0f));
-    RGB[1] = _Hue_2_RGB(var_1, var_2, H);
-    RGB[2] = _Hue_2_RGB(var_1, var_2, H - (1.0f / 3.0f));
-  }
-}
-
-
-static inline void _Lab_2_LCH(const float *Lab, float *LCH)
-{
-  float var_H = atan2f(Lab[2], Lab[1]);
-
-  if (var_H > 0.0f) var_H = var_H / (2.0f*M_PI);
-  else              var_H = 1.0f - fabs(var_H) / (2.0f*M_PI);
-
-  LCH[0] = Lab[0];
-  LCH[1] = sqrtf(Lab[1]*Lab[1] + Lab[2]*Lab[2]);
-  LCH[2] = var_H;
-}
+#include <xmmintrin.h>
+#include <emmintrin.h>
 
+#define CLAMP_RANGE(x,y,z)      (CLAMP(x,y,z))
 
+/* number of pixels converted to LCh/HSL in one go, small enough to live on the stack */
+#define BLEND_BLOCK 64
 
-static inline void _LCH_2_Lab(const float *LCH, float *Lab)
-{
-  Lab[0] = LCH[0];
-  Lab[1] = cosf(2.0f*M_PI*LCH[2]) * LCH[1];
-  Lab[2] = sinf(2.0f*M_PI*LCH[2]) * LCH[1];
-}
+typedef void (_blend_row_func)(const float *a, float *b, const float *mask, int stride, int flag);
 
 static inline void _CLAMP_XYZ(float *XYZ, const float *min, const float *max)
 {
@@ -144,7 +50,10 @@ static inline void _PX_COPY(const float *src, float *dst)
 
 
 
-static inline float _blendif_factor(dt_iop_colorspace_type_t cst,const float *input, const float *output, const unsigned int blendif, const float *parameters, 
+/* LCH_input/LCH_output (or HSL_input/HSL_output in rgb) are the converted pixels, only needed
+   if the LCh/HSL sliders are in use (blendif & 0x7f00). */
+static inline float _blendif_factor(dt_iop_colorspace_type_t cst,const float *input, const float *output,
+           const float *conv_input, const float *conv_output, const unsigned int blendif, const float *parameters,
            const unsigned int mask_mode, const unsigned int mask_combine)
 {
   float result = 1.0f;
@@ -165,10 +74,8 @@ static inline float _blendif_factor(dt_iop_colorspace_type_t cst,const float *in
 
       if(blendif & 0x7f00)  // do we need to consider LCh ?
       {
-        float LCH_input[3];
-        float LCH_output[3];
-        _Lab_2_LCH(input, LCH_input);
-        _Lab_2_LCH(output, LCH_output);
+        const float *LCH_input = conv_input;
+        const float *LCH_output = conv_output;
 
         scaled[DEVELOP_BLENDIF_C_in] = CLAMP_RANGE(LCH_input[1] / (128.0f*sqrtf(2.0f)), 0.0f, 1.0f);			        // C scaled to 0..1
         scaled[DEVELOP_BLENDIF_h_in] = CLAMP_RANGE(LCH_input[2], 0.0f, 1.0f);		          // h scaled to 0..1
@@ -192,10 +99,8 @@ static inline float _blendif_factor(dt_iop_colorspace_type_t cst,const float *in
 
       if(blendif & 0x7f00)  // do we need to consider HSL ?
       {
-        float HSL_input[3];
-        float HSL_output[3];
-        _RGB_2_HSL(input, HSL_input);
-        _RGB_2_HSL(output, HSL_output);
+        const float *HSL_input = conv_input;
+        const float *HSL_output = conv_output;
 
         scaled[DEVELOP_BLENDIF_H_in] = CLAMP_RANGE(HSL_input[0], 0.0f, 1.0f);			        // H scaled to 0..1
         scaled[DEVELOP_BLENDIF_S_in] = CLAMP_RANGE(HSL_input[1], 0.0f, 1.0f);		          // S scaled to 0..1
@@ -308,25 +213,147 @@ static inline void _blend_Lab_rescale(const float *i, float *o)
 }
 
 
+/* the LCh and HSL blend modes work on blocks of BLEND_BLOCK pixels: the block is
+   scaled and clamped pixel by pixel, then converted in one go. */
+static inline void _blend_Lab_to_LCh_block(const float *in, float *LCh, const float *min, const float *max, const int n)
+{
+  for(int k=0; k<n; k++)
+  {
+    _blend_Lab_scale(&in[4*k], &LCh[4*k]);
+    _CLAMP_XYZ(&LCh[4*k], min, max);
+    LCh[4*k+3] = 0.0f;
+  }
+  dt_Lab_to_LCh_row(LCh, LCh, n);
+}
+
+
+static inline void _blend_LCh_to_Lab_block(float *LCh, float *out, const float *mask, const float *min, const float *max, const int n)
+{
+  dt_LCh_to_Lab_row(LCh, LCh, n);
+  for(int k=0; k<n; k++)
+  {
+    _CLAMP_XYZ(&LCh[4*k], min, max);
+    _blend_Lab_rescale(&LCh[4*k], &out[4*k]);
+    out[4*k+3] = mask[k];
+  }
+}
+
+
+static inline void _blend_RGB_to_HSL_block(const float *in, float *HSL, const float *min, const float *max, const int n)
+{
+  for(int k=0; k<n; k++)
+  {
+    _PX_COPY(&in[4*k], &HSL[4*k]);
+    _CLAMP_XYZ(&HSL[4*k], min, max);
+    HSL[4*k+3] = 0.0f;
+  }
+  dt_RGB_to_HSL_row(HSL, HSL, n);
+}
+
+
+static inline void _blend_HSL_to_RGB_block(float *HSL, float *out, const float *mask, const float *min, const float *max, const int n)
+{
+  dt_HSL_to_RGB_row(HSL, HSL, n);
+  for(int k=0; k<n; k++)
+  {
+    _PX_COPY(&HSL[4*k], &out[4*k]);
+    _CLAMP_XYZ(&out[4*k], min, max);
+    out[4*k+3] = mask[k];
+  }
+}
+
+
+/* the color blend modes just pass the clamped input in raw */
+static inline void _blend_copy_clamped(const float *a, float *b, const int stride, const int channels, const float *min, const float *max)
+{
+  for(int j=0; j<stride; j+=4)
+    for(int k=0; k<channels; k++)
+      b[j+k] =  CLAMP_RANGE(a[j+k], min[k], max[k]);		// Noop for Raw
+}
+
+
 /* generate blend mask */
 static void _blend_make_mask(dt_iop_colorspace_type_t cst, const unsigned int blendif, const float *blendif_parameters, const unsigned int mask_mode, const unsigned int mask_combine,
                              const float gopacity, const float *a, const float *b, float *mask, int stride)
 {
-  for(int i=0, j=0; j<stride; i++, j+=4)
+  float ca[4*BLEND_BLOCK], cb[4*BLEND_BLOCK];
+  const int convert = (mask_mode & DEVELOP_MASK_CONDITIONAL) && (blendif & 0x7f00) && (cst == iop_cs_Lab || cst == iop_cs_rgb);
+
+  for(int i0=0; 4*i0<stride; i0+=BLEND_BLOCK)
   {
-    float form = mask[i];
-    float conditional = _blendif_factor(cst, &a[j], &b[j], blendif, blendif_parameters, mask_mode, mask_combine);
-    float opacity = (mask_combine & DEVELOP_COMBINE_INCL) ? 1.0f - (1.0f - form) * (1.0f - conditional) : form * conditional ;
-    opacity = (mask_combine & DEVELOP_COMBINE_INV) ? 1.0f - opacity : opacity;
-    mask[i] = opacity*gopacity;
+    const int n = MIN(BLEND_BLOCK, (stride+3)/4 - i0);
+
+    if(convert && cst == iop_cs_Lab)
+    {
+      dt_Lab_to_LCh_row(a + 4*i0, ca, n);
+      dt_Lab_to_LCh_row(b + 4*i0, cb, n);
+      // the hue sliders have always seen an angle of exactly zero as 1.0, keep it that way
+      for(int k=0; k<n; k++)
+      {
+        if(ca[4*k+2] == 0.0f) ca[4*k+2] = 1.0f;
+        if(cb[4*k+2] == 0.0f) cb[4*k+2] = 1.0f;
+      }
+    }
+    else if(convert)
+    {
+      dt_RGB_to_HSL_row(a + 4*i0, ca, n);
+      dt_RGB_to_HSL_row(b + 4*i0, cb, n);
+    }
+
+    for(int k=0; k<n; k++)
+    {
+      const int i = i0 + k, j = 4*i;
+      float form = mask[i];
+      float conditional = _blendif_factor(cst, &a[j], &b[j], &ca[4*k], &cb[4*k], blendif, blendif_parameters, mask_mode, mask_combine);
+      float opacity = (mask_combine & DEVELOP_COMBINE_INCL) ? 1.0f - (1.0f - form) * (1.0f - conditional) : form * conditional ;
+      opacity = (mask_combine & DEVELOP_COMBINE_INV) ? 1.0f - opacity : opacity;
+      mask[i] = opacity*gopacity;
+    }
   }
 }
 
 
 
+/* normal blend of Lab and rgb, one pixel per sse register. lerp in the scaled space,
+   optionally clamp, keep a/b of the input if only lightness is blended, and put the
+   opacity into the fourth channel. */
+static inline void _blend_normal_sse(dt_iop_colorspace_type_t cst, const float *a, float *b, const float *mask, int stride, int flag, const int bounded)
+{
+  float max[4]= {0},min[4]= {0};
+  _blend_colorspace_channel_range(cst,min,max);
+
+  const int Lab = (cst == iop_cs_Lab);
+  const __m128 scale   = Lab ? _mm_set_ps(1.0f, 1.0f/128.0f, 1.0f/128.0f, 1.0f/100.0f) : _mm_set1_ps(1.0f);
+  const __m128 rescale = Lab ? _mm_set_ps(1.0f, 128.0f, 128.0f, 100.0f) : _mm_set1_ps(1.0f);
+  const __m128 vmin = _mm_loadu_ps(min);
+  const __m128 vmax = _mm_loadu_ps(max);
+  const __m128 keep_a = (Lab && flag) ? _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, 0)) : _mm_setzero_ps();
+  const __m128 alpha = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+  const __m128 one = _mm_set1_ps(1.0f);
+
+  for(int i=0, j=0; j<stride; i++, j+=4)
+  {
+    const __m128 op = _mm_set1_ps(mask[i]);
+    const __m128 ta = _mm_mul_ps(_mm_loadu_ps(&a[j]), scale);
+    const __m128 tb = _mm_mul_ps(_mm_loadu_ps(&b[j]), scale);
+    __m128 t = _mm_add_ps(_mm_mul_ps(ta, _mm_sub_ps(one, op)), _mm_mul_ps(tb, op));
+    if(bounded) t = _mm_min_ps(_mm_max_ps(t, vmin), vmax);
+    t = _mm_or_ps(_mm_and_ps(keep_a, ta), _mm_andnot_ps(keep_a, t));
+    t = _mm_mul_ps(t, rescale);
+    _mm_storeu_ps(&b[j], _mm_or_ps(_mm_and_ps(alpha, op), _mm_andnot_ps(alpha, t)));
+  }
+}
+
+
 /* normal blend with clamping */
-static void _blend_normal_bounded(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_normal_bounded(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
+  if(cst != iop_cs_RAW)
+  {
+    _blend_normal_sse(cst, a, b, mask, stride, flag, 1);
+    return;
+  }
+
   float ta[3], tb[3];
   int channels = _blend_colorspace_channels(cst);
   float max[4]= {0},min[4]= {0};
@@ -366,8 +393,14 @@ static void _blend_normal_bounded(dt_iop_colorspace_type_t cst,const float *a, f
 }
 
 /* normal blend without any clamping */
-static void _blend_normal_unbounded(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_normal_unbounded(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
+  if(cst != iop_cs_RAW)
+  {
+    _blend_normal_sse(cst, a, b, mask, stride, flag, 0);
+    return;
+  }
+
   float ta[3], tb[3];
   int channels = _blend_colorspace_channels(cst);
   float max[4]= {0},min[4]= {0};
@@ -409,7 +442,7 @@ static void _blend_normal_unbounded(dt_iop_colorspace_type_t cst,const float *a,
 
 
 /* lighten */
-static void _blend_lighten(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_lighten(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
   int channels = _blend_colorspace_channels(cst);
   float ta[3], tb[3], tbo;
@@ -451,7 +484,7 @@ static void _blend_lighten(dt_iop_colorspace_type_t cst,const float *a, float *b
 }
 
 /* darken */
-static void _blend_darken(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_darken(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
   int channels = _blend_colorspace_channels(cst);
   float ta[3], tb[3], tbo;
@@ -495,7 +528,7 @@ static void _blend_darken(dt_iop_colorspace_type_t cst,const float *a, float *b,
 
 
 /* multiply */
-static void _blend_multiply(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_multiply(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
   float ta[3], tb[3];
   int channels = _blend_colorspace_channels(cst);
@@ -558,7 +591,7 @@ static void _blend_multiply(dt_iop_colorspace_type_t cst,const float *a, float *
 
 
 /* average */
-static void _blend_average(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_average(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
   float ta[3], tb[3];
   int channels = _blend_colorspace_channels(cst);
@@ -601,7 +634,7 @@ static void _blend_average(dt_iop_colorspace_type_t cst,const float *a, float *b
 
 
 /* add */
-static void _blend_add(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_add(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
   float ta[3], tb[3];
   int channels = _blend_colorspace_channels(cst);
@@ -647,7 +680,7 @@ static void _blend_add(dt_iop_colorspace_type_t cst,const float *a, float *b, co
 
 
 /* substract */
-static void _blend_substract(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_substract(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
   float ta[3], tb[3];
   int channels = _blend_colorspace_channels(cst);
@@ -693,7 +726,7 @@ static void _blend_substract(dt_iop_colorspace_type_t cst,const float *a, float
 
 
 /* difference (deprecated) */
-static void _blend_difference(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_difference(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
   float ta[3], tb[3];
   int channels = _blend_colorspace_channels(cst);
@@ -754,7 +787,7 @@ static void _blend_difference(dt_iop_colorspace_type_t cst,const float *a, float
 
 
 /* difference 2 (new) */
-static void _blend_difference2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_difference2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
   float ta[3], tb[3];
   int channels = _blend_colorspace_channels(cst);
@@ -811,7 +844,7 @@ static void _blend_difference2(dt_iop_colorspace_type_t cst,const float *a, floa
 
 
 /* screen */
-static void _blend_screen(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_screen(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
   float ta[3], tb[3];
   int channels = _blend_colorspace_channels(cst);
@@ -877,7 +910,7 @@ static void _blend_screen(dt_iop_colorspace_type_t cst,const float *a, float *b,
 }
 
 /* overlay */
-static void _blend_overlay(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_overlay(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
   float ta[3], tb[3];
   int channels = _blend_colorspace_channels(cst);
@@ -955,7 +988,7 @@ static void _blend_overlay(dt_iop_colorspace_type_t cst,const float *a, float *b
 }
 
 /* softlight */
-static void _blend_softlight(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_softlight(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
   float ta[3], tb[3];
   int channels = _blend_colorspace_channels(cst);
@@ -1029,7 +1062,7 @@ static void _blend_softlight(dt_iop_colorspace_type_t cst,const float *a, float
 }
 
 /* hardlight */
-static void _blend_hardlight(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_hardlight(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
   float ta[3], tb[3];
   int channels = _blend_colorspace_channels(cst);
@@ -1109,7 +1142,7 @@ static void _blend_hardlight(dt_iop_colorspace_type_t cst,const float *a, float
 
 
 /* vividlight */
-static void _blend_vividlight(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_vividlight(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
   float ta[3], tb[3];
   int channels = _blend_colorspace_channels(cst);
@@ -1186,7 +1219,7 @@ static void _blend_vividlight(dt_iop_colorspace_type_t cst,const float *a, float
 }
 
 /* linearlight */
-static void _blend_linearlight(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_linearlight(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
   float ta[3], tb[3];
   int channels = _blend_colorspace_channels(cst);
@@ -1257,7 +1290,7 @@ static void _blend_linearlight(dt_iop_colorspace_type_t cst,const float *a, floa
 }
 
 /* pinlight */
-static void _blend_pinlight(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_pinlight(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
   float ta[3], tb[3];
   int channels = _blend_colorspace_channels(cst);
@@ -1320,23 +1353,21 @@ static void _blend_pinlight(dt_iop_colorspace_type_t cst,const float *a, float *
 
 
 /* lightness blend */
-static void _blend_lightness(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_lightness(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
-  float ta[3], tb[3];
-  float tta[3], ttb[3];
+  float ta[4*BLEND_BLOCK], tb[4*BLEND_BLOCK];
   int channels = _blend_colorspace_channels(cst);
 
   float max[4]= {0},min[4]= {0};
 
   _blend_colorspace_channel_range(cst,min,max);
 
-
-  for(int i=0, j=0; j<stride; i++, j+=4)
+  if(cst==iop_cs_Lab)
   {
-    float local_opacity = mask[i];
-
-    if(cst==iop_cs_Lab)
+    for(int i=0, j=0; j<stride; i++, j+=4)
     {
+      float local_opacity = mask[i];
+
       _blend_Lab_scale(&a[j], ta);
       _blend_Lab_scale(&b[j], tb);
 
@@ -1346,288 +1377,295 @@ static void _blend_lightness(dt_iop_colorspace_type_t cst,const float *a, float
       tb[2] = CLAMP_RANGE(ta[2], min[2], max[2]);
 
       _blend_Lab_rescale(tb, &b[j]);
+      b[j+3] = local_opacity;
     }
-    else if(cst==iop_cs_rgb)
+  }
+  else if(cst==iop_cs_rgb)
+  {
+    for(int i0=0; 4*i0<stride; i0+=BLEND_BLOCK)
     {
-      _PX_COPY(&a[j], ta);
-
-      _CLAMP_XYZ(ta, min, max);
-      _CLAMP_XYZ(&b[j], min, max);
+      const int n = MIN(BLEND_BLOCK, stride/4 - i0);
+      _blend_RGB_to_HSL_block(&a[4*i0], ta, min, max, n);
+      _blend_RGB_to_HSL_block(&b[4*i0], tb, min, max, n);
 
-      _RGB_2_HSL(ta, tta);
-      _RGB_2_HSL(&b[j], ttb);
+      for(int k=0; k<n; k++)
+      {
+        const float local_opacity = mask[i0+k];
+        const float *tta = &ta[4*k];
+        float *ttb = &tb[4*k];
 
-      ttb[0] = tta[0];
-      ttb[1] = tta[1];
-      ttb[2] = (tta[2] * (1.0f - local_opacity)) + ttb[2] * local_opacity;
+        ttb[0] = tta[0];
+        ttb[1] = tta[1];
+        ttb[2] = (tta[2] * (1.0f - local_opacity)) + ttb[2] * local_opacity;
+      }
 
-      _HSL_2_RGB(ttb, &b[j]);
-      _CLAMP_XYZ(&b[j], min, max);
+      _blend_HSL_to_RGB_block(tb, &b[4*i0], &mask[i0], min, max, n);
     }
-    else
-      for(int k=0; k<channels; k++)
-        b[j+k] =  CLAMP_RANGE(a[j+k], min[k], max[k]);		// Noop for Raw
-
-    if(cst != iop_cs_RAW) b[j+3] = local_opacity;
   }
+  else
+    _blend_copy_clamped(a, b, stride, channels, min, max);
 }
 
 
 /* chroma blend */
-static void _blend_chroma(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_chroma(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
-  float ta[3], tb[3];
-  float tta[3], ttb[3];
+  float ta[4*BLEND_BLOCK], tb[4*BLEND_BLOCK];
   int channels = _blend_colorspace_channels(cst);
 
   float max[4]= {0},min[4]= {0};
   _blend_colorspace_channel_range(cst,min,max);
 
-  for(int i=0, j=0; j<stride; i++, j+=4)
+  if(cst==iop_cs_Lab)
   {
-    float local_opacity = mask[i];
-
-    if(cst==iop_cs_Lab)
+    for(int i0=0; 4*i0<stride; i0+=BLEND_BLOCK)
     {
-      _blend_Lab_scale(&a[j], ta);
-      _CLAMP_XYZ(ta, min, max);
-      _Lab_2_LCH(ta, tta);
+      const int n = MIN(BLEND_BLOCK, stride/4 - i0);
+      _blend_Lab_to_LCh_block(&a[4*i0], ta, min, max, n);
+      _blend_Lab_to_LCh_block(&b[4*i0], tb, min, max, n);
 
-      _blend_Lab_scale(&b[j], tb);
-      _CLAMP_XYZ(tb, min, max);
-      _Lab_2_LCH(tb, ttb);
+      for(int k=0; k<n; k++)
+      {
+        const float local_opacity = mask[i0+k];
+        const float *tta = &ta[4*k];
+        float *ttb = &tb[4*k];
 
-      ttb[0] = tta[0];
-      ttb[1] = (tta[1] * (1.0f - local_opacity)) + ttb[1] * local_opacity;
-      ttb[2] = tta[2];
+        ttb[0] = tta[0];
+        ttb[1] = (tta[1] * (1.0f - local_opacity)) + ttb[1] * local_opacity;
+        ttb[2] = tta[2];
+      }
 
-      _LCH_2_Lab(ttb, tb);
-      _CLAMP_XYZ(tb, min, max);
-      _blend_Lab_rescale(tb, &b[j]);
+      _blend_LCh_to_Lab_block(tb, &b[4*i0], &mask[i0], min, max, n);
     }
-    else if(cst==iop_cs_rgb)
+  }
+  else if(cst==iop_cs_rgb)
+  {
+    for(int i0=0; 4*i0<stride; i0+=BLEND_BLOCK)
     {
-      _PX_COPY(&a[j], ta);
-
-      _CLAMP_XYZ(ta, min, max);
-      _CLAMP_XYZ(&b[j], min, max);
+      const int n = MIN(BLEND_BLOCK, stride/4 - i0);
+      _blend_RGB_to_HSL_block(&a[4*i0], ta, min, max, n);
+      _blend_RGB_to_HSL_block(&b[4*i0], tb, min, max, n);
 
-      _RGB_2_HSL(ta, tta);
-      _RGB_2_HSL(&b[j], ttb);
+      for(int k=0; k<n; k++)
+      {
+        const float local_opacity = mask[i0+k];
+        const float *tta = &ta[4*k];
+        float *ttb = &tb[4*k];
 
-      ttb[0] = tta[0];
-      ttb[1] = (tta[1] * (1.0f - local_opacity)) + ttb[1] * local_opacity;
-      ttb[2] = tta[2];
+        ttb[0] = tta[0];
+        ttb[1] = (tta[1] * (1.0f - local_opacity)) + ttb[1] * local_opacity;
+        ttb[2] = tta[2];
+      }
 
-      _HSL_2_RGB(ttb, &b[j]);
-      _CLAMP_XYZ(&b[j], min, max);
+      _blend_HSL_to_RGB_block(tb, &b[4*i0], &mask[i0], min, max, n);
     }
-    else
-      for(int k=0; k<channels; k++)
-        b[j+k] =  CLAMP_RANGE(a[j+k], min[k], max[k]);		// Noop for Raw
-
-    if(cst != iop_cs_RAW) b[j+3] = local_opacity;
   }
+  else
+    _blend_copy_clamped(a, b, stride, channels, min, max);
 }
 
 
 /* hue blend */
-static void _blend_hue(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_hue(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
-  float ta[3], tb[3];
-  float tta[3], ttb[3];
+  float ta[4*BLEND_BLOCK], tb[4*BLEND_BLOCK];
   int channels = _blend_colorspace_channels(cst);
 
   float max[4]= {0},min[4]= {0};
   _blend_colorspace_channel_range(cst,min,max);
 
-  for(int i=0, j=0; j<stride; i++, j+=4)
+  if(cst==iop_cs_Lab)
   {
-    float local_opacity = mask[i];
-
-    if(cst==iop_cs_Lab)
+    for(int i0=0; 4*i0<stride; i0+=BLEND_BLOCK)
     {
-      _blend_Lab_scale(&a[j], ta);
-      _CLAMP_XYZ(ta, min, max);
-      _Lab_2_LCH(ta, tta);
+      const int n = MIN(BLEND_BLOCK, stride/4 - i0);
+      _blend_Lab_to_LCh_block(&a[4*i0], ta, min, max, n);
+      _blend_Lab_to_LCh_block(&b[4*i0], tb, min, max, n);
 
-      _blend_Lab_scale(&b[j], tb);
-      _CLAMP_XYZ(tb, min, max);
-      _Lab_2_LCH(tb, ttb);
-
-      ttb[0] = tta[0];
-      ttb[1] = tta[1];
-      /* blend hue along shortest distance on color circle */
-      float d = fabs(tta[2] - ttb[2]);
-      float s = d > 0.5f ? -local_opacity*(1.0f - d) / d : local_opacity;
-      ttb[2] = fmod((tta[2] * (1.0f - s)) + ttb[2] * s + 1.0f, 1.0f);
-
-      _LCH_2_Lab(ttb, tb);
-      _CLAMP_XYZ(tb, min, max);
-      _blend_Lab_rescale(tb, &b[j]);
+      for(int k=0; k<n; k++)
+      {
+        const float local_opacity = mask[i0+k];
+        const float *tta = &ta[4*k];
+        float *ttb = &tb[4*k];
+
+        ttb[0] = tta[0];
+        ttb[1] = tta[1];
+        /* blend hue along shortest distance on color circle */
+        float d = fabs(tta[2] - ttb[2]);
+        float s = d > 0.5f ? -local_opacity*(1.0f - d) / d : local_opacity;
+        ttb[2] = fmod((tta[2] * (1.0f - s)) + ttb[2] * s + 1.0f, 1.0f);
+      }
+
+      _blend_LCh_to_Lab_block(tb, &b[4*i0], &mask[i0], min, max, n);
     }
-    else if(cst==iop_cs_rgb)
+  }
+  else if(cst==iop_cs_rgb)
+  {
+    for(int i0=0; 4*i0<stride; i0+=BLEND_BLOCK)
     {
-      _PX_COPY(&a[j], ta);
-
-      _CLAMP_XYZ(ta, min, max);
-      _CLAMP_XYZ(&b[j], min, max);
-
-      _RGB_2_HSL(ta, tta);
-      _RGB_2_HSL(&b[j], ttb);
+      const int n = MIN(BLEND_BLOCK, stride/4 - i0);
+      _blend_RGB_to_HSL_block(&a[4*i0], ta, min, max, n);
+      _blend_RGB_to_HSL_block(&b[4*i0], tb, min, max, n);
 
-      /* blend hue along shortest distance on color circle */
-      float d = fabs(tta[0] - ttb[0]);
-      float s = d > 0.5f ? -local_opacity*(1.0f - d) / d : local_opacity;
-      ttb[0] = fmod((tta[0] * (1.0f - s)) + ttb[0] * s + 1.0f, 1.0f);
-      ttb[1] = tta[1];
-      ttb[2] = tta[2];
+      for(int k=0; k<n; k++)
+      {
+        const float local_opacity = mask[i0+k];
+        const float *tta = &ta[4*k];
+        float *ttb = &tb[4*k];
+
+        /* blend hue along shortest distance on color circle */
+        float d = fabs(tta[0] - ttb[0]);
+        float s = d > 0.5f ? -local_opacity*(1.0f - d) / d : local_opacity;
+        ttb[0] = fmod((tta[0] * (1.0f - s)) + ttb[0] * s + 1.0f, 1.0f);
+        ttb[1] = tta[1];
+        ttb[2] = tta[2];
+      }
 
-      _HSL_2_RGB(ttb, &b[j]);
-      _CLAMP_XYZ(&b[j], min, max);
+      _blend_HSL_to_RGB_block(tb, &b[4*i0], &mask[i0], min, max, n);
     }
-    else
-      for(int k=0; k<channels; k++)
-        b[j+k] =  CLAMP_RANGE(a[j+k], min[k], max[k]);		// Noop for Raw
-
-    if(cst != iop_cs_RAW) b[j+3] = local_opacity;
   }
+  else
+    _blend_copy_clamped(a, b, stride, channels, min, max);
 }
 
 
 /* color blend; blend hue and chroma, but not lightness */
-static void _blend_color(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_color(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
-  float ta[3], tb[3];
-  float tta[3], ttb[3];
+  float ta[4*BLEND_BLOCK], tb[4*BLEND_BLOCK];
   int channels = _blend_colorspace_channels(cst);
 
   float max[4]= {0},min[4]= {0};
   _blend_colorspace_channel_range(cst,min,max);
 
-  for(int i=0, j=0; j<stride; i++, j+=4)
+  if(cst==iop_cs_Lab)
   {
-    float local_opacity = mask[i];
-
-    if(cst==iop_cs_Lab)
+    for(int i0=0; 4*i0<stride; i0+=BLEND_BLOCK)
     {
-      _blend_Lab_scale(&a[j], ta);
-      _CLAMP_XYZ(ta, min, max);
-      _Lab_2_LCH(ta, tta);
+      const int n = MIN(BLEND_BLOCK, stride/4 - i0);
+      _blend_Lab_to_LCh_block(&a[4*i0], ta, min, max, n);
+      _blend_Lab_to_LCh_block(&b[4*i0], tb, min, max, n);
 
-      _blend_Lab_scale(&b[j], tb);
-      _CLAMP_XYZ(tb, min, max);
-      _Lab_2_LCH(tb, ttb);
+      for(int k=0; k<n; k++)
+      {
+        const float local_opacity = mask[i0+k];
+        const float *tta = &ta[4*k];
+        float *ttb = &tb[4*k];
 
-      ttb[0] = tta[0];
-      ttb[1] = (tta[1] * (1.0f - local_opacity)) + ttb[1] * local_opacity;
+        ttb[0] = tta[0];
+        ttb[1] = (tta[1] * (1.0f - local_opacity)) + ttb[1] * local_opacity;
 
-      /* blend hue along shortest distance on color circle */
-      float d = fabs(tta[2] - ttb[2]);
-      float s = d > 0.5f ? -local_opacity*(1.0f - d) / d : local_opacity;
-      ttb[2] = fmod((tta[2] * (1.0f - s)) + ttb[2] * s + 1.0f, 1.0f);
+        /* blend hue along shortest distance on color circle */
+        float d = fabs(tta[2] - ttb[2]);
+        float s = d > 0.5f ? -local_opacity*(1.0f - d) / d : local_opacity;
+        ttb[2] = fmod((tta[2] * (1.0f - s)) + ttb[2] * s + 1.0f, 1.0f);
+      }
 
-      _LCH_2_Lab(ttb, tb);
-      _CLAMP_XYZ(tb, min, max);
-      _blend_Lab_rescale(tb, &b[j]);
+      _blend_LCh_to_Lab_block(tb, &b[4*i0], &mask[i0], min, max, n);
     }
-    else if(cst==iop_cs_rgb)
+  }
+  else if(cst==iop_cs_rgb)
+  {
+    for(int i0=0; 4*i0<stride; i0+=BLEND_BLOCK)
     {
-      _PX_COPY(&a[j], ta);
-
-      _CLAMP_XYZ(ta, min, max);
-      _CLAMP_XYZ(&b[j], min, max);
+      const int n = MIN(BLEND_BLOCK, stride/4 - i0);
+      _blend_RGB_to_HSL_block(&a[4*i0], ta, min, max, n);
+      _blend_RGB_to_HSL_block(&b[4*i0], tb, min, max, n);
 
-      _RGB_2_HSL(ta, tta);
-      _RGB_2_HSL(&b[j], ttb);
+      for(int k=0; k<n; k++)
+      {
+        const float local_opacity = mask[i0+k];
+        const float *tta = &ta[4*k];
+        float *ttb = &tb[4*k];
 
-      /* blend hue along shortest distance on color circle */
-      float d = fabs(tta[0] - ttb[0]);
-      float s = d > 0.5f ? -local_opacity*(1.0f - d) / d : local_opacity;
-      ttb[0] = fmod((tta[0] * (1.0f - s)) + ttb[0] * s + 1.0f, 1.0f);
+        /* blend hue along shortest distance on color circle */
+        float d = fabs(tta[0] - ttb[0]);
+        float s = d > 0.5f ? -local_opacity*(1.0f - d) / d : local_opacity;
+        ttb[0] = fmod((tta[0] * (1.0f - s)) + ttb[0] * s + 1.0f, 1.0f);
 
-      ttb[1] = (tta[1] * (1.0f - local_opacity)) + ttb[1] * local_opacity;
-      ttb[2] = tta[2];
+        ttb[1] = (tta[1] * (1.0f - local_opacity)) + ttb[1] * local_opacity;
+        ttb[2] = tta[2];
+      }
 
-      _HSL_2_RGB(ttb, &b[j]);
-      _CLAMP_XYZ(&b[j], min, max);
+      _blend_HSL_to_RGB_block(tb, &b[4*i0], &mask[i0], min, max, n);
     }
-    else
-      for(int k=0; k<channels; k++)
-        b[j+k] =  CLAMP_RANGE(a[j+k], min[k], max[k]);		// Noop for Raw
-
-    if(cst != iop_cs_RAW) b[j+3] = local_opacity;
   }
+  else
+    _blend_copy_clamped(a, b, stride, channels, min, max);
 }
 
 /* color adjustment; blend hue and chroma; take lightness from module output */
-static void _blend_coloradjust(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_coloradjust(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
-  float ta[3], tb[3];
-  float tta[3], ttb[3];
+  float ta[4*BLEND_BLOCK], tb[4*BLEND_BLOCK];
   int channels = _blend_colorspace_channels(cst);
 
   float max[4]= {0},min[4]= {0};
   _blend_colorspace_channel_range(cst,min,max);
 
-  for(int i=0, j=0; j<stride; i++, j+=4)
+  if(cst==iop_cs_Lab)
   {
-    float local_opacity = mask[i];
-
-    if(cst==iop_cs_Lab)
+    for(int i0=0; 4*i0<stride; i0+=BLEND_BLOCK)
     {
-      _blend_Lab_scale(&a[j], ta);
-      _CLAMP_XYZ(ta, min, max);
-      _Lab_2_LCH(ta, tta);
+      const int n = MIN(BLEND_BLOCK, stride/4 - i0);
+      _blend_Lab_to_LCh_block(&a[4*i0], ta, min, max, n);
+      _blend_Lab_to_LCh_block(&b[4*i0], tb, min, max, n);
 
-      _blend_Lab_scale(&b[j], tb);
-      _CLAMP_XYZ(tb, min, max);
-      _Lab_2_LCH(tb, ttb);
+      for(int k=0; k<n; k++)
+      {
+        const float local_opacity = mask[i0+k];
+        const float *tta = &ta[4*k];
+        float *ttb = &tb[4*k];
 
-      // ttb[0] (output lightness) unchanged
-      ttb[1] = (tta[1] * (1.0f - local_opacity)) + ttb[1] * local_opacity;
+        // ttb[0] (output lightness) unchanged
+        ttb[1] = (tta[1] * (1.0f - local_opacity)) + ttb[1] * local_opacity;
 
-      /* blend hue along shortest distance on color circle */
-      float d = fabs(tta[2] - ttb[2]);
-      float s = d > 0.5f ? -local_opacity*(1.0f - d) / d : local_opacity;
-      ttb[2] = fmod((tta[2] * (1.0f - s)) + ttb[2] * s + 1.0f, 1.0f);
+        /* blend hue along shortest distance on color circle */
+        float d = fabs(tta[2] - ttb[2]);
+        float s = d > 0.5f ? -local_opacity*(1.0f - d) / d : local_opacity;
+        ttb[2] = fmod((tta[2] * (1.0f - s)) + ttb[2] * s + 1.0f, 1.0f);
+      }
 
-      _LCH_2_Lab(ttb, tb);
-      _CLAMP_XYZ(tb, min, max);
-      _blend_Lab_rescale(tb, &b[j]);
+      _blend_LCh_to_Lab_block(tb, &b[4*i0], &mask[i0], min, max, n);
     }
-    else if(cst==iop_cs_rgb)
-    {
-      _PX_COPY(&a[j], ta);
+  }
+  else if(cst==iop_cs_rgb)
+  {
+    // the module input goes to HSL unclamped here
+    const float nomin[4] = { -INFINITY, -INFINITY, -INFINITY, -INFINITY };
+    const float nomax[4] = { INFINITY, INFINITY, INFINITY, INFINITY };
 
-      _CLAMP_XYZ(ta, min, max);
-      _CLAMP_XYZ(&b[j], min, max);
+    for(int i0=0; 4*i0<stride; i0+=BLEND_BLOCK)
+    {
+      const int n = MIN(BLEND_BLOCK, stride/4 - i0);
+      _blend_RGB_to_HSL_block(&a[4*i0], ta, nomin, nomax, n);
+      _blend_RGB_to_HSL_block(&b[4*i0], tb, min, max, n);
 
-      _RGB_2_HSL(&a[j], tta);
-      _RGB_2_HSL(&b[j], ttb);
+      for(int k=0; k<n; k++)
+      {
+        const float local_opacity = mask[i0+k];
+        const float *tta = &ta[4*k];
+        float *ttb = &tb[4*k];
 
-      /* blend hue along shortest distance on color circle */
-      float d = fabs(tta[0] - ttb[0]);
-      float s = d > 0.5f ? -local_opacity*(1.0f - d) / d : local_opacity;
-      ttb[0] = fmod((tta[0] * (1.0f - s)) + ttb[0] * s + 1.0f, 1.0f);
+        /* blend hue along shortest distance on color circle */
+        float d = fabs(tta[0] - ttb[0]);
+        float s = d > 0.5f ? -local_opacity*(1.0f - d) / d : local_opacity;
+        ttb[0] = fmod((tta[0] * (1.0f - s)) + ttb[0] * s + 1.0f, 1.0f);
 
-      ttb[1] = (tta[1] * (1.0f - local_opacity)) + ttb[1] * local_opacity;
-      // ttb[2] (output lightness) unchanged
+        ttb[1] = (tta[1] * (1.0f - local_opacity)) + ttb[1] * local_opacity;
+        // ttb[2] (output lightness) unchanged
+      }
 
-      _HSL_2_RGB(ttb, &b[j]);
-      _CLAMP_XYZ(&b[j], min, max);
+      _blend_HSL_to_RGB_block(tb, &b[4*i0], &mask[i0], min, max, n);
     }
-    else
-      for(int k=0; k<channels; k++)
-        b[j+k] =  CLAMP_RANGE(a[j+k], min[k], max[k]);		// Noop for Raw
-
-    if(cst != iop_cs_RAW) b[j+3] = local_opacity;
   }
+  else
+    _blend_copy_clamped(a, b, stride, channels, min, max);
 }
 
 
 /* inverse blend */
-static void _blend_inverse(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+static inline void _blend_inverse(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
 {
   float ta[3], tb[3];
   int channels = _blend_colorspace_channels(cst);
@@ -1668,6 +1706,43 @@ static void _blend_inverse(dt_iop_colorspace_type_t cst,const float *a, float *b
   }
 }
 
+/* every blend mode is instantiated once per colorspace. the colorspace is a compile
+   time constant in each instance, so the per pixel colorspace branches disappear. */
+#define BLEND_KERNELS(mode) \
+  static __attribute__((flatten)) void mode##_Lab(const float *a, float *b, const float *mask, int stride, int flag) \
+  { mode(iop_cs_Lab, a, b, mask, stride, flag); } \
+  static __attribute__((flatten)) void mode##_rgb(const float *a, float *b, const float *mask, int stride, int flag) \
+  { mode(iop_cs_rgb, a, b, mask, stride, flag); } \
+  static __attribute__((flatten)) void mode##_RAW(const float *a, float *b, const float *mask, int stride, int flag) \
+  { mode(iop_cs_RAW, a, b, mask, stride, flag); }
+
+#define BLEND_KERNEL(mode, cst) \
+  ((cst) == iop_cs_Lab ? mode##_Lab : ((cst) == iop_cs_rgb ? mode##_rgb : mode##_RAW))
+
+BLEND_KERNELS(_blend_normal_bounded)
+BLEND_KERNELS(_blend_normal_unbounded)
+BLEND_KERNELS(_blend_lighten)
+BLEND_KERNELS(_blend_darken)
+BLEND_KERNELS(_blend_multiply)
+BLEND_KERNELS(_blend_average)
+BLEND_KERNELS(_blend_add)
+BLEND_KERNELS(_blend_substract)
+BLEND_KERNELS(_blend_difference)
+BLEND_KERNELS(_blend_difference2)
+BLEND_KERNELS(_blend_screen)
+BLEND_KERNELS(_blend_overlay)
+BLEND_KERNELS(_blend_softlight)
+BLEND_KERNELS(_blend_hardlight)
+BLEND_KERNELS(_blend_vividlight)
+BLEND_KERNELS(_blend_linearlight)
+BLEND_KERNELS(_blend_pinlight)
+BLEND_KERNELS(_blend_lightness)
+BLEND_KERNELS(_blend_chroma)
+BLEND_KERNELS(_blend_hue)
+BLEND_KERNELS(_blend_color)
+BLEND_KERNELS(_blend_coloradjust)
+BLEND_KERNELS(_blend_inverse)
+
 void dt_develop_blend_process (struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, void *i, void *o, const struct dt_iop_roi_t *roi_in, const struct dt_iop_roi_t *roi_out)
 {
   int ch = piece->colors;
@@ -1681,140 +1756,156 @@ void dt_develop_blend_process (struct dt_iop_module_t *self, struct dt_dev_pixel
   /* check if blend is disabled */
   if (!d || !(mask_mode & DEVELOP_MASK_ENABLED)) return;
 
+  /* get channel max values depending on colorspace */
+  const dt_iop_colorspace_type_t cst = dt_iop_module_colorspace(self);
+
   /* select the blend operator */
   switch (blend_mode)
   {
     case DEVELOP_BLEND_LIGHTEN:
-      blend = _blend_lighten;
+      blend = BLEND_KERNEL(_blend_lighten, cst);
       break;
     case DEVELOP_BLEND_DARKEN:
-      blend = _blend_darken;
+      blend = BLEND_KERNEL(_blend_darken, cst);
       break;
     case DEVELOP_BLEND_MULTIPLY:
-      blend = _blend_multiply;
+      blend = BLEND_KERNEL(_blend_multiply, cst);
       break;
     case DEVELOP_BLEND_AVERAGE:
-      blend = _blend_average;
+      blend = BLEND_KERNEL(_blend_average, cst);
       break;
     case DEVELOP_BLEND_ADD:
-      blend = _blend_add;
+      blend = BLEND_KERNEL(_blend_add, cst);
       break;
     case DEVELOP_BLEND_SUBSTRACT:
-      blend = _blend_substract;
+      blend = BLEND_KERNEL(_blend_substract, cst);
       break;
     case DEVELOP_BLEND_DIFFERENCE:
-      blend = _blend_difference;
+      blend = BLEND_KERNEL(_blend_difference, cst);
       break;
     case DEVELOP_BLEND_DIFFERENCE2:
-      blend = _blend_difference2;
+      blend = BLEND_KERNEL(_blend_difference2, cst);
       break;
     case DEVELOP_BLEND_SCREEN:
-      blend = _blend_screen;
+      blend = BLEND_KERNEL(_blend_screen, cst);
       break;
     case DEVELOP_BLEND_OVERLAY:
-      blend = _blend_overlay;
+      blend = BLEND_KERNEL(_blend_overlay, cst);
       break;
     case DEVELOP_BLEND_SOFTLIGHT:
-      blend = _blend_softlight;
+      blend = BLEND_KERNEL(_blend_softlight, cst);
       break;
     case DEVELOP_BLEND_HARDLIGHT:
-      blend = _blend_hardlight;
+      blend = BLEND_KERNEL(_blend_hardlight, cst);
       break;
     case DEVELOP_BLEND_VIVIDLIGHT:
-      blend = _blend_vividlight;
+      blend = BLEND_KERNEL(_blend_vividlight, cst);
       break;
     case DEVELOP_BLEND_LINEARLIGHT:
-      blend = _blend_linearlight;
+      blend = BLEND_KERNEL(_blend_linearlight, cst);
       break;
     case DEVELOP_BLEND_PINLIGHT:
-      blend = _blend_pinlight;
+      blend = BLEND_KERNEL(_blend_pinlight, cst);
       break;
     case DEVELOP_BLEND_LIGHTNESS:
-      blend = _blend_lightness;
+      blend = BLEND_KERNEL(_blend_lightness, cst);
       break;
     case DEVELOP_BLEND_CHROMA:
-      blend = _blend_chroma;
+      blend = BLEND_KERNEL(_blend_chroma, cst);
       break;
     case DEVELOP_BLEND_HUE:
-      blend = _blend_hue;
+      blend = BLEND_KERNEL(_blend_hue, cst);
       break;
     case DEVELOP_BLEND_COLOR:
-      blend = _blend_color;
+      blend = BLEND_KERNEL(_blend_color, cst);
       break;
     case DEVELOP_BLEND_INVERSE:
-      blend = _blend_inverse;
+      blend = BLEND_KERNEL(_blend_inverse, cst);
       break;
     case DEVELOP_BLEND_NORMAL:
     case DEVELOP_BLEND_BOUNDED:
-      blend = _blend_normal_bounded;
+      blend = BLEND_KERNEL(_blend_normal_bounded, cst);
       break;
     case DEVELOP_BLEND_COLORADJUST:
-      blend = _blend_coloradjust;
+      blend = BLEND_KERNEL(_blend_coloradjust, cst);
       break;
 
       /* fallback to normal blend */
     case DEVELOP_BLEND_NORMAL2:
     case DEVELOP_BLEND_UNBOUNDED:
     default:
-      blend = _blend_normal_unbounded;
+      blend = BLEND_KERNEL(_blend_normal_unbounded, cst);
       break;
   }
 
+  if (blend_mode & DEVELOP_BLEND_MASK_FLAG)
+  {
+    /* blending with mask */
+    dt_control_log("blending using masks is not yet implemented.");
+    return;
+  }
+
+  /* get the clipped opacity value  0 - 1 */
+  const float opacity = fmin(fmax(0,(d->opacity/100.0f)),1.0f);
+  const int maskblur = fabs(d->radius) <= 0.1f ? 0 : 1;
+  const int gaussian = d->radius > 0.0f ? 1 : 0;
+  const float radius = fabs(d->radius);
+
+  /* check if we only should blend lightness channel. will affect only Lab space */
+  const int blendflag = self->flags() & IOP_FLAGS_BLEND_ONLY_LIGHTNESS;
+
+  /* correct bpp per pixel for raw
+      \TODO actually invest why channels per pixel is 4 in raw..
+  */
+  if(cst==iop_cs_RAW)
+    ch = 1;
+
+  /* only true if mask_display was set by an _earlier_ module */
+  const int mask_display = piece->pipe->mask_display;
+
+  /* check if mask should be suppressed (i.e. just set to global opacity value) */
+  const int suppress = self->suppress_mask && self->dev->gui_attached && (self == self->dev->gui_module) && (piece->pipe == self->dev->pipe) && (mask_mode & DEVELOP_MASK_BOTH);
+
+  /* apply masks if there's some */
+  dt_masks_form_t *form = dt_masks_get_from_id(self->dev,d->mask_id);
+  const int drawn = form && (!(self->flags()&IOP_FLAGS_NO_MASKS)) && (d->mask_mode & DEVELOP_MASK_MASK);
+
+  /* a blurred mask has to be complete before anything is blended. otherwise the mask of a row
+     is made right before the row is blended, and only a drawn mask needs a full buffer. */
+  const int fused = suppress || !maskblur;
+  const int full = !suppress && (drawn || maskblur);
+  const int nthreads = dt_get_num_threads();
+
   /* allocate space for blend mask */
-  float *mask = dt_alloc_align(64, roi_out->width*roi_out->height*sizeof(float));
+  const size_t masksize = full ? (size_t)roi_out->width*roi_out->height : (size_t)roi_out->width*nthreads;
+  float *mask = dt_alloc_align(64, masksize*sizeof(float));
   if(!mask)
   {
     dt_control_log(_("could not allocate buffer for blending"));
     return;
   }
 
-  /* apply masks if there's some */
-  dt_masks_form_t *form = dt_masks_get_from_id(self->dev,d->mask_id);
-  
-  if (form && (!(self->flags()&IOP_FLAGS_NO_MASKS)) && (d->mask_mode & DEVELOP_MASK_MASK))
+  /* we fill the buffer with 1.0f or 0.0f depending on mask_combine */
+  const float fill = (d->mask_combine & DEVELOP_COMBINE_INCL) ? 0.0f : 1.0f;
+
+  if (full && drawn)
   {
     int roi[4] = {roi_out->x,roi_out->y,roi_out->width,roi_out->height};
     dt_masks_group_render(self,piece,form,&mask,roi,roi_in->scale);
   }
-  else
+  else if (full)
   {
-    //we fill the buffer with 1.0f or 0.0f depending on mask_combine
-    const float fill = (d->mask_combine & DEVELOP_COMBINE_INCL) ? 0.0f : 1.0f;
-    const int buffsize = roi_out->width*roi_out->height;
-    for (int i=0; i<buffsize; i++) mask[i] = fill;
+    for (size_t k=0; k<masksize; k++) mask[k] = fill;
   }
 
-  
-  if (!(blend_mode & DEVELOP_BLEND_MASK_FLAG))
+  if(!fused)
   {
-    /* get the clipped opacity value  0 - 1 */
-    const float opacity = fmin(fmax(0,(d->opacity/100.0f)),1.0f);
-    const int maskblur = fabs(d->radius) <= 0.1f ? 0 : 1;
-    const int gaussian = d->radius > 0.0f ? 1 : 0;
-    const float radius = fabs(d->radius);
-
-    /* get channel max values depending on colorspace */
-    const dt_iop_colorspace_type_t cst = dt_iop_module_colorspace(self);
-
-    /* check if we only should blend lightness channel. will affect only Lab space */
-    const int blendflag = self->flags() & IOP_FLAGS_BLEND_ONLY_LIGHTNESS;
-
-    /* correct bpp per pixel for raw
-        \TODO actually invest why channels per pixel is 4 in raw..
-    */
-    if(cst==iop_cs_RAW)
-      ch = 1;
-
-    /* only true if mask_display was set by an _earlier_ module */
-    const int mask_display = piece->pipe->mask_display;
-
 #ifdef _OPENMP
 #if !defined(__SUNOS__) && !defined(__NetBSD__)
-    #pragma omp parallel for default(none) shared(i,roi_out,o,mask,blend,d,stderr,ch)
+    #pragma omp parallel for default(none) shared(i,roi_out,o,mask,d,stderr,ch)
 #else
-    #pragma omp parallel for shared(i,roi_out,o,mask,blend,d,ch)
+    #pragma omp parallel for shared(i,roi_out,o,mask,d,ch)
 #endif
-
 #endif
     for (int y=0; y<roi_out->height; y++)
     {
@@ -1826,81 +1917,65 @@ void dt_develop_blend_process (struct dt_iop_module_t *self, struct dt_dev_pixel
       _blend_make_mask(cst, d->blendif, d->blendif_parameters, d->mask_mode, d->mask_combine, opacity, in, out, m, stride);
     }
 
-    if(maskblur)
+    if(gaussian)
     {
-      if(gaussian)
-      {
-        const float sigma = radius * roi_in->scale / piece ->iscale;
+      const float sigma = radius * roi_in->scale / piece ->iscale;
 
-        const float mmax[] = { 1.0f };
-        const float mmin[] = { 0.0f };
+      const float mmax[] = { 1.0f };
+      const float mmin[] = { 0.0f };
 
-        dt_gaussian_t *g = dt_gaussian_init(roi_out->width, roi_out->height, 1, mmax, mmin, sigma, 0);
-        if(g)
-        {
-          dt_gaussian_blur(g, mask, mask);
-          dt_gaussian_free(g);
-        }
-      }
-      else
+      dt_gaussian_t *g = dt_gaussian_init(roi_out->width, roi_out->height, 1, mmax, mmin, sigma, 0);
+      if(g)
       {
-        // potential further blend algorithm (bilateral grid?)
+        g->piece = piece;
+        dt_gaussian_blur(g, mask, mask);
+        dt_gaussian_free(g);
       }
     }
-
-
-    /* check if mask should be suppressed (i.e. just set to global opacity value) */
-    if(self->suppress_mask && self->dev->gui_attached && (self == self->dev->gui_module) && (piece->pipe == self->dev->pipe) && (mask_mode & DEVELOP_MASK_BOTH))
+    else
     {
-#ifdef _OPENMP
-#if !defined(__SUNOS__)
-      #pragma omp parallel for default(none) shared(roi_out,mask,stderr)
-#else
-      #pragma omp parallel for shared(roi_out,mask)
-#endif
-
-#endif
-      for (int k=0; k<roi_out->height*roi_out->width; k++)
-      {
-        mask[k] = opacity;
-      }
+      // potential further blend algorithm (bilateral grid?)
     }
+  }
 
-
+  /* one streaming pass over the rows: finish the mask of the row if that wasn't done above, then blend */
 #ifdef _OPENMP
 #if !defined(__SUNOS__)
-    #pragma omp parallel for default(none) shared(i,roi_out,o,mask,blend,stderr,ch)
+  #pragma omp parallel for default(none) shared(i,roi_out,o,mask,blend,d,stderr,ch)
 #else
-    #pragma omp parallel for shared(i,roi_out,o,mask,blend,ch)
+  #pragma omp parallel for shared(i,roi_out,o,mask,blend,d,ch)
 #endif
-
 #endif
-    for (int y=0; y<roi_out->height; y++)
-    {
-      int index = ch * y * roi_out->width;
-      int stride = ch * roi_out->width;
-      float *in = (float *)i + index;
-      float *out = (float *)o + index;
-      float *m = (float *)mask + y * roi_out->width;
-      blend(cst, in, out, m, stride, blendflag);
+  for (int y=0; y<roi_out->height; y++)
+  {
+    int index = ch * y * roi_out->width;
+    int stride = ch * roi_out->width;
+    float *in = (float *)i + index;
+    float *out = (float *)o + index;
+    float *m = full ? (float *)mask + y * roi_out->width : (float *)mask + dt_get_thread_num() * roi_out->width;
 
-      if(mask_display && cst != iop_cs_RAW)
-        for(int j=0; j<stride; j+=4)
-          out[j+3] = in[j+3];
+    if(suppress)
+    {
+      for (int k=0; k<roi_out->width; k++) m[k] = opacity;
     }
-
-    /* check if _this_ module should expose mask. */
-    if(self->request_mask_display && self->dev->gui_attached && (self == self->dev->gui_module) && (piece->pipe == self->dev->pipe) && (mask_mode & DEVELOP_MASK_BOTH))
+    else if(fused)
     {
-      piece->pipe->mask_display = 1;
+      if(!full)
+        for (int k=0; k<roi_out->width; k++) m[k] = fill;
+      _blend_make_mask(cst, d->blendif, d->blendif_parameters, d->mask_mode, d->mask_combine, opacity, in, out, m, stride);
     }
 
+    blend(in, out, m, stride, blendflag);
+
+    if(mask_display && cst != iop_cs_RAW)
+      for(int j=0; j<stride; j+=4)
+        out[j+3] = in[j+3];
   }
-  else
-  {
-    /* blending with mask */
-    dt_control_log("blending using masks is not yet implemented.");
 
+  /* check if _this_ module should expose mask. */
+  if(self->request_mask_display && self->dev->gui_attached && (self == self->dev->gui_module) && (piece->pipe == self->dev->pipe) && (mask_mode & DEVELOP_MASK_BOTH))
+  {
+    piece->pipe->mask_display = 1;
   }
 
   free(mask);
@@ -43,6 +43,8 @@
 #define DT_DEV_AVERAGE_DELAY_START            250
 #define DT_DEV_PREVIEW_AVERAGE_DELAY_START     50
 #define DT_DEV_AVERAGE_DELAY_COUNT              5
+#define DT_DEV_DRAFT_DOWNSCALE                  4
+#define DT_DEV_DRAFT_MIN_DELAY                200
 
 void dt_dev_init(dt_develop_t *dev, int32_t gui_attached)
 {
@@ -330,6 +332,32 @@ restart:
   x = MAX(0, scale*dev->pipe->processed_width *(.5+zoom_x)-dev->capwidth/2);
   y = MAX(0, scale*dev->pipe->processed_height*(.5+zoom_y)-dev->capheight/2);
 
+  // progressive rendering: if the full render is known to take a while, show a quick
+  // downscaled draft of the same region first and refine it afterwards.
+  if(dev->gui_attached && dev->average_delay > DT_DEV_DRAFT_MIN_DELAY &&
+     dev->capwidth >= 64*DT_DEV_DRAFT_DOWNSCALE && dev->capheight >= 64*DT_DEV_DRAFT_DOWNSCALE &&
+     dt_conf_get_bool("plugins/darkroom/progressive_rendering"))
+  {
+    dt_get_times(&start);
+    if(dt_dev_pixelpipe_process_draft(dev->pipe, dev, x, y, dev->capwidth, dev->capheight, scale, DT_DEV_DRAFT_DOWNSCALE))
+    {
+      if(dev->image_force_reload)
+      {
+        dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
+        dt_control_log_busy_leave();
+        dt_pthread_mutex_unlock(&dev->pipe_mutex);
+        return;
+      }
+      else goto restart;
+    }
+    dt_show_times(&start, "[dev_process_image] pixel pipeline draft processing", NULL);
+    if(dev->pipe->changed != DT_DEV_PIPE_UNCHANGED) goto restart;
+
+    // show the draft until the full render is done
+    dev->image_dirty = 0;
+    dt_control_queue_redraw_center();
+  }
+
   dt_get_times(&start);
   if(dt_dev_pixelpipe_process(dev->pipe, dev, x, y, dev->capwidth, dev->capheight, scale))
   {
@@ -2098,14 +2098,33 @@ GtkWidget *dt_iop_gui_get_pluginui(dt_iop_module_t *module)
   return gtk_bin_get_child(GTK_BIN(g_list_nth_data(gtk_container_get_children(GTK_CONTAINER(module->expander)),1)));
 }
 
-int dt_iop_breakpoint(struct dt_develop_t *dev, struct dt_dev_pixelpipe_t *pipe)
+static inline int _iop_pipe_interrupted(const struct dt_develop_t *dev, const struct dt_dev_pixelpipe_t *pipe)
 {
-  if(pipe != dev->preview_pipe) sched_yield();
   if(pipe != dev->preview_pipe && pipe->changed == DT_DEV_PIPE_ZOOMED) return 1;
   if((pipe->changed != DT_DEV_PIPE_UNCHANGED && pipe->changed != DT_DEV_PIPE_ZOOMED) || dev->gui_leaving) return 1;
   return 0;
 }
 
+int dt_iop_breakpoint(struct dt_develop_t *dev, struct dt_dev_pixelpipe_t *pipe)
+{
+  if(pipe != dev->preview_pipe) sched_yield();
+  return _iop_pipe_interrupted(dev, pipe);
+}
+
+int dt_iop_cancelled(struct dt_dev_pixelpipe_iop_t *piece)
+{
+  if(!piece || !piece->pipe) return 0;
+  if(piece->cancelled) return 1;
+  const dt_develop_t *dev = piece->module ? piece->module->dev : NULL;
+  if(piece->pipe->shutdown || (dev && _iop_pipe_interrupted(dev, piece->pipe)))
+  {
+    // remembered so the pipe knows the output is incomplete
+    piece->cancelled = 1;
+    return 1;
+  }
+  return 0;
+}
+
 void dt_iop_nap(int32_t usec)
 {
   if(usec <= 0) return;
@@ -2608,6 +2627,87 @@ dt_iop_clip_and_zoom_demosaic_half_size_f(
 }
 #endif
 
+// source coordinate of the j-th same color site binned into output site v,
+// stepping back by whole pattern periods at the right/bottom border.
+static inline int
+_mosaic_bin_coord(const int v, const int j, const int factor, const int offset, const int size)
+{
+  int c = 2*factor*(v >> 1) + (v & 1) + 2*j - offset;
+  if(c >= size) c -= 2*((c - size)/2 + 1);
+  return MAX(c, 0);
+}
+
+/**
+ * bins a mosaiced buffer (in) by the integer factor roi_in->scale/roi_out->scale and
+ * writes the region of interest to out, still mosaiced. every output site is the
+ * average of factor x factor input sites of the same color, so a 2x2 pattern is
+ * preserved for even roi_out->x/y. used by the pixelpipe to run the raw modules
+ * on a smaller buffer when exporting at small sizes.
+ */
+void
+dt_iop_clip_and_zoom_mosaic_bin(
+  uint16_t *out,
+  const uint16_t *const in,
+  const dt_iop_roi_t *const roi_out,
+  const dt_iop_roi_t *const roi_in,
+  const int32_t out_stride,
+  const int32_t in_stride)
+{
+  const int factor = MAX(1, (int)roundf(roi_in->scale/roi_out->scale));
+  const uint32_t num = factor*factor;
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(none) shared(out) schedule(static)
+#endif
+  for(int y=0; y<roi_out->height; y++)
+  {
+    uint16_t *outc = out + out_stride*y;
+    for(int x=0; x<roi_out->width; x++)
+    {
+      uint32_t sum = 0;
+      for(int j=0; j<factor; j++)
+      {
+        const uint16_t *inr = in + in_stride*_mosaic_bin_coord(y + roi_out->y, j, factor, roi_in->y, roi_in->height);
+        for(int i=0; i<factor; i++)
+          sum += inr[_mosaic_bin_coord(x + roi_out->x, i, factor, roi_in->x, roi_in->width)];
+      }
+      outc[x] = (sum + num/2)/num;
+    }
+  }
+}
+
+void
+dt_iop_clip_and_zoom_mosaic_bin_f(
+  float *out,
+  const float *const in,
+  const dt_iop_roi_t *const roi_out,
+  const dt_iop_roi_t *const roi_in,
+  const int32_t out_stride,
+  const int32_t in_stride)
+{
+  const int factor = MAX(1, (int)roundf(roi_in->scale/roi_out->scale));
+  const float norm = 1.0f/(factor*factor);
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(none) shared(out) schedule(static)
+#endif
+  for(int y=0; y<roi_out->height; y++)
+  {
+    float *outc = out + out_stride*y;
+    for(int x=0; x<roi_out->width; x++)
+    {
+      float sum = 0.0f;
+      for(int j=0; j<factor; j++)
+      {
+        const float *inr = in + in_stride*_mosaic_bin_coord(y + roi_out->y, j, factor, roi_in->y, roi_in->height);
+        for(int i=0; i<factor; i++)
+          sum += inr[_mosaic_bin_coord(x + roi_out->x, i, factor, roi_in->x, roi_in->width)];
+      }
+      outc[x] = sum*norm;
+    }
+  }
+}
+
 void dt_iop_RGB_to_YCbCr(const float *rgb, float *yuv)
 {
   yuv[0] =  0.299*rgb[0] + 0.587*rgb[1] + 0.114*rgb[2];
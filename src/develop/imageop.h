@@ -64,6 +64,7 @@ struct dt_develop_tiling_t;
 #define IOP_FLAGS_PREVIEW_NON_OPENCL  256                       // Preview pixelpipe of this module must not run on GPU but always on CPU
 #define IOP_FLAGS_NO_HISTORY_STACK    512                       // This iop will never show up in the history stack
 #define IOP_FLAGS_NO_MASKS  1024    // The module doesn't support masks (used with SUPPORT_BLENDING)
+#define IOP_FLAGS_ALLOW_RAW_DOWNSCALE 2048                      // Works per pixel on the mosaic, may run on a binned (downscaled) raw
 /** status of a module*/
 typedef enum dt_iop_module_state_t
 {
@@ -377,6 +378,11 @@ int  dt_iop_load_preset_interpolated_iso(dt_iop_module_t *module, const dt_image
 /** let plugins have breakpoints: */
 int dt_iop_breakpoint(struct dt_develop_t *dev, struct dt_dev_pixelpipe_t *pipe);
 
+/** cancellation point for long running process() implementations, to be polled every few rows
+ * (from any thread). returns 1 if the pipe will be restarted or shut down anyways, in which case
+ * the module should return as soon as possible: its output is then dropped from the cache. */
+int dt_iop_cancelled(struct dt_dev_pixelpipe_iop_t *piece);
+
 /** allow plugins to relinquish CPU and go to sleep for some time */
 void dt_iop_nap(int32_t usec);
 
@@ -420,6 +426,27 @@ dt_iop_clip_and_zoom_demosaic_half_size_f(
   const uint32_t filters,
   const float clip);
 
+/** bin a mosaiced buffer by an integer factor (roi_in->scale/roi_out->scale),
+ *  averaging same color sites only. the bayer pattern is preserved, as long
+ *  as it repeats every two rows and roi_out->x/y are even. */
+void
+dt_iop_clip_and_zoom_mosaic_bin(
+  uint16_t *out,
+  const uint16_t *const in,
+  const struct dt_iop_roi_t *const roi_out,
+  const struct dt_iop_roi_t *const roi_in,
+  const int32_t out_stride,
+  const int32_t in_stride);
+
+void
+dt_iop_clip_and_zoom_mosaic_bin_f(
+  float *out,
+  const float *const in,
+  const struct dt_iop_roi_t *const roi_out,
+  const struct dt_iop_roi_t *const roi_in,
+  const int32_t out_stride,
+  const int32_t in_stride);
+
 /** as dt_iop_clip_and_zoom, but for rgba 8-bit channels. */
 void dt_iop_clip_and_zoom_8(const uint8_t *i, int32_t ix, int32_t iy, int32_t iw, int32_t ih, int32_t ibw, int32_t ibh,
                             uint8_t *o, int32_t ox, int32_t oy, int32_t ow, int32_t oh, int32_t obw, int32_t obh);
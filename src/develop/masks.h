@@ -48,6 +48,9 @@ dt_masks_type_t;
 #define	DT_MASKS_STATE_DIFFERENCE 32
 #define	DT_MASKS_STATE_EXCLUSION 64
 
+/** spacing in pixels of the grid of points back transformed when drawing a mask at roi scale */
+#define DT_MASKS_ROI_GRID 8
+
 typedef enum dt_masks_points_states_t
 {
   DT_MASKS_POINT_STATE_NORMAL   = 1,
@@ -160,6 +163,8 @@ int dt_masks_get_area(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt
 int dt_masks_get_source_area(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form, int *width, int *height, int *posx, int *posy);
 /** get the transparency mask of the form and his border */
 int dt_masks_get_mask(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form, float **buffer, int *width, int *height, int *posx, int *posy);
+/** get the transparency mask of the form and his border, drawn directly into a buffer of the size of roi */
+int dt_masks_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form, const dt_iop_roi_t *roi, float *buffer);
 int dt_masks_group_render(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form, float **buffer, int *roi, float scale);
 
 /** we create a completly new form. */
@@ -716,6 +716,87 @@ static int dt_circle_get_mask(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *p
   return 1;
 }
 
+static int dt_circle_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form, const dt_iop_roi_t *roi, float *buffer)
+{
+  double start2 = dt_get_wtime();
+  const int w = roi->width, h = roi->height;
+  memset(buffer,0,w*h*sizeof(float));
+
+  //we get the area, in full resolution
+  int fx,fy,fw,fh;
+  if (!dt_circle_get_area(module,piece,form,&fw,&fh,&fx,&fy)) return 0;
+
+  //and the part of the roi it covers
+  const float scale = roi->scale;
+  const int x0 = MAX(0,(int)floorf(fx*scale)-roi->x);
+  const int y0 = MAX(0,(int)floorf(fy*scale)-roi->y);
+  const int x1 = MIN(w,(int)ceilf((fx+fw)*scale)-roi->x+1);
+  const int y1 = MIN(h,(int)ceilf((fy+fh)*scale)-roi->y+1);
+  if (x0 >= x1 || y0 >= y1) return 1;
+
+  if (darktable.unmuted & DT_DEBUG_PERF) dt_print(DT_DEBUG_MASKS, "[masks %s] circle area took %0.04f sec\n", form->name, dt_get_wtime()-start2);
+  start2 = dt_get_wtime();
+
+  //we only back transform the nodes of a coarse grid, distortions are smooth enough
+  //to interpolate the positions of the pixels in between
+  const int gw = (x1-x0-1)/DT_MASKS_ROI_GRID+2;
+  const int gh = (y1-y0-1)/DT_MASKS_ROI_GRID+2;
+  float *grid = malloc(gw*gh*2*sizeof(float));
+  for (int j=0; j<gh; j++)
+    for (int i=0; i<gw; i++)
+    {
+      grid[(j*gw+i)*2] = (x0+i*DT_MASKS_ROI_GRID+roi->x)/scale;
+      grid[(j*gw+i)*2+1] = (y0+j*DT_MASKS_ROI_GRID+roi->y)/scale;
+    }
+
+  if (!dt_dev_distort_backtransform_plus(module->dev,piece->pipe,0,module->priority,grid,gw*gh))
+  {
+    free(grid);
+    return 0;
+  }
+
+  if (darktable.unmuted & DT_DEBUG_PERF) dt_print(DT_DEBUG_MASKS, "[masks %s] circle transform took %0.04f sec\n", form->name, dt_get_wtime()-start2);
+  start2 = dt_get_wtime();
+
+  //we get the cicle values
+  dt_masks_point_circle_t *circle = (dt_masks_point_circle_t *) (g_list_first(form->points)->data);
+  const int wi = piece->pipe->iwidth, hi=piece->pipe->iheight;
+  const float center[2] = {circle->center[0]*wi, circle->center[1]*hi};
+  const float radius2 = circle->radius*MIN(wi,hi)*circle->radius*MIN(wi,hi);
+  const float total2 = (circle->radius+circle->border)*MIN(wi,hi)*(circle->radius+circle->border)*MIN(wi,hi);
+
+  //we populate the buffer, row by row
+#ifdef _OPENMP
+  #pragma omp parallel for default(none) shared(buffer,grid) schedule(static)
+#endif
+  for (int i=y0; i<y1; i++)
+  {
+    const int gy = (i-y0)/DT_MASKS_ROI_GRID;
+    const float ty = (i-y0-gy*DT_MASKS_ROI_GRID)/(float)DT_MASKS_ROI_GRID;
+    const float *g0 = grid+gy*gw*2;
+    const float *g1 = g0+gw*2;
+    for (int j=x0; j<x1; j++)
+    {
+      const int gx = (j-x0)/DT_MASKS_ROI_GRID;
+      const float tx = (j-x0-gx*DT_MASKS_ROI_GRID)/(float)DT_MASKS_ROI_GRID;
+      const float x = (1.0f-ty)*((1.0f-tx)*g0[gx*2]+tx*g0[gx*2+2]) + ty*((1.0f-tx)*g1[gx*2]+tx*g1[gx*2+2]);
+      const float y = (1.0f-ty)*((1.0f-tx)*g0[gx*2+1]+tx*g0[gx*2+3]) + ty*((1.0f-tx)*g1[gx*2+1]+tx*g1[gx*2+3]);
+      const float l2 = (x-center[0])*(x-center[0]) + (y-center[1])*(y-center[1]);
+      if (l2<radius2) buffer[i*w+j] = 1.0f;
+      else if (l2 < total2)
+      {
+        const float f = (total2-l2)/(total2-radius2);
+        buffer[i*w+j] = f*f;
+      }
+    }
+  }
+  free(grid);
+
+  if (darktable.unmuted & DT_DEBUG_PERF) dt_print(DT_DEBUG_MASKS, "[masks %s] circle fill took %0.04f sec\n", form->name, dt_get_wtime()-start2);
+
+  return 1;
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
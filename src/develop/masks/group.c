@@ -332,55 +332,77 @@ static int dt_group_get_mask(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *pi
   return 1;
 }
 
+static int dt_group_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form, const dt_iop_roi_t *roi, float *buffer)
+{
+  double start2;
+  const int nb = g_list_length(form->points);
+  if (nb == 0) return 0;
+  const int w = roi->width, h = roi->height;
+  memset(buffer,0,w*h*sizeof(float));
+
+  //all forms are drawn at roi size, so they are combined pixel by pixel
+  float *buf = malloc(w*h*sizeof(float));
+  int nb_ok = 0;
+  GList *fpts = g_list_first(form->points);
+  while(fpts)
+  {
+    dt_masks_point_group_t *fpt = (dt_masks_point_group_t *) fpts->data;
+    dt_masks_form_t *sel = dt_masks_get_from_id(module->dev,fpt->formid);
+    fpts = g_list_next(fpts);
+    if (!sel) continue;
+    if (!dt_masks_get_mask_roi(module,piece,sel,roi,buf)) continue;
+    nb_ok++;
+
+    start2 = dt_get_wtime();
+    const int state = fpt->state;
+    const float op = fpt->opacity;
+#ifdef _OPENMP
+    #pragma omp parallel for default(none) shared(buffer,buf) schedule(static)
+#endif
+    for (int y=0; y<h; y++)
+    {
+      for (int x=0; x<w; x++)
+      {
+        const int k = y*w+x;
+        const float b1 = buffer[k];
+        const float b2 = ((state & DT_MASKS_STATE_INVERSE) ? 1.0f-buf[k] : buf[k])*op;
+        if (state & DT_MASKS_STATE_UNION) buffer[k] = fmaxf(b1,b2);
+        else if (state & DT_MASKS_STATE_INTERSECTION) buffer[k] = (b1>0.0f && b2>0.0f) ? fminf(b1,b2) : 0.0f;
+        else if (state & DT_MASKS_STATE_DIFFERENCE)
+        {
+          if (b1>0.0f && b2>0.0f) buffer[k] = b1*(1.0f-b2);
+        }
+        else if (state & DT_MASKS_STATE_EXCLUSION)
+        {
+          if (b1>0.0f && b2>0.0f) buffer[k] = fmaxf((1.0f-b1)*b2,b1*(1.0f-b2));
+          else buffer[k] = fmaxf(b1,b2);
+        }
+        else buffer[k] = b2; //if we are here, this mean that we just have to copy the shape
+      }
+    }
+    if (darktable.unmuted & DT_DEBUG_PERF) dt_print(DT_DEBUG_MASKS, "[masks %s] combine took %0.04f sec\n", sel->name, dt_get_wtime()-start2);
+  }
+  free(buf);
+
+  return nb_ok > 0;
+}
+
 int dt_masks_group_render(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form, float **buffer, int *roi, float scale)
 {
   double start2 = dt_get_wtime();
 
   if (!form) return 0;
   float *mask = *buffer;
-  //we first reset the buffer to 0
-  memset(mask,0,roi[2]*roi[3]*sizeof(float));
-
-  //we get the mask
-  float *fm = NULL;
-  int fx,fy,fw,fh;
-  if (!dt_masks_get_mask(module,piece,form,&fm,&fw,&fh,&fx,&fy)) return 0;
-
-  if (darktable.unmuted & DT_DEBUG_PERF) dt_print(DT_DEBUG_MASKS, "[masks] get all masks took %0.04f sec\n", dt_get_wtime()-start2);
-  start2 = dt_get_wtime();
-
-  //we don't want row which are outisde the roi_out
-  int fxx = fx*scale;
-  int fww = fw*scale;
-  int fyy = fy*scale;
-  int fhh = fh*scale;
-  if (fxx>roi[0]+roi[2]) return 1;
-
-  if (fxx<roi[0]) fww += fxx-roi[0], fxx=roi[0];
-  if (fww+fxx>=roi[0]+roi[2]) fww = roi[0]+roi[2]-fxx-1;
-
-  //we adjust to avoid rounding errors
-  if (fyy/scale-fy<0) fyy++, fhh--;
-  if (fxx/scale-fx<0) fxx++, fww--;
-  if ((fyy+fhh)/scale-fy>=fh) fhh--;
-  if ((fxx+fww)/scale-fx>=fw) fww--;
-
-  //we apply the mask row by row
-  for (int yy=fyy; yy<fyy+fhh; yy++)
+
+  //we draw the mask directly at the size of the roi
+  const dt_iop_roi_t mroi = { .x = roi[0], .y = roi[1], .width = roi[2], .height = roi[3], .scale = scale };
+  if (!dt_masks_get_mask_roi(module,piece,form,&mroi,mask))
   {
-    if (yy<roi[1] || yy>=roi[1]+roi[3]) continue;
-    for (int xx=fxx; xx<fxx+fww; xx++)
-    {
-      int a = (yy/scale-fy);
-      int b = (xx/scale);
-      mask[(yy-roi[1])*roi[2]+xx-roi[0]] = fmaxf(mask[(yy-roi[1])*roi[2]+xx-roi[0]],fm[a*fw+b-fx]);
-    }
+    memset(mask,0,roi[2]*roi[3]*sizeof(float));
+    return 0;
   }
 
-  //we free the mask
-  free(fm);
-
-  if (darktable.unmuted & DT_DEBUG_PERF) dt_print(DT_DEBUG_MASKS, "[masks] scale all masks took %0.04f sec\n", dt_get_wtime()-start2);
+  if (darktable.unmuted & DT_DEBUG_PERF) dt_print(DT_DEBUG_MASKS, "[masks] render all masks took %0.04f sec\n", dt_get_wtime()-start2);
 
   return 1;
 }
@@ -1943,7 +1943,8 @@ static void _path_falloff(float **buffer, int *p0, int *p1, int posx, int posy,
   }
 }
 
-static int dt_path_get_mask(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form, float **buffer, int *width, int *height, int *posx, int *posy)
+/** rasterize the path at the given scale of the full resolution pipe input */
+static int _path_get_mask_scaled(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form, const float scale, float **buffer, int *width, int *height, int *posx, int *posy)
 {
   if (!module) return 0;
   double start = dt_get_wtime();
@@ -1954,6 +1955,18 @@ static int dt_path_get_mask(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *pie
   int points_count,border_count;
   if (!_path_get_points_border(module->dev,form,module->priority,piece->pipe,&points,&points_count,&border,&border_count,0)) return 0;
 
+  //and bring them to the requested scale, leaving the skip markers of the border alone
+  if (scale != 1.0f)
+  {
+    for (int i=0; i<points_count*2; i++) points[i] *= scale;
+    for (int i=0; i<border_count; i++)
+    {
+      if (border[i*2] == -999999) continue;
+      border[i*2] *= scale;
+      border[i*2+1] *= scale;
+    }
+  }
+
   if (darktable.unmuted & DT_DEBUG_PERF) dt_print(DT_DEBUG_MASKS, "[masks %s] path points took %0.04f sec\n", form->name, dt_get_wtime()-start);
   start = start2 = dt_get_wtime();
 
@@ -2081,6 +2094,9 @@ static int dt_path_get_mask(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *pie
   if (darktable.unmuted & DT_DEBUG_PERF) dt_print(DT_DEBUG_MASKS, "[masks %s] path_fill draw path took %0.04f sec\n", form->name, dt_get_wtime()-start2);
   start2 = dt_get_wtime();
 
+#ifdef _OPENMP
+  #pragma omp parallel for default(none) shared(buffer) schedule(static)
+#endif
   for (int yy=0; yy<hb; yy++)
   {
     int state = 0;
@@ -2133,6 +2149,31 @@ static int dt_path_get_mask(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *pie
 
   return 1;
 }
+
+static int dt_path_get_mask(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form, float **buffer, int *width, int *height, int *posx, int *posy)
+{
+  return _path_get_mask_scaled(module,piece,form,1.0f,buffer,width,height,posx,posy);
+}
+
+static int dt_path_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form, const dt_iop_roi_t *roi, float *buffer)
+{
+  const int w = roi->width, h = roi->height;
+  memset(buffer,0,w*h*sizeof(float));
+
+  //the path is already in output space, so we can draw it directly at roi scale
+  float *fm = NULL;
+  int fx,fy,fw,fh;
+  if (!_path_get_mask_scaled(module,piece,form,roi->scale,&fm,&fw,&fh,&fx,&fy)) return 0;
+
+  //and copy the part inside the roi
+  const int x0 = MAX(0,fx-roi->x), x1 = MIN(w,fx+fw-roi->x);
+  const int y0 = MAX(0,fy-roi->y), y1 = MIN(h,fy+fh-roi->y);
+  for (int yy=y0; yy<y1; yy++)
+    if (x1 > x0) memcpy(buffer+yy*w+x0,fm+(yy+roi->y-fy)*fw+x0+roi->x-fx,(x1-x0)*sizeof(float));
+  free(fm);
+  return 1;
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -22,6 +22,7 @@
 #include "gui/gtk.h"
 #include "control/control.h"
 #include "control/signal.h"
+#include "common/bench.h"
 #include "common/opencl.h"
 #include "common/imageio.h"
 #include "libs/lib.h"
@@ -37,6 +38,7 @@
 
 // this is to ensure compatibility with pixelpipe_gegl.c, which does not need to build the other module:
 #include "develop/pixelpipe_cache.c"
+#include "develop/pixelpipe_scratch.c"
 
 #define max(a,b) ((a) > (b) ? (a) : (b))
 
@@ -90,6 +92,9 @@ int dt_dev_pixelpipe_init(dt_dev_pixelpipe_t *pipe)
 {
   int res = dt_dev_pixelpipe_init_cached(pipe, 4*sizeof(float)*darktable.thumbnail_width*darktable.thumbnail_height, 5);
   pipe->type = DT_DEV_PIXELPIPE_FULL;
+  // drafts are at least 2x downscaled, lines grow on demand anyways.
+  if(res && !dt_dev_pixelpipe_cache_init(&(pipe->draft_cache), 3, pipe->backbuf_size/4))
+    pipe->draft_cache.entries = 0;
   return res;
 }
 
@@ -103,8 +108,12 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, int32_t size, int32_t
   pipe->backbuf_size = size;
   if(!dt_dev_pixelpipe_cache_init(&(pipe->cache), entries, pipe->backbuf_size))
     return 0;
+  pipe->draft_cache.entries = 0;
+  dt_dev_pixelpipe_scratch_init(&(pipe->scratch));
   pipe->cache_obsolete = 0;
   pipe->backbuf = NULL;
+  pipe->backbuf_upscale = 1.0f;
+  pipe->draft = 0;
   pipe->processing = 0;
   pipe->shutdown = 0;
   pipe->opencl_error = 0;
@@ -135,6 +144,8 @@ void dt_dev_pixelpipe_cleanup(dt_dev_pixelpipe_t *pipe)
   dt_dev_pixelpipe_cleanup_nodes(pipe);
   // so now it's safe to clean up cache:
   dt_dev_pixelpipe_cache_cleanup(&(pipe->cache));
+  if(pipe->draft_cache.entries > 0) dt_dev_pixelpipe_cache_cleanup(&(pipe->draft_cache));
+  dt_dev_pixelpipe_scratch_cleanup(&(pipe->scratch));
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
   dt_pthread_mutex_destroy(&(pipe->backbuf_mutex));
   dt_pthread_mutex_destroy(&(pipe->busy_mutex));
@@ -183,6 +194,7 @@ void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
       piece->module  = module;
       piece->pipe    = pipe;
       piece->data = NULL;
+      piece->cancelled = 0;
       piece->hash = 0;
       piece->process_cl_ready = 0;
       dt_iop_init_pipe(piece->module, pipe,piece);
@@ -675,6 +687,18 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
           for(int j=0; j<cp_height; j++)
             memcpy(((char *)*output) + bpp*j*roi_out->width, ((char *)pipe->input) + bpp*(in_x + (in_y + j)*pipe->iwidth), bpp*cp_width);
         }
+        else if((pipe->image.flags & DT_IMAGE_RAW) && pipe->image.filters && bpp <= sizeof(float))
+        {
+          // raw-domain downscale (see dt_dev_pixelpipe_raw_downscale_factor()): bin the mosaic.
+          roi_in.x = roi_in.y = 0;
+          roi_in.width = pipe->iwidth;
+          roi_in.height = pipe->iheight;
+          roi_in.scale = 1.0f;
+          if(bpp == sizeof(float))
+            dt_iop_clip_and_zoom_mosaic_bin_f((float *)*output, (const float *)pipe->input, roi_out, &roi_in, roi_out->width, pipe->iwidth);
+          else
+            dt_iop_clip_and_zoom_mosaic_bin((uint16_t *)*output, (const uint16_t *)pipe->input, roi_out, &roi_in, roi_out->width, pipe->iwidth);
+        }
         else
         {
           roi_in.x /= roi_out->scale;
@@ -782,9 +806,13 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
 #endif
 
 
+    // modules flag this when they stop early, see dt_iop_cancelled()
+    piece->cancelled = 0;
+
     dt_pthread_mutex_lock(&pipe->busy_mutex);
-    if(pipe->shutdown)
+    if(pipe->shutdown || piece->cancelled)
     {
+      dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
       dt_pthread_mutex_unlock(&pipe->busy_mutex);
       return 1;
     }
@@ -813,8 +841,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
 
     assert(tiling.factor > 0.0f);
 
-    if(pipe->shutdown)
+    if(pipe->shutdown || piece->cancelled)
     {
+      dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
       dt_pthread_mutex_unlock(&pipe->busy_mutex);
       return 1;
     }
@@ -921,8 +950,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
             dt_pthread_mutex_lock(&pipe->busy_mutex);
           }
 
-          if(pipe->shutdown)
+          if(pipe->shutdown || piece->cancelled)
           {
+            dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
             dt_pthread_mutex_unlock(&pipe->busy_mutex);
             return 1;
           }
@@ -940,8 +970,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
             dt_pthread_mutex_lock(&pipe->busy_mutex);
           }
 
-          if(pipe->shutdown)
+          if(pipe->shutdown || piece->cancelled)
           {
+            dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
             dt_pthread_mutex_unlock(&pipe->busy_mutex);
             return 1;
           }
@@ -990,8 +1021,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
             valid_input_on_gpu_only = FALSE;
           }
 
-          if(pipe->shutdown)
+          if(pipe->shutdown || piece->cancelled)
           {
+            dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
             dt_pthread_mutex_unlock(&pipe->busy_mutex);
             return 1;
           }
@@ -1003,8 +1035,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
           if (success_opencl)
             success_opencl = module->process_tiling_cl(module, piece, input, *output, &roi_in, roi_out, in_bpp);
 
-          if(pipe->shutdown)
+          if(pipe->shutdown || piece->cancelled)
           {
+            dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
             dt_pthread_mutex_unlock(&pipe->busy_mutex);
             return 1;
           }
@@ -1024,8 +1057,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
             dt_pthread_mutex_lock(&pipe->busy_mutex);
           }
 
-          if(pipe->shutdown)
+          if(pipe->shutdown || piece->cancelled)
           {
+            dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
             dt_pthread_mutex_unlock(&pipe->busy_mutex);
             return 1;
           }
@@ -1043,8 +1077,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
             dt_pthread_mutex_lock(&pipe->busy_mutex);
           }
 
-          if(pipe->shutdown)
+          if(pipe->shutdown || piece->cancelled)
           {
+            dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
             dt_pthread_mutex_unlock(&pipe->busy_mutex);
             return 1;
           }
@@ -1057,8 +1092,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
           if (success_opencl && (!darktable.opencl->async_pixelpipe || pipe->type == DT_DEV_PIXELPIPE_EXPORT))
             success_opencl = dt_opencl_finish(pipe->devid);
 
-          if(pipe->shutdown)
+          if(pipe->shutdown || piece->cancelled)
           {
+            dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
             dt_pthread_mutex_unlock(&pipe->busy_mutex);
             return 1;
           }
@@ -1165,8 +1201,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
             valid_input_on_gpu_only = FALSE;
           }
 
-          if(pipe->shutdown)
+          if(pipe->shutdown || piece->cancelled)
           {
+            dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
             dt_pthread_mutex_unlock(&pipe->busy_mutex);
             return 1;
           }
@@ -1179,8 +1216,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
           else
             module->process(module, piece, input, *output, &roi_in, roi_out);
 
-          if(pipe->shutdown)
+          if(pipe->shutdown || piece->cancelled)
           {
+            dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
             dt_pthread_mutex_unlock(&pipe->busy_mutex);
             return 1;
           }
@@ -1200,8 +1238,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
             dt_pthread_mutex_lock(&pipe->busy_mutex);
           }
 
-          if(pipe->shutdown)
+          if(pipe->shutdown || piece->cancelled)
           {
+            dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
             dt_pthread_mutex_unlock(&pipe->busy_mutex);
             return 1;
           }
@@ -1220,8 +1259,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
             dt_pthread_mutex_lock(&pipe->busy_mutex);
           }
 
-          if(pipe->shutdown)
+          if(pipe->shutdown || piece->cancelled)
           {
+            dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
             dt_pthread_mutex_unlock(&pipe->busy_mutex);
             return 1;
           }
@@ -1231,8 +1271,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
           dt_develop_blend_process(module, piece, input, *output, &roi_in, roi_out);
         }
 
-        if(pipe->shutdown)
+        if(pipe->shutdown || piece->cancelled)
         {
+          dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
           dt_pthread_mutex_unlock(&pipe->busy_mutex);
           return 1;
         }
@@ -1269,8 +1310,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
           valid_input_on_gpu_only = FALSE;
         }
 
-        if(pipe->shutdown)
+        if(pipe->shutdown || piece->cancelled)
         {
+          dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
           dt_pthread_mutex_unlock(&pipe->busy_mutex);
           return 1;
         }
@@ -1283,8 +1325,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
         else
           module->process(module, piece, input, *output, &roi_in, roi_out);
 
-        if(pipe->shutdown)
+        if(pipe->shutdown || piece->cancelled)
         {
+          dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
           dt_pthread_mutex_unlock(&pipe->busy_mutex);
           return 1;
         }
@@ -1304,8 +1347,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
           dt_pthread_mutex_lock(&pipe->busy_mutex);
         }
 
-        if(pipe->shutdown)
+        if(pipe->shutdown || piece->cancelled)
         {
+          dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
           dt_pthread_mutex_unlock(&pipe->busy_mutex);
           return 1;
         }
@@ -1323,8 +1367,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
           dt_pthread_mutex_lock(&pipe->busy_mutex);
         }
 
-        if(pipe->shutdown)
+        if(pipe->shutdown || piece->cancelled)
         {
+          dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
           dt_pthread_mutex_unlock(&pipe->busy_mutex);
           return 1;
         }
@@ -1332,8 +1377,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
         /* process blending */
         dt_develop_blend_process(module, piece, input, *output, &roi_in, roi_out);
 
-        if(pipe->shutdown)
+        if(pipe->shutdown || piece->cancelled)
         {
+          dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
           dt_pthread_mutex_unlock(&pipe->busy_mutex);
           return 1;
         }
@@ -1355,8 +1401,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
       else
         module->process(module, piece, input, *output, &roi_in, roi_out);
 
-      if(pipe->shutdown)
+      if(pipe->shutdown || piece->cancelled)
       {
+        dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
         dt_pthread_mutex_unlock(&pipe->busy_mutex);
         return 1;
       }
@@ -1376,8 +1423,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
         dt_pthread_mutex_lock(&pipe->busy_mutex);
       }
 
-      if(pipe->shutdown)
+      if(pipe->shutdown || piece->cancelled)
       {
+        dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
         dt_pthread_mutex_unlock(&pipe->busy_mutex);
         return 1;
       }
@@ -1395,8 +1443,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
         dt_pthread_mutex_lock(&pipe->busy_mutex);
       }
 
-      if(pipe->shutdown)
+      if(pipe->shutdown || piece->cancelled)
       {
+        dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
         dt_pthread_mutex_unlock(&pipe->busy_mutex);
         return 1;
       }
@@ -1413,8 +1462,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
     else
       module->process(module, piece, input, *output, &roi_in, roi_out);
 
-    if(pipe->shutdown)
+    if(pipe->shutdown || piece->cancelled)
     {
+      dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
       dt_pthread_mutex_unlock(&pipe->busy_mutex);
       return 1;
     }
@@ -1434,8 +1484,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
       dt_pthread_mutex_lock(&pipe->busy_mutex);
     }
 
-    if(pipe->shutdown)
+    if(pipe->shutdown || piece->cancelled)
     {
+      dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
       dt_pthread_mutex_unlock(&pipe->busy_mutex);
       return 1;
     }
@@ -1453,8 +1504,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
       dt_pthread_mutex_lock(&pipe->busy_mutex);
     }
 
-    if(pipe->shutdown)
+    if(pipe->shutdown || piece->cancelled)
     {
+      dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
       dt_pthread_mutex_unlock(&pipe->busy_mutex);
       return 1;
     }
@@ -1463,8 +1515,17 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
     dt_develop_blend_process(module, piece, input, *output, &roi_in, roi_out);
 #endif
 
+    // the module or its blending gave up half way through, the output is incomplete
+    if(piece->cancelled)
+    {
+      dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
+      dt_pthread_mutex_unlock(&pipe->busy_mutex);
+      return 1;
+    }
+
     dt_show_times(&start, "[dev_pixelpipe]", "processing `%s' [%s]", module->name(),
                   _pipe_type_to_str(pipe->type));
+    dt_bench_add(darktable.bench, &start, "pipe/%s", module->op);
     // in case we get this buffer from the cache, also get the processed max:
     for(int k=0; k<3; k++) piece->processed_maximum[k] = pipe->processed_maximum[k];
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
@@ -1479,8 +1540,9 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
 #endif
     {
       dt_pthread_mutex_lock(&pipe->busy_mutex);
-      if(pipe->shutdown)
+      if(pipe->shutdown || piece->cancelled)
       {
+        dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
         dt_pthread_mutex_unlock(&pipe->busy_mutex);
         return 1;
       }
@@ -1873,6 +1935,31 @@ int dt_dev_pixelpipe_process_no_gamma(dt_dev_pixelpipe_t *pipe, dt_develop_t *de
   return ret;
 }
 
+int dt_dev_pixelpipe_raw_downscale_factor(
+  dt_dev_pixelpipe_t *pipe,
+  const float scale)
+{
+  if(pipe->type != DT_DEV_PIXELPIPE_EXPORT && pipe->type != DT_DEV_PIXELPIPE_THUMBNAIL) return 1;
+  if(dt_dev_pixelpipe_uses_downsampled_input(pipe) || !(pipe->image.flags & DT_IMAGE_RAW)) return 1;
+  if(scale >= 0.5f || !dt_conf_get_bool("plugins/lighttable/export/raw_downscale")) return 1;
+  // binning keeps only the parity of the coordinates, so the pattern has to repeat every two rows:
+  const uint32_t filters = pipe->image.filters;
+  if(!filters || filters != (filters & 0xff) * 0x01010101u) return 1;
+
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(!strcmp(piece->module->op, "demosaic"))
+    {
+      // keep demosaic itself at twice the output resolution or more,
+      // unless that doesn't gain anything over the full buffer.
+      return MAX(2, (int)(0.5f/scale));
+    }
+    if(piece->enabled && !(piece->module->flags() & IOP_FLAGS_ALLOW_RAW_DOWNSCALE)) return 1;
+  }
+  return 1;
+}
+
 void dt_dev_pixelpipe_disable_after(
   dt_dev_pixelpipe_t *pipe,
   const char *op)
@@ -2028,6 +2115,8 @@ restart:
     dt_opencl_unlock_device(pipe->devid);
     pipe->devid = -1;
   }
+  // drafts are interleaved with full runs, don't let them shrink the scratch pool:
+  if(!pipe->draft) dt_dev_pixelpipe_scratch_trim(&(pipe->scratch));
   // ... and in case of other errors ...
   if (err)
   {
@@ -2041,6 +2130,7 @@ restart:
   pipe->backbuf = buf;
   pipe->backbuf_width  = width;
   pipe->backbuf_height = height;
+  pipe->backbuf_upscale = pipe->draft > 1 ? pipe->draft : 1.0f;
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
 
   // printf("pixelpipe homebrew process end\n");
@@ -2048,9 +2138,40 @@ restart:
   return 0;
 }
 
+int dt_dev_pixelpipe_process_draft(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width, int height, float scale, int downscale)
+{
+  if(pipe->draft_cache.entries <= 0 || downscale < 2)
+    return dt_dev_pixelpipe_process(pipe, dev, x, y, width, height, scale);
+
+  // obsoleting the cache is meant for both sets of lines
+  if(pipe->cache_obsolete) dt_dev_pixelpipe_flush_caches(pipe);
+  pipe->cache_obsolete = 0;
+
+  // swap in the draft cache. lines from the last draft are still valid as long as the
+  // history below them didn't change, so the draft pipe gets the usual reuse too.
+  dt_pthread_mutex_lock(&pipe->busy_mutex);
+  dt_dev_pixelpipe_cache_t cache = pipe->cache;
+  pipe->cache = pipe->draft_cache;
+  pipe->draft_cache = cache;
+  pipe->draft = downscale;
+  dt_pthread_mutex_unlock(&pipe->busy_mutex);
+
+  const int err = dt_dev_pixelpipe_process(pipe, dev, x/downscale, y/downscale,
+                                           MAX(1, width/downscale), MAX(1, height/downscale), scale/downscale);
+
+  dt_pthread_mutex_lock(&pipe->busy_mutex);
+  cache = pipe->cache;
+  pipe->cache = pipe->draft_cache;
+  pipe->draft_cache = cache;
+  pipe->draft = 0;
+  dt_pthread_mutex_unlock(&pipe->busy_mutex);
+  return err;
+}
+
 void dt_dev_pixelpipe_flush_caches(dt_dev_pixelpipe_t *pipe)
 {
   dt_dev_pixelpipe_cache_flush(&pipe->cache);
+  if(pipe->draft_cache.entries > 0) dt_dev_pixelpipe_cache_flush(&pipe->draft_cache);
 }
 
 void dt_dev_pixelpipe_get_dimensions(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int width_in, int height_in, int *width, int *height)
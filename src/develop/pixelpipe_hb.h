@@ -24,6 +24,7 @@
 #include "develop/imageop.h"
 #include "develop/develop.h"
 #include "develop/pixelpipe_cache.h"
+#include "develop/pixelpipe_scratch.h"
 
 /**
  * struct used by iop modules to connect to pixelpipe.
@@ -56,6 +57,7 @@ typedef struct dt_dev_pixelpipe_iop_t
   dt_iop_roi_t buf_in, buf_out;    // theoretical full buffer regions of interest, as passed through modify_roi_out
   int process_cl_ready;            // set this to 0 in commit_params to temporarily disable the use of process_cl
   float processed_maximum[3];      // sensor saturation after this iop, used internally for caching
+  int cancelled;                   // set by dt_iop_cancelled() when process() was told to stop early
 }
 dt_dev_pixelpipe_iop_t;
 
@@ -88,6 +90,10 @@ typedef struct dt_dev_pixelpipe_t
 {
   // store history/zoom caches
   dt_dev_pixelpipe_cache_t cache;
+  // small separate cache for draft renders, so they don't evict the full resolution lines
+  dt_dev_pixelpipe_cache_t draft_cache;
+  // temporary buffers for the modules, reused across runs
+  dt_dev_pixelpipe_scratch_t scratch;
   // set to non-zero in order to obsolete old cache entries on next pixelpipe run
   int cache_obsolete;
   // input buffer
@@ -111,6 +117,8 @@ typedef struct dt_dev_pixelpipe_t
   int backbuf_size;
   int backbuf_width, backbuf_height;
   uint64_t backbuf_hash;
+  // backbuf has to be drawn this much larger (draft renders)
+  float backbuf_upscale;
   dt_pthread_mutex_t backbuf_mutex, busy_mutex;
   // working?
   int processing;
@@ -122,6 +130,8 @@ typedef struct dt_dev_pixelpipe_t
   int opencl_error;
   // running in a tiling context?
   int tiling;
+  // downscale factor of the draft currently being rendered, 0 for normal processing
+  int draft;
   // should this pixelpipe display a mask in the end?
   int mask_display;
   // input data based on this timestamp:
@@ -173,9 +183,17 @@ void dt_dev_pixelpipe_synch_top(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *d
 
 // process region of interest of pixels. returns 1 if pipe was altered during processing.
 int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y, int width, int height, float scale);
+// quick low resolution render of the same region of interest, downscaled by the given factor. it runs on
+// a separate small cache and the backbuf is marked to be drawn upscaled. returns 1 if pipe was altered.
+int dt_dev_pixelpipe_process_draft(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y, int width, int height, float scale, int downscale);
 // convenience method that does not gamma-compress the image.
 int dt_dev_pixelpipe_process_no_gamma(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y, int width, int height, float scale);
 
+// raw-domain downscale plan for exports and thumbnails at less than half size: returns the integer
+// factor by which the mosaic can be binned at the pipe input before demosaic runs, or 1 if any enabled
+// module before demosaic needs full resolution (not flagged IOP_FLAGS_ALLOW_RAW_DOWNSCALE).
+int dt_dev_pixelpipe_raw_downscale_factor(dt_dev_pixelpipe_t *pipe, const float scale);
+
 // disable given op and all that comes after it in the pipe:
 void dt_dev_pixelpipe_disable_after(dt_dev_pixelpipe_t *pipe, const char *op);
 // disable given op andn all that comes before it in the pipe:
@@ -0,0 +1,148 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/pixelpipe_scratch.h"
+#include "common/darktable.h"
+#include <stdlib.h>
+#include <string.h>
+
+void dt_dev_pixelpipe_scratch_init(dt_dev_pixelpipe_scratch_t *scratch)
+{
+  memset(scratch, 0, sizeof(dt_dev_pixelpipe_scratch_t));
+  dt_pthread_mutex_init(&scratch->lock, NULL);
+}
+
+void dt_dev_pixelpipe_scratch_cleanup(dt_dev_pixelpipe_scratch_t *scratch)
+{
+  for(int k=0; k<DT_DEV_PIXELPIPE_SCRATCH_SLOTS; k++)
+  {
+    if(scratch->used[k])
+      fprintf(stderr, "[pixelpipe_scratch] buffer of %zu bytes still in use at cleanup!\n", scratch->size[k]);
+    free(scratch->data[k]);
+    scratch->data[k] = NULL;
+    scratch->size[k] = 0;
+  }
+  scratch->allocated = 0;
+  dt_pthread_mutex_destroy(&scratch->lock);
+}
+
+static void _scratch_drop(dt_dev_pixelpipe_scratch_t *scratch, const int k)
+{
+  free(scratch->data[k]);
+  scratch->allocated -= scratch->size[k];
+  scratch->data[k] = NULL;
+  scratch->size[k] = 0;
+}
+
+void *dt_dev_pixelpipe_scratch_alloc(dt_dev_pixelpipe_scratch_t *scratch, const size_t size)
+{
+  dt_pthread_mutex_lock(&scratch->lock);
+  scratch->queries++;
+  scratch->clock++;
+
+  // best fit among the idle buffers
+  int slot = -1;
+  for(int k=0; k<DT_DEV_PIXELPIPE_SCRATCH_SLOTS; k++)
+    if(scratch->data[k] && !scratch->used[k] && scratch->size[k] >= size
+       && (slot < 0 || scratch->size[k] < scratch->size[slot]))
+      slot = k;
+
+  if(slot < 0)
+  {
+    scratch->misses++;
+    // idle buffers which are too small would only pile up, replace them.
+    for(int k=0; k<DT_DEV_PIXELPIPE_SCRATCH_SLOTS; k++)
+      if(scratch->data[k] && !scratch->used[k]) _scratch_drop(scratch, k);
+    for(int k=0; k<DT_DEV_PIXELPIPE_SCRATCH_SLOTS; k++)
+      if(!scratch->data[k])
+      {
+        slot = k;
+        break;
+      }
+    if(slot < 0)
+    {
+      // all slots busy, hand out an untracked buffer. release() will free it.
+      dt_pthread_mutex_unlock(&scratch->lock);
+      return dt_alloc_align(64, size);
+    }
+    scratch->data[slot] = dt_alloc_align(64, size);
+    if(!scratch->data[slot])
+    {
+      dt_pthread_mutex_unlock(&scratch->lock);
+      return NULL;
+    }
+    scratch->size[slot] = size;
+    scratch->allocated += size;
+  }
+
+  scratch->used[slot] = 1;
+  scratch->last_used[slot] = scratch->clock;
+  scratch->in_use += scratch->size[slot];
+  scratch->peak = MAX(scratch->peak, scratch->in_use);
+  void *data = scratch->data[slot];
+  dt_pthread_mutex_unlock(&scratch->lock);
+  return data;
+}
+
+void dt_dev_pixelpipe_scratch_release(dt_dev_pixelpipe_scratch_t *scratch, void *data)
+{
+  if(!data) return;
+  dt_pthread_mutex_lock(&scratch->lock);
+  for(int k=0; k<DT_DEV_PIXELPIPE_SCRATCH_SLOTS; k++)
+  {
+    if(scratch->data[k] == data)
+    {
+      scratch->used[k] = 0;
+      scratch->in_use -= scratch->size[k];
+      dt_pthread_mutex_unlock(&scratch->lock);
+      return;
+    }
+  }
+  dt_pthread_mutex_unlock(&scratch->lock);
+  free(data);
+}
+
+void dt_dev_pixelpipe_scratch_trim(dt_dev_pixelpipe_scratch_t *scratch)
+{
+  dt_pthread_mutex_lock(&scratch->lock);
+  // drop what hasn't been asked for since the last trim
+  for(int k=0; k<DT_DEV_PIXELPIPE_SCRATCH_SLOTS; k++)
+    if(scratch->data[k] && !scratch->used[k] && scratch->last_used[k] <= scratch->generation)
+      _scratch_drop(scratch, k);
+  // and keep no more than was needed at the same time, oldest first
+  while(scratch->allocated > MAX(scratch->peak, scratch->in_use))
+  {
+    int oldest = -1;
+    for(int k=0; k<DT_DEV_PIXELPIPE_SCRATCH_SLOTS; k++)
+      if(scratch->data[k] && !scratch->used[k]
+         && (oldest < 0 || scratch->last_used[k] < scratch->last_used[oldest]))
+        oldest = k;
+    if(oldest < 0) break;
+    _scratch_drop(scratch, oldest);
+  }
+  dt_print(DT_DEBUG_MEMORY, "[pixelpipe_scratch] peak %.1f MB, keeping %.1f MB, %" PRIu64 " of %" PRIu64 " requests allocated\n",
+           scratch->peak/(1024.0*1024.0), scratch->allocated/(1024.0*1024.0), scratch->misses, scratch->queries);
+  scratch->generation = scratch->clock;
+  scratch->peak = scratch->in_use;
+  scratch->queries = scratch->misses = 0;
+  dt_pthread_mutex_unlock(&scratch->lock);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
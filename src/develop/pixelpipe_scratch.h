@@ -0,0 +1,68 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef DT_PIXELPIPE_SCRATCH_H
+#define DT_PIXELPIPE_SCRATCH_H
+
+#include "common/dtpthread.h"
+#include <inttypes.h>
+#include <stddef.h>
+
+/**
+ * per pipe pool of temporary buffers for modules that need a couple of
+ * full size scratch images during process() (wavelet scales and such).
+ * buffers are kept across pipe runs, so moving a slider doesn't go through
+ * malloc/free of hundreds of megabytes each time. after each run the pool is
+ * trimmed down to what was actually needed at the same time (high water mark).
+ */
+#define DT_DEV_PIXELPIPE_SCRATCH_SLOTS 16
+
+typedef struct dt_dev_pixelpipe_scratch_t
+{
+  dt_pthread_mutex_t lock;
+  void    *data[DT_DEV_PIXELPIPE_SCRATCH_SLOTS];
+  size_t   size[DT_DEV_PIXELPIPE_SCRATCH_SLOTS];
+  int32_t  used[DT_DEV_PIXELPIPE_SCRATCH_SLOTS];
+  uint64_t last_used[DT_DEV_PIXELPIPE_SCRATCH_SLOTS];
+  uint64_t clock;      // incremented on every allocation
+  uint64_t generation; // clock at the last trim
+  size_t   allocated;  // bytes held by the pool
+  size_t   in_use;     // bytes currently handed out
+  size_t   peak;       // high water mark of in_use since the last trim
+  // profiling:
+  uint64_t queries;
+  uint64_t misses;
+}
+dt_dev_pixelpipe_scratch_t;
+
+void dt_dev_pixelpipe_scratch_init(dt_dev_pixelpipe_scratch_t *scratch);
+void dt_dev_pixelpipe_scratch_cleanup(dt_dev_pixelpipe_scratch_t *scratch);
+
+/** returns a 64 byte aligned buffer of at least size bytes, reusing one from an
+ * earlier run if possible. contents are undefined. returns NULL if out of memory. */
+void *dt_dev_pixelpipe_scratch_alloc(dt_dev_pixelpipe_scratch_t *scratch, const size_t size);
+
+/** gives a buffer back to the pool. NULL is ignored. */
+void dt_dev_pixelpipe_scratch_release(dt_dev_pixelpipe_scratch_t *scratch, void *data);
+
+/** frees buffers not needed in the last run, keeping at most the high water mark. */
+void dt_dev_pixelpipe_scratch_trim(dt_dev_pixelpipe_scratch_t *scratch);
+
+#endif
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
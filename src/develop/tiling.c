@@ -724,6 +724,9 @@ _default_process_tiling_ptp (struct dt_iop_module_t *self, struct dt_dev_pixelpi
     {
       piece->pipe->tiling = 1;
 
+      /* leave the remaining tiles alone if the pipe got cancelled, the output is thrown away anyways */
+      if(dt_iop_cancelled(piece)) goto cancelled;
+
       size_t wd = tx * tile_wd + width > roi_in->width  ? roi_in->width - tx * tile_wd : width;
       size_t ht = ty * tile_ht + height > roi_in->height ? roi_in->height- ty * tile_ht : height;
 
@@ -796,6 +799,7 @@ _default_process_tiling_ptp (struct dt_iop_module_t *self, struct dt_dev_pixelpi
   for(int k=0; k<3; k++)
     piece->pipe->processed_maximum[k] = processed_maximum_new[k];
 
+cancelled:
   if(input != NULL) free(input);
   if(output != NULL) free(output);
   piece->pipe->tiling = 0;
@@ -955,6 +959,9 @@ _default_process_tiling_roi (struct dt_iop_module_t *self, struct dt_dev_pixelpi
     {
       piece->pipe->tiling = 1;
 
+      /* leave the remaining tiles alone if the pipe got cancelled, the output is thrown away anyways */
+      if(dt_iop_cancelled(piece)) goto cancelled;
+
       /* the output dimensions of the good part of this specific tile */
       size_t wd = (tx + 1) * tile_wd > roi_out->width  ? roi_out->width - tx * tile_wd : tile_wd;
       size_t ht = (ty + 1) * tile_ht > roi_out->height ? roi_out->height- ty * tile_ht : tile_ht;
@@ -1092,6 +1099,7 @@ _default_process_tiling_roi (struct dt_iop_module_t *self, struct dt_dev_pixelpi
   for(int k=0; k<3; k++)
     piece->pipe->processed_maximum[k] = processed_maximum_new[k];
 
+cancelled:
   if(input != NULL) free(input);
   if(output != NULL) free(output);
   piece->pipe->tiling = 0;
@@ -1,5 +1,6 @@
 #include "StdAfx.h"
 #include "DngDecoderSlices.h"
+#include "TaskPool.h"
 /*
     RawSpeed - RAW file decoder.
 
@@ -29,7 +30,7 @@ namespace RawSpeed {
 #endif
 #define CHECKSIZE(A) if (A > size) ThrowIOE("Error decoding DNG Slice (invalid size). File Corrupt")
 
-void *DecodeThread(void *_this) {
+static void DecodeThread(void *_this) {
   DngDecoderThread* me = (DngDecoderThread*)_this;
   DngDecoderSlices* parent = me->parent;
   try {
@@ -37,8 +38,6 @@ void *DecodeThread(void *_this) {
   } catch (...) {
     parent->mRaw->setError("DNGDEcodeThread: Caught exception.");
   }
-  pthread_exit(NULL);
-  return NULL;
 }
 
 
@@ -56,15 +55,13 @@ void DngDecoderSlices::addSlice(DngSliceElement slice) {
 }
 
 void DngDecoderSlices::startDecoding() {
-  // Create threads
+  // Hand the slices to the shared decoder pool
 
-  nThreads = getThreadCount();
+  TaskPool *pool = TaskPool::getShared();
+  nThreads = pool->getThreads() + 1;
   int slicesPerThread = ((int)slices.size() + nThreads - 1) / nThreads;
 //  decodedSlices = 0;
-  pthread_attr_t attr;
-  /* Initialize and set thread detached attribute */
-  pthread_attr_init(&attr);
-  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+  void **args = new void*[nThreads];
 
   for (uint32 i = 0; i < nThreads; i++) {
     DngDecoderThread* t = new DngDecoderThread();
@@ -75,17 +72,16 @@ void DngDecoderSlices::startDecoding() {
       }
     }
     t->parent = this;
-    pthread_create(&t->threadid, &attr, DecodeThread, t);
+    args[i] = t;
     threads.push_back(t);
   }
-  pthread_attr_destroy(&attr);
 
-  void *status;
-  for (uint32 i = 0; i < nThreads; i++) {
-    pthread_join(threads[i]->threadid, &status);
-    delete(threads[i]);
-  }
+  pool->runTasks(DecodeThread, args, nThreads);
 
+  for (uint32 i = 0; i < nThreads; i++)
+    delete(threads[i]);
+  threads.clear();
+  delete[] args;
 }
 
 #if JPEG_LIB_VERSION < 80
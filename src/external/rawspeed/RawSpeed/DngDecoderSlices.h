@@ -47,7 +47,6 @@ class DngDecoderThread
 public:
   DngDecoderThread(void) {}
   ~DngDecoderThread(void) {}
-  pthread_t threadid;
   queue<DngSliceElement> slices;
   DngDecoderSlices* parent;
 };
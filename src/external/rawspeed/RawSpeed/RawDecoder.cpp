@@ -1,5 +1,6 @@
 #include "StdAfx.h"
 #include "RawDecoder.h"
+#include "TaskPool.h"
 /*
     RawSpeed - RAW file decoder.
 
@@ -260,7 +261,7 @@ void RawDecoder::setMetaData(CameraMetaData *meta, string make, string model, st
 }
 
 
-void *RawDecoderDecodeThread(void *_this) {
+static void RawDecoderDecodeThread(void *_this) {
   RawDecoderThread* me = (RawDecoderThread*)_this;
   try {
       me->parent->decodeThreaded(me);
@@ -268,41 +269,35 @@ void *RawDecoderDecodeThread(void *_this) {
     me->parent->mRaw->setError(ex.what());
   } catch (IOException &ex) {
     me->parent->mRaw->setError(ex.what());
+  } catch (...) {
+    me->parent->mRaw->setError("RawDecoderDecodeThread: Caught exception.");
   }
-
-  pthread_exit(NULL);
-  return 0;
 }
 
 void RawDecoder::startThreads() {
+  TaskPool *pool = TaskPool::getShared();
   uint32 threads;
-  threads = getThreadCount(); 
+  threads = pool->getThreads() + 1;
   int y_offset = 0;
   int y_per_thread = (mRaw->dim.y + threads - 1) / threads;
   RawDecoderThread *t = new RawDecoderThread[threads];
-
-  pthread_attr_t attr;
-
-  /* Initialize and set thread detached attribute */
-  pthread_attr_init(&attr);
-  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+  void **args = new void*[threads];
 
   for (uint32 i = 0; i < threads; i++) {
     t[i].start_y = y_offset;
     t[i].end_y = MIN(y_offset + y_per_thread, mRaw->dim.y);
     t[i].parent = this;
-    pthread_create(&t[i].threadid, &attr, RawDecoderDecodeThread, &t[i]);
+    args[i] = &t[i];
     y_offset = t[i].end_y;
   }
 
-  void *status;
-  for (uint32 i = 0; i < threads; i++) {
-    pthread_join(t[i].threadid, &status);
-  }
-  if (mRaw->errors.size() >= threads)
-    ThrowRDE("RawDecoder::startThreads: All threads reported errors. Cannot load image.");
+  pool->runTasks(RawDecoderDecodeThread, args, threads);
 
+  delete[] args;
   delete[] t;
+
+  if (mRaw->errors.size() >= threads)
+    ThrowRDE("RawDecoder::startThreads: All threads reported errors. Cannot load image.");
 }
 
 void RawDecoder::decodeThreaded(RawDecoderThread * t) {
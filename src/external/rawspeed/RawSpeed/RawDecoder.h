@@ -45,7 +45,6 @@ class RawDecoderThread
     uint32 start_y;
     uint32 end_y;
     const char* error;
-    pthread_t threadid;
     RawDecoder* parent;
 };
 
@@ -1,6 +1,7 @@
 #include "StdAfx.h"
 #include "RawImage.h"
 #include "RawDecoder.h"  // For exceptions
+#include "TaskPool.h"
 /*
     RawSpeed - RAW file decoder.
 
@@ -271,11 +272,14 @@ void RawImageData::fixBadPixels()
 
 }
 
+static void RawImageWorkerThread(void *_this);
+
 void RawImageData::startWorker(RawImageWorker::RawImageWorkerTask task, bool cropped )
 {
   int height = cropped ? dim.y : uncropped_dim.y;
 
-  int threads = getThreadCount(); 
+  TaskPool *pool = TaskPool::getShared();
+  int threads = pool->getThreads() + 1;
   if (threads <= 1) {
     RawImageWorker worker(this, task, 0, height);
     worker.performTask();
@@ -283,19 +287,20 @@ void RawImageData::startWorker(RawImageWorker::RawImageWorkerTask task, bool cro
   }
 
   RawImageWorker **workers = new RawImageWorker*[threads];
+  void **args = new void*[threads];
   int y_offset = 0;
   int y_per_thread = (height + threads - 1) / threads;
 
   for (int i = 0; i < threads; i++) {
     int y_end = MIN(y_offset + y_per_thread, height);
     workers[i] = new RawImageWorker(this, task, y_offset, y_end);
-    workers[i]->startThread();
+    args[i] = workers[i];
     y_offset = y_end;
   }
-  for (int i = 0; i < threads; i++) {
-    workers[i]->waitForThread();
+  pool->runTasks(RawImageWorkerThread, args, threads);
+  for (int i = 0; i < threads; i++)
     delete workers[i];
-  }
+  delete[] args;
   delete[] workers;
 }
 
@@ -336,11 +341,9 @@ RawImage& RawImage::operator=(const RawImage & p) {
   return *this;
 }
 
-void *RawImageWorkerThread(void *_this) {
+static void RawImageWorkerThread(void *_this) {
   RawImageWorker* me = (RawImageWorker*)_this;
   me->performTask();
-  pthread_exit(NULL);
-  return 0;
 }
 
 RawImageWorker::RawImageWorker( RawImageData *_img, RawImageWorkerTask _task, int _start_y, int _end_y )
@@ -351,21 +354,6 @@ RawImageWorker::RawImageWorker( RawImageData *_img, RawImageWorkerTask _task, in
   task = _task;
 }
 
-void RawImageWorker::startThread()
-{
-  /* Initialize and set thread detached attribute */
-  pthread_attr_t attr;
-  pthread_attr_init(&attr);
-  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-  pthread_create(&threadid, &attr, RawImageWorkerThread, this);
-}
-
-void RawImageWorker::waitForThread()
-{ 
-  void *status;
-  pthread_join(threadid, &status);
-}
-
 void RawImageWorker::performTask()
 {
   try {
@@ -386,6 +374,8 @@ void RawImageWorker::performTask()
     data->setError(e.what());
   } catch (IOException &e) {
     data->setError(e.what());
+  } catch (...) {
+    data->setError("RawImageWorker: Caught exception.");
   }
 }
 
@@ -36,11 +36,8 @@ class RawImageWorker {
 public:
   typedef enum {SCALE_VALUES, FIX_BAD_PIXELS} RawImageWorkerTask;
   RawImageWorker(RawImageData *img, RawImageWorkerTask task, int start_y, int end_y);
-  void startThread();
-  void waitForThread();
   void performTask();
 protected:
-  pthread_t threadid;
   RawImageData* data;
   RawImageWorkerTask task;
   int start_y;
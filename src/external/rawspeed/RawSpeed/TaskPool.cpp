@@ -0,0 +1,144 @@
+#include "StdAfx.h"
+#include "TaskPool.h"
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2026 agent
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+namespace RawSpeed {
+
+static TaskPool* sharedPool = NULL;
+static pthread_once_t sharedPoolOnce = PTHREAD_ONCE_INIT;
+
+static void createSharedPool() {
+  // The calling thread always takes part, so one worker less is enough.
+  uint32 threads = getThreadCount();
+  sharedPool = new TaskPool(threads > 1 ? threads - 1 : 0);
+}
+
+TaskPool* TaskPool::getShared() {
+  pthread_once(&sharedPoolOnce, createSharedPool);
+  return sharedPool;
+}
+
+TaskPool::TaskPool(uint32 nThreads) : stop(false) {
+  pthread_mutex_init(&mutex, NULL);
+  pthread_cond_init(&wakeup, NULL);
+
+  pthread_attr_t attr;
+  /* Initialize and set thread detached attribute */
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+  for (uint32 i = 0; i < nThreads; i++) {
+    pthread_t t;
+    if (pthread_create(&t, &attr, workerMain, this) == 0)
+      workers.push_back(t);
+  }
+  pthread_attr_destroy(&attr);
+}
+
+TaskPool::~TaskPool(void) {
+  pthread_mutex_lock(&mutex);
+  stop = true;
+  pthread_cond_broadcast(&wakeup);
+  pthread_mutex_unlock(&mutex);
+
+  void *status;
+  for (uint32 i = 0; i < workers.size(); i++)
+    pthread_join(workers[i], &status);
+
+  pthread_cond_destroy(&wakeup);
+  pthread_mutex_destroy(&mutex);
+}
+
+// Must be called with the mutex held.
+bool TaskPool::takeTask(Batch *b, uint32 *item) {
+  if (b->next >= b->count)
+    return false;
+  *item = b->next++;
+  if (b->next == b->count)
+    pending.remove(b);
+  return true;
+}
+
+// Must be called with the mutex held.
+void TaskPool::finishTask(Batch *b) {
+  if (++b->done == b->count)
+    pthread_cond_signal(&b->finished);
+}
+
+void* TaskPool::workerMain(void *_this) {
+  TaskPool* me = (TaskPool*)_this;
+  pthread_mutex_lock(&me->mutex);
+  while (true) {
+    while (me->pending.empty() && !me->stop)
+      pthread_cond_wait(&me->wakeup, &me->mutex);
+    if (me->stop)
+      break;
+
+    Batch *b = me->pending.front();
+    uint32 item;
+    if (!me->takeTask(b, &item))
+      continue;
+    pthread_mutex_unlock(&me->mutex);
+    b->func(b->args[item]);
+    pthread_mutex_lock(&me->mutex);
+    me->finishTask(b);
+  }
+  pthread_mutex_unlock(&me->mutex);
+  return NULL;
+}
+
+void TaskPool::runTasks(TaskPoolFunc func, void **args, uint32 count) {
+  if (count == 0)
+    return;
+
+  if (workers.empty() || count == 1) {
+    for (uint32 i = 0; i < count; i++)
+      func(args[i]);
+    return;
+  }
+
+  Batch b;
+  b.func = func;
+  b.args = args;
+  b.count = count;
+  b.next = 0;
+  b.done = 0;
+  pthread_cond_init(&b.finished, NULL);
+
+  pthread_mutex_lock(&mutex);
+  pending.push_back(&b);
+  pthread_cond_broadcast(&wakeup);
+
+  // Work on our own items until all are taken, then wait for the workers.
+  uint32 item;
+  while (takeTask(&b, &item)) {
+    pthread_mutex_unlock(&mutex);
+    func(args[item]);
+    pthread_mutex_lock(&mutex);
+    finishTask(&b);
+  }
+  while (b.done < b.count)
+    pthread_cond_wait(&b.finished, &mutex);
+  pthread_mutex_unlock(&mutex);
+
+  pthread_cond_destroy(&b.finished);
+}
+
+} // namespace RawSpeed
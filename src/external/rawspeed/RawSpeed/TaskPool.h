@@ -0,0 +1,73 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include "Common.h"
+/* 
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2026 agent
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+namespace RawSpeed {
+
+/*************************************************************************
+ * Persistent pool of worker threads shared by all decoders.
+ *
+ * Instead of creating and joining getThreadCount() threads for every
+ * file, decoders hand their work items to the shared pool. The calling
+ * thread works on its own items too, so concurrent decodes never wait
+ * for each other, and the total number of decoder threads stays bounded
+ * by the pool size no matter how many files are decoded in parallel.
+ *
+ * Task functions must not throw.
+ *****************************/
+typedef void (*TaskPoolFunc)(void *arg);
+
+class TaskPool
+{
+public:
+  TaskPool(uint32 nThreads);
+  ~TaskPool(void);
+  /* Run func(args[i]) for all i < count and return when all have finished */
+  void runTasks(TaskPoolFunc func, void **args, uint32 count);
+  uint32 getThreads() {return (uint32)workers.size();}
+  /* The pool used by the decoders, created on first use */
+  static TaskPool* getShared();
+private:
+  class Batch
+  {
+  public:
+    TaskPoolFunc func;
+    void **args;
+    uint32 count;
+    uint32 next;    // first item not yet taken
+    uint32 done;    // number of finished items
+    pthread_cond_t finished;
+  };
+  static void* workerMain(void *_this);
+  bool takeTask(Batch *b, uint32 *item);
+  void finishTask(Batch *b);
+  pthread_mutex_t mutex;
+  pthread_cond_t wakeup;
+  list<Batch*> pending;
+  vector<pthread_t> workers;
+  bool stop;
+};
+
+} // namespace RawSpeed
+
+#endif
@@ -29,6 +29,7 @@
 #include "common/imageio_format.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <png.h>
 #include <inttypes.h>
 #include <zlib.h>
@@ -122,89 +123,251 @@ static void PNGwriteRawProfile(png_struct *ping,
   png_free(ping, text);
 }
 
+// rows are filtered and deflated in parallel, in blocks of about this many bytes.
+// every block is primed with the data before it, so this costs hardly any compression.
+#define DT_PNG_BLOCK_SIZE (1<<18)
+#define DT_PNG_WINDOW 32768
+
+// converts row y of the rgba input to png byte order
+static void
+_png_pack_row(const void *in, const int bpp, const int width, const int y, uint8_t *row)
+{
+  if(bpp > 8)
+  {
+    const uint16_t *in16 = (const uint16_t *)in + (size_t)4*width*y;
+    for(int x=0; x<width; x++) for(int k=0; k<3; k++)
+      {
+        const uint16_t pix = in16[4*x + k];
+        row[6*x + 2*k + 0] = pix >> 8;
+        row[6*x + 2*k + 1] = pix & 0xff;
+      }
+  }
+  else
+  {
+    const uint8_t *in8 = (const uint8_t *)in + (size_t)4*width*y;
+    for(int x=0; x<width; x++) for(int k=0; k<3; k++) row[3*x + k] = in8[4*x + k];
+  }
+}
+
+static inline uint8_t
+_png_paeth(const int a, const int b, const int c)
+{
+  const int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+  if(pa <= pb && pa <= pc) return a;
+  if(pb <= pc) return b;
+  return c;
+}
+
+static inline uint8_t
+_png_filter_byte(const int f, const uint8_t *cur, const uint8_t *prev, const size_t i, const int pixbytes)
+{
+  const int a = i >= pixbytes ? cur[i - pixbytes] : 0;
+  const int b = prev ? prev[i] : 0;
+  const int c = (prev && i >= pixbytes) ? prev[i - pixbytes] : 0;
+  switch(f)
+  {
+    case 1: return cur[i] - a;
+    case 2: return cur[i] - b;
+    case 3: return cur[i] - ((a + b) >> 1);
+    case 4: return cur[i] - _png_paeth(a, b, c);
+    default: return cur[i];
+  }
+}
+
+// writes the filter byte and the filtered row to out. like libpng, picks the filter
+// with the smallest sum of absolute (signed) differences.
+static void
+_png_filter_row(const uint8_t *cur, const uint8_t *prev, const size_t len, const int pixbytes, uint8_t *out)
+{
+  size_t sum[5] = { 0 };
+  for(size_t i=0; i<len; i++)
+  {
+    const int a = i >= pixbytes ? cur[i - pixbytes] : 0;
+    const int b = prev ? prev[i] : 0;
+    const int c = (prev && i >= pixbytes) ? prev[i - pixbytes] : 0;
+    const uint8_t v[5] = { cur[i], cur[i] - a, cur[i] - b, cur[i] - ((a + b) >> 1), cur[i] - _png_paeth(a, b, c) };
+    for(int f=0; f<5; f++) sum[f] += v[f] < 128 ? v[f] : 256 - v[f];
+  }
+  int best = 0;
+  for(int f=1; f<5; f++) if(sum[f] < sum[best]) best = f;
+  out[0] = best;
+  for(size_t i=0; i<len; i++) out[i + 1] = _png_filter_byte(best, cur, prev, i, pixbytes);
+}
+
 int
 write_image (dt_imageio_module_data_t *p_tmp, const char *filename, const void *in_void, void *exif, int exif_len, int imgid)
 {
   dt_imageio_png_t*p=(dt_imageio_png_t*)p_tmp;
   const int width = p->width, height = p->height;
   const uint8_t *in = (uint8_t *)in_void;
-  FILE *f = fopen(filename, "wb");
-  if (!f) return 1;
+
+  const int pixbytes = p->bpp > 8 ? 6 : 3;
+  const size_t rowbytes = (size_t)pixbytes*width;
+  const int block_rows = MAX(1, DT_PNG_BLOCK_SIZE/(rowbytes + 1));
+  const int nblocks = dt_get_num_threads();
+  const int batch_rows = nblocks*block_rows;
+  const size_t block_bytes = (size_t)block_rows*(rowbytes + 1);
+  const size_t zbound = compressBound(block_bytes) + 6;
+
+  // filtered scanlines of one batch of blocks, preceded by the end of the previous batch
+  // as dictionary for the first block, and the deflated blocks.
+  uint8_t *filtered = (uint8_t *)malloc(DT_PNG_WINDOW + (size_t)nblocks*block_bytes);
+  uint8_t *zbuf = (uint8_t *)malloc((size_t)nblocks*zbound);
+  size_t *zlen = (size_t *)malloc(sizeof(size_t)*nblocks);
+  uLong *adler = (uLong *)malloc(sizeof(uLong)*nblocks);
+  // current and previous row in png byte order, per thread
+  uint8_t *packed = (uint8_t *)malloc((size_t)2*rowbytes*nblocks);
+  int *packed_y = (int *)malloc(sizeof(int)*nblocks);
+  FILE *f = filtered && zbuf && zlen && adler && packed && packed_y ? fopen(filename, "wb") : NULL;
+  if (!f) goto error_nofile;
 
   png_structp png_ptr;
   png_infop info_ptr;
 
   png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
   if (!png_ptr)
-  {
-    fclose(f);
-    return 1;
-  }
+    goto error;
 
   info_ptr = png_create_info_struct(png_ptr);
   if (!info_ptr)
   {
-    fclose(f);
     png_destroy_write_struct(&png_ptr, NULL);
-    return 1;
+    goto error;
   }
 
   if (setjmp(png_jmpbuf(png_ptr)))
   {
-    fclose(f);
-    png_destroy_write_struct(&png_ptr, NULL);
-    return 1;
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    goto error;
   }
 
   png_init_io(png_ptr, f);
 
-  png_set_compression_level(png_ptr, Z_BEST_COMPRESSION);
-  png_set_compression_mem_level(png_ptr, 8);
-  png_set_compression_strategy(png_ptr, Z_DEFAULT_STRATEGY);
-  png_set_compression_window_bits(png_ptr, 15);
-  png_set_compression_method(png_ptr, 8);
-  png_set_compression_buffer_size(png_ptr, 8192);
-
   png_set_IHDR(png_ptr, info_ptr, width, height,
                p->bpp, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
                PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
-  png_write_info(png_ptr, info_ptr);
+  // goes out with the header, as we write the image data ourselves
+  PNGwriteRawProfile(png_ptr, info_ptr, "exif", exif, exif_len);
+
+  // TODO: embed icc profile!
 
-  // png_bytep row_pointer = (png_bytep) in;
-  png_byte row[6*width];
-  // unsigned long rowbytes = png_get_rowbytes(png_ptr, info_ptr);
+  png_write_info(png_ptr, info_ptr);
 
-  if(p->bpp > 8)
+  // libpng deflates the image data as one stream on one thread. instead, compress
+  // blocks of rows in parallel as raw deflate, ended with a sync flush so they can
+  // be concatenated, and wrap them into a single zlib stream in the IDAT chunks.
+  for(int t=0; t<nblocks; t++) packed_y[t] = -1;
+  uLong stream_adler = adler32(0L, Z_NULL, 0);
+  size_t dict_len = 0;
+  for(int y0=0; y0<height; y0+=batch_rows)
   {
-    for (int y = 0; y < height; y++)
+    const int rows = MIN(batch_rows, height - y0);
+    uint8_t *const batch = filtered + DT_PNG_WINDOW;
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(none) shared(in, p, batch, y0, packed, packed_y) schedule(static)
+#endif
+    for(int r=0; r<rows; r++)
     {
-      for(int x=0; x<width; x++) for(int k=0; k<3; k++)
-        {
-          uint16_t pix = ((uint16_t *)in)[4*width*y + 4*x + k];
-          uint16_t swapped = (0xff00 & (pix<<8)) | (pix>>8);
-          ((uint16_t *)row)[3*x+k] = swapped;
-        }
-      png_write_row(png_ptr, row);
+      // the two rows of a thread take turns, so consecutive rows are packed only once
+      const int thread = dt_get_thread_num();
+      const int y = y0 + r;
+      uint8_t *cur = packed + (size_t)rowbytes*(2*thread + (y & 1));
+      uint8_t *prev = packed + (size_t)rowbytes*(2*thread + !(y & 1));
+      if(y > 0 && packed_y[thread] != y - 1) _png_pack_row(in, p->bpp, width, y - 1, prev);
+      _png_pack_row(in, p->bpp, width, y, cur);
+      packed_y[thread] = y;
+      _png_filter_row(cur, y > 0 ? prev : NULL, rowbytes, pixbytes, batch + (size_t)r*(rowbytes + 1));
     }
-  }
-  else
-  {
-    for (int y = 0; y < height; y++)
+
+    const int blocks = (rows + block_rows - 1)/block_rows;
+    const size_t batch_bytes = (size_t)rows*(rowbytes + 1);
+    int failed = 0;
+#ifdef _OPENMP
+    #pragma omp parallel for default(none) shared(batch, zbuf, zlen, adler, y0, dict_len) reduction(+:failed) schedule(static)
+#endif
+    for(int b=0; b<blocks; b++)
     {
-      for(int x=0; x<width; x++) for(int k=0; k<3; k++) row[3*x+k] = in[4*width*y + 4*x + k];
-      png_write_row(png_ptr, row);
+      const uint8_t *src = batch + (size_t)b*block_bytes;
+      const size_t len = MIN(block_bytes, batch_bytes - (size_t)b*block_bytes);
+      const int last = y0 + rows == height && b == blocks - 1;
+      // zlib header in front of the first block, adler32 behind the last one
+      uint8_t *dst = zbuf + (size_t)b*zbound + 2;
+      adler[b] = adler32(adler32(0L, Z_NULL, 0), src, len);
+
+      z_stream strm;
+      memset(&strm, 0, sizeof(strm));
+      if(deflateInit2(&strm, Z_BEST_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      {
+        failed++;
+        continue;
+      }
+      const size_t dlen = b ? MIN((size_t)DT_PNG_WINDOW, (size_t)b*block_bytes) : dict_len;
+      if(dlen) deflateSetDictionary(&strm, src - dlen, dlen);
+      strm.next_in = (Bytef *)src;
+      strm.avail_in = len;
+      strm.next_out = dst;
+      strm.avail_out = zbound - 6;
+      if(deflate(&strm, last ? Z_FINISH : Z_SYNC_FLUSH) != (last ? Z_STREAM_END : Z_OK) || strm.avail_in) failed++;
+      zlen[b] = strm.total_out;
+      deflateEnd(&strm);
     }
-  }
+    if(failed) png_error(png_ptr, "deflate failed");
 
-  PNGwriteRawProfile(png_ptr, info_ptr, "exif", exif, exif_len);
+    for(int b=0; b<blocks; b++)
+    {
+      const size_t len = MIN(block_bytes, batch_bytes - (size_t)b*block_bytes);
+      uint8_t *dst = zbuf + (size_t)b*zbound + 2;
+      size_t out_len = zlen[b];
+      stream_adler = adler32_combine(stream_adler, adler[b], len);
+      if(y0 == 0 && b == 0)
+      {
+        // deflate, 32k window, best compression
+        dst -= 2;
+        dst[0] = 0x78;
+        dst[1] = 0xda;
+        out_len += 2;
+      }
+      if(y0 + rows == height && b == blocks - 1)
+      {
+        uint8_t *trailer = dst + out_len;
+        trailer[0] = stream_adler >> 24;
+        trailer[1] = stream_adler >> 16;
+        trailer[2] = stream_adler >> 8;
+        trailer[3] = stream_adler;
+        out_len += 4;
+      }
+      png_write_chunk(png_ptr, (png_const_bytep)"IDAT", dst, out_len);
+    }
 
-  // TODO: embed icc profile!
+    // keep the end of this batch around to prime the next one
+    dict_len = MIN((size_t)DT_PNG_WINDOW, batch_bytes);
+    memmove(filtered + DT_PNG_WINDOW - dict_len, batch + batch_bytes - dict_len, dict_len);
+  }
 
-  png_write_end(png_ptr, info_ptr);
+  // png_write_end() insists on image data written through libpng, finish the file by hand
+  png_write_chunk(png_ptr, (png_const_bytep)"IEND", NULL, 0);
   png_destroy_write_struct(&png_ptr, &info_ptr);
   fclose(f);
+  free(filtered);
+  free(zbuf);
+  free(zlen);
+  free(adler);
+  free(packed);
+  free(packed_y);
   return 0;
+
+error:
+  fclose(f);
+error_nofile:
+  free(filtered);
+  free(zbuf);
+  free(zlen);
+  free(adler);
+  free(packed);
+  free(packed_y);
+  return 1;
 }
 
 int read_header(const char *filename, dt_imageio_module_data_t *p_tmp)
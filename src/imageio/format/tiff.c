@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <inttypes.h>
 #include <tiffio.h>
+#include <zlib.h>
 #include "common/darktable.h"
 #include "common/imageio_module.h"
 #include "common/imageio.h"
@@ -70,6 +71,11 @@ int write_image (dt_imageio_module_data_t *d_tmp, const char *filename, const vo
 
   // Create tiff image
   TIFF *tif=TIFFOpen(filename,"wb");
+  if(!tif)
+  {
+    free(profile);
+    return 1;
+  }
   if(d->bpp == 8) TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
   else            TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 16);
   TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_DEFLATE);
@@ -88,65 +94,66 @@ int write_image (dt_imageio_module_data_t *d_tmp, const char *filename, const vo
   TIFFSetField(tif, TIFFTAG_YRESOLUTION, 300.0);
   TIFFSetField(tif, TIFFTAG_ZIPQUALITY, 9);
 
-  const uint8_t  *in8 =(const uint8_t  *)in_void;
-  const uint16_t *in16=(const uint16_t *)in_void;
-  if(d->bpp == 16)
+  // libtiff deflates strip by strip on one thread. instead, convert and compress a
+  // batch of strips in parallel and hand the finished strips to libtiff in order.
+  const int bytes = d->bpp == 16 ? sizeof(uint16_t) : sizeof(uint8_t);
+  const size_t rowsize = (size_t)d->width*3*bytes;
+  const size_t stripesize = rowsize*DT_TIFFIO_STRIPE;
+  const uLong zbound = compressBound(stripesize);
+  const int nstripes = (d->height + DT_TIFFIO_STRIPE - 1)/DT_TIFFIO_STRIPE;
+  const int batch = dt_get_num_threads();
+  // raw strips bypass libtiff's byte swapping for the big endian file
+  const int swab = TIFFIsByteSwapped(tif);
+  uint8_t *rowdata = (uint8_t *)malloc(stripesize*batch);
+  uint8_t *zdata = (uint8_t *)malloc((size_t)zbound*batch);
+  uLongf *zlen = (uLongf *)malloc(sizeof(uLongf)*batch);
+  int failed = !rowdata || !zdata || !zlen;
+
+  for(int s0=0; s0<nstripes && !failed; s0+=batch)
   {
-    uint32_t rowsize=(d->width*3)*sizeof(uint16_t);
-    uint32_t stripesize=rowsize*DT_TIFFIO_STRIPE;
-    uint16_t *rowdata = (uint16_t *)malloc(stripesize);
-    uint16_t *wdata = rowdata;
-    uint32_t stripe=0;
-    // uint32_t insize=((d->width*d->height)*3)*sizeof(uint16_t);
-    // while(stripedata<(in8+insize)-(stripesize)) {
-    // TIFFWriteEncodedStrip(tif,stripe++,stripedata,stripesize);
-    // stripedata+=stripesize;
-    // }
-    for (int y = 0; y < d->height; y++)
+    const int stripes = MIN(batch, nstripes - s0);
+#ifdef _OPENMP
+    #pragma omp parallel for default(none) shared(in_void, d, rowdata, zdata, zlen, s0) reduction(+:failed) schedule(dynamic)
+#endif
+    for(int s=0; s<stripes; s++)
     {
-      for(int x=0; x<d->width; x++)
-        for(int k=0; k<3; k++)
-        {
-          (wdata)[0] = in16[4*d->width*y + 4*x + k];
-          wdata++;
-        }
-      if((wdata-stripesize/sizeof(uint16_t))==rowdata)
+      const int y0 = (s0 + s)*DT_TIFFIO_STRIPE;
+      const int rows = MIN(DT_TIFFIO_STRIPE, d->height - y0);
+      uint8_t *stripe = rowdata + stripesize*s;
+      if(d->bpp == 16)
       {
-        TIFFWriteEncodedStrip(tif,stripe++,rowdata,rowsize*DT_TIFFIO_STRIPE);
-        wdata=rowdata;
+        const uint16_t *in16 = (const uint16_t *)in_void + (size_t)4*d->width*y0;
+        uint16_t *wdata = (uint16_t *)stripe;
+        for(size_t k=0; k<(size_t)d->width*rows; k++, in16 += 4, wdata += 3)
+          for(int c=0; c<3; c++)
+            wdata[c] = swab ? (uint16_t)((in16[c] << 8) | (in16[c] >> 8)) : in16[c];
       }
-    }
-    if((wdata-stripesize/sizeof(uint16_t))!=rowdata)
-      TIFFWriteEncodedStrip(tif,stripe,rowdata,(wdata-rowdata)*sizeof(uint16_t));
-    TIFFClose(tif);
-    free(rowdata);
-  }
-  else
-  {
-    uint32_t rowsize=(d->width*3)*sizeof(uint8_t);
-    uint32_t stripesize=rowsize*DT_TIFFIO_STRIPE;
-    uint8_t *rowdata = (uint8_t *)malloc(stripesize);
-    uint8_t *wdata = rowdata;
-    uint32_t stripe=0;
-
-    for (int y = 0; y < d->height; y++)
-    {
-      for(int x=0; x<d->width; x++)
-        for(int k=0; k<3; k++)
+      else
+      {
+        const uint8_t *in8 = (const uint8_t *)in_void + (size_t)4*d->width*y0;
+        uint8_t *wdata = stripe;
+        for(size_t k=0; k<(size_t)d->width*rows; k++, in8 += 4, wdata += 3)
         {
-          (wdata)[0] = in8[4*d->width*y + 4*x + k];
-          wdata++;
+          wdata[0] = in8[0];
+          wdata[1] = in8[1];
+          wdata[2] = in8[2];
         }
-      if((wdata-stripesize)==rowdata)
-      {
-        TIFFWriteEncodedStrip(tif,stripe++,rowdata,rowsize*DT_TIFFIO_STRIPE);
-        wdata=rowdata;
       }
+      // same as libtiff's own deflate codec at zip quality 9
+      zlen[s] = zbound;
+      if(compress2(zdata + (size_t)zbound*s, &zlen[s], stripe, rowsize*rows, Z_BEST_COMPRESSION) != Z_OK) failed++;
     }
-    if((wdata-stripesize)!=rowdata)
-      TIFFWriteEncodedStrip(tif,stripe,rowdata,wdata-rowdata);
-    TIFFClose(tif);
-    free(rowdata);
+    for(int s=0; s<stripes && !failed; s++)
+      if(TIFFWriteRawStrip(tif, s0 + s, zdata + (size_t)zbound*s, zlen[s]) < 0) failed++;
+  }
+  TIFFClose(tif);
+  free(rowdata);
+  free(zdata);
+  free(zlen);
+  if(failed)
+  {
+    free(profile);
+    return 1;
   }
 
   if(exif)
@@ -142,6 +142,45 @@ gui_reset (dt_imageio_module_storage_t *self)
   dt_conf_set_string("plugins/imageio/storage/disk/file_directory", gtk_entry_get_text(d->entry));
 }
 
+typedef struct disk_written_t
+{
+  int num, total;
+}
+disk_written_t;
+
+// called once the file is written, possibly on an encoder thread of the export job:
+static void
+_written(const int res, const uint32_t imgid, const char *filename, dt_imageio_module_format_t *format,
+         dt_imageio_module_data_t *fdata, void *user_data)
+{
+  disk_written_t *w = (disk_written_t *)user_data;
+  if(res != 0)
+  {
+    fprintf(stderr, "[imageio_storage_disk] could not export to file: `%s'!\n", filename);
+    dt_control_log(_("could not export to file `%s'!"), filename);
+    // remove the placeholder reserving the file name
+    g_unlink(filename);
+    free(w);
+    return;
+  }
+
+  /* now write xmp into that container, if possible */
+  if((format->flags(fdata) & FORMAT_FLAGS_SUPPORT_XMP) && dt_exif_xmp_attach(imgid, filename) != 0)
+  {
+    fprintf(stderr, "[imageio_storage_disk] could not attach xmp data to file: `%s'!\n", filename);
+    // don't report that one to gui, as some formats (pfm, ppm, exr) just don't support
+    // writing xmp via exiv2, so it might not be to worry.
+    free(w);
+    return;
+  }
+
+  printf("[export_job] exported to `%s'\n", filename);
+  const char *trunc = filename + strlen(filename) - 32;
+  if(trunc < filename) trunc = filename;
+  dt_control_log(_("%d/%d exported to `%s%s'"), w->num, w->total, trunc != filename ? ".." : "", trunc);
+  free(w);
+}
+
 int
 store (dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, const int imgid, dt_imageio_module_format_t *format, dt_imageio_module_data_t *fdata,
        const int num, const int total, const gboolean high_quality)
@@ -228,32 +267,24 @@ failed:
       }
       while (g_file_test (filename,G_FILE_TEST_EXISTS));
     }
+    // the file may be written later by the export job's encoder threads,
+    // so reserve the name now for the check above to work on the next image:
+    if(!fail && g_file_set_contents(filename, "", 0, NULL) == FALSE)
+    {
+      fprintf(stderr, "[imageio_storage_disk] could not create file: `%s'!\n", filename);
+      dt_control_log(_("could not export to file `%s'!"), filename);
+      fail = 1;
+    }
 
   } // end of critical block
   dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
   if(fail) return 1;
 
   /* export image to file */
-  if(dt_imageio_export(imgid, filename, format, fdata, high_quality) != 0)
-  {
-    fprintf(stderr, "[imageio_storage_disk] could not export to file: `%s'!\n", filename);
-    dt_control_log(_("could not export to file `%s'!"), filename);
-    return 1;
-  }
-
-  /* now write xmp into that container, if possible */
-  if((format->flags(fdata) & FORMAT_FLAGS_SUPPORT_XMP) && dt_exif_xmp_attach(imgid, filename) != 0)
-  {
-    fprintf(stderr, "[imageio_storage_disk] could not attach xmp data to file: `%s'!\n", filename);
-    // don't report that one to gui, as some formats (pfm, ppm, exr) just don't support
-    // writing xmp via exiv2, so it might not be to worry.
-    return 1;
-  }
-
-  printf("[export_job] exported to `%s'\n", filename);
-  char *trunc = filename + strlen(filename) - 32;
-  if(trunc < filename) trunc = filename;
-  dt_control_log(_("%d/%d exported to `%s%s'"), num, total, trunc != filename ? ".." : "", trunc);
+  disk_written_t *w = (disk_written_t *)malloc(sizeof(disk_written_t));
+  w->num = num;
+  w->total = total;
+  dt_imageio_export_async(imgid, filename, format, fdata, high_quality, _written, w);
   return 0;
 }
 
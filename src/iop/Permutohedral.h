@@ -37,31 +37,26 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
  * The key for each point is its spatial location in the (d+1)-    *
  * dimensional space.                                              *
  *                                                                 *
+ * Open addressing with linear probing. A slot holds the key and   *
+ * the index of the point, values, keys and hashes of the points   *
+ * live in separate flat arrays.                                   *
+ *                                                                 *
  *******************************************************************/
 template <int KD, int VD>
 class HashTablePermutohedral
 {
 public:
   /* Constructor
-   *  kd_: the dimensionality of the position vectors on the hyperplane.
-   *  vd_: the dimensionality of the value vectors
+   *  expected: number of lattice points to make room for up front.
    */
-  HashTablePermutohedral()
+  HashTablePermutohedral(size_t expected = 0) : keys(NULL), values(NULL), hashes(NULL), entries(NULL), capacity(0), filled(0)
   {
-    capacity = 1 << 15;
-    capacity_bits = 0x7fff;
-    filled = 0;
-    entries = new Entry[capacity];
-    keys = new short[KD*capacity/2];
-    values = new float[VD*capacity/2];
-    memset(values, 0, sizeof(float)*VD*capacity/2);
+    allocate(expected);
   }
 
   ~HashTablePermutohedral()
   {
-    delete[] entries;
-    delete[] keys;
-    delete[] values;
+    release();
   }
 
   // Returns the number of vectors stored.
@@ -76,55 +71,72 @@ public:
     return keys;
   }
 
-  // Returns a pointer to the values array.
+  // Returns a pointer to the values array. There is always a zero vector right after the last point.
   float *getValues()
   {
     return values;
   }
 
-  /* Returns the index into the hash table for a given key.
+  // Returns a pointer to the hashes of the stored keys.
+  const size_t *getHashes()
+  {
+    return hashes;
+  }
+
+  // Make room for at least n points without growing in between.
+  void reserve(size_t n)
+  {
+    while(n >= capacity/2 - 1) grow();
+  }
+
+  // Frees all memory, the table is empty afterwards.
+  void clear()
+  {
+    release();
+    allocate(0);
+  }
+
+  /* Returns the index of the point with the given key.
    *     key: a pointer to the position vector.
    *       h: hash of the position vector.
    *  create: a flag specifying whether an entry should be created,
    *          should an entry with the given key not found.
    */
-  int lookupOffset(const short *key, size_t h, bool create = true)
+  int lookupIndex(const short *key, size_t h, bool create = true)
   {
-
     // Double hash table size if necessary
-    if (filled >= (capacity/2)-1)
+    if(create && filled >= (capacity/2)-1)
     {
       grow();
     }
 
+    size_t b = h & capacity_bits;
     // Find the entry with the given key
-    while (1)
+    while(1)
     {
-      Entry e = entries[h];
+      const Entry e = entries[b];
       // check if the cell is empty
-      if (e.keyIdx == -1)
+      if(e.index == -1)
       {
-        if (!create) return -1; // Return not found.
+        if(!create) return -1; // Return not found.
         // need to create an entry. Store the given key.
-        for (int i = 0; i < KD; i++)
+        for(int i = 0; i < KD; i++)
           keys[filled*KD+i] = key[i];
-        e.keyIdx = filled*KD;
-        e.valueIdx = filled*VD;
-        entries[h] = e;
-        filled++;
-        return e.valueIdx;
+        hashes[filled] = h;
+        entries[b].index = filled;
+        memcpy(entries[b].key, key, sizeof(short)*KD);
+        return filled++;
       }
 
       // check if the cell has a matching key
       bool match = true;
-      for (int i = 0; i < KD && match; i++)
-        match = keys[e.keyIdx+i] == key[i];
-      if (match)
-        return e.valueIdx;
+      for(int i = 0; i < KD && match; i++)
+        match = e.key[i] == key[i];
+      if(match)
+        return e.index;
 
       // increment the bucket with wraparound
-      h++;
-      if (h == capacity) h = 0;
+      b = (b + 1) & capacity_bits;
     }
   }
 
@@ -134,17 +146,17 @@ public:
    */
   float *lookup(const short *k, bool create = true)
   {
-    size_t h = hash(k) & capacity_bits;
-    int offset = lookupOffset(k, h, create);
-    if (offset < 0) return NULL;
-    else return values + offset;
+    const int index = lookupIndex(k, hash(k), create);
+    if(index < 0) return NULL;
+    else return values + (size_t)index*VD;
   };
 
-  /* Hash function used in this implementation. A simple base conversion. */
-  size_t hash(const short *key)
+  /* Hash function used in this implementation. A simple base conversion.
+   * It is linear in the key, see PermutohedralLattice::blur(). */
+  static size_t hash(const short *key)
   {
     size_t k = 0;
-    for (int i = 0; i < KD; i++)
+    for(int i = 0; i < KD; i++)
     {
       k += key[i];
       k *= 2531011;
@@ -153,12 +165,36 @@ public:
   }
 
 private:
+  void allocate(size_t expected)
+  {
+    capacity = 1 << 15;
+    while(capacity/2 - 1 <= expected) capacity *= 2;
+    capacity_bits = capacity - 1;
+    filled = 0;
+    entries = new Entry[capacity];
+    keys = new short[KD*capacity/2];
+    hashes = new size_t[capacity/2];
+    values = new float[VD*capacity/2];
+    memset(values, 0, sizeof(float)*VD*capacity/2);
+  }
+
+  void release()
+  {
+    delete[] entries;
+    delete[] keys;
+    delete[] hashes;
+    delete[] values;
+    entries = NULL;
+    keys = NULL;
+    hashes = NULL;
+    values = NULL;
+  }
+
   /* Grows the size of the hash table */
   void grow()
   {
-    size_t oldCapacity = capacity;
     capacity *= 2;
-    capacity_bits = (capacity_bits << 1) | 1;
+    capacity_bits = capacity - 1;
 
     // Migrate the value vectors.
     float *newValues = new float[VD*capacity/2];
@@ -167,43 +203,44 @@ private:
     delete[] values;
     values = newValues;
 
-    // Migrate the key vectors.
+    // Migrate the key vectors and hashes.
     short *newKeys = new short[KD*capacity/2];
     memcpy(newKeys, keys, sizeof(short)*KD*filled);
     delete[] keys;
     keys = newKeys;
 
-    Entry *newEntries = new Entry[capacity];
+    size_t *newHashes = new size_t[capacity/2];
+    memcpy(newHashes, hashes, sizeof(size_t)*filled);
+    delete[] hashes;
+    hashes = newHashes;
 
-    // Migrate the table of indices.
-    for (size_t i = 0; i < oldCapacity; i++)
+    // Rebuild the table of indices from the stored hashes.
+    delete[] entries;
+    entries = new Entry[capacity];
+    for(size_t i = 0; i < filled; i++)
     {
-      if (entries[i].keyIdx == -1) continue;
-      size_t h = hash(keys + entries[i].keyIdx) & capacity_bits;
-      while (newEntries[h].keyIdx != -1)
-      {
-        h++;
-        if (h == capacity) h = 0;
-      }
-      newEntries[h] = entries[i];
+      size_t b = hashes[i] & capacity_bits;
+      while(entries[b].index != -1) b = (b + 1) & capacity_bits;
+      entries[b].index = i;
+      memcpy(entries[b].key, keys + i*KD, sizeof(short)*KD);
     }
-    delete[] entries;
-    entries = newEntries;
   }
 
-  // Private struct for the hash table entries.
+  // Private struct for the hash table entries. the key is kept in the slot, so probing
+  // doesn't have to touch the key array.
   struct Entry
   {
-    Entry() : keyIdx(-1), valueIdx(-1) {}
-    int keyIdx;
-    int valueIdx;
+    Entry() : index(-1) {}
+    short key[KD];
+    int index;
   };
 
   short *keys;
   float *values;
+  size_t *hashes;
   Entry *entries;
   size_t capacity, filled;
-  unsigned long capacity_bits;
+  size_t capacity_bits;
 };
 
 /******************************************************************
@@ -229,7 +266,9 @@ public:
     float *scaleFactorTmp = new float[D];
     int *canonicalTmp = new int[(D+1)*(D+1)];
 
-    replay = new ReplayEntry[nData*(D+1)];
+    replayIndex = new int[(size_t)nData*(D+1)];
+    replayWeight = new float[(size_t)nData*(D+1)];
+    replayTable = new short[nData];
 
     // compute the coordinates of the canonical simplex, in which
     // the difference between a contained point and the zero
@@ -265,14 +304,26 @@ public:
     }
     scaleFactor = scaleFactorTmp;
 
+    // every pixel touches d+1 lattice points, but neighbouring pixels mostly share them.
+    // start each thread's table with some room to spare, to avoid the first few rehashes.
+    const size_t expected = (size_t)nData*(D+1)/(16*nThreads);
     hashTables = new HashTablePermutohedral<D,VD>[nThreads];
+    for (int i = 0; i < nThreads; i++)
+      hashTables[i].reserve(expected < (1 << 18) ? expected : (1 << 18));
+
+    splatCache = new SplatCache[nThreads];
+    for (int i = 0; i < nThreads; i++)
+      for (int r = 0; r <= D; r++) splatCache[i].index[r] = -1;
   }
 
 
   ~PermutohedralLattice()
   {
     delete[] scaleFactor;
-    delete[] replay;
+    delete[] replayIndex;
+    delete[] replayWeight;
+    delete[] replayTable;
+    delete[] splatCache;
     delete[] canonical;
     delete[] hashTables;
   }
@@ -314,12 +365,21 @@ public:
     sum /= D+1;
 
     // rank differential to find the permutation between this simplex and the canonical one.
-    // (See pg. 3-4 in paper.)
-    memset(rank, 0, sizeof rank);
+    // (See pg. 3-4 in paper.) written without branches, the outcome of the comparisons is
+    // all but random.
+    float differential[D+1];
+    for (int i = 0; i <= D; i++)
+    {
+      differential[i] = elevated[i] - greedy[i];
+      rank[i] = 0;
+    }
     for (int i = 0; i < D; i++)
       for (int j = i+1; j <= D; j++)
-        if (elevated[i] - greedy[i] < elevated[j] - greedy[j]) rank[i]++;
-        else rank[j]++;
+      {
+        const int less = differential[i] < differential[j];
+        rank[i] += less;
+        rank[j] += 1 - less;
+      }
 
     if (sum > 0)
     {
@@ -362,23 +422,33 @@ public:
     barycentric[0] += 1.0f + barycentric[D+1];
 
     // Splat the value into each vertex of the simplex, with barycentric weights.
+    HashTablePermutohedral<D,VD> &table = hashTables[thread_index];
+    replayTable[replay_index] = thread_index;
     for (int remainder = 0; remainder <= D; remainder++)
     {
       // Compute the location of the lattice point explicitly (all but the last coordinate - it's redundant because they sum to zero)
       for (int i = 0; i < D; i++)
         key[i] = greedy[i] + canonical[remainder*(D+1) + rank[i]];
 
-      // Retrieve pointer to the value at this vertex.
-      float * val = hashTables[thread_index].lookup(key, true);
+      // Retrieve the value at this vertex. neighbouring input points mostly fall into the
+      // same simplex, so check the vertex this thread used last time first.
+      SplatCache &cache = splatCache[thread_index];
+      int index = cache.index[remainder];
+      if (index < 0 || memcmp(cache.key[remainder], key, sizeof(key)))
+      {
+        index = table.lookupIndex(key, table.hash(key), true);
+        cache.index[remainder] = index;
+        memcpy(cache.key[remainder], key, sizeof(key));
+      }
+      float *val = table.getValues() + (size_t)index*VD;
 
       // Accumulate values with barycentric weight.
       for (int i = 0; i < VD; i++)
         val[i] += barycentric[remainder]*value[i];
 
       // Record this interaction to use later when slicing
-      replay[replay_index*(D+1)+remainder].table = thread_index;
-      replay[replay_index*(D+1)+remainder].offset = val - hashTables[thread_index].getValues();
-      replay[replay_index*(D+1)+remainder].weight = barycentric[remainder];
+      replayIndex[(size_t)replay_index*(D+1)+remainder] = index;
+      replayWeight[(size_t)replay_index*(D+1)+remainder] = barycentric[remainder];
     }
   }
 
@@ -388,31 +458,47 @@ public:
     if (nThreads <= 1)
       return;
 
-    /* Merge the multiple hash tables into one, creating an offset remap table. */
-    int *offset_remap[nThreads];
+    // the merged table can't hold more points than all tables together, make room once
+    size_t total = 0;
+    for (int i = 0; i < nThreads; i++)
+      total += hashTables[i].size();
+    hashTables[0].reserve(total);
+
+    /* Merge the multiple hash tables into one, creating an index remap table. */
+    int *index_remap[nThreads];
     for (int i = 1; i < nThreads; i++)
     {
       const short *oldKeys = hashTables[i].getKeys();
+      const size_t *oldHashes = hashTables[i].getHashes();
       const float *oldVals = hashTables[i].getValues();
       const int filled = hashTables[i].size();
-      offset_remap[i] = new int[filled];
+      index_remap[i] = new int[filled];
       for (int j = 0; j < filled; j++)
       {
-        float *val = hashTables[0].lookup(oldKeys+j*D, true);
-        const float *oldVal = oldVals + j*VD;
+        const int index = hashTables[0].lookupIndex(oldKeys+(size_t)j*D, oldHashes[j], true);
+        float *val = hashTables[0].getValues() + (size_t)index*VD;
+        const float *oldVal = oldVals + (size_t)j*VD;
         for (int k = 0; k < VD; k++)
           val[k] += oldVal[k];
-        offset_remap[i][j] = val - hashTables[0].getValues();
+        index_remap[i][j] = index;
       }
+      hashTables[i].clear();
     }
 
-    /* Rewrite the offsets in the replay structure from the above generated table. */
-    for (int i = 0; i < nData*(D+1); i++)
-      if (replay[i].table > 0)
-        replay[i].offset = offset_remap[replay[i].table][replay[i].offset/VD];
+    /* Rewrite the indices in the replay structure from the above generated table. */
+#ifdef _OPENMP
+    #pragma omp parallel for shared(index_remap)
+#endif
+    for (int i = 0; i < nData; i++)
+    {
+      const int t = replayTable[i];
+      if (t > 0)
+        for (int r = 0; r <= D; r++)
+          replayIndex[(size_t)i*(D+1)+r] = index_remap[t][replayIndex[(size_t)i*(D+1)+r]];
+    }
 
     for (int i = 1; i < nThreads; i++)
-      delete[] offset_remap[i];
+      delete[] index_remap[i];
   }
 
   /* Performs slicing out of position vectors. Note that the barycentric weights and the simplex
@@ -421,39 +507,55 @@ public:
    */
   void slice(float *col, int replay_index)
   {
-    float *base = hashTables[0].getValues();
+    const float *base = hashTables[0].getValues();
+    const int *index = replayIndex + (size_t)replay_index*(D+1);
+    const float *weight = replayWeight + (size_t)replay_index*(D+1);
     for (int j = 0; j < VD; j++) col[j] = 0;
     for (int i = 0; i <= D; i++)
     {
-      ReplayEntry r = replay[replay_index*(D+1)+i];
+      const float *val = base + (size_t)index[i]*VD;
       for (int j = 0; j < VD; j++)
-      {
-        col[j] += r.weight*base[r.offset + j];
-      }
+        col[j] += weight[i]*val[j];
     }
   }
 
   /* Performs a Gaussian blur along each projected axis in the hyperplane. */
   void blur()
   {
-    // Prepare arrays
-    float *newValue = new float[VD*hashTables[0].size()];
-    float *oldValue = hashTables[0].getValues();
+    HashTablePermutohedral<D,VD> &table = hashTables[0];
+    const int n = table.size();
+
+    // Prepare arrays. both have a zero vector at index n, which stands in for missing
+    // neighbours, so the mixing below is the same for every vertex.
+    float *oldValue = table.getValues();
+    float *newValue = new float[(size_t)VD*(n+1)];
     float *hashTableBase = oldValue;
+    memset(newValue + (size_t)VD*n, 0, sizeof(float)*VD);
+
+    const short *keys = table.getKeys();
+    const size_t *hashes = table.getHashes();
 
-    float zero[VD];
-    for (int k = 0; k < VD; k++) zero[k] = 0;
+    // the hash is linear in the key, so the hashes of the neighbours along an axis are a
+    // constant offset away from the hash of the vertex itself.
+    size_t power[D];
+    size_t sum = 0;
+    for (int k = D-1; k >= 0; k--)
+    {
+      power[k] = (k == D-1) ? 2531011 : power[k+1]*2531011;
+      sum += power[k];
+    }
 
     // For each of d+1 axes,
     for (int j = 0; j <= D; j++)
     {
+      const size_t offset = j < D ? sum - (size_t)(D+1)*power[j] : sum;
 #ifdef _OPENMP
-      #pragma omp parallel for shared(j, oldValue, newValue, hashTableBase, zero)
+      #pragma omp parallel for schedule(static) shared(j, oldValue, newValue, keys, hashes, table)
 #endif
       // For each vertex in the lattice,
-      for (int i = 0; i < hashTables[0].size(); i++)   // blur point i in dimension j
+      for (int i = 0; i < n; i++)   // blur point i in dimension j
       {
-        const short *key    = hashTables[0].getKeys() + i*(D); // keys to current vertex
+        const short *key = keys + (size_t)i*D; // keys to current vertex
         short neighbor1[D+1];
         short neighbor2[D+1];
         for (int k = 0; k < D; k++)
@@ -464,18 +566,15 @@ public:
         neighbor1[j] = key[j] - D;
         neighbor2[j] = key[j] + D; // keys to the neighbors along the given axis.
 
-        float *oldVal = oldValue + i*VD;
-        float *newVal = newValue + i*VD;
+        int i1 = table.lookupIndex(neighbor1, hashes[i] + offset, false); // look up first neighbor
+        int i2 = table.lookupIndex(neighbor2, hashes[i] - offset, false); // look up second neighbor
+        if (i1 < 0) i1 = n;
+        if (i2 < 0) i2 = n;
 
-        float *vm1, *vp1;
-
-        vm1 = hashTables[0].lookup(neighbor1, false); // look up first neighbor
-        if (vm1) vm1 = vm1 - hashTableBase + oldValue;
-        else vm1 = zero;
-
-        vp1 = hashTables[0].lookup(neighbor2, false); // look up second neighbor
-        if (vp1) vp1 = vp1 - hashTableBase + oldValue;
-        else vp1 = zero;
+        const float *vm1 = oldValue + (size_t)i1*VD;
+        const float *vp1 = oldValue + (size_t)i2*VD;
+        const float *oldVal = oldValue + (size_t)i*VD;
+        float *newVal = newValue + (size_t)i*VD;
 
         // Mix values of the three vertices
         for (int k = 0; k < VD; k++)
@@ -490,7 +589,7 @@ public:
     // depending where we ended up, we may have to copy data
     if (oldValue != hashTableBase)
     {
-      memcpy(hashTableBase, oldValue, hashTables[0].size()*VD*sizeof(float));
+      memcpy(hashTableBase, oldValue, (size_t)n*VD*sizeof(float));
       delete[] oldValue;
     }
     else
@@ -506,13 +605,20 @@ private:
   const float *scaleFactor;
   const int *canonical;
 
-  // slicing is done by replaying splatting (ie storing the sparse matrix)
-  struct ReplayEntry
+  // slicing is done by replaying splatting (ie storing the sparse matrix). the d+1 lattice
+  // points and weights of every input point are stored in flat arrays, along with the
+  // table (thread) that splatted it, which is needed until the tables are merged.
+  int *replayIndex;
+  float *replayWeight;
+  short *replayTable;
+
+  // the vertices of the last simplex splatted into, per thread
+  struct SplatCache
   {
-    int table;
-    int offset;
-    float weight;
-  } *replay;
+    short key[D+1][D];
+    int index[D+1];
+    char padding[64]; // keep threads off each other's cache lines
+  } *splatCache;
 
   HashTablePermutohedral<D,VD> *hashTables;
 };
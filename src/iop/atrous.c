@@ -19,6 +19,7 @@
 #include "develop/tiling.h"
 #include "common/opencl.h"
 #include "common/debug.h"
+#include "common/cpu_dispatch.h"
 #include "control/conf.h"
 #include "gui/accelerators.h"
 #include "gui/draw.h"
@@ -229,11 +230,12 @@ weight_sse(const __m128 *c1, const __m128 *c2, const float sharpen)
   pcoarse+=4;
 
 static void
-eaw_decompose (float *const out, const float *const in, float *const detail, const int scale,
+eaw_decompose (dt_dev_pixelpipe_iop_t *const piece, float *const out, const float *const in, float *const detail, const int scale,
                const float sharpen, const int32_t width, const int32_t height)
 {
   const int mult = 1<<scale;
   static const float filter[5] = {1.0f/16.0f, 4.0f/16.0f, 6.0f/16.0f, 4.0f/16.0f, 1.0f/16.0f};
+  const dt_cpu_kernels_t *const kernels = darktable.kernels;
 
   /* The first "2*mult" lines use the macro with tests because the 5x5 kernel
    * requires nearest pixel interpolation for at least a pixel in the sum */
@@ -263,6 +265,9 @@ eaw_decompose (float *const out, const float *const in, float *const detail, con
 #endif
   for(int j=2*mult; j<height-2*mult; j++)
   {
+    // bail out row by row, the pipe discards the result if it got cancelled
+    if(dt_iop_cancelled(piece)) continue;
+
     ROW_PROLOGUE
 
     /* The first "2*mult" pixels use the macro with tests because the 5x5 kernel
@@ -280,23 +285,13 @@ eaw_decompose (float *const out, const float *const in, float *const detail, con
       SUM_PIXEL_EPILOGUE
     }
 
-    /* For pixels [2*mult, width-2*mult], we can safely use macro w/o tests
-     * to avoid uneeded branching in the inner loops */
-    for(int i=2*mult; i<width-2*mult; i++)
-    {
-      SUM_PIXEL_PROLOGUE
-      px2 = ((__m128*)in) + i-2*mult + (j-2*mult)*width;
-      for (int jj=0; jj<5; jj++)
-      {
-        for (int ii=0; ii<5; ii++)
-        {
-          SUM_PIXEL_CONTRIBUTION_COMMON(ii, jj);
-          px2 += mult;
-        }
-        px2 += (width-5)*mult;
-      }
-      SUM_PIXEL_EPILOGUE
-    }
+    /* For pixels [2*mult, width-2*mult], no tests are needed. this is where the time goes,
+     * so it runs through the sse2/avx2 kernel picked at startup */
+    kernels->eaw_decompose_row(in, out, detail, j, 2*mult, width-2*mult, width, mult, sharpen);
+    const int interior = MAX(0, width-4*mult);
+    px += interior;
+    pdetail += 4*interior;
+    pcoarse += 4*interior;
 
     /* Last two pixels in the row require a slow variant... blablabla */
     for (int i=width-2*mult; i<width; i++)
@@ -346,7 +341,7 @@ eaw_decompose (float *const out, const float *const in, float *const detail, con
 #undef SUM_PIXEL_EPILOGUE
 
 static void
-eaw_synthesize (float *const out, const float *const in, const float *const detail,
+eaw_synthesize (dt_dev_pixelpipe_iop_t *const piece, float *const out, const float *const in, const float *const detail,
                 const float *thrsf, const float *boostf, const int32_t width, const int32_t height)
 {
   const __m128 threshold = _mm_set_ps(thrsf[3], thrsf[2], thrsf[1], thrsf[0]);
@@ -357,6 +352,7 @@ eaw_synthesize (float *const out, const float *const in, const float *const deta
 #endif
   for(int j=0; j<height; j++)
   {
+    if(dt_iop_cancelled(piece)) continue;
     // TODO: prefetch? _mm_prefetch()
     const __m128 *pin = (__m128 *)in + j*width;
     __m128 *pdetail = (__m128 *)detail + j*width;
@@ -453,63 +449,50 @@ process (struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, voi
     // dt_control_queue_draw(GTK_WIDGET(g->area));
   }
 
-  float *detail[MAX_NUM_SCALES] = { NULL };
-  float *tmp = NULL;
-  float *buf2 = NULL;
-  float *buf1 = NULL;
-
   const int width = roi_out->width;
   const int height = roi_out->height;
-
-  tmp = (float *)dt_alloc_align(64, sizeof(float)*4*width*height);
-  if(tmp == NULL)
+  const size_t bufsize = sizeof(float)*4*width*height;
+  dt_dev_pixelpipe_scratch_t *scratch = &piece->pipe->scratch;
+
+  // synthesis just adds up the processed detail scales on top of the coarse residual,
+  // so every scale can go into the output right after it has been split off. this way
+  // only two coarse buffers and one detail buffer are needed, whatever the number of scales.
+  float *coarse[2] = { NULL, NULL };
+  float *detail = NULL;
+  float *out = (float *)o;
+
+  coarse[0] = (float *)dt_dev_pixelpipe_scratch_alloc(scratch, bufsize);
+  coarse[1] = (float *)dt_dev_pixelpipe_scratch_alloc(scratch, bufsize);
+  detail = (float *)dt_dev_pixelpipe_scratch_alloc(scratch, bufsize);
+  if(coarse[0] == NULL || coarse[1] == NULL || detail == NULL)
   {
-    fprintf(stderr, "[atrous] failed to allocate coarse buffer!\n");
+    fprintf(stderr, "[atrous] failed to allocate scratch buffers!\n");
     goto error;
   }
 
-  for(int k=0; k<max_scale; k++)
-  {
-    detail[k] = (float *)dt_alloc_align(64, sizeof(float)*4*width*height);
-    if(detail[k] == NULL)
-    {
-      fprintf(stderr, "[atrous] failed to allocate one of the detail buffers!\n");
-      goto error;
-    }
-  }
-
-  buf1 = (float *)i;
-  buf2 = tmp;
+  memset(out, 0, bufsize);
 
-  for(int scale=0; scale<max_scale; scale++)
+  const float *buf_in = (const float *)i;
+  for(int scale=0; scale<max_scale && !dt_iop_cancelled(piece); scale++)
   {
-    eaw_decompose (buf2, buf1, detail[scale], scale, sharp[scale], width, height);
-    if(scale == 0) buf1 = (float *)o;  // now switch to (float *)o for buffer ping-pong between buf1 and buf2
-    float *buf3 = buf2;
-    buf2 = buf1;
-    buf1 = buf3;
+    float *buf_out = coarse[scale & 1];
+    eaw_decompose (piece, buf_out, buf_in, detail, scale, sharp[scale], width, height);
+    eaw_synthesize (piece, out, out, detail, thrs[scale], boost[scale], width, height);
+    buf_in = buf_out;
   }
 
-  for(int scale=max_scale-1; scale>=0; scale--)
-  {
-    eaw_synthesize (buf2, buf1, detail[scale], thrs[scale], boost[scale], width, height);
-    float *buf3 = buf2;
-    buf2 = buf1;
-    buf1 = buf3;
-  }
-  /* due to symmetric processing, output will be left in (float *)o */
-
-  for(int k=0; k<max_scale; k++) free(detail[k]);
-  free(tmp);
+  // finally put the residual back in
+  const float zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+  const float one[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+  eaw_synthesize (piece, out, buf_in, out, zero, one, width, height);
 
   if(piece->pipe->mask_display)
     dt_iop_alpha_copy(i, o, width, height);
 
-  return;
-
 error:
-  for(int k=0; k<max_scale; k++) if(detail[k] != NULL) free(detail[k]);
-  if(tmp != NULL) free(tmp);
+  dt_dev_pixelpipe_scratch_release(scratch, detail);
+  dt_dev_pixelpipe_scratch_release(scratch, coarse[1]);
+  dt_dev_pixelpipe_scratch_release(scratch, coarse[0]);
   return;
 }
 
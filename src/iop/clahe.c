@@ -77,163 +77,207 @@ int flags()
   return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_DEPRECATED;
 }
 
-void process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void *ivoid, void *ovoid, const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out)
+/* build the clipped, redistributed and normalized cdf of one window histogram
+ * as a lookup table over all bins, using the same clipping as the original
+ * per-pixel implementation. */
+static void
+clahe_build_lut(const int *hist, const int n, const float slope, const int bins, float *lut)
 {
-  dt_iop_rlce_data_t *data = (dt_iop_rlce_data_t *)piece->data;
-  const int ch = piece->colors;
+  int clippedhist[bins+1];
+  const int limit = ( int )( slope * n /  bins + 0.5f );
 
-  // PASS1: Get a luminance map of image...
-  float *luminance=(float *)malloc((roi_out->width*roi_out->height)*sizeof(float));
-  //double lsmax=0.0,lsmin=1.0;
-#ifdef _OPENMP
-  #pragma omp parallel for default(none) schedule(static) shared(luminance,roi_in,roi_out,ivoid)
-#endif
-  for(int j=0; j<roi_out->height; j++)
+  /* clip histogram and redistribute clipped entries */
+  memcpy(clippedhist,hist,(bins+1)*sizeof(int));
+  int ce = 0, ceb=0;
+  do
   {
-    float *in=(float *)ivoid+j*roi_out->width*ch;
-    float *lm=luminance+j*roi_out->width;
-    for(int i=0; i<roi_out->width; i++)
+    ceb = ce;
+    ce = 0;
+    for ( int b = 0; b <= bins; b++ )
     {
-      double pmax=CLIP(fmax(in[0],fmax(in[1],in[2]))); // Max value in RGB set
-      double pmin=CLIP(fmin(in[0],fmin(in[1],in[2]))); // Min value in RGB set
-      *lm=(pmax+pmin)/2.0;        // Pixel luminocity
-      in+=ch;
-      lm++;
+      int d = clippedhist[ b ] - limit;
+      if ( d > 0 )
+      {
+        ce += d;
+        clippedhist[ b ] = limit;
+      }
+    }
+
+    int d = (ce / (float) ( bins + 1 ));
+    int m = ce % ( bins + 1 );
+    for ( int h = 0; h <= bins; h++)
+      clippedhist[ h ] += d;
+
+    if ( m != 0 )
+    {
+      int s = bins / (float)m;
+      for ( int h = 0; h <= bins; h += s )
+        ++clippedhist[ h ];
     }
   }
+  while ( ce != ceb);
 
+  /* build cdf of clipped histogram */
+  int hMin = bins;
+  for ( int h = 0; h < hMin; h++ )
+    if ( clippedhist[ h ] != 0 ) hMin = h;
 
-  // Params
-  const int rad=data->radius*roi_in->scale/piece->iscale;
+  int cdfMax = 0;
+  for ( int h = hMin; h <= bins; h++ )
+    cdfMax += clippedhist[ h ];
 
-  const int bins=256;
-  const float slope=data->slope;
+  const int cdfMin = clippedhist[ hMin ];
+  const float norm = 1.0f / ( float )( cdfMax - cdfMin );
+
+  int cdf = 0;
+  for ( int h = 0; h <= bins; h++ )
+  {
+    if ( h >= hMin ) cdf += clippedhist[ h ];
+    lut[ h ] = ( cdf - cdfMin ) * norm;
+  }
+}
+
+/* compute the luts of all nodes in grid row gy. nodes are processed in tiles of
+ * a few grid points along the row. within a tile, the window histogram is slid
+ * from node to node, adding and removing whole columns, which costs O(rad) per
+ * node step instead of O(rad^2). */
+static void
+clahe_node_row(const uint16_t *const luminance, const int width, const int height,
+               const int rad, const int step, const int bins, const float slope,
+               const int gy, const int gw, float *const lut)
+{
+  const int tile = 4;
+  const int tw = (gw + tile - 1) / tile;
 
-  // CLAHE
+  const int y = MIN(gy * step, height - 1);
+  const int yMin = MAX( 0, y - rad );
+  const int yMax = MIN( height, y + rad + 1 );
+  const int h = yMax - yMin;
 #ifdef _OPENMP
-  #pragma omp parallel for default(none) schedule(static) shared(luminance,roi_in,roi_out,ivoid,ovoid)
+  #pragma omp parallel for default(none) schedule(dynamic)
 #endif
-  for(int j=0; j<roi_out->height; j++)
+  for(int t=0; t<tw; t++)
   {
-    int yMin = fmax( 0, j - rad );
-    int yMax = fmin( roi_in->height, j + rad + 1 );
-    int h = yMax - yMin;
-
-    int xMin0 = fmax( 0, 0-rad );
-    int xMax0 = fmin( roi_in->width - 1, rad );
+    const int gx0 = t * tile;
+    const int gx1 = MIN(gx0 + tile, gw);
 
     int hist[bins+1];
-    int clippedhist[bins+1];
-    float dest[roi_out->width];
-
-    /* initially fill histogram */
     memset(hist,0,(bins+1)*sizeof(int));
-    for ( int yi = yMin; yi < yMax; ++yi )
-      for ( int xi = xMin0; xi < xMax0; ++xi )
-        ++hist[ ROUND_POSISTIVE(luminance[yi*roi_in->width+xi] * (float)bins) ];
+    int c0 = 0, c1 = 0; // columns [c0,c1) are currently in the histogram
 
-    // Destination row
-    memset(dest,0,roi_out->width*sizeof(float));
-    float *ld=dest;
-
-    for(int i=0; i<roi_out->width; i++)
+    for(int gx=gx0; gx<gx1; gx++)
     {
-
-      int v = ROUND_POSISTIVE(luminance[j*roi_in->width+i] * (float)bins);
-
-      int xMin = fmax( 0, i - rad );
-      int xMax = i + rad + 1;
-      int w = fmin( roi_in->width, xMax ) - xMin;
-      int n = h * w;
-
-      int limit = ( int )( slope * n /  bins + 0.5f );
-
-      /* remove left behind values from histogram */
-      if ( xMin > 0 )
+      const int x = MIN(gx * step, width - 1);
+      const int xMin = MAX( 0, x - rad );
+      const int xMax = MIN( width, x + rad + 1 );
+      if(c1 <= xMin)
       {
-        int xMin1 = xMin - 1;
-        for ( int yi = yMin; yi < yMax; ++yi )
-          --hist[  ROUND_POSISTIVE(luminance[yi*roi_in->width+xMin1] * (float)bins) ];
+        // no overlap with the previous window, start over
+        memset(hist,0,(bins+1)*sizeof(int));
+        c0 = c1 = xMin;
       }
 
-      /* add newly included values to histogram */
-      if ( xMax <= roi_in->width )
+      /* add newly included and remove left behind values, row by row */
+      for ( int yi = yMin; yi < yMax; ++yi )
       {
-        int xMax1 = xMax - 1;
-        for ( int yi = yMin; yi < yMax; ++yi )
-          ++hist[  ROUND_POSISTIVE(luminance[yi*roi_in->width+xMax1] * (float)bins) ];
+        const uint16_t *lm = luminance + (size_t)yi*width;
+        for ( int xi = c1; xi < xMax; ++xi ) ++hist[ lm[xi] ];
+        for ( int xi = c0; xi < xMin; ++xi ) --hist[ lm[xi] ];
       }
+      c0 = MAX(c0, xMin);
+      c1 = MAX(c1, xMax);
 
-      /* clip histogram and redistribute clipped entries */
-      memcpy(clippedhist,hist,(bins+1)*sizeof(int));
-      int ce = 0, ceb=0;
-      do
-      {
-        ceb = ce;
-        ce = 0;
-        for ( int b = 0; b <= bins; b++ )
-        {
-          int d = clippedhist[ b ] - limit;
-          if ( d > 0 )
-          {
-            ce += d;
-            clippedhist[ b ] = limit;
-          }
-        }
-
-        int d = (ce / (float) ( bins + 1 ));
-        int m = ce % ( bins + 1 );
-        for ( int h = 0; h <= bins; h++)
-          clippedhist[ h ] += d;
-
-        if ( m != 0 )
-        {
-          int s = bins / (float)m;
-          for ( int h = 0; h <= bins; h += s )
-            ++clippedhist[ h ];
-        }
-      }
-      while ( ce != ceb);
-
-      /* build cdf of clipped histogram */
-      int hMin = bins;
-      for ( int h = 0; h < hMin; h++ )
-        if ( clippedhist[ h ] != 0 ) hMin = h;
-
-      int cdf = 0;
-      for ( int h = hMin; h <= v; h++ )
-        cdf += clippedhist[ h ];
+      clahe_build_lut(hist, h * (xMax - xMin), slope, bins, lut + (size_t)gx*(bins+1));
+    }
+  }
+}
 
-      int cdfMax = cdf;
-      for ( int h = v + 1; h <= bins; h++ )
-        cdfMax += clippedhist[ h ];
+void process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void *ivoid, void *ovoid, const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out)
+{
+  dt_iop_rlce_data_t *data = (dt_iop_rlce_data_t *)piece->data;
+  const int ch = piece->colors;
+  const int width = roi_out->width;
+  const int height = roi_out->height;
 
-      int cdfMin = clippedhist[ hMin ];
+  // Params
+  const int rad=data->radius*roi_in->scale/piece->iscale;
 
-      *ld=( cdf - cdfMin ) / ( float )( cdfMax - cdfMin );
+  const int bins=256;
+  const float slope=data->slope;
 
-      ld++;
+  // PASS1: Get a luminance map of image, already quantized to histogram bins
+  uint16_t *luminance=(uint16_t *)malloc(((size_t)width*height)*sizeof(uint16_t));
+#ifdef _OPENMP
+  #pragma omp parallel for default(none) schedule(static) shared(luminance,ivoid)
+#endif
+  for(int j=0; j<height; j++)
+  {
+    float *in=(float *)ivoid+(size_t)j*width*ch;
+    uint16_t *lm=luminance+(size_t)j*width;
+    for(int i=0; i<width; i++)
+    {
+      double pmax=CLIP(fmax(in[0],fmax(in[1],in[2]))); // Max value in RGB set
+      double pmin=CLIP(fmin(in[0],fmin(in[1],in[2]))); // Min value in RGB set
+      float l=(pmax+pmin)/2.0;        // Pixel luminocity
+      *lm=ROUND_POSISTIVE(l * (float)bins);
+      in+=ch;
+      lm++;
     }
+  }
 
-    // Apply row
-    float *in = ((float *)ivoid) + j*roi_out->width*ch;
-    float *out = ((float *)ovoid) + j*roi_out->width*ch;
-    for(int r=0; r<roi_out->width; r++)
+  // PASS2: CLAHE. instead of clipping a histogram for every pixel, evaluate the
+  // (2*rad+1)^2 window histogram on a grid of nodes spaced rad apart and
+  // interpolate their mapping curves bilinearly in between (contextual regions
+  // as in Zuiderveld's CLAHE). the image is done in bands between two node
+  // rows, so only the luts of those two rows are kept around at any time.
+  const int step = MAX(rad, 1);
+  const int gw = (width  - 1) / step + 2;
+  const int gh = (height - 1) / step + 2;
+  const size_t lutrow = (size_t)gw*(bins+1);
+  float *lut = (float *)dt_alloc_align(64, sizeof(float)*2*lutrow);
+
+  clahe_node_row(luminance, width, height, rad, step, bins, slope, 0, gw, lut);
+  for(int gy=0; gy<gh-1; gy++)
+  {
+    float *const lut0 = lut + (gy & 1)*lutrow;
+    float *const lut1 = lut + ((gy + 1) & 1)*lutrow;
+    clahe_node_row(luminance, width, height, rad, step, bins, slope, gy + 1, gw, lut1);
+
+    // PASS3: interpolate the node luts and apply to the rows of this band
+    const int y0 = gy * step, y1 = MIN((gy + 1) * step, height - 1);
+    const int jEnd = MIN((gy + 1) * step, height);
+#ifdef _OPENMP
+    #pragma omp parallel for default(none) schedule(static) shared(luminance,ivoid,ovoid)
+#endif
+    for(int j=y0; j<jEnd; j++)
     {
-      float H, S, L;
-      rgb2hsl(in,&H,&S,&L);
-      //hsl2rgb(out,H,S,( L / dest[r] ) * (L-lsmin) + lsmin );
-      hsl2rgb(out,H,S,dest[r] );
-      out += ch;
-      in += ch;
-      ld++;
+      const float fy = y1 > y0 ? (j - y0) / (float)(y1 - y0) : 0.0f;
+      const uint16_t *lm = luminance + (size_t)j*width;
+      float *in = ((float *)ivoid) + (size_t)j*width*ch;
+      float *out = ((float *)ovoid) + (size_t)j*width*ch;
+      for(int i=0; i<width; i++)
+      {
+        const int gx = MIN(i / step, gw - 2);
+        const int x0 = MIN(gx * step, width - 1), x1 = MIN((gx + 1) * step, width - 1);
+        const float fx = x1 > x0 ? (i - x0) / (float)(x1 - x0) : 0.0f;
+        const int v = lm[i];
+        const size_t k = (size_t)gx*(bins+1) + v;
+        const float top = (1.0f - fx) * lut0[k] + fx * lut0[k + bins + 1];
+        const float bot = (1.0f - fx) * lut1[k] + fx * lut1[k + bins + 1];
+        const float L = (1.0f - fy) * top + fy * bot;
+
+        float H, S, Lold;
+        rgb2hsl(in,&H,&S,&Lold);
+        hsl2rgb(out,H,S,L);
+        out += ch;
+        in += ch;
+      }
     }
-
   }
 
   // Cleanup
+  free(lut);
   free(luminance);
-
 }
 
 static void
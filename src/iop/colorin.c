@@ -27,6 +27,7 @@
 #include "common/colorspaces.h"
 #include "common/colormatrices.c"
 #include "common/opencl.h"
+#include "common/cpu_dispatch.h"
 #include "common/image_cache.h"
 #ifdef HAVE_OPENJPEG
 #include "common/imageio_j2k.h"
@@ -199,40 +200,36 @@ error:
 }
 #endif
 
-static inline __m128
-lab_f_m(const __m128 x)
+// copy a row to 3 floats per pixel for lcms, dampening the deeply saturated blues on the way
+static inline void
+_lcms_cam_row(const float *const in, float *const cam, const int width, const int ch)
 {
-  const __m128 epsilon = _mm_set1_ps(216.0f/24389.0f);
-  const __m128 kappa   = _mm_set1_ps(24389.0f/27.0f);
-
-  // calculate as if x > epsilon : result = cbrtf(x)
-  // approximate cbrtf(x):
-  const __m128 a = _mm_castsi128_ps(_mm_add_epi32(_mm_cvtps_epi32(_mm_div_ps(_mm_cvtepi32_ps(_mm_castps_si128(x)),_mm_set1_ps(3.0f))),_mm_set1_epi32(709921077)));
-  const __m128 a3 = _mm_mul_ps(_mm_mul_ps(a,a),a);
-  const __m128 res_big = _mm_div_ps(_mm_mul_ps(a,_mm_add_ps(a3,_mm_add_ps(x,x))),_mm_add_ps(_mm_add_ps(a3,a3),x));
-
-  // calculate as if x <= epsilon : result = (kappa*x+16)/116
-  const __m128 res_small = _mm_div_ps(_mm_add_ps(_mm_mul_ps(kappa,x),_mm_set1_ps(16.0f)),_mm_set1_ps(116.0f));
+  for (int l=0; l<width; l++)
+  {
+    int ci=3*l, ii=ch*l;
 
-  // blend results according to whether each component is > epsilon or not
-  const __m128 mask = _mm_cmpgt_ps(x,epsilon);
-  return _mm_or_ps(_mm_and_ps(mask,res_big),_mm_andnot_ps(mask,res_small));
-}
+    cam[ci+0] = in[ii+0];
+    cam[ci+1] = in[ii+1];
+    cam[ci+2] = in[ii+2];
 
-static inline __m128
-dt_XYZ_to_Lab_SSE(const __m128 XYZ)
-{
-  const __m128 d50_inv  = _mm_set_ps(0.0f, 1.0f/0.8249f, 1.0f, 1.0f/0.9642f);
-  const __m128 coef = _mm_set_ps(0.0f,200.0f,500.0f,116.0f);
-  const __m128 f = lab_f_m(_mm_mul_ps(XYZ,d50_inv));
-  // because d50_inv.z is 0.0f, lab_f(0) == 16/116, so Lab[0] = 116*f[0] - 16 equal to 116*(f[0]-f[3])
-  return _mm_mul_ps(coef,_mm_sub_ps(_mm_shuffle_ps(f,f,_MM_SHUFFLE(3,1,0,1)),_mm_shuffle_ps(f,f,_MM_SHUFFLE(3,2,1,3))));
+    const float YY = cam[ci+0]+cam[ci+1]+cam[ci+2];
+    const float zz = cam[ci+2]/YY;
+    const float bound_z = 0.5f, bound_Y = 0.5f;
+    const float amount = 0.11f;
+    if (zz > bound_z)
+    {
+      const float t = (zz - bound_z)/(1.0f-bound_z) * fminf(1.0, YY/bound_Y);
+      cam[ci+1] += t*amount;
+      cam[ci+2] -= t*amount;
+    }
+  }
 }
 
 void process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void *i, void *o, const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out)
 {
   const dt_iop_colorin_data_t *const d = (dt_iop_colorin_data_t *)piece->data;
   const float *const mat = d->cmatrix;
+  const dt_cpu_kernels_t *const kernels = darktable.kernels;
   float *in  = (float *)i;
   float *out = (float *)o;
   const int ch = piece->colors;
@@ -249,13 +246,12 @@ void process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void
 
       float *buf_in  = in + ch*roi_in->width *j;
       float *buf_out = out + ch*roi_out->width*j;
-      float cam[3];
-      const __m128 m0 = _mm_set_ps(0.0f,mat[6],mat[3],mat[0]);
-      const __m128 m1 = _mm_set_ps(0.0f,mat[7],mat[4],mat[1]);
-      const __m128 m2 = _mm_set_ps(0.0f,mat[8],mat[5],mat[2]);
+      float *const row_out = buf_out;
 
+      // linearize into the output row, then convert the whole row to Lab at once
       for(int i=0; i<roi_out->width; i++, buf_in+=ch, buf_out+=ch )
       {
+        float *const cam = buf_out;
 
         // memcpy(cam, buf_in, sizeof(float)*3);
         // avoid calling this for linear profiles (marked with negative entries), assures unbounded
@@ -285,61 +281,89 @@ void process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void
           }
         }
 
-#if 0
-        __attribute__((aligned(16))) float XYZ[4];
-        _mm_store_ps(XYZ,_mm_add_ps(_mm_add_ps( _mm_mul_ps(m0,_mm_set1_ps(cam[0])), _mm_mul_ps(m1,_mm_set1_ps(cam[1]))), _mm_mul_ps(m2,_mm_set1_ps(cam[2]))));
-        dt_XYZ_to_Lab(XYZ, buf_out);
-#endif
-        __m128 xyz = _mm_add_ps(_mm_add_ps( _mm_mul_ps(m0,_mm_set1_ps(cam[0])), _mm_mul_ps(m1,_mm_set1_ps(cam[1]))), _mm_mul_ps(m2,_mm_set1_ps(cam[2])));
-        _mm_stream_ps(buf_out,dt_XYZ_to_Lab_SSE(xyz));
       }
+      kernels->rgb_to_Lab_row(row_out, row_out, mat, roi_out->width);
     }
-    _mm_sfence();
   }
   else
   {
     // use general lcms2 fallback
-    int rowsize=roi_out->width*3;
-    float cam[rowsize];
-    float Lab[rowsize];
+    const int rowsize=roi_out->width*3;
 
-    // FIXME: for some unapparent reason even this breaks lcms2 :(
-#if 0//def _OPENMP
-    #pragma omp parallel for default(none) shared(roi_out, out, in, d, cam, Lab, rowsize) schedule(static)
-#endif
-    for(int k=0; k<roi_out->height; k++)
+    if(d->clut)
     {
-      const int m=(k*(roi_out->width*ch));
-
-      for (int l=0; l<roi_out->width; l++)
+      // with a baked lut, only the few pixels outside of it need lcms. the lut runs in
+      // parallel, these are collected (their cam values are left in out) and converted
+      // in a serial pass afterwards, lcms still doesn't like to be run in parallel (below).
+      uint8_t *miss = (uint8_t *)malloc((size_t)roi_out->width*roi_out->height);
+      int *row_misses = (int *)malloc(sizeof(int)*roi_out->height);
+#ifdef _OPENMP
+      #pragma omp parallel for default(none) shared(roi_out, out, in, miss, row_misses) schedule(static)
+#endif
+      for(int k=0; k<roi_out->height; k++)
       {
-        int ci=3*l, ii=ch*l;
-
-        cam[ci+0] = in[m+ii+0];
-        cam[ci+1] = in[m+ii+1];
-        cam[ci+2] = in[m+ii+2];
-
-        const float YY = cam[ci+0]+cam[ci+1]+cam[ci+2];
-        const float zz = cam[ci+2]/YY;
-        const float bound_z = 0.5f, bound_Y = 0.5f;
-        const float amount = 0.11f;
-        if (zz > bound_z)
+        const int m=(k*(roi_out->width*ch));
+        float cam[rowsize];
+        float Lab[rowsize];
+        _lcms_cam_row(in + m, cam, roi_out->width, ch);
+        row_misses[k] = dt_icc_lut_transform_lut(d->clut, cam, Lab, miss + (size_t)k*roi_out->width, roi_out->width);
+        for (int l=0; l<roi_out->width; l++)
         {
-          const float t = (zz - bound_z)/(1.0f-bound_z) * fminf(1.0, YY/bound_Y);
-          cam[ci+1] += t*amount;
-          cam[ci+2] -= t*amount;
+          int li=3*l, oi=ch*l;
+          out[m+oi+0] = Lab[li+0];
+          out[m+oi+1] = Lab[li+1];
+          out[m+oi+2] = Lab[li+2];
         }
       }
-      // convert to (L,a/L,b/L) to be able to change L without changing saturation.
-      // lcms is not thread safe, so work on one copy for each thread :(
-      cmsDoTransform (d->xform[dt_get_thread_num()], cam, Lab, roi_out->width);
 
-      for (int l=0; l<roi_out->width; l++)
+      float cam[rowsize];
+      float Lab[rowsize];
+      for(int k=0; k<roi_out->height; k++)
+      {
+        if(!row_misses[k]) continue;
+        const int m=(k*(roi_out->width*ch));
+        const uint8_t *rm = miss + (size_t)k*roi_out->width;
+        int n = 0;
+        for (int l=0; l<roi_out->width; l++) if(rm[l])
+          {
+            memcpy(cam + 3*n, out + m + ch*l, 3*sizeof(float));
+            n++;
+          }
+        cmsDoTransform (d->xform[0], cam, Lab, n);
+        n = 0;
+        for (int l=0; l<roi_out->width; l++) if(rm[l])
+          {
+            memcpy(out + m + ch*l, Lab + 3*n, 3*sizeof(float));
+            n++;
+          }
+      }
+      free(row_misses);
+      free(miss);
+    }
+    else
+    {
+      float cam[rowsize];
+      float Lab[rowsize];
+
+      // FIXME: for some unapparent reason even this breaks lcms2 :(
+#if 0//def _OPENMP
+      #pragma omp parallel for default(none) shared(roi_out, out, in, d, cam, Lab, rowsize) schedule(static)
+#endif
+      for(int k=0; k<roi_out->height; k++)
       {
-        int li=3*l, oi=ch*l;
-        out[m+oi+0] = Lab[li+0];
-        out[m+oi+1] = Lab[li+1];
-        out[m+oi+2] = Lab[li+2];
+        const int m=(k*(roi_out->width*ch));
+        _lcms_cam_row(in + m, cam, roi_out->width, ch);
+        // convert to (L,a/L,b/L) to be able to change L without changing saturation.
+        // lcms is not thread safe, so work on one copy for each thread :(
+        cmsDoTransform (d->xform[dt_get_thread_num()], cam, Lab, roi_out->width);
+
+        for (int l=0; l<roi_out->width; l++)
+        {
+          int li=3*l, oi=ch*l;
+          out[m+oi+0] = Lab[li+0];
+          out[m+oi+1] = Lab[li+1];
+          out[m+oi+2] = Lab[li+2];
+        }
       }
     }
   }
@@ -355,6 +379,8 @@ void commit_params (struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pi
   if(d->input) cmsCloseProfile(d->input);
   const int num_threads = dt_get_num_threads();
   d->input = NULL;
+  dt_icc_lut_release(d->clut);
+  d->clut = NULL;
   for(int t=0; t<num_threads; t++) if(d->xform[t])
     {
       cmsDeleteTransform(d->xform[t]);
@@ -469,6 +495,8 @@ void commit_params (struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pi
       for(int t=0; t<num_threads; t++) d->xform[t] = cmsCreateTransform(d->input, TYPE_RGB_FLT, d->Lab, TYPE_Lab_FLT, p->intent, 0);
     }
   }
+  // the generic lcms path is slow, bake it into a lut if that's accurate enough
+  if(d->xform[0]) d->clut = dt_icc_lut_get(d->input, d->Lab, p->intent, DT_ICC_LUT_RGB_TO_LAB);
   // user selected a non-supported output profile, check that:
   if(!d->xform[0] && d->cmatrix[0] == -666.0f)
   {
@@ -509,6 +537,7 @@ void init_pipe (struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_p
   piece->data = malloc(sizeof(dt_iop_colorin_data_t));
   dt_iop_colorin_data_t *d = (dt_iop_colorin_data_t *)piece->data;
   d->input = NULL;
+  d->clut = NULL;
   d->xform = (cmsHTRANSFORM *)malloc(sizeof(cmsHTRANSFORM)*dt_get_num_threads());
   for(int t=0; t<dt_get_num_threads(); t++) d->xform[t] = NULL;
   d->Lab = dt_colorspaces_create_lab_profile();
@@ -520,6 +549,7 @@ void cleanup_pipe (struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_de
   dt_iop_colorin_data_t *d = (dt_iop_colorin_data_t *)piece->data;
   if(d->input) dt_colorspaces_cleanup_profile(d->input);
   dt_colorspaces_cleanup_profile(d->Lab);
+  dt_icc_lut_release(d->clut);
   for(int t=0; t<dt_get_num_threads(); t++) if(d->xform[t]) cmsDeleteTransform(d->xform[t]);
   free(d->xform);
   free(piece->data);
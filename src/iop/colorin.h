@@ -19,6 +19,7 @@
 #define DARKTABLE_IOP_COLORIN_H
 
 #include "common/colorspaces.h"
+#include "common/icc_lut.h"
 #include "develop/imageop.h"
 #include <gtk/gtk.h>
 #include <inttypes.h>
@@ -67,6 +68,7 @@ typedef struct dt_iop_colorin_data_t
   cmsHPROFILE input;
   cmsHPROFILE Lab;
   cmsHTRANSFORM *xform;
+  dt_icc_lut_t *clut;                 // baked xform, if accurate enough
   float lut[3][LUT_SAMPLES];
   float cmatrix[9];
   float unbounded_coeffs[3][3];       // approximation for extrapolation of shaper curves
@@ -495,6 +495,7 @@ process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void *ivoi
       // bilateral blur of delta L to avoid artifacts caused by limited histogram resolution
       dt_bilateral_t *b = dt_bilateral_init(width, height, sigma_s, sigma_r);
       if(!b) return;
+      b->piece = piece;
       dt_bilateral_splat(b, out);
       dt_bilateral_blur(b);
       dt_bilateral_slice(b, out, out, -1.0f);
@@ -28,6 +28,7 @@
 #include "gui/gtk.h"
 #include "common/colorspaces.h"
 #include "common/opencl.h"
+#include "common/cpu_dispatch.h"
 
 #include <xmmintrin.h>
 #include <stdlib.h>
@@ -346,36 +347,6 @@ error:
 }
 #endif
 
-static inline __m128
-lab_f_inv_m(const __m128 x)
-{
-  const __m128 epsilon = _mm_set1_ps(0.20689655172413796f); // cbrtf(216.0f/24389.0f);
-  const __m128 kappa_rcp_x16   = _mm_set1_ps(16.0f*27.0f/24389.0f);
-  const __m128 kappa_rcp_x116   = _mm_set1_ps(116.0f*27.0f/24389.0f);
-
-  // x > epsilon
-  const __m128 res_big   = _mm_mul_ps(_mm_mul_ps(x,x),x);
-  // x <= epsilon
-  const __m128 res_small = _mm_sub_ps(_mm_mul_ps(kappa_rcp_x116,x),kappa_rcp_x16);
-
-  // blend results according to whether each component is > epsilon or not
-  const __m128 mask = _mm_cmpgt_ps(x,epsilon);
-  return _mm_or_ps(_mm_and_ps(mask,res_big),_mm_andnot_ps(mask,res_small));
-}
-
-static inline __m128
-dt_Lab_to_XYZ_SSE(const __m128 Lab)
-{
-  const __m128 d50    = _mm_set_ps(0.0f, 0.8249f, 1.0f, 0.9642f);
-  const __m128 coef   = _mm_set_ps(0.0f,-1.0f/200.0f,1.0f/116.0f,1.0f/500.0f);
-  const __m128 offset = _mm_set1_ps(0.137931034f);
-
-  // last component ins shuffle taken from 1st component of Lab to make sure it is not nan, so it will become 0.0f in f
-  const __m128 f = _mm_mul_ps(_mm_shuffle_ps(Lab,Lab,_MM_SHUFFLE(0,2,0,1)),coef);
-
-  return _mm_mul_ps(d50,lab_f_inv_m(_mm_add_ps(_mm_add_ps(f,_mm_shuffle_ps(f,f,_MM_SHUFFLE(1,1,3,1))),offset)));
-}
-
 void
 process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void *ivoid, void *ovoid, const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out)
 {
@@ -386,39 +357,20 @@ process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void *ivoi
   if(!isnan(d->cmatrix[0]))
   {
     //fprintf(stderr,"Using cmatrix codepath\n");
-    // convert to rgb using matrix
+    // convert to rgb using matrix, then apply the profile curves on the same row
+    const dt_cpu_kernels_t *const kernels = darktable.kernels;
 #ifdef _OPENMP
     #pragma omp parallel for schedule(static) default(none) shared(roi_in,roi_out, ivoid, ovoid)
 #endif
     for(int j=0; j<roi_out->height; j++)
     {
 
-      float *in  = (float*)ivoid + ch*roi_in->width *j;
+      const float *in  = (float*)ivoid + ch*roi_in->width *j;
       float *out = (float*)ovoid + ch*roi_out->width*j;
-      const __m128 m0 = _mm_set_ps(0.0f,d->cmatrix[6],d->cmatrix[3],d->cmatrix[0]);
-      const __m128 m1 = _mm_set_ps(0.0f,d->cmatrix[7],d->cmatrix[4],d->cmatrix[1]);
-      const __m128 m2 = _mm_set_ps(0.0f,d->cmatrix[8],d->cmatrix[5],d->cmatrix[2]);
-
-      for(int i=0; i<roi_out->width; i++, in+=ch, out+=ch )
-      {
-        const __m128 xyz = dt_Lab_to_XYZ_SSE(_mm_load_ps(in));
-        const __m128 t = _mm_add_ps(_mm_mul_ps(m0,_mm_shuffle_ps(xyz,xyz,_MM_SHUFFLE(0,0,0,0))),_mm_add_ps(_mm_mul_ps(m1,_mm_shuffle_ps(xyz,xyz,_MM_SHUFFLE(1,1,1,1))),_mm_mul_ps(m2,_mm_shuffle_ps(xyz,xyz,_MM_SHUFFLE(2,2,2,2)))));
 
-        _mm_stream_ps(out,t);
-      }
-    }
-    _mm_sfence();
-    // apply profile
-#ifdef _OPENMP
-    #pragma omp parallel for schedule(static) default(none) shared(roi_in,roi_out, ivoid, ovoid)
-#endif
-    for(int j=0; j<roi_out->height; j++)
-    {
+      kernels->Lab_to_rgb_row(out, in, d->cmatrix, roi_out->width);
 
-      float *in  = (float*)ivoid + ch*roi_in->width *j;
-      float *out = (float*)ovoid + ch*roi_out->width*j;
-
-      for(int i=0; i<roi_out->width; i++, in+=ch, out+=ch )
+      for(int i=0; i<roi_out->width; i++, out+=ch )
       {
         for(int i=0; i<3; i++)
           if (d->lut[i][0] >= 0.0f)
@@ -452,7 +404,8 @@ process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void *ivoi
         Lab[li+2] = in[m+ii+2];
       }
 
-      cmsDoTransform (d->xform, Lab, rgb, roi_out->width);
+      if(d->clut) dt_icc_lut_transform(d->clut, d->xform, Lab, rgb, roi_out->width);
+      else cmsDoTransform (d->xform, Lab, rgb, roi_out->width);
 
       for (int l=0; l<roi_out->width; l++)
       {
@@ -541,6 +494,8 @@ void commit_params (struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pi
     dt_iop_colorout_gui_data_t *g = (dt_iop_colorout_gui_data_t *)self->gui_data;
     g->softproof_enabled = p->softproof_enabled;
   }
+  dt_icc_lut_release(d->clut);
+  d->clut = NULL;
   if (d->xform)
   {
     cmsDeleteTransform(d->xform);
@@ -631,6 +586,11 @@ void commit_params (struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pi
     }
   }
 
+  // plain profile conversions can be baked into a lut, softproofing and forced
+  // high quality export stay with lcms.
+  if (d->xform && !d->softproof_enabled && !high_quality_processing)
+    d->clut = dt_icc_lut_get(d->Lab, d->output, outintent, DT_ICC_LUT_LAB_TO_RGB);
+
   // now try to initialize unbounded mode:
   // we do extrapolation for input values above 1.0f.
   // unfortunately we can only do this if we got the computation
@@ -663,6 +623,7 @@ void init_pipe (struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_p
   d->softproof_enabled = 0;
   d->softproof = d->output = NULL;
   d->xform = 0;
+  d->clut = NULL;
   d->Lab = dt_colorspaces_create_lab_profile();
   self->commit_params(self, self->default_params, pipe, piece);
 }
@@ -672,6 +633,7 @@ void cleanup_pipe (struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_de
   dt_iop_colorout_data_t *d = (dt_iop_colorout_data_t *)piece->data;
   if(d->output) dt_colorspaces_cleanup_profile(d->output);
   dt_colorspaces_cleanup_profile(d->Lab);
+  dt_icc_lut_release(d->clut);
   if (d->xform)
   {
     cmsDeleteTransform(d->xform);
@@ -70,6 +70,7 @@ typedef struct dt_iop_colorout_data_t
   cmsHPROFILE output;
   cmsHPROFILE Lab;
   cmsHTRANSFORM *xform;
+  dt_icc_lut_t *clut;                 // baked xform, if accurate enough
   float unbounded_coeffs[3][3];       // for extrapolation of shaper curves
 }
 dt_iop_colorout_data_t;
@@ -19,6 +19,7 @@
 #include "config.h"
 #endif
 #include "common/colorspaces.h"
+#include "common/colorspaces_rows.h"
 #include "common/darktable.h"
 #include "common/debug.h"
 #include "common/opencl.h"
@@ -41,6 +42,7 @@ DT_MODULE(3)
 #define DT_IOP_COLORZONES_CURVE_INFL .3f
 #define DT_IOP_COLORZONES_RES 64
 #define DT_IOP_COLORZONES_LUT_RES 0x10000
+#define DT_IOP_COLORZONES_BLOCK 256
 
 #define DT_IOP_COLORZONES_BANDS 8
 #define DT_IOP_COLORZONES1_BANDS 6
@@ -209,42 +211,49 @@ process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void *i, v
 {
   dt_iop_colorzones_data_t *d = (dt_iop_colorzones_data_t *)(piece->data);
   const int ch = piece->colors;
+  const int npixels = roi_out->width*roi_out->height;
+  // convert to LCh and back in blocks of pixels, the per pixel work in between only needs the curves
 #ifdef _OPENMP
-  #pragma omp parallel for default(none) schedule(static) shared(roi_in, roi_out, d, i, o)
+  #pragma omp parallel for default(none) schedule(static) shared(d, i, o)
 #endif
-  for(int k=0; k<roi_out->width*roi_out->height; k++)
+  for(int k0=0; k0<npixels; k0+=DT_IOP_COLORZONES_BLOCK)
   {
-    float *in = (float *)i + ch*k;
-    float *out = (float *)o + ch*k;
-    const float a = in[1], b = in[2];
-    const float h = fmodf(atan2f(b, a) + 2.0*M_PI, 2.0*M_PI)/(2.0*M_PI);
-    const float C = sqrtf(b*b + a*a);
-    float select = 0.0f;
-    float blend = 0.0f;
-    switch(d->channel)
+    const int n = MIN(DT_IOP_COLORZONES_BLOCK, npixels - k0);
+    const float *in = (float *)i + ch*k0;
+    float *out = (float *)o + ch*k0;
+    float LCh[4*DT_IOP_COLORZONES_BLOCK];
+    dt_Lab_to_LCh_row(in, LCh, n);
+    for(int k=0; k<n; k++)
     {
-      case DT_IOP_COLORZONES_L:
-        select = fminf(1.0, in[0]/100.0);
-        break;
-      case DT_IOP_COLORZONES_C:
-        select = fminf(1.0, C/128.0);
-        break;
-      default:
-      case DT_IOP_COLORZONES_h:
-        select = h;
-        blend = powf(1.0f - C/128.0f, 2.0f);
-        break;
+      const float C = LCh[4*k+1];
+      const float h = LCh[4*k+2];
+      float select = 0.0f;
+      float blend = 0.0f;
+      switch(d->channel)
+      {
+        case DT_IOP_COLORZONES_L:
+          select = fminf(1.0, LCh[4*k]/100.0);
+          break;
+        case DT_IOP_COLORZONES_C:
+          select = fminf(1.0, C/128.0);
+          break;
+        default:
+        case DT_IOP_COLORZONES_h:
+          select = h;
+          blend = powf(1.0f - C/128.0f, 2.0f);
+          break;
+      }
+      const float Lm =       (blend*.5f + (1.0f-blend)*lookup(d->lut[0], select)) - .5f;
+      const float hm =       (blend*.5f + (1.0f-blend)*lookup(d->lut[2], select)) - .5f;
+      blend *= blend; // saturation isn't as prone to artifacts:
+      // const float Cm = 2.0 * (blend*.5f + (1.0f-blend)*lookup(d->lut[1], select));
+      const float Cm = 2.0 * lookup(d->lut[1], select);
+      LCh[4*k+0] = LCh[4*k] * powf(2.0f, 4.0f*Lm);
+      LCh[4*k+1] = Cm * C;
+      LCh[4*k+2] = h + hm;
     }
-    const float Lm =       (blend*.5f + (1.0f-blend)*lookup(d->lut[0], select)) - .5f;
-    const float hm =       (blend*.5f + (1.0f-blend)*lookup(d->lut[2], select)) - .5f;
-    blend *= blend; // saturation isn't as prone to artifacts:
-    // const float Cm = 2.0 * (blend*.5f + (1.0f-blend)*lookup(d->lut[1], select));
-    const float Cm = 2.0 * lookup(d->lut[1], select);
-    const float L = in[0] * powf(2.0f, 4.0f*Lm);
-    out[0] = L;
-    out[1] = cosf(2.0*M_PI*(h + hm)) * Cm * C;
-    out[2] = sinf(2.0*M_PI*(h + hm)) * Cm * C;
-    out[3] = in[3];
+    // alpha is passed through from the input
+    dt_LCh_to_Lab_row(LCh, out, n);
   }
 }
 
@@ -619,22 +619,26 @@ modify_roi_in (struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piec
   // this op is disabled for preview pipe/filters == 0
 
   *roi_in = *roi_out;
-  // need 1:1, demosaic and then sub-sample. or directly sample half-size
-  roi_in->x /= roi_out->scale;
-  roi_in->y /= roi_out->scale;
-  roi_in->width /= roi_out->scale;
-  roi_in->height /= roi_out->scale;
-  roi_in->scale = 1.0f;
+  // need 1:1, demosaic and then sub-sample. or directly sample half-size.
+  // small exports may get the mosaic binned by an integer factor instead of 1:1:
+  const int factor = dt_dev_pixelpipe_raw_downscale_factor(piece->pipe, roi_out->scale);
+  const float scale = roi_out->scale * factor;
+  roi_in->x /= scale;
+  roi_in->y /= scale;
+  roi_in->width /= scale;
+  roi_in->height /= scale;
+  roi_in->scale = 1.0f/factor;
   // clamp to even x/y, to make demosaic pattern still hold..
   roi_in->x = MAX(0, roi_in->x & ~1);
   roi_in->y = MAX(0, roi_in->y & ~1);
 
   // clamp numeric inaccuracies to full buffer, to avoid scaling/copying in pixelpipe:
-  if(abs(piece->pipe->image.width - roi_in->width) < MAX(ceilf(1.0f/roi_out->scale), 10))
-    roi_in->width  = piece->pipe->image.width;
+  const int width = piece->pipe->image.width / factor, height = piece->pipe->image.height / factor;
+  if(abs(width - roi_in->width) < MAX(ceilf(1.0f/scale), 10))
+    roi_in->width  = width;
 
-  if(abs(piece->pipe->image.height - roi_in->height) < MAX(ceilf(1.0f/roi_out->scale), 10))
-    roi_in->height = piece->pipe->image.height;
+  if(abs(height - roi_in->height) < MAX(ceilf(1.0f/scale), 10))
+    roi_in->height = height;
 }
 
 static int get_quality()
@@ -663,6 +667,9 @@ process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void *i, v
   roo = *roi_out;
   roo.x = roo.y = 0;
   // roi_out->scale = global scale: (iscale == 1.0, always when demosaic is on)
+  // the input is the full mosaic, or binned to roi_in->scale for small exports:
+  const float scale = roi_out->scale / roi_in->scale;
+  roo.scale = scale;
 
   dt_iop_demosaic_data_t *data = (dt_iop_demosaic_data_t *)piece->data;
 
@@ -672,7 +679,7 @@ process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void *i, v
     demosaicing_method = DT_IOP_DEMOSAIC_PPG;
 
   const float *const pixels = (float *)i;
-  if(roi_out->scale > .99999f && roi_out->scale < 1.00001f)
+  if(scale > .99999f && scale < 1.00001f)
   {
     // output 1:1
     // green eq:
@@ -710,15 +717,15 @@ process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void *i, v
         amaze_demosaic_RT(self, piece, pixels, (float *)o, &roi, &roo, data->filters);
     }
   }
-  else if(roi_out->scale > .5f ||                                      // also covers roi_out->scale >1
+  else if(scale > .5f ||                                               // also covers scale >1
           (piece->pipe->type == DT_DEV_PIXELPIPE_FULL && qual > 0) ||  // or in darkroom mode and quality requested by user settings
           (piece->pipe->type == DT_DEV_PIXELPIPE_EXPORT))              // we assume you always want that for exports.
   {
     // demosaic and then clip and zoom
     // roo.x = roi_out->x / global_scale;
     // roo.y = roi_out->y / global_scale;
-    roo.width  = roi_out->width / roi_out->scale;
-    roo.height = roi_out->height / roi_out->scale;
+    roo.width  = roi_out->width / scale;
+    roo.height = roi_out->height / scale;
     roo.scale = 1.0f;
 
     float *tmp = (float *)dt_alloc_align(16, roo.width*roo.height*4*sizeof(float));
@@ -758,7 +765,7 @@ process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void *i, v
     }
     roi = *roi_out;
     roi.x = roi.y = 0;
-    roi.scale = roi_out->scale;
+    roi.scale = scale;
     dt_iop_clip_and_zoom((float *)o, tmp, &roi, &roo, roi.width, roo.width);
     free(tmp);
   }
@@ -790,14 +797,15 @@ process_cl (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem
   const float threshold = 0.0001f * img->exif_iso;
 
   const int qual = get_quality();
+  const float scale = roi_out->scale / roi_in->scale;
   const struct dt_interpolation* interpolation = dt_interpolation_new(DT_INTERPOLATION_USERPREF);
-  if(interpolation->id != DT_INTERPOLATION_BILINEAR && roi_out->scale <= .99999f && roi_out->scale > 0.5f)
+  if(interpolation->id != DT_INTERPOLATION_BILINEAR && scale <= .99999f && scale > 0.5f)
   {
     dt_print(DT_DEBUG_OPENCL, "[opencl_demosaic] only bilinear interpolation currently supported by opencl demosaic\n");
     return FALSE;
   }
 
-  if(roi_out->scale >= 1.00001f)
+  if(scale >= 1.00001f)
   {
     dt_print(DT_DEBUG_OPENCL, "[opencl_demosaic] demosaic with upscaling not yet supported by opencl code\n");
     return FALSE;
@@ -809,7 +817,7 @@ process_cl (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem
   cl_mem dev_green_eq = NULL;
   cl_int err = -999;
 
-  if(roi_out->scale > .99999f)
+  if(scale > .99999f)
   {
     const int width = roi_out->width;
     const int height = roi_out->height;
@@ -882,7 +890,7 @@ process_cl (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem
     if(err != CL_SUCCESS) goto error;
 
   }
-  else if(roi_out->scale > .5f ||  // full needed because zoomed in enough
+  else if(scale > .5f ||  // full needed because zoomed in enough
           (piece->pipe->type == DT_DEV_PIXELPIPE_FULL && qual > 0) ||  // or in darkroom mode and quality requested by user settings
           (piece->pipe->type == DT_DEV_PIXELPIPE_EXPORT))              // we assume you always want that for exports.
   {
@@ -969,7 +977,7 @@ process_cl (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem
     dt_opencl_set_kernel_arg(devid, gd->kernel_downsample, 5, sizeof(int), (void*)&zero);
     dt_opencl_set_kernel_arg(devid, gd->kernel_downsample, 6, sizeof(int), (void*)&roi_out->width);
     dt_opencl_set_kernel_arg(devid, gd->kernel_downsample, 7, sizeof(int), (void*)&roi_out->height);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_downsample, 8, sizeof(float), (void*)&roi_out->scale);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_downsample, 8, sizeof(float), (void*)&scale);
     err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_downsample, sizes);
     if(err != CL_SUCCESS) goto error;
   }
@@ -1010,7 +1018,7 @@ process_cl (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem
     dt_opencl_set_kernel_arg(devid, gd->kernel_zoom_half_size, 5, sizeof(int), (void*)&zero);
     dt_opencl_set_kernel_arg(devid, gd->kernel_zoom_half_size, 6, sizeof(int), (void*)&roi_in->width);
     dt_opencl_set_kernel_arg(devid, gd->kernel_zoom_half_size, 7, sizeof(int), (void*)&roi_in->height);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_zoom_half_size, 8, sizeof(float), (void*)&roi_out->scale);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_zoom_half_size, 8, sizeof(float), (void*)&scale);
     dt_opencl_set_kernel_arg(devid, gd->kernel_zoom_half_size, 9, sizeof(uint32_t), (void*)&data->filters);
     err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_zoom_half_size, sizes);
     if(err != CL_SUCCESS) goto error;
@@ -1117,14 +1125,15 @@ void tiling_callback  (struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop
   dt_iop_demosaic_data_t *data = (dt_iop_demosaic_data_t *)piece->data;
 
   const int qual = get_quality();
+  const float scale = roi_out->scale / roi_in->scale;
   const float ioratio = (float)roi_out->width*roi_out->height/((float)roi_in->width*roi_in->height);
   const float smooth = data->color_smoothing ? ioratio : 0.0f;
 
   tiling->factor = 1.0f + ioratio;
 
-  if(roi_out->scale > 0.99999f && roi_out->scale < 1.00001f)
+  if(scale > 0.99999f && scale < 1.00001f)
     tiling->factor += fmax(0.25f, smooth);
-  else if(roi_out->scale > 0.5f ||
+  else if(scale > 0.5f ||
           (piece->pipe->type == DT_DEV_PIXELPIPE_FULL && qual > 0) || (piece->pipe->type == DT_DEV_PIXELPIPE_EXPORT))
     tiling->factor += fmax(1.25f, smooth);
   else
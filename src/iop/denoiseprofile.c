@@ -23,6 +23,7 @@
 #include "bauhaus/bauhaus.h"
 #include "control/control.h"
 #include "common/noiseprofiles.h"
+#include "common/cpu_dispatch.h"
 #include "common/opencl.h"
 #include "gui/accelerators.h"
 #include "gui/presets.h"
@@ -352,7 +353,7 @@ weight_sse(const __m128 *c1, const __m128 *c2, const float inv_sigma2)
   pcoarse+=4;
 
 static void
-eaw_decompose (float *const out, const float *const in, float *const detail, const int scale,
+eaw_decompose (dt_dev_pixelpipe_iop_t *const piece, float *const out, const float *const in, float *const detail, const int scale,
                const float inv_sigma2, const int32_t width, const int32_t height)
 {
   const int mult = 1<<scale;
@@ -386,6 +387,9 @@ eaw_decompose (float *const out, const float *const in, float *const detail, con
 #endif
   for(int j=2*mult; j<height-2*mult; j++)
   {
+    // bail out row by row, the pipe discards the result if it got cancelled
+    if(dt_iop_cancelled(piece)) continue;
+
     ROW_PROLOGUE
 
     /* The first "2*mult" pixels use the macro with tests because the 5x5 kernel
@@ -469,7 +473,7 @@ eaw_decompose (float *const out, const float *const in, float *const detail, con
 #undef SUM_PIXEL_EPILOGUE
 
 static void
-eaw_synthesize (float *const out, const float *const in, const float *const detail,
+eaw_synthesize (dt_dev_pixelpipe_iop_t *const piece, float *const out, const float *const in, const float *const detail,
                 const float *thrsf, const float *boostf, const int32_t width, const int32_t height)
 {
   const __m128 threshold = _mm_set_ps(thrsf[3], thrsf[2], thrsf[1], thrsf[0]);
@@ -480,6 +484,7 @@ eaw_synthesize (float *const out, const float *const in, const float *const deta
 #endif
   for(int j=0; j<height; j++)
   {
+    if(dt_iop_cancelled(piece)) continue;
     // TODO: prefetch? _mm_prefetch()
     const __m128 *pin = (__m128 *)in + j*width;
     __m128 *pdetail = (__m128 *)detail + j*width;
@@ -533,12 +538,18 @@ void process_wavelets(
     if(t < 0.0f) break;
   }
 
-  float *buf[max_max_scale];
-  float *tmp = NULL;
-  float *buf1 = NULL, *buf2 = NULL;
-  for(int k=0; k<max_scale; k++)
-    buf[k] = dt_alloc_align(64, 4*sizeof(float)*roi_in->width*roi_in->height);
-  tmp = dt_alloc_align(64, 4*sizeof(float)*roi_in->width*roi_in->height);
+  // the synthesis only adds up the thresholded detail scales, and the threshold of a scale
+  // only depends on that scale. so every scale goes into the output right away, and only
+  // two coarse buffers and one detail buffer have to be kept around.
+  dt_dev_pixelpipe_scratch_t *scratch = &piece->pipe->scratch;
+  const size_t bufsize = 4*sizeof(float)*roi_in->width*roi_in->height;
+  float *coarse[2] = { dt_dev_pixelpipe_scratch_alloc(scratch, bufsize), dt_dev_pixelpipe_scratch_alloc(scratch, bufsize) };
+  float *detail = dt_dev_pixelpipe_scratch_alloc(scratch, bufsize);
+  if(coarse[0] == NULL || coarse[1] == NULL || detail == NULL)
+  {
+    fprintf(stderr, "[denoiseprofile] failed to allocate scratch buffers!\n");
+    goto error;
+  }
 
   const float wb[3] =
   {
@@ -574,17 +585,20 @@ void process_wavelets(
     fclose(f);
   }
 #endif
-  buf1 = (float *)ovoid;
-  buf2 = tmp;
-
+  float *out = (float *)ovoid;
+  const float *buf_in = out;
   for(int scale=0; scale<max_scale; scale++)
   {
+    // skip the serial threshold estimation too if the pipe got cancelled
+    if(dt_iop_cancelled(piece)) break;
+    float *buf_out = coarse[scale & 1];
     const float sigma = 1.0f;
     const float varf = sqrtf(2.0f + 2.0f * 4.0f*4.0f + 6.0f*6.0f)/16.0f; // about 0.5
     const float sigma_band = powf(varf, scale) *sigma;
-    eaw_decompose (buf2, buf1, buf[scale], scale, 1.0f/(sigma_band*sigma_band), width, height);
-    // DEBUG: clean out temporary memory:
-    // memset(buf1, 0, sizeof(float)*4*width*height);
+    eaw_decompose (piece, buf_out, buf_in, detail, scale, 1.0f/(sigma_band*sigma_band), width, height);
+    // the preconditioned input is not needed any more after the finest scale,
+    // accumulate the output in its place:
+    if(scale == 0) memset(out, 0, bufsize);
 # if 0 // DEBUG: print wavelet scales:
     if(piece->pipe->type != DT_DEV_PIXELPIPE_PREVIEW)
     {
@@ -594,37 +608,26 @@ void process_wavelets(
       FILE *f = fopen(filename, "wb");
       fprintf(f, "PF\n%d %d\n-1.0\n", width, height);
       for(int k=0; k<n; k++)
-        fwrite(buf2+4*k, sizeof(float), 3, f);
+        fwrite(buf_out+4*k, sizeof(float), 3, f);
       fclose(f);
       snprintf(filename, 512, "/tmp/detail_%d.pfm", scale);
       f = fopen(filename, "wb");
       fprintf(f, "PF\n%d %d\n-1.0\n", width, height);
       for(int k=0; k<n; k++)
-        fwrite(buf[scale]+4*k, sizeof(float), 3, f);
+        fwrite(detail+4*k, sizeof(float), 3, f);
       fclose(f);
     }
 #endif
-    float *buf3 = buf2;
-    buf2 = buf1;
-    buf1 = buf3;
-  }
-
-  // now do everything backwards, so the result will end up in *ovoid
-  for(int scale=max_scale-1; scale>=0; scale--)
-  {
 #if 1
     // variance stabilizing transform maps sigma to unity.
-    const float sigma = 1.0f;
-    // it is then transformed by wavelet scales via the 5 tap a-trous filter:
-    const float varf = sqrtf(2.0f + 2.0f * 4.0f*4.0f + 6.0f*6.0f)/16.0f; // about 0.5
-    const float sigma_band = powf(varf, scale) *sigma;
+    // it is then transformed by wavelet scales via the 5 tap a-trous filter (varf above).
     // determine thrs as bayesshrink
     // TODO: parallelize!
     float sum_y2[3] = {0.0f};
     const int n = width*height;
     for(int k=0; k<n; k++)
       for(int c=0; c<3; c++)
-        sum_y2[c] += buf[scale][4*k+c]*buf[scale][4*k+c];
+        sum_y2[c] += detail[4*k+c]*detail[4*k+c];
 
     const float sb2 = sigma_band*sigma_band;
     const float var_y[3] =
@@ -648,23 +651,27 @@ void process_wavelets(
 #endif
     const float boost[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
     // const float thrs[4] = { 0.0, 0.0, 0.0, 0.0 };
-    eaw_synthesize (buf2, buf1, buf[scale], thrs, boost, width, height);
-    // DEBUG: clean out temporary memory:
-    // memset(buf1, 0, sizeof(float)*4*width*height);
+    eaw_synthesize (piece, out, out, detail, thrs, boost, width, height);
+    buf_in = buf_out;
+  }
 
-    float *buf3 = buf2;
-    buf2 = buf1;
-    buf1 = buf3;
+  // add the coarse residual, result ends up in *ovoid
+  if(buf_in != out)
+  {
+    const float zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    const float one[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    eaw_synthesize (piece, out, buf_in, out, zero, one, width, height);
   }
 
   backtransform((float *)ovoid, width, height, aa, bb);
 
-  for(int k=0; k<max_scale; k++)
-    free(buf[k]);
-  free(tmp);
-
   if(piece->pipe->mask_display)
     dt_iop_alpha_copy(ivoid, ovoid, width, height);
+
+error:
+  dt_dev_pixelpipe_scratch_release(scratch, detail);
+  dt_dev_pixelpipe_scratch_release(scratch, coarse[1]);
+  dt_dev_pixelpipe_scratch_release(scratch, coarse[0]);
 }
 
 void process_nlmeans(
@@ -712,11 +719,18 @@ void process_nlmeans(
   };
   precondition((float *)ivoid, in, roi_in->width, roi_in->height, aa, bb);
 
+  // the variance stabilizing transform made all channels equally important:
+  const float norm2[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+  const dt_cpu_kernels_t *const kernels = darktable.kernels;
+
   // for each shift vector
   for(int kj=-K; kj<=K; kj++)
   {
     for(int ki=-K; ki<=K; ki++)
     {
+      // one pass per shift vector, stop early if the pipe got cancelled
+      if(dt_iop_cancelled(piece)) break;
+
       // TODO: adaptive K tests here!
       // TODO: expf eval for real bilateral experience :)
 
@@ -748,11 +762,7 @@ void process_nlmeans(
             const float *inp  = in + 4*i + 4* roi_in->width *(j+jj);
             const float *inps = in + 4*i + 4*(roi_in->width *(j+jj+kj) + ki);
             const int last = roi_out->width + MIN(0, -ki);
-            for(; i<last; i++, inp+=4, inps+=4, s++)
-            {
-              for(int k=0; k<3; k++)
-                s[0] += (inp[k] - inps[k])*(inp[k] - inps[k]);
-            }
+            kernels->nlmeans_dist_row(s, inp, inps, NULL, NULL, norm2, last-i);
           }
           // only reuse this if we had a full stripe
           if(Pm == P && PM == P) inited_slide = 1;
@@ -792,66 +802,7 @@ void process_nlmeans(
           const float *inm  = in + 4*i + 4* roi_in->width *(j-P);
           const float *inms = in + 4*i + 4*(roi_in->width *(j-P+kj) + ki);
           const int last = roi_out->width + MIN(0, -ki);
-          for(; ((unsigned long)s & 0xf) != 0 && i<last; i++, inp+=4, inps+=4, inm+=4, inms+=4, s++)
-          {
-            float stmp = s[0];
-            for(int k=0; k<3; k++)
-              stmp += ((inp[k] - inps[k])*(inp[k] - inps[k])
-                       -  (inm[k] - inms[k])*(inm[k] - inms[k]));
-            s[0] = stmp;
-          }
-          /* Process most of the line 4 pixels at a time */
-          for(; i<last-4; i+=4, inp+=16, inps+=16, inm+=16, inms+=16, s+=4)
-          {
-            __m128 sv = _mm_load_ps(s);
-            const __m128 inp1 = _mm_load_ps(inp)    - _mm_load_ps(inps);
-            const __m128 inp2 = _mm_load_ps(inp+4)  - _mm_load_ps(inps+4);
-            const __m128 inp3 = _mm_load_ps(inp+8)  - _mm_load_ps(inps+8);
-            const __m128 inp4 = _mm_load_ps(inp+12) - _mm_load_ps(inps+12);
-
-            const __m128 inp12lo = _mm_unpacklo_ps(inp1,inp2);
-            const __m128 inp34lo = _mm_unpacklo_ps(inp3,inp4);
-            const __m128 inp12hi = _mm_unpackhi_ps(inp1,inp2);
-            const __m128 inp34hi = _mm_unpackhi_ps(inp3,inp4);
-
-            const __m128 inpv0 = _mm_movelh_ps(inp12lo,inp34lo);
-            sv += inpv0*inpv0;
-
-            const __m128 inpv1 = _mm_movehl_ps(inp34lo,inp12lo);
-            sv += inpv1*inpv1;
-
-            const __m128 inpv2 = _mm_movelh_ps(inp12hi,inp34hi);
-            sv += inpv2*inpv2;
-
-            const __m128 inm1 = _mm_load_ps(inm)    - _mm_load_ps(inms);
-            const __m128 inm2 = _mm_load_ps(inm+4)  - _mm_load_ps(inms+4);
-            const __m128 inm3 = _mm_load_ps(inm+8)  - _mm_load_ps(inms+8);
-            const __m128 inm4 = _mm_load_ps(inm+12) - _mm_load_ps(inms+12);
-
-            const __m128 inm12lo = _mm_unpacklo_ps(inm1,inm2);
-            const __m128 inm34lo = _mm_unpacklo_ps(inm3,inm4);
-            const __m128 inm12hi = _mm_unpackhi_ps(inm1,inm2);
-            const __m128 inm34hi = _mm_unpackhi_ps(inm3,inm4);
-
-            const __m128 inmv0 = _mm_movelh_ps(inm12lo,inm34lo);
-            sv -= inmv0*inmv0;
-
-            const __m128 inmv1 = _mm_movehl_ps(inm34lo,inm12lo);
-            sv -= inmv1*inmv1;
-
-            const __m128 inmv2 = _mm_movelh_ps(inm12hi,inm34hi);
-            sv -= inmv2*inmv2;
-
-            _mm_store_ps(s, sv);
-          }
-          for(; i<last; i++, inp+=4, inps+=4, inm+=4, inms+=4, s++)
-          {
-            float stmp = s[0];
-            for(int k=0; k<3; k++)
-              stmp += ((inp[k] - inps[k])*(inp[k] - inps[k])
-                       -  (inm[k] - inms[k])*(inm[k] - inms[k]));
-            s[0] = stmp;
-          }
+          kernels->nlmeans_dist_row(s, inp, inps, inm, inms, norm2, last-i);
         }
         else inited_slide = 0;
       }
@@ -82,15 +82,32 @@ void process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void
   const int numl_cap = MIN(DT_IOP_EQUALIZER_MAX_LEVEL-l1+1.5, numl);
   // printf("level range in %d %d: %f %f, cap: %d\n", 1, d->num_levels, l1, lm, numl_cap);
 
-  // TODO: fixed alloc for data piece at capped resolution?
+  // weights of all levels go into one block from the pipe's scratch pool,
+  // each level starting on a cache line.
   float **tmp = (float **)malloc(sizeof(float *)*numl_cap);
+  size_t weights_size = 0;
   for(int k=1; k<numl_cap; k++)
   {
-    const int wd = (int)(1 + (width>>(k-1))), ht = (int)(1 + (height>>(k-1)));
-    tmp[k] = (float *)malloc(sizeof(float)*wd*ht);
+    const size_t wd = 1 + (width>>(k-1)), ht = 1 + (height>>(k-1));
+    weights_size += (wd*ht + 15) & ~(size_t)15;
+  }
+  float *weights = (float *)dt_dev_pixelpipe_scratch_alloc(&piece->pipe->scratch, sizeof(float)*MAX(weights_size, 1));
+  if(!weights)
+  {
+    fprintf(stderr, "[equalizer] failed to allocate weight buffers!\n");
+    free(tmp);
+    return;
+  }
+  size_t offset = 0;
+  for(int k=1; k<numl_cap; k++)
+  {
+    const size_t wd = 1 + (width>>(k-1)), ht = 1 + (height>>(k-1));
+    tmp[k] = weights + offset;
+    offset += (wd*ht + 15) & ~(size_t)15;
   }
 
-  for(int level=1; level<numl_cap; level++) dt_iop_equalizer_wtf(out, tmp, level, width, height);
+  // the levels are checked for a cancelled pipe, the output is thrown away then anyways
+  for(int level=1; level<numl_cap && !dt_iop_cancelled(piece); level++) dt_iop_equalizer_wtf(out, tmp, level, width, height);
 
 #if 0
   // printf("transformed\n");
@@ -149,9 +166,9 @@ void process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void
     }
   }
   // printf("applied\n");
-  for(int level=numl_cap-1; level>0; level--) dt_iop_equalizer_iwtf(out, tmp, level, width, height);
+  for(int level=numl_cap-1; level>0 && !dt_iop_cancelled(piece); level--) dt_iop_equalizer_iwtf(out, tmp, level, width, height);
 
-  for(int k=1; k<numl_cap; k++) free(tmp[k]);
+  dt_dev_pixelpipe_scratch_release(&piece->pipe->scratch, weights);
   free(tmp);
   // printf("thread %d finished equalizer", (int)pthread_self());
   // if(piece->iscale != 1.0) printf(" for preview\n");
@@ -23,6 +23,7 @@
 #include <string.h>
 #include <inttypes.h>
 #include "common/colorspaces.h"
+#include "common/colorspaces_rows.h"
 #include "common/darktable.h"
 #include "common/debug.h"
 #include "common/opencl.h"
@@ -139,45 +140,49 @@ process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void *i, v
 #ifdef _OPENMP
   #pragma omp parallel for default(none) schedule(static) shared(roi_in, roi_out, d, i, o, XYZ_sw)
 #endif
-  for(int k=0; k<roi_out->width*roi_out->height; k++)
+  for(int j=0; j<roi_out->height; j++)
   {
-    float *in = (float *)i + ch*k;
-    float *out = (float *)o + ch*k;
-    float XYZ[3], XYZ_s[3];
-    float V;
-    float w;
+    const float *in = (float *)i + ch*roi_out->width*j;
+    float *out = (float *)o + ch*roi_out->width*j;
 
-    dt_Lab_to_XYZ(in, XYZ);
+    // work on XYZ in the output row, alpha is passed through
+    dt_Lab_to_XYZ_row(in, out, roi_out->width);
 
-    // calculate scotopic luminanse
-    if (XYZ[0] > threshold)
+    for(int k=0; k<roi_out->width; k++)
     {
-      // normal flow
-      V = XYZ[1] * ( 1.33f * ( 1.0f + (XYZ[1]+XYZ[2])/XYZ[0]) - 1.68f );
-    }
-    else
-    {
-      // low red flow, avoids "snow" on dark noisy areas
-      V = XYZ[1] * ( 1.33f * ( 1.0f + (XYZ[1]+XYZ[2])/threshold) - 1.68f );
-    }
+      float *XYZ = out + ch*k;
+      float XYZ_s[3];
+      float V;
+      float w;
 
-    // scale using empiric coefficient and fit inside limits
-    V = fminf(1.0f,fmaxf(0.0f,c*V));
+      // calculate scotopic luminanse
+      if (XYZ[0] > threshold)
+      {
+        // normal flow
+        V = XYZ[1] * ( 1.33f * ( 1.0f + (XYZ[1]+XYZ[2])/XYZ[0]) - 1.68f );
+      }
+      else
+      {
+        // low red flow, avoids "snow" on dark noisy areas
+        V = XYZ[1] * ( 1.33f * ( 1.0f + (XYZ[1]+XYZ[2])/threshold) - 1.68f );
+      }
 
-    // blending coefficient from curve
-    w = lookup(d->lut,in[0]/100.f);
+      // scale using empiric coefficient and fit inside limits
+      V = fminf(1.0f,fmaxf(0.0f,c*V));
 
-    XYZ_s[0] = V * XYZ_sw[0];
-    XYZ_s[1] = V * XYZ_sw[1];
-    XYZ_s[2] = V * XYZ_sw[2];
+      // blending coefficient from curve
+      w = lookup(d->lut,in[ch*k]/100.f);
 
-    XYZ[0] = w * XYZ[0] + (1.0f - w) * XYZ_s[0];
-    XYZ[1] = w * XYZ[1] + (1.0f - w) * XYZ_s[1];
-    XYZ[2] = w * XYZ[2] + (1.0f - w) * XYZ_s[2];
+      XYZ_s[0] = V * XYZ_sw[0];
+      XYZ_s[1] = V * XYZ_sw[1];
+      XYZ_s[2] = V * XYZ_sw[2];
 
-    dt_XYZ_to_Lab(XYZ,out);
+      XYZ[0] = w * XYZ[0] + (1.0f - w) * XYZ_s[0];
+      XYZ[1] = w * XYZ[1] + (1.0f - w) * XYZ_s[1];
+      XYZ[2] = w * XYZ[2] + (1.0f - w) * XYZ_s[2];
+    }
 
-    out[3] = in[3];
+    dt_XYZ_to_Lab_row(out, out, roi_out->width);
   }
 }
 
@@ -20,6 +20,7 @@
 #include "common/film.h"
 #include "common/collection.h"
 #include "common/debug.h"
+#include "common/name_index.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "control/jobs.h"
@@ -480,6 +481,7 @@ void view_popup_menu_onSearchFilmroll (GtkWidget *menuitem, gpointer userdata)
         DT_DEBUG_SQLITE3_BIND_INT(stmt2, 2, id);
         sqlite3_step(stmt2);
         sqlite3_finalize(stmt2);
+        dt_name_index_insert(darktable.film_index, id, final);
       }
       g_free(query);
 
@@ -1077,6 +1079,54 @@ folders_view (dt_lib_collect_rule_t *dr)
   gtk_widget_show(GTK_WIDGET(d->sw2));
 }
 
+static gint
+_sort_name_desc(gconstpointer a, gconstpointer b)
+{
+  return strcmp(((const dt_name_index_item_t *)b)->name, ((const dt_name_index_item_t *)a)->name);
+}
+
+static gint
+_sort_name_upper(gconstpointer a, gconstpointer b)
+{
+  // same order as sqlite's order by upper(name)
+  const char *s = ((const dt_name_index_item_t *)a)->name;
+  const char *t = ((const dt_name_index_item_t *)b)->name;
+  while(*s && g_ascii_toupper(*s) == g_ascii_toupper(*t))
+  {
+    s++;
+    t++;
+  }
+  return (guchar)g_ascii_toupper(*s) - (guchar)g_ascii_toupper(*t);
+}
+
+// fill the list with the names matching text from one of the in-memory
+// indices, instead of running a like query on every keystroke.
+static void
+_list_view_from_index(GtkListStore *store, dt_name_index_t *index, const gchar *text, GCompareFunc sort, const int property)
+{
+  gchar *pattern = g_strdup_printf("%%%s%%", text);
+  GList *matches = g_list_sort(dt_name_index_like(index, pattern), sort);
+  g_free(pattern);
+  for(GList *m = matches; m; m = g_list_next(m))
+  {
+    const dt_name_index_item_t *item = (const dt_name_index_item_t *)m->data;
+    const char *label = item->name;
+    if(property == DT_COLLECTION_PROP_FILMROLL)
+      label = dt_image_film_roll_name(label);
+    gchar *escaped_text = g_markup_escape_text(item->name, -1);
+    GtkTreeIter iter;
+    gtk_list_store_append(store, &iter);
+    gtk_list_store_set (store, &iter,
+                        DT_LIB_COLLECT_COL_TEXT, label,
+                        DT_LIB_COLLECT_COL_ID, item->id,
+                        DT_LIB_COLLECT_COL_TOOLTIP, escaped_text,
+                        DT_LIB_COLLECT_COL_PATH, item->name,
+                        -1);
+    g_free(escaped_text);
+  }
+  dt_name_index_free_result(matches);
+}
+
 static void
 list_view (dt_lib_collect_rule_t *dr)
 {
@@ -1109,14 +1159,16 @@ list_view (dt_lib_collect_rule_t *dr)
   switch(property)
   {
     case DT_COLLECTION_PROP_FILMROLL: // film roll
-      snprintf(query, 1024, "select distinct folder, id from film_rolls where folder like '%%%s%%'  order by folder desc", escaped_text);
-      break;
+      _list_view_from_index(GTK_LIST_STORE(listmodel), darktable.film_index, text, _sort_name_desc, property);
+      g_free(escaped_text);
+      goto entry_key_press_exit;
     case DT_COLLECTION_PROP_CAMERA: // camera
       snprintf(query, 1024, "select distinct maker || ' ' || model as model, 1 from images where maker || ' ' || model like '%%%s%%' order by model", escaped_text);
       break;
     case DT_COLLECTION_PROP_TAG: // tag
-      snprintf(query, 1024, "SELECT distinct name, id FROM tags WHERE name LIKE '%%%s%%' ORDER BY UPPER(name)", escaped_text);
-      break;
+      _list_view_from_index(GTK_LIST_STORE(listmodel), darktable.tag_index, text, _sort_name_upper, property);
+      g_free(escaped_text);
+      goto entry_key_press_exit;
     case DT_COLLECTION_PROP_HISTORY: // History, 2 hardcoded alternatives
       gtk_list_store_append(GTK_LIST_STORE(listmodel), &iter);
       gtk_list_store_set (GTK_LIST_STORE(listmodel), &iter,
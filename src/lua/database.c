@@ -119,6 +119,10 @@ int dt_lua_init_database(lua_State * L)
   dt_lua_register_type_callback_stack(L,dt_lua_database_t,"duplicate");
   lua_pushcfunction(L,import_images);
   dt_lua_register_type_callback_stack(L,dt_lua_database_t,"import");
+  lua_pushcfunction(L,dt_lua_image_bulk_read);
+  dt_lua_register_type_callback_stack(L,dt_lua_database_t,"bulk_read");
+  lua_pushcfunction(L,dt_lua_image_bulk_update);
+  dt_lua_register_type_callback_stack(L,dt_lua_database_t,"bulk_update");
 
   /* darktable.images() */
   dt_lua_push_darktable_lib(L);
@@ -26,8 +26,11 @@
 #include "common/image_cache.h"
 #include "common/metadata.h"
 #include "common/grouping.h"
+#include "control/conf.h"
 #include "metadata_gen.h"
 
+#include <string.h>
+
 /***********************************************************************
   handling of dt_image_t
  **********************************************************************/
@@ -107,20 +110,39 @@ const char *image_fields_name[] =
   NULL
 };
 
-static int image_index(lua_State *L)
+static int image_field_lookup(const char *name)
 {
-  const char* membername = lua_tostring(L, -1);
-  const dt_image_t * my_image=checkreadimage(L,-2);
-  if(luaA_struct_has_member_name(L,dt_image_t,membername))
+  for(int i=0; image_fields_name[i]; i++)
+    if(!strcmp(name,image_fields_name[i])) return i;
+  return -1;
+}
+
+static void push_image_metadata(lua_State *L,const int imgid,const int key)
+{
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),"select value from meta_data where id = ?1 and key = ?2", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, key);
+  if(sqlite3_step(stmt) != SQLITE_ROW)
   {
-    const int result = luaA_struct_push_member_name(L, dt_image_t, my_image, membername);
-    releasereadimage(L,my_image);
-    return result;
+    lua_pushstring(L,"");
+  }
+  else
+  {
+    lua_pushstring(L,(char *)sqlite3_column_text(stmt, 0));
   }
-  switch(luaL_checkoption(L,-1,NULL,image_fields_name))
+  sqlite3_finalize(stmt);
+}
+
+// pushes the value of field, the caller holds the read lock on my_image.
+// doesn't raise errors, returns 0 if there is no value.
+static int push_image_field(lua_State *L,const dt_image_t *my_image,const int field)
+{
+  switch(field)
   {
     case PATH:
       {
+        int result = 0;
         sqlite3_stmt *stmt;
         DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
             "select folder from images, film_rolls where "
@@ -129,15 +151,10 @@ static int image_index(lua_State *L)
         if(sqlite3_step(stmt) == SQLITE_ROW)
         {
           lua_pushstring(L,(char *)sqlite3_column_text(stmt, 0));
-        }
-        else
-        {
-          sqlite3_finalize(stmt);
-          releasereadimage(L,my_image);
-          return luaL_error(L,"should never happen");
+          result = 1;
         }
         sqlite3_finalize(stmt);
-        break;
+        return result;
       }
     case DUP_INDEX:
       {
@@ -154,17 +171,17 @@ static int image_index(lua_State *L)
           version = sqlite3_column_int(stmt, 0);
         sqlite3_finalize(stmt);
         lua_pushinteger(L,version);
-        break;
+        return 1;
       }
     case IS_LDR:
       lua_pushboolean(L,dt_image_is_ldr(my_image));
-      break;
+      return 1;
     case IS_HDR:
       lua_pushboolean(L,dt_image_is_hdr(my_image));
-      break;
+      return 1;
     case IS_RAW:
       lua_pushboolean(L,dt_image_is_raw(my_image));
-      break;
+      return 1;
     case RATING:
       {
         int score = my_image->flags & 0x7;
@@ -172,113 +189,113 @@ static int image_index(lua_State *L)
         if(score ==6) score=-1;
 
         lua_pushinteger(L,score);
-        break;
+        return 1;
       }
     case ID:
       lua_pushinteger(L,my_image->id);
-      break;
+      return 1;
     case CREATOR:
-      {
-        sqlite3_stmt *stmt;
-        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),"select value from meta_data where id = ?1 and key = ?2", -1, &stmt, NULL);
-        DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, my_image->id);
-        DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, DT_METADATA_XMP_DC_CREATOR);
-        if(sqlite3_step(stmt) != SQLITE_ROW)
-        {
-          lua_pushstring(L,"");
-        }
-        else
-        {
-          lua_pushstring(L,(char *)sqlite3_column_text(stmt, 0));
-        }
-        sqlite3_finalize(stmt);
-        break;
-
-      }
+      push_image_metadata(L,my_image->id,DT_METADATA_XMP_DC_CREATOR);
+      return 1;
     case PUBLISHER:
-      {
-        sqlite3_stmt *stmt;
-        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),"select value from meta_data where id = ?1 and key = ?2", -1, &stmt, NULL);
-        DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, my_image->id);
-        DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, DT_METADATA_XMP_DC_PUBLISHER);
-        if(sqlite3_step(stmt) != SQLITE_ROW)
-        {
-          lua_pushstring(L,"");
-        }
-        else
-        {
-          lua_pushstring(L,(char *)sqlite3_column_text(stmt, 0));
-        }
-        sqlite3_finalize(stmt);
-        break;
-
-      }
+      push_image_metadata(L,my_image->id,DT_METADATA_XMP_DC_PUBLISHER);
+      return 1;
     case TITLE:
-      {
-        sqlite3_stmt *stmt;
-        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),"select value from meta_data where id = ?1 and key = ?2", -1, &stmt, NULL);
-        DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, my_image->id);
-        DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, DT_METADATA_XMP_DC_TITLE);
-        if(sqlite3_step(stmt) != SQLITE_ROW)
-        {
-          lua_pushstring(L,"");
-        }
-        else
-        {
-          lua_pushstring(L,(char *)sqlite3_column_text(stmt, 0));
-        }
-        sqlite3_finalize(stmt);
-        break;
-
-      }
+      push_image_metadata(L,my_image->id,DT_METADATA_XMP_DC_TITLE);
+      return 1;
     case DESCRIPTION:
-      {
-        sqlite3_stmt *stmt;
-        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),"select value from meta_data where id = ?1 and key = ?2", -1, &stmt, NULL);
-        DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, my_image->id);
-        DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, DT_METADATA_XMP_DC_DESCRIPTION);
-        if(sqlite3_step(stmt) != SQLITE_ROW)
-        {
-          lua_pushstring(L,"");
-        }
-        else
-        {
-          lua_pushstring(L,(char *)sqlite3_column_text(stmt, 0));
-        }
-        sqlite3_finalize(stmt);
-        break;
+      push_image_metadata(L,my_image->id,DT_METADATA_XMP_DC_DESCRIPTION);
+      return 1;
+    case RIGHTS:
+      push_image_metadata(L,my_image->id,DT_METADATA_XMP_DC_RIGHTS);
+      return 1;
+    case GROUP_LEADER:
+      luaA_push(L,dt_lua_image_t,&(my_image->group_id));
+      return 1;
+    default:
+      return 0;
+  }
+}
 
+static int image_index(lua_State *L)
+{
+  const char* membername = lua_tostring(L, -1);
+  const dt_image_t * my_image=checkreadimage(L,-2);
+  if(luaA_struct_has_member_name(L,dt_image_t,membername))
+  {
+    const int result = luaA_struct_push_member_name(L, dt_image_t, my_image, membername);
+    releasereadimage(L,my_image);
+    return result;
+  }
+  const int field = image_field_lookup(membername);
+  const int result = field < 0 ? 0 : push_image_field(L,my_image,field);
+  releasereadimage(L,my_image);
+  if(!result)
+    return luaL_error(L,"should never happen %s",membername);
+  return result;
+}
+
+// checks that the value at index can be written to field, without raising errors.
+// returns an error message or NULL.
+static const char *check_image_value(lua_State *L,const int field,const int index)
+{
+  switch(field)
+  {
+    case RATING:
+      {
+        if(!lua_isnumber(L,index)) return "rating has to be a number";
+        const int my_score = lua_tointeger(L,index);
+        if(my_score > 5) return "rating too high";
+        if(my_score < -1) return "rating too low";
+        return NULL;
       }
+    case CREATOR:
+    case PUBLISHER:
+    case TITLE:
+    case DESCRIPTION:
     case RIGHTS:
-      {
-        sqlite3_stmt *stmt;
-        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),"select value from meta_data where id = ?1 and key = ?2", -1, &stmt, NULL);
-        DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, my_image->id);
-        DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, DT_METADATA_XMP_DC_RIGHTS);
-        if(sqlite3_step(stmt) != SQLITE_ROW)
-        {
-          lua_pushstring(L,"");
-        }
-        else
-        {
-          lua_pushstring(L,(char *)sqlite3_column_text(stmt, 0));
-        }
-        sqlite3_finalize(stmt);
-        break;
+      if(!lua_isstring(L,index)) return "metadata has to be a string";
+      return NULL;
+    default:
+      return "field is read only";
+  }
+}
 
-      }
-    case GROUP_LEADER:
+// writes a value which passed check_image_value() to field.
+// metadata goes to the db right away, the sidecar file is written if synch is set.
+static void set_image_field(lua_State *L,dt_image_t *my_image,const int field,const int index,const int synch)
+{
+  const char *key = NULL;
+  switch(field)
+  {
+    case RATING:
       {
-        luaA_push(L,dt_lua_image_t,&(my_image->group_id));
-        break;
+        int my_score = lua_tointeger(L,index);
+        if(my_score == -1) my_score = 6;
+        my_image->flags &= ~0x7;
+        my_image->flags |= my_score;
+        return;
       }
+    case CREATOR:
+      key = "Xmp.dc.creator";
+      break;
+    case PUBLISHER:
+      key = "Xmp.dc.publisher";
+      break;
+    case TITLE:
+      key = "Xmp.dc.title";
+      break;
+    case DESCRIPTION:
+      key = "Xmp.dc.description";
+      break;
+    case RIGHTS:
+      key = "Xmp.dc.rights";
+      break;
     default:
-      releasereadimage(L,my_image);
-      return luaL_error(L,"should never happen %s",lua_tostring(L,-1));
-
+      return;
   }
-  releasereadimage(L,my_image);
-  return 1;
+  dt_metadata_set(my_image->id,key,lua_tostring(L,index));
+  if(synch) dt_image_synch_xmp(my_image->id);
 }
 
 static int image_newindex(lua_State *L)
@@ -299,53 +316,209 @@ static int image_newindex(lua_State *L)
     releasewriteimage(L,my_image);
     return 0;
   }
-  switch(luaL_checkoption(L,-2,NULL,image_fields_name))
+  const int field = image_field_lookup(membername);
+  const char *error = field < 0 ? "unknown index for image" : check_image_value(L,field,-1);
+  if(error)
   {
-    case RATING:
+    releasewriteimage(L,my_image);
+    return luaL_error(L,"%s : %s",error,membername);
+  }
+  set_image_field(L,my_image,field,-1,TRUE);
+  releasewriteimage(L,my_image);
+  return 0;
+}
+
+/***********************************************************************
+  bulk access
+ **********************************************************************/
+
+typedef enum
+{
+  BULK_IMAGE_FIELD,
+  BULK_IMAGE_MEMBER,
+  BULK_COLORLABEL,
+}
+bulk_field_kind;
+
+static int bulk_field_lookup(lua_State *L,const char *name,int *field)
+{
+  if(luaA_struct_has_member_name(L,dt_image_t,name)) return BULK_IMAGE_MEMBER;
+  for(int i=0; dt_colorlabels_name[i]; i++)
+    if(!strcmp(name,dt_colorlabels_name[i]))
+    {
+      *field = i;
+      return BULK_COLORLABEL;
+    }
+  *field = image_field_lookup(name);
+  return *field < 0 ? -1 : BULK_IMAGE_FIELD;
+}
+
+static int *bulk_check_images(lua_State *L,const int index,int *count)
+{
+  luaL_checktype(L,index,LUA_TTABLE);
+  *count = luaL_len(L,index);
+  // owned by lua, so raising an error doesn't leak it:
+  int *imgs = (int *)lua_newuserdata(L,sizeof(int)*MAX(1,*count));
+  for(int k=0; k<*count; k++)
+  {
+    lua_rawgeti(L,index,k+1);
+    luaA_to(L,dt_lua_image_t,&imgs[k],-1);
+    lua_pop(L,1);
+  }
+  return imgs;
+}
+
+// darktable.database.bulk_read(images,{field,...})
+// returns a table with one table of the requested fields per image, in the same order.
+// takes one read lock per image instead of one per field and image.
+int dt_lua_image_bulk_read(lua_State *L)
+{
+  int count;
+  const int *imgs = bulk_check_images(L,1,&count);
+  luaL_checktype(L,2,LUA_TTABLE);
+  const int num_fields = luaL_len(L,2);
+  for(int f=1; f<=num_fields; f++)
+  {
+    lua_rawgeti(L,2,f);
+    int field;
+    if(lua_type(L,-1) != LUA_TSTRING || bulk_field_lookup(L,lua_tostring(L,-1),&field) < 0)
+      return luaL_error(L,"unknown field for image : %s",lua_tostring(L,-1));
+    lua_pop(L,1);
+  }
+
+  lua_createtable(L,count,0);
+  const int result = lua_gettop(L);
+  for(int k=0; k<count; k++)
+  {
+    lua_createtable(L,0,num_fields);
+    const dt_image_t *my_image = dt_image_cache_read_get(darktable.image_cache,imgs[k]);
+    if(my_image)
+    {
+      for(int f=1; f<=num_fields; f++)
       {
-        int my_score = luaL_checkinteger(L,-1);
-        if(my_score > 5)
-        {
-          releasewriteimage(L,my_image);
-          return luaL_error(L,"rating too high : %d",my_score);
-        }
-        if(my_score == -1) my_score = 6;
-        if(my_score < -1)
+        lua_rawgeti(L,2,f);
+        const char *name = lua_tostring(L,-1);
+        int field = 0;
+        switch(bulk_field_lookup(L,name,&field))
         {
-          releasewriteimage(L,my_image);
-          return luaL_error(L,"rating too low : %d",my_score);
+          case BULK_IMAGE_MEMBER:
+            luaA_struct_push_member_name(L,dt_image_t,my_image,name);
+            break;
+          case BULK_COLORLABEL:
+            lua_pushboolean(L,dt_colorlabels_check_label(imgs[k],field));
+            break;
+          default:
+            if(!push_image_field(L,my_image,field)) lua_pushnil(L);
+            break;
         }
-        my_image->flags &= ~0x7;
-        my_image->flags |= my_score;
-        break;
+        // t[name] = value, the name is still below the value
+        lua_rawset(L,-3);
       }
+      dt_image_cache_read_release(darktable.image_cache,my_image);
+    }
+    lua_rawseti(L,result,k+1);
+  }
+  return 1;
+}
 
-    case CREATOR:
-      dt_metadata_set(my_image->id,"Xmp.dc.creator",luaL_checkstring(L,-1));
-      dt_image_synch_xmp(my_image->id);
-      break;
-    case PUBLISHER:
-      dt_metadata_set(my_image->id,"Xmp.dc.publisher",luaL_checkstring(L,-1));
-      dt_image_synch_xmp(my_image->id);
-      break;
-    case TITLE:
-      dt_metadata_set(my_image->id,"Xmp.dc.title",luaL_checkstring(L,-1));
-      dt_image_synch_xmp(my_image->id);
-      break;
-    case DESCRIPTION:
-      dt_metadata_set(my_image->id,"Xmp.dc.description",luaL_checkstring(L,-1));
-      dt_image_synch_xmp(my_image->id);
-      break;
-    case RIGHTS:
-      dt_metadata_set(my_image->id,"Xmp.dc.title",luaL_checkstring(L,-1));
-      dt_image_synch_xmp(my_image->id);
-      break;
-    default:
-      releasewriteimage(L,my_image);
-      return luaL_error(L,"unknown index for image : ",lua_tostring(L,-2));
+// darktable.database.bulk_update(images,{field=value,...})
+// sets the fields of all images. a value can be a function, which is called with the
+// image and returns the value for it. everything goes to the db in one transaction, and
+// each image is locked once. the sidecar files are written at the end.
+int dt_lua_image_bulk_update(lua_State *L)
+{
+  int count;
+  const int *imgs = bulk_check_images(L,1,&count);
+  luaL_checktype(L,2,LUA_TTABLE);
+
+  // work out all values first, nothing must raise an error while images are locked.
+  // members of dt_image_t are converted into a scratch image to find out: the
+  // conversion checks types and string lengths with luaL_error. the same values
+  // convert the same way again below.
+  dt_image_t scratch;
+  memset(&scratch,0,sizeof(scratch));
+  lua_createtable(L,count,0);
+  const int values = lua_gettop(L);
+  for(int k=0; k<count; k++)
+  {
+    lua_newtable(L);
+    lua_pushnil(L);
+    while(lua_next(L,2))
+    {
+      if(lua_type(L,-2) != LUA_TSTRING)
+        return luaL_error(L,"field names have to be strings");
+      const char *name = lua_tostring(L,-2);
+      if(lua_isfunction(L,-1))
+      {
+        luaA_push(L,dt_lua_image_t,&imgs[k]);
+        lua_call(L,1,1);
+      }
+      int field;
+      const char *error = NULL;
+      switch(bulk_field_lookup(L,name,&field))
+      {
+        case BULK_IMAGE_MEMBER:
+          if(!luaA_type_has_to_func(luaA_struct_typeof_member_name(L,dt_image_t,name)))
+            error = "field is read only";
+          else if(!lua_isnumber(L,-1) && !lua_isstring(L,-1))
+            error = "value has to be a number or a string";
+          else
+            luaA_struct_to_member_name(L,dt_image_t,&scratch,name,-1);
+          break;
+        case BULK_COLORLABEL:
+          break;
+        case BULK_IMAGE_FIELD:
+          error = check_image_value(L,field,-1);
+          break;
+        default:
+          error = "unknown index for image";
+          break;
+      }
+      if(error) return luaL_error(L,"%s : %s",error,name);
+      // values[k][name] = value, keep the key for lua_next
+      lua_pushvalue(L,-2);
+      lua_insert(L,-2);
+      lua_rawset(L,-4);
+    }
+    lua_rawseti(L,values,k+1);
+  }
 
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "begin transaction", NULL, NULL, NULL);
+  for(int k=0; k<count; k++)
+  {
+    const dt_image_t *cimg = dt_image_cache_read_get(darktable.image_cache,imgs[k]);
+    if(!cimg) continue;
+    dt_image_t *my_image = dt_image_cache_write_get(darktable.image_cache,cimg);
+    lua_rawgeti(L,values,k+1);
+    lua_pushnil(L);
+    while(lua_next(L,-2))
+    {
+      const char *name = lua_tostring(L,-2);
+      int field = 0;
+      switch(bulk_field_lookup(L,name,&field))
+      {
+        case BULK_IMAGE_MEMBER:
+          luaA_struct_to_member_name(L,dt_image_t,my_image,name,-1);
+          break;
+        case BULK_COLORLABEL:
+          if(lua_toboolean(L,-1)) dt_colorlabels_set_label(imgs[k],field);
+          else dt_colorlabels_remove_label(imgs[k],field);
+          break;
+        default:
+          set_image_field(L,my_image,field,-1,FALSE);
+          break;
+      }
+      lua_pop(L,1);
+    }
+    lua_pop(L,1);
+    // only the db, the sidecars are written all together below:
+    dt_image_cache_write_release(darktable.image_cache,my_image,DT_IMAGE_CACHE_RELAXED);
+    dt_image_cache_read_release(darktable.image_cache,my_image);
   }
-  releasewriteimage(L,my_image);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "commit", NULL, NULL, NULL);
+
+  if(dt_conf_get_bool("write_sidecar_files"))
+    dt_image_write_sidecar_files(imgs,count);
   return 0;
 }
 
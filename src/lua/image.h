@@ -23,6 +23,11 @@
 typedef int dt_lua_image_t; // wrapper for dt_image_t id
 
 int dt_lua_init_image(lua_State * L);
+
+/** read several fields of many images, one lock per image */
+int dt_lua_image_bulk_read(lua_State *L);
+/** write several fields of many images in one db transaction */
+int dt_lua_image_bulk_update(lua_State *L);
 #endif
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
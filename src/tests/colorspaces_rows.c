@@ -0,0 +1,183 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// unit test for the batched colorspace conversions: compares against
+// straight libm implementations and checks the error bounds promised in
+// common/colorspaces_rows.h.
+#include "common/colorspaces_rows.c"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define N 100003 // odd on purpose, to exercise the row tail
+
+static float
+frand(const float lo, const float hi)
+{
+  return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+static double
+lab_f(const double x)
+{
+  const double epsilon = 216.0/24389.0;
+  const double kappa = 24389.0/27.0;
+  return x > epsilon ? cbrt(x) : (kappa*x + 16.0)/116.0;
+}
+
+static double
+lab_f_inv(const double x)
+{
+  const double epsilon = 0.20689655172413796;
+  const double kappa = 24389.0/27.0;
+  return x > epsilon ? x*x*x : (116.0*x - 16.0)/kappa;
+}
+
+static void
+ref_rgb2hsl(const float *RGB, double *HSL)
+{
+  const double R = RGB[0], G = RGB[1], B = RGB[2];
+  const double mx = fmax(R, fmax(G, B)), mn = fmin(R, fmin(G, B)), del = mx - mn;
+  double H = 0.0, S = 0.0;
+  const double L = (mx + mn)/2.0;
+  if(del >= 1e-6)
+  {
+    S = L < 0.5 ? del/(mx + mn) : del/(2.0 - mx - mn);
+    if(R == mx) H = (G - B)/(6.0*del);
+    else if(G == mx) H = 1.0/3.0 + (B - R)/(6.0*del);
+    else H = 2.0/3.0 + (R - G)/(6.0*del);
+    if(H < 0.0) H += 1.0;
+    if(H > 1.0) H -= 1.0;
+  }
+  HSL[0] = H;
+  HSL[1] = S;
+  HSL[2] = L;
+}
+
+static int failed = 0;
+
+static void
+check(const char *what, const double err, const double bound)
+{
+  fprintf(stderr, "%-14s max error %g (bound %g)%s\n", what, err, bound, err <= bound ? "" : "  FAILED");
+  if(err > bound) failed = 1;
+}
+
+int main(int argc, char *arg[])
+{
+  float *in = malloc(sizeof(float)*4*N);
+  float *out = malloc(sizeof(float)*4*N);
+  float *back = malloc(sizeof(float)*4*N);
+  double err[3];
+
+  // XYZ -> Lab
+  for(int k=0; k<N; k++)
+  {
+    in[4*k+0] = frand(0.0f, 1.0f);
+    in[4*k+1] = frand(0.0f, 1.0f);
+    in[4*k+2] = frand(0.0f, 1.0f);
+    in[4*k+3] = k;
+  }
+  dt_XYZ_to_Lab_row(in, out, N);
+  err[0] = 0.0;
+  for(int k=0; k<N; k++)
+  {
+    const double fx = lab_f(in[4*k+0]/0.9642), fy = lab_f(in[4*k+1]), fz = lab_f(in[4*k+2]/0.8249);
+    const double Lab[3] = { 116.0*fy - 16.0, 500.0*(fx - fy), 200.0*(fy - fz) };
+    for(int c=0; c<3; c++) err[0] = fmax(err[0], fabs(out[4*k+c] - Lab[c]));
+    if(out[4*k+3] != in[4*k+3]) failed = 1;
+  }
+  check("XYZ -> Lab", err[0], 2e-4);
+
+  // Lab -> XYZ
+  dt_Lab_to_XYZ_row(out, back, N);
+  err[0] = 0.0;
+  for(int k=0; k<N; k++)
+  {
+    const double fy = (out[4*k+0] + 16.0)/116.0;
+    const double XYZ[3] = { 0.9642*lab_f_inv(out[4*k+1]/500.0 + fy), lab_f_inv(fy), 0.8249*lab_f_inv(fy - out[4*k+2]/200.0) };
+    for(int c=0; c<3; c++) err[0] = fmax(err[0], fabs(back[4*k+c] - XYZ[c]));
+  }
+  check("Lab -> XYZ", err[0], 1e-6);
+
+  // Lab -> LCh, including the axes and the origin
+  for(int k=0; k<N; k++)
+  {
+    in[4*k+0] = frand(0.0f, 100.0f);
+    in[4*k+1] = (k % 7 == 0) ? 0.0f : frand(-128.0f, 128.0f);
+    in[4*k+2] = (k % 5 == 0) ? 0.0f : frand(-128.0f, 128.0f);
+    in[4*k+3] = k;
+  }
+  dt_Lab_to_LCh_row(in, out, N);
+  err[0] = err[1] = 0.0;
+  for(int k=0; k<N; k++)
+  {
+    double h = atan2(in[4*k+2], in[4*k+1])/(2.0*M_PI);
+    if(h < 0.0) h += 1.0;
+    double d = fabs(out[4*k+2] - h);
+    d = fmin(d, 1.0 - d); // 0 and 1 are the same hue
+    err[0] = fmax(err[0], fabs(out[4*k+1] - hypot(in[4*k+1], in[4*k+2]))/128.0);
+    err[1] = fmax(err[1], d);
+    if(out[4*k+0] != in[4*k+0] || out[4*k+3] != in[4*k+3] || out[4*k+2] < 0.0f || out[4*k+2] > 1.0f) failed = 1;
+  }
+  check("Lab -> LCh C", err[0], 1e-6);
+  check("Lab -> LCh h", err[1], 2e-6);
+
+  // LCh -> Lab, with hue outside [0,1]
+  for(int k=0; k<N; k++) out[4*k+2] = frand(-1.5f, 2.5f);
+  dt_LCh_to_Lab_row(out, back, N);
+  err[0] = 0.0;
+  for(int k=0; k<N; k++)
+  {
+    const double C = out[4*k+1], h = 2.0*M_PI*out[4*k+2];
+    err[0] = fmax(err[0], fmax(fabs(back[4*k+1] - C*cos(h)), fabs(back[4*k+2] - C*sin(h)))/fmax(C, 1.0));
+  }
+  check("LCh -> Lab", err[0], 2e-6);
+
+  // RGB -> HSL -> RGB, including greys
+  for(int k=0; k<N; k++)
+  {
+    in[4*k+0] = frand(0.0f, 1.0f);
+    in[4*k+1] = (k % 11 == 0) ? in[4*k+0] : frand(0.0f, 1.0f);
+    in[4*k+2] = (k % 11 == 0) ? in[4*k+0] : frand(0.0f, 1.0f);
+    in[4*k+3] = k;
+  }
+  dt_RGB_to_HSL_row(in, out, N);
+  dt_HSL_to_RGB_row(out, back, N);
+  err[0] = err[1] = 0.0;
+  for(int k=0; k<N; k++)
+  {
+    double HSL[3];
+    ref_rgb2hsl(in + 4*k, HSL);
+    for(int c=0; c<3; c++) err[0] = fmax(err[0], fabs(out[4*k+c] - HSL[c]));
+    for(int c=0; c<3; c++) err[1] = fmax(err[1], fabs(back[4*k+c] - in[4*k+c]));
+    if(back[4*k+3] != in[4*k+3]) failed = 1;
+  }
+  check("RGB -> HSL", err[0], 2e-6);
+  check("HSL -> RGB", err[1], 2e-6);
+
+  free(in);
+  free(out);
+  free(back);
+  fprintf(stderr, failed ? "FAILED\n" : "all fine\n");
+  exit(failed);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
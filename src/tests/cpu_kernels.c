@@ -0,0 +1,118 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2026 agent.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// unit test for the row kernels behind common/cpu_dispatch.h: runs the sse2
+// and, if the cpu has it, the avx2 variant against a plain c reference.
+#include "common/cpu_dispatch.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define N 1003 // odd on purpose, to exercise the row tails
+
+static float
+frand(const float lo, const float hi)
+{
+  return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+static int failed = 0;
+
+static void
+check(const char *what, const double err, const double bound)
+{
+  fprintf(stderr, "%-24s max error %g (bound %g)%s\n", what, err, bound, err <= bound ? "" : "  FAILED");
+  if(!(err <= bound)) failed = 1;
+}
+
+static void
+ref_nlmeans_dist_row(double *s, const float *p, const float *ps, const float *m, const float *ms,
+                     const float *norm2, const int n)
+{
+  for(int i=0; i<n; i++)
+    for(int k=0; k<3; k++)
+    {
+      s[i] += (p[4*i+k] - ps[4*i+k])*(p[4*i+k] - ps[4*i+k]) * (double)norm2[k];
+      if(m) s[i] -= (m[4*i+k] - ms[4*i+k])*(m[4*i+k] - ms[4*i+k]) * (double)norm2[k];
+    }
+}
+
+// the nl-means patch distance, with garbage in the alpha channel, which has to be ignored.
+static void
+test_nlmeans_dist_row(const dt_cpu_kernels_t *kernels)
+{
+  float *buf[4];
+  for(int b=0; b<4; b++)
+  {
+    buf[b] = malloc(sizeof(float)*4*N);
+    for(int k=0; k<N; k++)
+    {
+      for(int c=0; c<3; c++) buf[b][4*k+c] = frand(0.0f, 1.0f);
+      buf[b][4*k+3] = (k % 3 == 0) ? NAN : (k % 3 == 1) ? INFINITY : frand(-1e30f, 1e30f);
+    }
+  }
+  const float norm2[3] = { 1.0f, 2.0f, 0.5f };
+  float *s = malloc(sizeof(float)*(N + 4));
+  double *ref = malloc(sizeof(double)*N);
+
+  for(int with_m=0; with_m<2; with_m++)
+  {
+    // the sse2 version peels off unaligned pixels first, so try all offsets.
+    double err = 0.0;
+    for(int off=0; off<4; off++)
+    {
+      for(int i=0; i<N; i++) ref[i] = s[off+i] = frand(0.0f, 1.0f);
+      kernels->nlmeans_dist_row(s + off, buf[0], buf[1], with_m ? buf[2] : NULL, with_m ? buf[3] : NULL, norm2, N);
+      ref_nlmeans_dist_row(ref, buf[0], buf[1], with_m ? buf[2] : NULL, with_m ? buf[3] : NULL, norm2, N);
+      for(int i=0; i<N; i++) err = fmax(err, isfinite(s[off+i]) ? fabs(s[off+i] - ref[i]) : INFINITY);
+    }
+    char what[64];
+    snprintf(what, sizeof(what), "%s nlmeans%s", kernels->name, with_m ? " (m)" : "");
+    check(what, err, 1e-5);
+  }
+
+  for(int b=0; b<4; b++) free(buf[b]);
+  free(s);
+  free(ref);
+}
+
+int main(int argc, char *arg[])
+{
+  dt_cpu_kernels_t kernels;
+
+  dt_cpu_kernels_init_sse2(&kernels);
+  test_nlmeans_dist_row(&kernels);
+
+#ifdef HAVE_AVX2_KERNELS
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+  {
+    dt_cpu_kernels_init_avx2(&kernels);
+    test_nlmeans_dist_row(&kernels);
+  }
+  else fprintf(stderr, "no avx2, skipping those kernels\n");
+#endif
+
+  fprintf(stderr, failed ? "FAILED\n" : "all fine\n");
+  exit(failed);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -19,6 +19,7 @@
 /** this is the view for the darkroom module.  */
 #include "common/darktable.h"
 #include "common/collection.h"
+#include "common/mipmap_regen.h"
 #include "views/view.h"
 #include "develop/develop.h"
 #include "control/jobs.h"
@@ -189,11 +190,14 @@ void expose(dt_view_t *self, cairo_t *cri, int32_t width_i, int32_t height_i, in
     dt_pthread_mutex_lock(mutex);
     wd = dev->pipe->backbuf_width;
     ht = dev->pipe->backbuf_height;
+    // a draft render is blown up to the size of the final one
+    const float upscale = dev->pipe->backbuf_upscale;
+    const float dwd = wd*upscale, dht = ht*upscale;
     stride = cairo_format_stride_for_width (CAIRO_FORMAT_RGB24, wd);
     surface = cairo_image_surface_create_for_data (dev->pipe->backbuf, CAIRO_FORMAT_RGB24, wd, ht, stride);
     cairo_set_source_rgb (cr, .2, .2, .2);
     cairo_paint(cr);
-    cairo_translate(cr, .5f*(width-wd), .5f*(height-ht));
+    cairo_translate(cr, .5f*(width-dwd), .5f*(height-dht));
     if(closeup)
     {
       const float closeup_scale = 2.0;
@@ -203,13 +207,14 @@ void expose(dt_view_t *self, cairo_t *cri, int32_t width_i, int32_t height_i, in
       dt_dev_check_zoom_bounds(dev, &zx1, &zy1, zoom, 1, &boxw, &boxh);
       dt_dev_check_zoom_bounds(dev, &zxm, &zym, zoom, 1, &boxw, &boxh);
       const float fx = 1.0 - fmaxf(0.0, (zx0 - zx1)/(zx0 - zxm)), fy = 1.0 - fmaxf(0.0, (zy0 - zy1)/(zy0 - zym));
-      cairo_translate(cr, -wd/(2.0*closeup_scale) * fx, -ht/(2.0*closeup_scale) * fy);
+      cairo_translate(cr, -dwd/(2.0*closeup_scale) * fx, -dht/(2.0*closeup_scale) * fy);
     }
+    cairo_scale(cr, upscale, upscale);
     cairo_rectangle(cr, 0, 0, wd, ht);
     cairo_set_source_surface (cr, surface, 0, 0);
-    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_FAST);
+    cairo_pattern_set_filter(cairo_get_source(cr), upscale > 1.0f ? CAIRO_FILTER_GOOD : CAIRO_FILTER_FAST);
     cairo_fill_preserve(cr);
-    cairo_set_line_width(cr, 1.0);
+    cairo_set_line_width(cr, 1.0/upscale);
     cairo_set_source_rgb (cr, .3, .3, .3);
     cairo_stroke(cr);
     cairo_surface_destroy (surface);
@@ -1042,6 +1047,8 @@ static gboolean _overexposed_toggle_callback(GtkAccelGroup *accel_group,
 
 void enter(dt_view_t *self)
 {
+  // the pixelpipes here need the cores more than thumbnails in the background:
+  dt_mipmap_regen_pause(darktable.mipmap_regen);
 
   /* connect to ui pipe finished signal for redraw */
   dt_control_signal_connect(darktable.signals,
@@ -1263,6 +1270,8 @@ void enter(dt_view_t *self)
 
 void leave(dt_view_t *self)
 {
+  dt_mipmap_regen_resume(darktable.mipmap_regen);
+
   /* disconnect from filmstrip image activate */
   dt_control_signal_disconnect(darktable.signals,
                                G_CALLBACK(_view_darkroom_filmstrip_activate_callback),